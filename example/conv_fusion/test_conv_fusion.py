@@ -0,0 +1,91 @@
+# Copyright (c) 2023 Intel Corporation
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ==============================================================================
+
+import jax
+from jax import lax
+from jax import random
+import jax.numpy as jnp
+
+import numpy as np
+
+# Each check runs a model op by op, which leaves every conv unfused, and as
+# one jitted function, which the oneDNN conv rewriters fuse, and compares the
+# results.
+
+def conv(input, filter):
+    return lax.conv_general_dilated(
+        input, filter, (1, 1), 'SAME',
+        dimension_numbers=('NHWC', 'HWIO', 'NHWC'))
+
+def quantizedConv(input, filter, bias, requantize):
+    # Per tensor s8 input with a zero point, per output feature s8 filter.
+    x = (input.astype(jnp.float32) - 3.0) * 0.05
+    w = filter.astype(jnp.float32) * jnp.linspace(0.01, 0.02, filter.shape[-1])
+    y = jnp.maximum(conv(x, w) + bias, 0.0)
+    if not requantize:
+        return y
+    y = jnp.round(y / 0.1) + 4.0
+    return jnp.clip(y, 0.0, 255.0).astype(jnp.uint8)
+
+def convBatchNormSilu(input, filter, mean, var, gamma, beta):
+    y = conv(input, filter)
+    y = (y - mean) * (gamma / jnp.sqrt(var + 1e-5)) + beta
+    return y * jax.nn.sigmoid(y)
+
+def convSubResidual(input, filter, residual):
+    return conv(input, filter) - residual
+
+def testQuantizedConv():
+    key = random.PRNGKey(1701)
+    k1, k2, k3 = random.split(key, 3)
+    input = random.randint(k1, (2, 14, 14, 32), -128, 128).astype(jnp.int8)
+    filter = random.randint(k2, (3, 3, 32, 64), -128, 128).astype(jnp.int8)
+    bias = random.uniform(k3, (64,))
+    cpu = quantizedConv(input, filter, bias, False)
+    xpu = jax.jit(quantizedConv, static_argnums=3)(input, filter, bias, False)
+    print(np.allclose(xpu, cpu, atol=1e-3, rtol=1e-3))
+    # Requantized results may round the other way at ties.
+    cpu = quantizedConv(input, filter, bias, True)
+    xpu = jax.jit(quantizedConv, static_argnums=3)(input, filter, bias, True)
+    print(xpu.dtype == jnp.uint8 and
+          np.abs(xpu.astype(np.int32) - cpu.astype(np.int32)).max() <= 1)
+
+def testConvBatchNormSilu():
+    key = random.PRNGKey(1701)
+    k1, k2, k3, k4, k5, k6 = random.split(key, 6)
+    input = random.uniform(k1, (2, 14, 14, 32))
+    filter = random.uniform(k2, (3, 3, 32, 64))
+    mean = random.uniform(k3, (64,))
+    var = random.uniform(k4, (64,))
+    gamma = random.uniform(k5, (64,))
+    beta = random.uniform(k6, (64,))
+    cpu = convBatchNormSilu(input, filter, mean, var, gamma, beta)
+    xpu = jax.jit(convBatchNormSilu)(input, filter, mean, var, gamma, beta)
+    print(np.allclose(xpu, cpu, atol=1e-3, rtol=1e-3))
+
+def testConvSubResidual():
+    key = random.PRNGKey(1701)
+    k1, k2, k3 = random.split(key, 3)
+    input = random.uniform(k1, (2, 14, 14, 32))
+    filter = random.uniform(k2, (3, 3, 32, 64))
+    residual = random.uniform(k3, (2, 14, 14, 64))
+    cpu = convSubResidual(input, filter, residual)
+    xpu = jax.jit(convSubResidual)(input, filter, residual)
+    print(np.allclose(xpu, cpu, atol=1e-3, rtol=1e-3))
+
+if __name__ == '__main__':
+    testQuantizedConv()
+    testConvBatchNormSilu()
+    testConvSubResidual()
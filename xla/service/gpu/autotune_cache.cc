@@ -0,0 +1,247 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/service/gpu/autotune_cache.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/match.h"
+#include "absl/synchronization/mutex.h"
+#include "tsl/platform/env.h"
+#include "tsl/platform/logging.h"
+#include "tsl/platform/protobuf.h"
+#include "tsl/platform/statusor.h"
+#include "tsl/util/env_var.h"
+#include "xla/shape_util.h"
+#include "xla/util.h"
+
+namespace xla {
+namespace gpu {
+namespace {
+
+// Format version of AutotuneResults with a flat `results` list.
+constexpr int kAutotuneResultsVersion = 2;
+
+constexpr int kProfileIterations = 5;
+
+struct Cache {
+  absl::Mutex mu;
+  absl::flat_hash_map<std::pair<std::string, std::string>, AutotuneResult>
+      results ABSL_GUARDED_BY(mu);
+  // Latest result per HLO across devices, for deviceless compilation.
+  absl::flat_hash_map<std::string, AutotuneResult> results_by_hlo
+      ABSL_GUARDED_BY(mu);
+};
+
+bool IsTextProto(absl::string_view path) {
+  return absl::EndsWith(path, ".txt") || absl::EndsWith(path, ".pbtxt");
+}
+
+void InsertLocked(Cache& cache, absl::string_view device,
+                  absl::string_view hlo, const AutotuneResult& result,
+                  bool overwrite) ABSL_EXCLUSIVE_LOCKS_REQUIRED(cache.mu) {
+  auto key = std::make_pair(std::string(device), std::string(hlo));
+  if (overwrite) {
+    cache.results[key] = result;
+    cache.results_by_hlo[key.second] = result;
+  } else {
+    cache.results.try_emplace(key, result);
+    cache.results_by_hlo.try_emplace(key.second, result);
+  }
+}
+
+Status LoadLocked(Cache& cache, const AutotuneResults& results)
+    ABSL_EXCLUSIVE_LOCKS_REQUIRED(cache.mu) {
+  if (results.version() != kAutotuneResultsVersion) {
+    return InvalidArgument("Unsupported autotune results version %d",
+                           results.version());
+  }
+  for (const AutotuneResults::Entry& entry : results.results()) {
+    InsertLocked(cache, entry.device(), entry.hlo(), entry.result(),
+                 /*overwrite=*/false);
+  }
+  return OkStatus();
+}
+
+StatusOr<AutotuneResults> ReadAutotuneResults(absl::string_view path) {
+  std::string data;
+  TF_RETURN_IF_ERROR(
+      tsl::ReadFileToString(tsl::Env::Default(), std::string(path), &data));
+  AutotuneResults results;
+  bool parsed = IsTextProto(path)
+                    ? tsl::protobuf::TextFormat::ParseFromString(data, &results)
+                    : results.ParseFromString(data);
+  if (!parsed) return InvalidArgument("Failed to parse %s", path);
+  return results;
+}
+
+Cache& GetCache() {
+  static Cache* cache = [] {
+    auto* cache = new Cache();
+    std::string path;
+    TF_CHECK_OK(
+        tsl::ReadStringFromEnvVar("XLA_AUTOTUNE_RESULTS_LOAD", "", &path));
+    if (path.empty()) return cache;
+
+    StatusOr<AutotuneResults> results = ReadAutotuneResults(path);
+    Status status = results.status();
+    if (status.ok()) {
+      absl::MutexLock lock(&cache->mu);
+      status = LoadLocked(*cache, *results);
+    }
+    if (!status.ok()) {
+      LOG(WARNING) << "Ignoring autotune results in " << path << ": "
+                   << status;
+    } else {
+      VLOG(1) << "Loaded " << results->results_size()
+              << " autotune results from " << path;
+    }
+    return cache;
+  }();
+  return *cache;
+}
+
+}  // namespace
+
+/*static*/ bool AutotuneCache::AutotuneEnabled() {
+  static bool enabled = [] {
+    bool flag = false;
+    TF_CHECK_OK(tsl::ReadBoolFromEnvVar("XLA_AUTOTUNE", false, &flag));
+    return flag;
+  }();
+  return enabled;
+}
+
+/*static*/ std::string AutotuneCache::DeviceKey(
+    se::StreamExecutor* stream_exec) {
+  if (stream_exec == nullptr) return "";
+  return stream_exec->GetDeviceDescription().name();
+}
+
+/*static*/ std::string AutotuneCache::HloKey(const HloInstruction& instr) {
+  return instr.ToString(
+      HloPrintOptions::Canonical().set_print_backend_config(true));
+}
+
+/*static*/ std::optional<AutotuneResult> AutotuneCache::Lookup(
+    absl::string_view device, absl::string_view hlo) {
+  Cache& cache = GetCache();
+  absl::MutexLock lock(&cache.mu);
+  if (device.empty()) {
+    auto it = cache.results_by_hlo.find(hlo);
+    if (it != cache.results_by_hlo.end()) return it->second;
+    return std::nullopt;
+  }
+  auto it =
+      cache.results.find(std::make_pair(std::string(device), std::string(hlo)));
+  if (it != cache.results.end()) return it->second;
+  return std::nullopt;
+}
+
+/*static*/ void AutotuneCache::Insert(absl::string_view device,
+                                      absl::string_view hlo,
+                                      const AutotuneResult& result) {
+  Cache& cache = GetCache();
+  absl::MutexLock lock(&cache.mu);
+  InsertLocked(cache, device, hlo, result, /*overwrite=*/true);
+}
+
+/*static*/ Status AutotuneCache::Load(const AutotuneResults& results) {
+  Cache& cache = GetCache();
+  absl::MutexLock lock(&cache.mu);
+  return LoadLocked(cache, results);
+}
+
+/*static*/ Status AutotuneCache::Serialize(AutotuneResults* results) {
+  Cache& cache = GetCache();
+  results->set_version(kAutotuneResultsVersion);
+  {
+    absl::MutexLock lock(&cache.mu);
+    for (const auto& [key, result] : cache.results) {
+      AutotuneResults::Entry* entry = results->add_results();
+      entry->set_device(key.first);
+      entry->set_hlo(key.second);
+      *entry->mutable_result() = result;
+    }
+  }
+  // Sort for a deterministic file.
+  std::sort(results->mutable_results()->pointer_begin(),
+            results->mutable_results()->pointer_end(),
+            [](const auto* a, const auto* b) {
+              return std::make_pair(a->device(), a->hlo()) <
+                     std::make_pair(b->device(), b->hlo());
+            });
+  return OkStatus();
+}
+
+/*static*/ Status AutotuneCache::LoadFromFile(absl::string_view path) {
+  TF_ASSIGN_OR_RETURN(AutotuneResults results, ReadAutotuneResults(path));
+  return Load(results);
+}
+
+/*static*/ Status AutotuneCache::SerializeToFile(absl::string_view path) {
+  AutotuneResults results;
+  TF_RETURN_IF_ERROR(Serialize(&results));
+  std::string data;
+  if (IsTextProto(path)) {
+    if (!tsl::protobuf::TextFormat::PrintToString(results, &data)) {
+      return InternalError("Failed to print autotune results");
+    }
+  } else {
+    data = results.SerializeAsString();
+  }
+  return tsl::WriteStringToFile(tsl::Env::Default(), std::string(path), data);
+}
+
+/*static*/ Status AutotuneCache::MaybeDump() {
+  std::string path;
+  TF_RETURN_IF_ERROR(
+      tsl::ReadStringFromEnvVar("XLA_AUTOTUNE_RESULTS_DUMP", "", &path));
+  if (path.empty()) return OkStatus();
+  return SerializeToFile(path);
+}
+
+StatusOr<se::OwningDeviceMemory> AllocateAutotuneBuffer(
+    se::DeviceMemoryAllocator* allocator, se::Stream* stream,
+    const Shape& shape) {
+  int64_t size = ShapeUtil::ByteSizeOf(shape);
+  TF_ASSIGN_OR_RETURN(
+      se::OwningDeviceMemory buffer,
+      allocator->Allocate(stream->parent()->device_ordinal(), size));
+  if (size > 0) {
+    se::DeviceMemoryBase memory = *buffer;
+    stream->ThenMemZero(&memory, size);
+  }
+  return std::move(buffer);
+}
+
+StatusOr<absl::Duration> ProfileAutotuneCandidate(
+    se::Stream* stream, absl::FunctionRef<Status()> run) {
+  TF_RETURN_IF_ERROR(run());
+  TF_RETURN_IF_ERROR(stream->BlockHostUntilDone());
+  uint64_t start_us = tsl::Env::Default()->NowMicros();
+  for (int i = 0; i < kProfileIterations; ++i) {
+    TF_RETURN_IF_ERROR(run());
+  }
+  TF_RETURN_IF_ERROR(stream->BlockHostUntilDone());
+  uint64_t end_us = tsl::Env::Default()->NowMicros();
+  return absl::Microseconds(end_us - start_us) / kProfileIterations;
+}
+
+}  // namespace gpu
+}  // namespace xla
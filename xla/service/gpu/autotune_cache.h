@@ -0,0 +1,84 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef XLA_SERVICE_GPU_AUTOTUNE_CACHE_H_
+#define XLA_SERVICE_GPU_AUTOTUNE_CACHE_H_
+
+#include <optional>
+#include <string>
+
+#include "absl/functional/function_ref.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "xla/autotune_results.pb.h"
+#include "xla/hlo/ir/hlo_instruction.h"
+#include "xla/shape.h"
+#include "xla/status.h"
+#include "xla/statusor.h"
+#include "xla/stream_executor/device_memory_allocator.h"
+#include "xla/stream_executor/stream_executor.h"
+
+namespace xla {
+namespace gpu {
+
+// Process-wide store of GEMM and convolution autotuning results, keyed by
+// device and canonical HLO text of the custom call.
+//
+// Environment variables:
+//   XLA_AUTOTUNE=1                benchmark candidates on the attached device.
+//   XLA_AUTOTUNE_RESULTS_LOAD=f   read AutotuneResults from `f` on first use.
+//   XLA_AUTOTUNE_RESULTS_DUMP=f   write all results to `f` after each module.
+// A file ending in .txt or .pbtxt is text proto, anything else binary proto.
+class AutotuneCache {
+ public:
+  // Whether on-device benchmarking is enabled.
+  static bool AutotuneEnabled();
+
+  // Device part of the cache key. Empty when compiling without a device, in
+  // which case lookups match a result recorded for any device.
+  static std::string DeviceKey(se::StreamExecutor* stream_exec);
+
+  static std::string HloKey(const HloInstruction& instr);
+
+  static std::optional<AutotuneResult> Lookup(absl::string_view device,
+                                              absl::string_view hlo);
+  static void Insert(absl::string_view device, absl::string_view hlo,
+                     const AutotuneResult& result);
+
+  // Merges `results` into the cache. Existing entries are kept.
+  static Status Load(const AutotuneResults& results);
+  static Status Serialize(AutotuneResults* results);
+
+  static Status LoadFromFile(absl::string_view path);
+  static Status SerializeToFile(absl::string_view path);
+
+  // Writes the cache to XLA_AUTOTUNE_RESULTS_DUMP, if set.
+  static Status MaybeDump();
+};
+
+// Allocates a zero-filled device buffer for `shape` to benchmark on.
+StatusOr<se::OwningDeviceMemory> AllocateAutotuneBuffer(
+    se::DeviceMemoryAllocator* allocator, se::Stream* stream,
+    const Shape& shape);
+
+// Runs `run` once as warm-up and returns the average wall time of the
+// following runs, synchronizing `stream` around them.
+StatusOr<absl::Duration> ProfileAutotuneCandidate(
+    se::Stream* stream, absl::FunctionRef<Status()> run);
+
+}  // namespace gpu
+}  // namespace xla
+
+#endif  // XLA_SERVICE_GPU_AUTOTUNE_CACHE_H_
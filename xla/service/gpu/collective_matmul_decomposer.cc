@@ -0,0 +1,351 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/service/gpu/collective_matmul_decomposer.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "tsl/platform/errors.h"
+#include "tsl/platform/logging.h"
+#include "tsl/platform/statusor.h"
+#include "tsl/util/env_var.h"
+#include "xla/hlo/ir/hlo_casting_utils.h"
+#include "xla/hlo/ir/hlo_computation.h"
+#include "xla/hlo/ir/hlo_instruction.h"
+#include "xla/hlo/ir/hlo_instructions.h"
+#include "xla/hlo/ir/hlo_opcode.h"
+#include "xla/hlo/utils/hlo_query.h"
+#include "xla/literal_util.h"
+#include "xla/service/collective_ops_utils.h"
+#include "xla/service/hlo_creation_utils.h"
+#include "xla/shape_util.h"
+#include "xla/statusor.h"
+#include "xla/xla_data.pb.h"
+
+namespace xla {
+namespace gpu {
+namespace {
+
+// Collectives moving fewer bytes than this are left alone; negative disables
+// the pass.
+int64_t ThresholdBytes() {
+  static int64_t threshold = [] {
+    int64_t mib = -1;
+    TF_CHECK_OK(tsl::ReadInt64FromEnvVar("XLA_COLLECTIVE_MATMUL_THRESHOLD_MIB",
+                                         -1, &mib));
+    return mib < 0 ? -1 : mib << 20;
+  }();
+  return threshold;
+}
+
+// The devices of a collective as rings, one per replica group.
+struct Ring {
+  int64_t size = 0;
+  // Every partition sends to the one before it in its group.
+  std::vector<std::pair<int64_t, int64_t>> pairs;
+  // Position of each partition in its group.
+  std::vector<int32_t> positions;
+};
+
+std::optional<Ring> GetRing(const HloInstruction* collective,
+                            int64_t num_partitions) {
+  if (!collective->channel_id().has_value()) return std::nullopt;
+  std::vector<ReplicaGroup> groups(collective->replica_groups().begin(),
+                                   collective->replica_groups().end());
+  if (groups.empty()) {
+    groups.emplace_back();
+    for (int64_t id = 0; id < num_partitions; ++id) {
+      groups[0].add_replica_ids(id);
+    }
+  }
+  Ring ring;
+  ring.size = groups[0].replica_ids_size();
+  if (ring.size < 2) return std::nullopt;
+  ring.positions.assign(num_partitions, -1);
+  for (const ReplicaGroup& group : groups) {
+    if (group.replica_ids_size() != ring.size) return std::nullopt;
+    for (int64_t i = 0; i < ring.size; ++i) {
+      int64_t id = group.replica_ids(i);
+      if (id < 0 || id >= num_partitions || ring.positions[id] != -1) {
+        return std::nullopt;
+      }
+      ring.positions[id] = i;
+      int64_t previous = group.replica_ids((i + ring.size - 1) % ring.size);
+      ring.pairs.emplace_back(id, previous);
+    }
+  }
+  if (absl::c_linear_search(ring.positions, -1)) return std::nullopt;
+  return ring;
+}
+
+// The dimension of the output of `dot` that dimension `dim` of operand
+// `operand_index` becomes, unless it is a batch or contracting dimension.
+std::optional<int64_t> DotOutputDim(const HloInstruction* dot,
+                                    int64_t operand_index, int64_t dim) {
+  const DotDimensionNumbers& dnums = dot->dot_dimension_numbers();
+  auto free_dims = [&](int64_t index) {
+    const auto& batch = index == 0 ? dnums.lhs_batch_dimensions()
+                                   : dnums.rhs_batch_dimensions();
+    const auto& contracting = index == 0 ? dnums.lhs_contracting_dimensions()
+                                         : dnums.rhs_contracting_dimensions();
+    std::vector<int64_t> dims;
+    for (int64_t i = 0; i < dot->operand(index)->shape().rank(); ++i) {
+      if (!absl::c_linear_search(batch, i) &&
+          !absl::c_linear_search(contracting, i)) {
+        dims.push_back(i);
+      }
+    }
+    return dims;
+  };
+  int64_t output_dim = dnums.lhs_batch_dimensions_size();
+  if (operand_index == 1) output_dim += free_dims(0).size();
+  std::vector<int64_t> dims = free_dims(operand_index);
+  auto it = absl::c_find(dims, dim);
+  if (it == dims.end()) return std::nullopt;
+  return output_dim + (it - dims.begin());
+}
+
+// The S32 position of this partition in its ring.
+StatusOr<HloInstruction*> MakeRingPosition(HloComputation* computation,
+                                           const Ring& ring) {
+  HloInstruction* partition_id =
+      computation->AddInstruction(HloInstruction::CreatePartitionId());
+  HloInstruction* table =
+      MakeR1ConstantHlo<int32_t>(computation, S32, ring.positions);
+  TF_ASSIGN_OR_RETURN(
+      HloInstruction * position,
+      MakeDynamicSliceHlo(table, std::vector<HloInstruction*>{partition_id},
+                          {1}));
+  return MakeReshapeHlo(ShapeUtil::MakeShape(S32, {}), position);
+}
+
+// The offset of chunk (position + shift) % ring.size.
+StatusOr<HloInstruction*> MakeChunkOffset(HloInstruction* position,
+                                          const Ring& ring, int64_t shift,
+                                          int64_t chunk_size) {
+  HloComputation* computation = position->parent();
+  HloInstruction* index = position;
+  if (shift % ring.size != 0) {
+    TF_ASSIGN_OR_RETURN(
+        index, MakeBinaryHlo(HloOpcode::kAdd, index,
+                             MakeR0ConstantHlo<int32_t>(computation, shift)));
+    TF_ASSIGN_OR_RETURN(
+        index,
+        MakeBinaryHlo(HloOpcode::kRemainder, index,
+                      MakeR0ConstantHlo<int32_t>(computation, ring.size)));
+  }
+  return MakeBinaryHlo(HloOpcode::kMultiply, index,
+                       MakeR0ConstantHlo<int32_t>(computation, chunk_size));
+}
+
+std::vector<HloInstruction*> MakeStartIndices(HloInstruction* offset,
+                                              int64_t rank, int64_t dim) {
+  std::vector<HloInstruction*> starts(
+      rank, MakeR0ConstantHlo<int32_t>(offset->parent(), 0));
+  starts[dim] = offset;
+  return starts;
+}
+
+// Clones `dot` onto `operands` as the dot of a ring step.
+HloInstruction* MakeStepDot(HloInstruction* dot, const Shape& shape,
+                            absl::Span<HloInstruction* const> operands) {
+  HloInstruction* step = dot->parent()->AddInstruction(
+      dot->CloneWithNewOperands(shape, operands));
+  FrontendAttributes attributes = step->frontend_attributes();
+  (*attributes.mutable_map())[std::string(kCollectiveMatmulStepAttr)] =
+      "true";
+  step->set_frontend_attributes(attributes);
+  return step;
+}
+
+HloInstruction* MakeRingPermute(HloInstruction* operand, const Ring& ring,
+                                int64_t* next_channel_id) {
+  return operand->parent()->AddInstruction(
+      HloInstruction::CreateCollectivePermute(operand->shape(), operand,
+                                              ring.pairs,
+                                              (*next_channel_id)++));
+}
+
+// dot(all-gather(x), w): after `step` permutes, a device holds the chunk of
+// x of the device `step` places after it in the ring.
+StatusOr<bool> DecomposeAllGatherDot(HloInstruction* dot,
+                                     int64_t num_partitions,
+                                     int64_t* next_channel_id) {
+  for (int64_t i = 0; i < 2; ++i) {
+    HloInstruction* all_gather = dot->mutable_operand(i);
+    if (all_gather->opcode() != HloOpcode::kAllGather ||
+        all_gather->operand_count() != 1 || all_gather->user_count() != 1 ||
+        ShapeUtil::ByteSizeOf(all_gather->shape()) < ThresholdBytes()) {
+      continue;
+    }
+    int64_t dim =
+        Cast<HloAllGatherInstruction>(all_gather)->all_gather_dimension();
+    std::optional<int64_t> output_dim = DotOutputDim(dot, i, dim);
+    std::optional<Ring> ring = GetRing(all_gather, num_partitions);
+    if (!output_dim.has_value() || !ring.has_value()) continue;
+
+    VLOG(1) << "Decomposing " << all_gather->name() << " -> " << dot->name()
+            << " into " << ring->size << " ring steps";
+    HloComputation* computation = dot->parent();
+    HloInstruction* chunk = all_gather->mutable_operand(0);
+    HloInstruction* other = dot->mutable_operand(1 - i);
+    int64_t chunk_size = chunk->shape().dimensions(dim);
+    Shape partial_shape = dot->shape();
+    partial_shape.set_dimensions(*output_dim, chunk_size);
+    TF_ASSIGN_OR_RETURN(HloInstruction * position,
+                        MakeRingPosition(computation, *ring));
+
+    HloInstruction* output = MakeBroadcastHlo(
+        computation->AddInstruction(HloInstruction::CreateConstant(
+            LiteralUtil::Zero(dot->shape().element_type()))),
+        {}, dot->shape());
+    for (int64_t step = 0; step < ring->size; ++step) {
+      if (step > 0) chunk = MakeRingPermute(chunk, *ring, next_channel_id);
+      std::vector<HloInstruction*> operands = {chunk, other};
+      if (i == 1) std::swap(operands[0], operands[1]);
+      HloInstruction* partial = MakeStepDot(dot, partial_shape, operands);
+      TF_ASSIGN_OR_RETURN(
+          HloInstruction * offset,
+          MakeChunkOffset(position, *ring, step, chunk_size));
+      TF_ASSIGN_OR_RETURN(
+          output, MakeDynamicUpdateSliceHlo(
+                      output, partial,
+                      MakeStartIndices(offset, dot->shape().rank(),
+                                       *output_dim)));
+    }
+    TF_RETURN_IF_ERROR(computation->ReplaceInstruction(dot, output));
+    return true;
+  }
+  return false;
+}
+
+// reduce-scatter(dot(x, w)): at `step`, a device adds its dot for chunk
+// position + step + 1 to the partial sum of that chunk received from the
+// device after it, so the last step completes its own chunk.
+StatusOr<bool> DecomposeDotReduceScatter(HloInstruction* reduce_scatter,
+                                         int64_t num_partitions,
+                                         int64_t* next_channel_id) {
+  HloInstruction* dot = reduce_scatter->mutable_operand(0);
+  if (reduce_scatter->operand_count() != 1 ||
+      dot->opcode() != HloOpcode::kDot || dot->user_count() != 1 ||
+      MatchReductionComputation(reduce_scatter->to_apply()) !=
+          ReductionKind::SUM ||
+      ShapeUtil::ByteSizeOf(dot->shape()) < ThresholdBytes()) {
+    return false;
+  }
+  int64_t output_dim =
+      Cast<HloReduceScatterInstruction>(reduce_scatter)->scatter_dimension();
+  std::optional<Ring> ring = GetRing(reduce_scatter, num_partitions);
+  if (!ring.has_value()) return false;
+  for (int64_t i = 0; i < 2; ++i) {
+    HloInstruction* operand = dot->mutable_operand(i);
+    std::optional<int64_t> dim;
+    for (int64_t d = 0; d < operand->shape().rank(); ++d) {
+      if (DotOutputDim(dot, i, d) == output_dim) dim = d;
+    }
+    if (!dim.has_value()) continue;
+
+    VLOG(1) << "Decomposing " << dot->name() << " -> "
+            << reduce_scatter->name() << " into " << ring->size
+            << " ring steps";
+    HloComputation* computation = dot->parent();
+    HloInstruction* other = dot->mutable_operand(1 - i);
+    int64_t chunk_size = reduce_scatter->shape().dimensions(output_dim);
+    std::vector<int64_t> slice_sizes(operand->shape().dimensions().begin(),
+                                     operand->shape().dimensions().end());
+    slice_sizes[*dim] = chunk_size;
+    TF_ASSIGN_OR_RETURN(HloInstruction * position,
+                        MakeRingPosition(computation, *ring));
+
+    HloInstruction* sum = nullptr;
+    for (int64_t step = 0; step < ring->size; ++step) {
+      TF_ASSIGN_OR_RETURN(
+          HloInstruction * offset,
+          MakeChunkOffset(position, *ring, step + 1, chunk_size));
+      TF_ASSIGN_OR_RETURN(
+          HloInstruction * piece,
+          MakeDynamicSliceHlo(
+              operand,
+              MakeStartIndices(offset, operand->shape().rank(), *dim),
+              slice_sizes));
+      std::vector<HloInstruction*> operands = {piece, other};
+      if (i == 1) std::swap(operands[0], operands[1]);
+      HloInstruction* partial =
+          MakeStepDot(dot, reduce_scatter->shape(), operands);
+      if (sum == nullptr) {
+        sum = partial;
+      } else {
+        TF_ASSIGN_OR_RETURN(
+            sum, MakeBinaryHlo(HloOpcode::kAdd,
+                               MakeRingPermute(sum, *ring, next_channel_id),
+                               partial));
+      }
+    }
+    TF_RETURN_IF_ERROR(computation->ReplaceInstruction(reduce_scatter, sum));
+    return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+const absl::string_view kCollectiveMatmulStepAttr =
+    "_xla_collective_matmul_step";
+
+bool IsCollectiveMatmulStep(const HloInstruction& hlo) {
+  return hlo.frontend_attributes().map().contains(
+      std::string(kCollectiveMatmulStepAttr));
+}
+
+bool IsCollectiveMatmulEnabled() { return ThresholdBytes() >= 0; }
+
+StatusOr<bool> CollectiveMatmulDecomposer::Run(
+    HloModule* module,
+    const absl::flat_hash_set<absl::string_view>& execution_threads) {
+  int64_t num_partitions = module->config().num_partitions();
+  if (!IsCollectiveMatmulEnabled() || num_partitions < 2 ||
+      module->config().replica_count() != 1) {
+    return false;
+  }
+  int64_t next_channel_id = hlo_query::NextChannelId(*module);
+  bool changed = false;
+  for (HloComputation* computation :
+       module->MakeNonfusionComputations(execution_threads)) {
+    for (HloInstruction* instr : computation->MakeInstructionPostOrder()) {
+      bool decomposed = false;
+      if (instr->opcode() == HloOpcode::kDot) {
+        TF_ASSIGN_OR_RETURN(
+            decomposed,
+            DecomposeAllGatherDot(instr, num_partitions, &next_channel_id));
+      } else if (instr->opcode() == HloOpcode::kReduceScatter) {
+        TF_ASSIGN_OR_RETURN(decomposed,
+                            DecomposeDotReduceScatter(instr, num_partitions,
+                                                      &next_channel_id));
+      }
+      changed |= decomposed;
+    }
+  }
+  return changed;
+}
+
+}  // namespace gpu
+}  // namespace xla
@@ -0,0 +1,72 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef XLA_SERVICE_GPU_COLLECTIVE_MATMUL_DECOMPOSER_H_
+#define XLA_SERVICE_GPU_COLLECTIVE_MATMUL_DECOMPOSER_H_
+
+#include "absl/strings/string_view.h"
+#include "xla/hlo/ir/hlo_instruction.h"
+#include "xla/hlo/ir/hlo_module.h"
+#include "xla/service/hlo_pass_interface.h"
+
+namespace xla {
+namespace gpu {
+
+// Decomposes the collectives around the dots of tensor-parallel layers into
+// ring steps, so that communication overlaps with the GEMMs:
+//
+//   dot(all-gather(x), w) becomes N dots, one per chunk of x. Each chunk is
+//   passed on to the next device of the ring by a collective-permute while
+//   the dot of the chunk before it runs, and the dots are assembled into the
+//   output with dynamic-update-slices.
+//
+//   reduce-scatter(dot(x, w)) becomes N dots, one per chunk of the scattered
+//   dimension. The partial sum of each chunk travels around the ring, and
+//   every device adds the dot of that chunk to it. The permute of one partial
+//   sum overlaps with the next dot.
+//
+// The latency-hiding scheduler places the collective-permutes beside the
+// dots, and they run on the async collective stream. Only cross-partition
+// collectives with a single replica are decomposed, when the gathered or
+// reduced tensor holds at least XLA_COLLECTIVE_MATMUL_THRESHOLD_MIB MiB; the
+// default of -1 disables the pass. Runs after SPMD partitioning and after
+// DotMerger; the dots it creates are marked with kCollectiveMatmulStepAttr.
+class CollectiveMatmulDecomposer : public HloModulePass {
+ public:
+  absl::string_view name() const override {
+    return "collective-matmul-decomposer";
+  }
+
+  using HloPassInterface::Run;
+  StatusOr<bool> Run(
+      HloModule* module,
+      const absl::flat_hash_set<absl::string_view>& execution_threads) override;
+};
+
+// Frontend attribute marking the dots of ring steps. Passes that combine
+// dots must leave them apart, or the steps could no longer overlap with the
+// collective-permutes.
+extern const absl::string_view kCollectiveMatmulStepAttr;
+
+bool IsCollectiveMatmulStep(const HloInstruction& hlo);
+
+// Whether XLA_COLLECTIVE_MATMUL_THRESHOLD_MIB enables the pass, in which case
+// collective-permutes must run asynchronously for its steps to overlap.
+bool IsCollectiveMatmulEnabled();
+
+}  // namespace gpu
+}  // namespace xla
+
+#endif  // XLA_SERVICE_GPU_COLLECTIVE_MATMUL_DECOMPOSER_H_
@@ -49,18 +49,19 @@ limitations under the License.
 #include "xla/service/bitcast_dtypes_expander.h"
 #include "xla/service/buffer_assignment.h"
 #include "xla/service/dump.h"
+#include "xla/service/gpu/compile_profile.h"
 #include "xla/service/gpu/conditional_thunk.h"
 #include "xla/service/gpu/for_thunk.h"
 #include "xla/service/gpu/gpu_constants.h"
 #include "xla/service/gpu/gpu_convert_async_collectives_to_sync.h"
 #include "xla/service/gpu/gpu_device_info.h"
 #include "xla/service/gpu/gpu_executable.h"
-#include "xla/service/gpu/gpu_hlo_schedule.h"
 #include "xla/service/gpu/ir_emitter_context.h"
 #include "xla/service/gpu/ir_emitter_unnested.h"
 #include "xla/service/gpu/metrics.h"
 #include "xla/service/gpu/sequential_thunk.h"
 #include "xla/service/gpu/while_thunk.h"
+#include "xla/service/gpu/xpu_hlo_schedule.h"
 #include "xla/service/hlo_dataflow_analysis.h"
 #include "xla/service/hlo_pass_pipeline.h"
 #include "xla/service/hlo_rematerialization.h"
@@ -229,10 +230,15 @@ Status CompileModuleToLlvmIrImpl(
   results->llvm_module->setTargetTriple(target_triple);
   results->llvm_module->setDataLayout(data_layout);
 
-  TF_RETURN_IF_ERROR(
-      ScheduleGpuModule(hlo_module, pointer_size, gpu_device_info));
+  std::shared_ptr<CompileProfile> profile = CompileProfile::Get(*hlo_module);
   {
-    HloPassPipeline pipeline("post-scheduling-passes");
+    CompileProfile::ScopedStage stage(profile.get(), "scheduling");
+    TF_RETURN_IF_ERROR(
+        ScheduleXpuModule(hlo_module, pointer_size, gpu_device_info));
+  }
+  {
+    HloPassPipeline pipeline("post-scheduling-passes",
+                             CompileProfile::StatsFor(hlo_module));
 
     HloPredicate is_nop =
         HloPredicateIsOp<HloOpcode::kParameter, HloOpcode::kConstant,
@@ -244,7 +250,8 @@ Status CompileModuleToLlvmIrImpl(
   }
 
   {
-    HloPassPipeline pipeline("remat-pipeline");
+    HloPassPipeline pipeline("remat-pipeline",
+                             CompileProfile::StatsFor(hlo_module));
 
     HloRematerialization::RematerializationSizes sizes;
     pipeline.AddPass<HloRematerialization>(
@@ -271,17 +278,20 @@ Status CompileModuleToLlvmIrImpl(
     return GetSizeOfShape(buffer_value.shape(), pointer_size);
   };
 
-  TF_ASSIGN_OR_RETURN(
-      results->buffer_assignment,
-      BufferAssigner::Run(
-          hlo_module,
-          std::make_unique<SequentialHloOrdering>(hlo_module->schedule()),
-          buffer_size_bytes_function,
-          /*color_alignment=*/
-          [](LogicalBuffer::Color) { return kXlaAllocatedBufferAlignBytes; },
-          /*allocate_buffers_for_constants=*/true,
-          /*colorer=*/BufferAssigner::DefaultColorer(),
-          /*must_not_live_out=*/{}, can_share_buffer_function));
+  {
+    CompileProfile::ScopedStage stage(profile.get(), "buffer-assignment");
+    TF_ASSIGN_OR_RETURN(
+        results->buffer_assignment,
+        BufferAssigner::Run(
+            hlo_module,
+            std::make_unique<SequentialHloOrdering>(hlo_module->schedule()),
+            buffer_size_bytes_function,
+            /*color_alignment=*/
+            [](LogicalBuffer::Color) { return kXlaAllocatedBufferAlignBytes; },
+            /*allocate_buffers_for_constants=*/true,
+            /*colorer=*/BufferAssigner::DefaultColorer(),
+            /*must_not_live_out=*/{}, can_share_buffer_function));
+  }
 
   VLOG(1) << "Buffer Assignment Stats for " << hlo_module->name() << "\n"
           << results->buffer_assignment->GetStats().ToString();
@@ -300,8 +310,11 @@ Status CompileModuleToLlvmIrImpl(
   mlir::OwningOpRef<mlir::ModuleOp> mlir_module =
       mlir::ModuleOp::create(mlir::Builder(&mlir_context).getUnknownLoc());
 
-  TF_RETURN_IF_ERROR(
-      HloToLhloModule(*results->buffer_assignment, *hlo_module, *mlir_module));
+  {
+    CompileProfile::ScopedStage stage(profile.get(), "hlo-to-lhlo");
+    TF_RETURN_IF_ERROR(HloToLhloModule(*results->buffer_assignment,
+                                       *hlo_module, *mlir_module));
+  }
 
   results->module_name =
       mlir::mhlo::GetDebugNameFromLocation(mlir_module->getLoc());
@@ -331,6 +344,7 @@ Status CompileModuleToLlvmIrImpl(
   {
     XLA_SCOPED_LOGGING_TIMER(absl::StrCat(
         "GpuCompiler::RunBackend - IR emission for ", hlo_module->name()));
+    CompileProfile::ScopedStage stage(profile.get(), "ir-emission");
 
     TF_RETURN_IF_ERROR(ir_emitter->EmitLmhloRegion(&entry_function.getBody()));
 
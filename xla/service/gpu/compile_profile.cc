@@ -0,0 +1,350 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/service/gpu/compile_profile.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "tsl/platform/env.h"
+#include "tsl/platform/logging.h"
+#include "tsl/profiler/lib/traceme.h"
+#include "tsl/util/env_var.h"
+#include "xla/service/dump.h"
+
+namespace xla {
+namespace gpu {
+namespace {
+
+// Current resident set size of the process in KiB.
+int64_t CurrentRssKb() {
+  std::ifstream statm("/proc/self/statm");
+  int64_t size_pages = 0, resident_pages = 0;
+  if (!(statm >> size_pages >> resident_pages)) return 0;
+  return resident_pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// High-water mark of the resident set size in KiB since the last
+// ResetPeakRss, or 0 if unknown.
+int64_t PeakRssKb() {
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (!absl::StartsWith(line, "VmHWM:")) continue;
+    // "VmHWM:     1234 kB"
+    std::istringstream value(line.substr(6));
+    int64_t kb = 0;
+    return value >> kb ? kb : 0;
+  }
+  return 0;
+}
+
+// Resets the high-water mark to the current resident set size. Returns
+// false where /proc/self/clear_refs is unavailable.
+bool ResetPeakRss() {
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5";
+  clear_refs.flush();
+  return clear_refs.good();
+}
+
+// Tracks the peak RSS of possibly nested and concurrent intervals. The
+// high-water mark belongs to the process, so every interval start resets it,
+// after folding the mark reached so far into all intervals still open.
+class PeakRssTracker {
+ public:
+  static PeakRssTracker& Global() {
+    static auto* tracker = new PeakRssTracker();
+    return *tracker;
+  }
+
+  // Starts an interval and returns its id.
+  int64_t Open() {
+    absl::MutexLock lock(&mu_);
+    Sample();
+    supported_ = supported_ && ResetPeakRss();
+    int64_t id = next_id_++;
+    open_[id] = 0;
+    return id;
+  }
+
+  // Ends interval `id` and returns its peak RSS in KiB, or -1 if the
+  // high-water mark cannot be reset.
+  int64_t Close(int64_t id) {
+    absl::MutexLock lock(&mu_);
+    Sample();
+    auto it = open_.find(id);
+    if (it == open_.end()) return -1;
+    int64_t peak_kb = it->second;
+    open_.erase(it);
+    return supported_ ? peak_kb : -1;
+  }
+
+ private:
+  void Sample() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    int64_t peak_kb = PeakRssKb();
+    for (auto& [id, open_peak_kb] : open_) {
+      open_peak_kb = std::max(open_peak_kb, peak_kb);
+    }
+  }
+
+  absl::Mutex mu_;
+  bool supported_ ABSL_GUARDED_BY(mu_) = true;
+  int64_t next_id_ ABSL_GUARDED_BY(mu_) = 0;
+  absl::flat_hash_map<int64_t, int64_t> open_ ABSL_GUARDED_BY(mu_);
+};
+
+std::string JsonEscape(absl::string_view s) {
+  std::string out;
+  out.reserve(s.size());
+  for (char c : s) {
+    switch (c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          absl::StrAppendFormat(&out, "\\u%04x", c);
+        } else {
+          out += c;
+        }
+    }
+  }
+  return out;
+}
+
+struct Registry {
+  absl::Mutex mu;
+  absl::flat_hash_map<int, std::shared_ptr<CompileProfile>> profiles
+      ABSL_GUARDED_BY(mu);
+};
+
+Registry& GetRegistry() {
+  static auto* registry = new Registry();
+  return *registry;
+}
+
+}  // namespace
+
+CompileProfile::CompileProfile(std::string module_name)
+    : module_name_(std::move(module_name)),
+      created_us_(tsl::Env::Default()->NowMicros()) {}
+
+/*static*/ bool CompileProfile::Enabled() {
+  static bool enabled = [] {
+    bool flag = false;
+    TF_CHECK_OK(tsl::ReadBoolFromEnvVar("XLA_COMPILE_PROFILE", false, &flag));
+    return flag;
+  }();
+  return enabled;
+}
+
+/*static*/ std::shared_ptr<CompileProfile> CompileProfile::GetOrCreate(
+    const HloModule& module) {
+  if (!Enabled()) return nullptr;
+  Registry& registry = GetRegistry();
+  absl::MutexLock lock(&registry.mu);
+  std::shared_ptr<CompileProfile>& profile =
+      registry.profiles[module.unique_id()];
+  if (profile == nullptr) {
+    profile = std::make_shared<CompileProfile>(module.name());
+  }
+  return profile;
+}
+
+/*static*/ std::shared_ptr<CompileProfile> CompileProfile::Get(
+    const HloModule& module) {
+  if (!Enabled()) return nullptr;
+  Registry& registry = GetRegistry();
+  absl::MutexLock lock(&registry.mu);
+  auto it = registry.profiles.find(module.unique_id());
+  return it == registry.profiles.end() ? nullptr : it->second;
+}
+
+/*static*/ std::shared_ptr<CompileProfile> CompileProfile::Release(
+    const HloModule& module) {
+  if (!Enabled()) return nullptr;
+  Registry& registry = GetRegistry();
+  absl::MutexLock lock(&registry.mu);
+  auto it = registry.profiles.find(module.unique_id());
+  if (it == registry.profiles.end()) return nullptr;
+  std::shared_ptr<CompileProfile> profile = std::move(it->second);
+  registry.profiles.erase(it);
+  return profile;
+}
+
+/*static*/ CompilationStats* CompileProfile::StatsFor(const HloModule* module) {
+  if (module == nullptr) return nullptr;
+  // The registry keeps the profile alive for the whole compilation.
+  return GetOrCreate(*module).get();
+}
+
+void CompileProfile::StartPass(absl::string_view pass_name) {
+  int64_t activity_id = tsl::profiler::TraceMe::ActivityStart(
+      [&] { return absl::StrCat("HLO pass:", pass_name); });
+  OpenPass open{std::string(pass_name), activity_id,
+                tsl::Env::Default()->NowMicros(), CurrentRssKb(),
+                PeakRssTracker::Global().Open()};
+  absl::MutexLock lock(&mu_);
+  open_passes_.push_back(std::move(open));
+}
+
+void CompileProfile::EndPass(absl::string_view pass_name) {
+  OpenPass open;
+  int depth;
+  {
+    absl::MutexLock lock(&mu_);
+    if (open_passes_.empty() || open_passes_.back().name != pass_name) {
+      LOG(WARNING) << "Unbalanced EndPass for " << pass_name;
+      return;
+    }
+    open = std::move(open_passes_.back());
+    open_passes_.pop_back();
+    depth = open_passes_.size();
+  }
+  tsl::profiler::TraceMe::ActivityEnd(open.activity_id);
+  AddRecord(Kind::kPass, pass_name, depth, open.start_us, open.rss_start_kb,
+            PeakRssTracker::Global().Close(open.peak_rss_id));
+}
+
+void CompileProfile::CompilationReport() { LOG(INFO) << ToJson(); }
+
+int CompileProfile::GetPassesSize() {
+  absl::MutexLock lock(&mu_);
+  return std::count_if(records_.begin(), records_.end(),
+                       [](const Record& r) { return r.kind == Kind::kPass; });
+}
+
+void CompileProfile::AddRecord(Kind kind, absl::string_view name, int depth,
+                               uint64_t start_us, int64_t rss_start_kb,
+                               int64_t peak_rss_kb) {
+  int64_t rss_end_kb = CurrentRssKb();
+  // Without a resettable high-water mark, the ends of the interval are the
+  // best lower bound of its peak.
+  if (peak_rss_kb < 0) peak_rss_kb = std::max(rss_start_kb, rss_end_kb);
+  Record record{kind,
+                std::string(name),
+                depth,
+                start_us,
+                tsl::Env::Default()->NowMicros() - start_us,
+                rss_start_kb,
+                rss_end_kb,
+                peak_rss_kb};
+  absl::MutexLock lock(&mu_);
+  records_.push_back(std::move(record));
+}
+
+CompileProfile::ScopedStage::ScopedStage(CompileProfile* profile,
+                                         absl::string_view stage_name)
+    : profile_(profile) {
+  if (profile_ == nullptr) return;
+  stage_name_ = std::string(stage_name);
+  activity_id_ = tsl::profiler::TraceMe::ActivityStart(
+      [&] { return absl::StrCat("Compile stage:", stage_name_); });
+  start_us_ = tsl::Env::Default()->NowMicros();
+  start_rss_kb_ = CurrentRssKb();
+  peak_rss_id_ = PeakRssTracker::Global().Open();
+}
+
+CompileProfile::ScopedStage::~ScopedStage() {
+  if (profile_ == nullptr) return;
+  tsl::profiler::TraceMe::ActivityEnd(activity_id_);
+  profile_->AddRecord(Kind::kStage, stage_name_, /*depth=*/0, start_us_,
+                      start_rss_kb_,
+                      PeakRssTracker::Global().Close(peak_rss_id_));
+}
+
+std::string CompileProfile::ToJson() const {
+  absl::MutexLock lock(&mu_);
+
+  struct Total {
+    int64_t count = 0;
+    uint64_t wall_us = 0;
+    int64_t rss_growth_kb = 0;
+  };
+  absl::flat_hash_map<std::string, Total> pass_totals;
+  std::vector<std::string> order;
+  int64_t peak_rss_kb = 0;
+
+  std::string json =
+      absl::StrFormat("{\n  \"module\": \"%s\",\n  \"records\": [",
+                      JsonEscape(module_name_));
+  for (int i = 0; i < records_.size(); ++i) {
+    const Record& r = records_[i];
+    absl::StrAppendFormat(
+        &json,
+        "%s\n    {\"kind\": \"%s\", \"name\": \"%s\", \"depth\": %d, "
+        "\"start_us\": %d, \"wall_us\": %d, \"rss_start_kb\": %d, "
+        "\"rss_end_kb\": %d, \"peak_rss_kb\": %d}",
+        i == 0 ? "" : ",", r.kind == Kind::kPass ? "pass" : "stage",
+        JsonEscape(r.name), r.depth, r.start_us - created_us_, r.wall_us,
+        r.rss_start_kb, r.rss_end_kb, r.peak_rss_kb);
+    peak_rss_kb = std::max(peak_rss_kb, r.peak_rss_kb);
+    if (r.kind != Kind::kPass) continue;
+    auto [it, inserted] = pass_totals.try_emplace(r.name);
+    if (inserted) order.push_back(r.name);
+    it->second.count++;
+    it->second.wall_us += r.wall_us;
+    it->second.rss_growth_kb += r.rss_end_kb - r.rss_start_kb;
+  }
+
+  // Most expensive passes first.
+  std::stable_sort(order.begin(), order.end(),
+                   [&](const std::string& a, const std::string& b) {
+                     return pass_totals[a].wall_us > pass_totals[b].wall_us;
+                   });
+  absl::StrAppend(&json, "\n  ],\n  \"pass_totals\": [");
+  for (int i = 0; i < order.size(); ++i) {
+    const Total& total = pass_totals[order[i]];
+    absl::StrAppendFormat(
+        &json,
+        "%s\n    {\"name\": \"%s\", \"count\": %d, \"wall_us\": %d, "
+        "\"rss_growth_kb\": %d}",
+        i == 0 ? "" : ",", JsonEscape(order[i]), total.count, total.wall_us,
+        total.rss_growth_kb);
+  }
+  absl::StrAppendFormat(&json,
+                        "\n  ],\n  \"total_wall_us\": %d,\n"
+                        "  \"peak_rss_kb\": %d\n}\n",
+                        tsl::Env::Default()->NowMicros() - created_us_,
+                        peak_rss_kb);
+  return json;
+}
+
+void CompileProfile::Dump(const HloModule& module) const {
+  if (DumpingEnabledForHloModule(module)) {
+    DumpToFileInDirOrStdout(module, "", "compile_profile.json", ToJson());
+  } else {
+    LOG(INFO) << "Compile profile for " << module_name_ << ":\n" << ToJson();
+  }
+}
+
+}  // namespace gpu
+}  // namespace xla
@@ -0,0 +1,126 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef XLA_SERVICE_GPU_COMPILE_PROFILE_H_
+#define XLA_SERVICE_GPU_COMPILE_PROFILE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "xla/hlo/ir/hlo_module.h"
+#include "xla/service/compilation_stats.h"
+
+namespace xla {
+namespace gpu {
+
+// Collects wall time and resident set size of every HLO pass and backend stage
+// (IR emission, LLVM optimization, SPIR-V translation, module load) of one
+// module compilation, and writes them out as a JSON report.
+//
+// Each record's peak_rss_kb is the high-water mark of the resident set size
+// while it ran, found by resetting the kernel's mark (VmHWM) at every record
+// start. Where the mark cannot be reset, it is the larger of the start and
+// end sizes.
+//
+// Profiling is enabled with XLA_COMPILE_PROFILE=1. Passes get recorded by
+// handing StatsFor(module) to the HloPassPipeline constructor, backend stages
+// by ScopedStage. Every record is also emitted as a TraceMe span.
+class CompileProfile : public CompilationStats {
+ public:
+  explicit CompileProfile(std::string module_name);
+
+  static bool Enabled();
+
+  // Returns the profile registered for `module`, creating it on first use.
+  // Returns nullptr if profiling is disabled.
+  static std::shared_ptr<CompileProfile> GetOrCreate(const HloModule& module);
+
+  // Returns the profile registered for `module`, or nullptr.
+  static std::shared_ptr<CompileProfile> Get(const HloModule& module);
+
+  // Unregisters the profile of `module` and returns it.
+  static std::shared_ptr<CompileProfile> Release(const HloModule& module);
+
+  // Stats to pass to HloPassPipeline, nullptr if profiling is disabled.
+  static CompilationStats* StatsFor(const HloModule* module);
+
+  void StartPass(absl::string_view pass_name) override;
+  void EndPass(absl::string_view pass_name) override;
+  void CompilationReport() override;
+  int GetPassesSize() override;
+
+  // Records a backend stage for the lifetime of the object. A null profile
+  // makes this a no-op.
+  class ScopedStage {
+   public:
+    ScopedStage(CompileProfile* profile, absl::string_view stage_name);
+    ~ScopedStage();
+
+   private:
+    CompileProfile* profile_;
+    std::string stage_name_;
+    int64_t activity_id_ = 0;
+    uint64_t start_us_ = 0;
+    int64_t start_rss_kb_ = 0;
+    int64_t peak_rss_id_ = 0;
+  };
+
+  std::string ToJson() const;
+
+  // Writes the report as <module>.compile_profile.json into the dump
+  // directory, or logs it when dumping is disabled for `module`.
+  void Dump(const HloModule& module) const;
+
+ private:
+  enum class Kind { kPass, kStage };
+
+  struct Record {
+    Kind kind;
+    std::string name;
+    int depth;
+    uint64_t start_us;
+    uint64_t wall_us;
+    int64_t rss_start_kb;
+    int64_t rss_end_kb;
+    int64_t peak_rss_kb;
+  };
+
+  struct OpenPass {
+    std::string name;
+    int64_t activity_id;
+    uint64_t start_us;
+    int64_t rss_start_kb;
+    int64_t peak_rss_id;
+  };
+
+  void AddRecord(Kind kind, absl::string_view name, int depth,
+                 uint64_t start_us, int64_t rss_start_kb, int64_t peak_rss_kb);
+
+  const std::string module_name_;
+  const uint64_t created_us_;
+
+  mutable absl::Mutex mu_;
+  std::vector<Record> records_ ABSL_GUARDED_BY(mu_);
+  std::vector<OpenPass> open_passes_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace gpu
+}  // namespace xla
+
+#endif  // XLA_SERVICE_GPU_COMPILE_PROFILE_H_
@@ -0,0 +1,260 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/service/gpu/conv_autotuner.h"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "tsl/platform/errors.h"
+#include "tsl/platform/logging.h"
+#include "tsl/platform/statusor.h"
+#include "tsl/util/proto/proto_utils.h"
+#include "xla/hlo/ir/hlo_casting_utils.h"
+#include "xla/hlo/ir/hlo_instructions.h"
+#include "xla/literal_util.h"
+#include "xla/service/gpu/autotune_cache.h"
+#include "xla/service/gpu/backend_configs.pb.h"
+#include "xla/service/gpu/convolution_thunk.h"
+#include "xla/service/gpu/cublas_cudnn.h"
+#include "xla/service/gpu/gpu_conv_runner.h"
+#include "xla/service/gpu/scratch_allocator.h"
+#include "xla/shape_util.h"
+#include "xla/util.h"
+
+namespace xla {
+namespace gpu {
+namespace {
+
+StatusOr<GpuConvDescriptor> GetConvDescriptor(
+    const HloCustomCallInstruction* conv) {
+  GpuConvDescriptor descriptor;
+  TF_ASSIGN_OR_RETURN(descriptor.kind, GetCudnnConvKind(conv));
+  TF_ASSIGN_OR_RETURN(descriptor.backend_config,
+                      conv->backend_config<CudnnConvBackendConfig>());
+  descriptor.operand0_shape = conv->operand(0)->shape();
+  descriptor.operand1_shape = conv->operand(1)->shape();
+  descriptor.result_shape = conv->shape().tuple_shapes(0);
+  descriptor.scratch_size =
+      ShapeUtil::ByteSizeOf(conv->shape().tuple_shapes(1));
+  descriptor.window = conv->window();
+  descriptor.dnums = conv->convolution_dimension_numbers();
+  descriptor.feature_group_count = conv->feature_group_count();
+  return descriptor;
+}
+
+// Implementations benchmarked per filter format at most.
+constexpr int64_t kMaxConvImplementations = 8;
+
+// Benchmarks the oneDNN filter formats and implementations for `conv` on
+// zero-filled buffers. Returns nullopt if none of them runs.
+StatusOr<std::optional<AutotuneResult>> BenchmarkConv(
+    const HloCustomCallInstruction* conv, se::StreamExecutor* stream_exec,
+    se::DeviceMemoryAllocator* allocator) {
+  TF_ASSIGN_OR_RETURN(GpuConvDescriptor descriptor, GetConvDescriptor(conv));
+
+  se::StreamExecutorMemoryAllocator default_allocator(stream_exec);
+  if (allocator == nullptr) allocator = &default_allocator;
+  TF_ASSIGN_OR_RETURN(se::Stream* const stream,
+                      allocator->GetStream(stream_exec->device_ordinal()));
+
+  std::vector<se::OwningDeviceMemory> operands;
+  std::vector<se::DeviceMemoryBase> operand_buffers;
+  for (const HloInstruction* operand : conv->operands()) {
+    TF_ASSIGN_OR_RETURN(
+        se::OwningDeviceMemory buffer,
+        AllocateAutotuneBuffer(allocator, stream, operand->shape()));
+    operand_buffers.push_back(*buffer);
+    operands.push_back(std::move(buffer));
+  }
+  TF_ASSIGN_OR_RETURN(
+      se::OwningDeviceMemory result,
+      AllocateAutotuneBuffer(allocator, stream, descriptor.result_shape));
+
+  std::optional<AutotuneResult> best;
+  absl::Duration best_time = absl::InfiniteDuration();
+  auto& knobs =
+      *descriptor.backend_config.mutable_algorithm()->mutable_tuning_knobs();
+  for (int64_t format : {kOneDnnWeightFormatAny, kOneDnnWeightFormatPlain}) {
+    knobs[kOneDnnWeightFormatKnob] = format;
+    for (int64_t implementation = 0;
+         implementation < kMaxConvImplementations; ++implementation) {
+      knobs[kOneDnnImplementationKnob] = implementation;
+      auto profile = [&]() -> StatusOr<absl::Duration> {
+        se::OwningScratchAllocator<2> scratch_allocator(
+            stream_exec->device_ordinal(), allocator);
+        OneDnnConvPrimitive primitive;
+        TF_RETURN_IF_ERROR(CreateOneDnnPrimitive(
+            &primitive, descriptor, absl::MakeSpan(operand_buffers), *result,
+            stream, &scratch_allocator));
+        return ProfileAutotuneCandidate(stream, [&] {
+          return RunGpuConv(primitive, descriptor,
+                            absl::MakeSpan(operand_buffers), *result, stream);
+        });
+      };
+      StatusOr<absl::Duration> run_time = profile();
+      // Implementations run out before kMaxConvImplementations.
+      if (tsl::errors::IsNotFound(run_time.status())) break;
+      if (!run_time.ok()) {
+        VLOG(1) << "Conv weight format " << format << " implementation "
+                << implementation << " failed: " << run_time.status();
+        continue;
+      }
+      VLOG(2) << conv->name() << " weight format " << format
+              << " implementation " << implementation << ": " << *run_time;
+      if (*run_time < best_time) {
+        best_time = *run_time;
+        best.emplace();
+        auto& best_knobs = *best->mutable_algorithm()->mutable_tuning_knobs();
+        best_knobs[kOneDnnWeightFormatKnob] = format;
+        best_knobs[kOneDnnImplementationKnob] = implementation;
+        *best->mutable_run_time() =
+            tsl::proto_utils::ToDurationProto(*run_time);
+      }
+    }
+  }
+  return best;
+}
+
+// Returns the bytes of workspace the oneDNN primitive for `conv` requests:
+// the scratchpad plus the reordered filter, laid out as
+// BufferScratchAllocator hands them out.
+StatusOr<int64_t> GetConvWorkspaceSize(const HloCustomCallInstruction* conv,
+                                       se::StreamExecutor* stream_exec,
+                                       se::DeviceMemoryAllocator* allocator) {
+  TF_ASSIGN_OR_RETURN(GpuConvDescriptor descriptor, GetConvDescriptor(conv));
+
+  se::StreamExecutorMemoryAllocator default_allocator(stream_exec);
+  if (allocator == nullptr) allocator = &default_allocator;
+  TF_ASSIGN_OR_RETURN(se::Stream* const stream,
+                      allocator->GetStream(stream_exec->device_ordinal()));
+
+  // Building the primitive only records buffer addresses, so every operand
+  // and workspace can point at the same small allocation.
+  TF_ASSIGN_OR_RETURN(
+      se::OwningDeviceMemory placeholder,
+      allocator->Allocate(stream_exec->device_ordinal(), kWorkspaceAlignment));
+  std::vector<se::DeviceMemoryBase> operand_buffers(conv->operand_count(),
+                                                    *placeholder);
+  WorkspaceSizingAllocator sizing_allocator(*placeholder);
+  OneDnnConvPrimitive primitive;
+  TF_RETURN_IF_ERROR(CreateOneDnnPrimitive(
+      &primitive, descriptor, absl::MakeSpan(operand_buffers), *placeholder,
+      stream, &sizing_allocator));
+  return sizing_allocator.total_bytes();
+}
+
+}  // namespace
+
+StatusOr<bool> ConvAutotuner::RunOnInstruction(HloInstruction* conv) {
+  TF_ASSIGN_OR_RETURN(bool changed, PickAlgorithm(conv));
+  if (stream_exec_ == nullptr) return changed;
+  TF_ASSIGN_OR_RETURN(bool resized, AssignWorkspace(conv));
+  return changed || resized;
+}
+
+StatusOr<bool> ConvAutotuner::PickAlgorithm(HloInstruction* conv) {
+  TF_ASSIGN_OR_RETURN(CudnnConvBackendConfig backend_config,
+                      conv->backend_config<CudnnConvBackendConfig>());
+  if (backend_config.algorithm().tuning_knobs().count(
+          kOneDnnWeightFormatKnob) > 0) {
+    return false;
+  }
+
+  std::string device = AutotuneCache::DeviceKey(stream_exec_);
+  std::string hlo = AutotuneCache::HloKey(*conv);
+  std::optional<AutotuneResult> result = AutotuneCache::Lookup(device, hlo);
+  if (!result.has_value()) {
+    if (stream_exec_ == nullptr || !AutotuneCache::AutotuneEnabled()) {
+      return false;
+    }
+    TF_ASSIGN_OR_RETURN(
+        result, BenchmarkConv(Cast<HloCustomCallInstruction>(conv),
+                              stream_exec_, allocator_));
+    if (!result.has_value()) return false;
+    AutotuneCache::Insert(device, hlo, *result);
+  }
+  const auto& result_knobs = result->algorithm().tuning_knobs();
+  if (result_knobs.count(kOneDnnWeightFormatKnob) == 0) return false;
+
+  VLOG(1) << "Selected conv algorithm { "
+          << result->algorithm().ShortDebugString() << " } for "
+          << conv->name();
+  // Results cached before implementations were tuned only hold the format.
+  auto& knobs = *backend_config.mutable_algorithm()->mutable_tuning_knobs();
+  for (int64_t key : {kOneDnnWeightFormatKnob, kOneDnnImplementationKnob}) {
+    auto knob = result_knobs.find(key);
+    if (knob != result_knobs.end()) knobs[key] = knob->second;
+  }
+  TF_RETURN_IF_ERROR(conv->set_backend_config(backend_config));
+  return true;
+}
+
+StatusOr<bool> ConvAutotuner::AssignWorkspace(HloInstruction* conv) {
+  StatusOr<int64_t> workspace_size = GetConvWorkspaceSize(
+      Cast<HloCustomCallInstruction>(conv), stream_exec_, allocator_);
+  if (!workspace_size.ok()) {
+    // The thunk allocates the workspace when it runs instead.
+    VLOG(1) << "Cannot size the workspace of " << conv->name() << ": "
+            << workspace_size.status();
+    return false;
+  }
+  const Shape& scratch_shape = conv->shape().tuple_shapes(1);
+  if (ShapeUtil::ByteSizeOf(scratch_shape) == *workspace_size) return false;
+
+  VLOG(2) << "Assigning " << *workspace_size << " bytes of workspace to "
+          << conv->name();
+  HloComputation* computation = conv->parent();
+  Shape new_shape = ShapeUtil::MakeTupleShape(
+      {conv->shape().tuple_shapes(0),
+       ShapeUtil::MakeShape(U8, {*workspace_size})});
+  HloInstruction* new_conv = computation->AddInstruction(
+      conv->CloneWithNewOperands(new_shape, conv->operands()));
+  new_conv->SetAndSanitizeName(conv->name());
+
+  // Users only read the result; the workspace keeps its old shape for them.
+  HloInstruction* new_tuple =
+      computation->AddInstruction(HloInstruction::CreateTuple(
+          {computation->AddInstruction(HloInstruction::CreateGetTupleElement(
+               new_shape.tuple_shapes(0), new_conv, 0)),
+           computation->AddInstruction(HloInstruction::CreateConstant(
+               LiteralUtil::CreateFromDimensions(
+                   U8, scratch_shape.dimensions())))}));
+  TF_RETURN_IF_ERROR(computation->ReplaceInstruction(conv, new_tuple));
+  return true;
+}
+
+StatusOr<bool> ConvAutotuner::Run(
+    HloModule* module,
+    const absl::flat_hash_set<absl::string_view>& execution_threads) {
+  XLA_SCOPED_LOGGING_TIMER(absl::StrCat("ConvAutotuner for ", module->name()));
+  bool changed = false;
+  for (HloComputation* computation :
+       module->MakeNonfusionComputations(execution_threads)) {
+    for (HloInstruction* instr : computation->MakeInstructionPostOrder()) {
+      if (IsCustomCallToDnnConvolution(*instr)) {
+        TF_ASSIGN_OR_RETURN(bool result, RunOnInstruction(instr));
+        changed |= result;
+      }
+    }
+  }
+  return changed;
+}
+
+}  // namespace gpu
+}  // namespace xla
@@ -21,10 +21,12 @@ limitations under the License.
 #include <optional>
 #include <string>
 
+#include "absl/base/casts.h"
 #include "absl/strings/str_cat.h"
 #include "tsl/platform/logging.h"
 #include "tsl/util/env_var.h"
 #include "xla/hlo/ir/hlo_casting_utils.h"
+#include "xla/primitive_util.h"
 #include "xla/service/gpu/gpu_conv_runner.h"
 #include "xla/service/gpu/ir_emission_utils.h"
 #include "xla/service/gpu/scratch_allocator.h"
@@ -76,14 +78,90 @@ int64_t GetVectCSize(FilterLayout layout) {
   }
 }
 
+// Moves `primitive_desc` to the `implementation`-th implementation oneDNN
+// offers for it. Returns NotFound when there are fewer.
+template <typename PrimitiveDesc>
+static Status SelectImplementation(PrimitiveDesc* primitive_desc,
+                                   int64_t implementation) {
+  for (int64_t i = 0; i < implementation; ++i) {
+    if (!primitive_desc->next_impl()) {
+      return NotFound("oneDNN has no convolution implementation %d",
+                      implementation);
+    }
+  }
+  VLOG(3) << "oneDNN convolution implementation " << implementation << ": "
+          << primitive_desc->impl_info_str();
+  return tsl::OkStatus();
+}
+
+// Appends the activation held in kOneDnnActivationKnob, if any, to `po`.
+static Status AppendActivationFromKnobs(
+    const google::protobuf::Map<int64_t, int64_t>& knobs,
+    dnnl::post_ops& po) {  // NOLINT
+  auto knob_value = [&](int64_t knob) {
+    auto it = knobs.find(knob);
+    return it == knobs.end() ? 0 : it->second;
+  };
+  switch (knob_value(kOneDnnActivationKnob)) {
+    case kOneDnnActivationNone:
+      break;
+    case kOneDnnActivationSiLU:
+      po.append_eltwise(dnnl::algorithm::eltwise_swish, 1, 0);
+      break;
+    case kOneDnnActivationHardSwish:
+      po.append_eltwise(dnnl::algorithm::eltwise_hardswish, 1.0f / 6, 0.5f);
+      break;
+    case kOneDnnActivationGELU:
+      po.append_eltwise(dnnl::algorithm::eltwise_gelu_tanh, 0, 0);
+      break;
+    case kOneDnnActivationGELUErf:
+      po.append_eltwise(dnnl::algorithm::eltwise_gelu_erf, 0, 0);
+      break;
+    case kOneDnnActivationClamp:
+      po.append_eltwise(dnnl::algorithm::eltwise_clip_v2,
+                        absl::bit_cast<float>(static_cast<int32_t>(
+                            knob_value(kOneDnnClampLowKnob))),
+                        absl::bit_cast<float>(static_cast<int32_t>(
+                            knob_value(kOneDnnClampHighKnob))));
+      break;
+    default:
+      return InternalError("Unsupported oneDNN activation %d",
+                           knob_value(kOneDnnActivationKnob));
+  }
+  return tsl::OkStatus();
+}
+
+// The oneDNN type of convolution operands and results of `type`.
+static StatusOr<dnnl::memory::data_type> ToOneDnnDataType(
+    PrimitiveType type) {
+  switch (type) {
+    case BF16:
+      return dnnl::memory::data_type::bf16;
+    case F32:
+      return dnnl::memory::data_type::f32;
+    case F16:
+      return dnnl::memory::data_type::f16;
+    case F64:
+      return dnnl::memory::data_type::f64;
+    case S8:
+      return dnnl::memory::data_type::s8;
+    case U8:
+      return dnnl::memory::data_type::u8;
+    case S32:
+      return dnnl::memory::data_type::s32;
+    default:
+      return InternalError("Unsupported convolution data type %s",
+                           PrimitiveType_Name(type));
+  }
+}
+
 Status CreateOneDnnPrimitive(
     OneDnnConvPrimitive* onednn_primitive,  // NOLINT
     const GpuConvDescriptor& conv_descriptor,
     absl::Span<const se::DeviceMemoryBase> operand_buffers,
-    se::DeviceMemoryBase result_buffer, const Thunk::ExecuteParams& params,
+    se::DeviceMemoryBase result_buffer, se::Stream* stream,
     se::ScratchAllocator* scratch_allocator) {
-  sycl::queue* dpcpp_stream = se::gpu::AsGpuStreamValue(params.stream);
-  auto& buffer_allocations = *params.buffer_allocations;
+  sycl::queue* dpcpp_stream = se::gpu::AsGpuStreamValue(stream);
   onednn_primitive->engine = FindOrCreateEngine(dpcpp_stream);
   onednn_primitive->stream =
       dnnl::sycl_interop::make_stream(onednn_primitive->engine, *dpcpp_stream);
@@ -404,46 +482,47 @@ Status CreateOneDnnPrimitive(
 
     auto kind = dnnl::sycl_interop::memory_kind::usm;
 
-    dnnl::memory::data_type data_type;
-
     PrimitiveType input_type = input_shape.element_type();
-    switch (input_type) {
-      case BF16:
-        data_type = dnnl::memory::data_type::bf16;
-        break;
-      case F32:
-        data_type = dnnl::memory::data_type::f32;
-        break;
-      case F16:
-        data_type = dnnl::memory::data_type::f16;
-        break;
-      case F64:
-        data_type = dnnl::memory::data_type::f64;
-        break;
-      case S8:
-        data_type = dnnl::memory::data_type::s8;
-        break;
-      case S32:
-        data_type = dnnl::memory::data_type::s32;
-        break;
-      default:
-        return InternalError("Unsupported convolution input data type");
-    }
+    TF_ASSIGN_OR_RETURN(dnnl::memory::data_type src_type,
+                        ToOneDnnDataType(input_type));
+    TF_ASSIGN_OR_RETURN(dnnl::memory::data_type filter_type,
+                        ToOneDnnDataType(filter_shape.element_type()));
+    TF_ASSIGN_OR_RETURN(dnnl::memory::data_type dst_type,
+                        ToOneDnnDataType(output_shape.element_type()));
+    // Integer convolutions take an f32 bias.
+    const dnnl::memory::data_type bias_type =
+        primitive_util::IsIntegralType(input_type)
+            ? dnnl::memory::data_type::f32
+            : src_type;
+
+    // Activations that OneDnnBlockedLayoutPropagation keeps blocked between
+    // convolutions.
+    const auto& knobs = backend_config.algorithm().tuning_knobs();
+    const dnnl::memory::format_tag blocked_fmt =
+        is_conv3d ? dnnl::memory::format_tag::nCdhw16c
+                  : dnnl::memory::format_tag::nChw16c;
+    auto has_knob = [&](int64_t knob) {
+      auto it = knobs.find(knob);
+      return it != knobs.end() && it->second != 0;
+    };
+    if (has_knob(kOneDnnBlockedInputKnob)) src_fmt = blocked_fmt;
+    if (has_knob(kOneDnnBlockedOutputKnob)) dst_fmt = blocked_fmt;
 
     dnnl::memory::desc src_md =
-        dnnl::memory::desc({src_dims}, data_type, src_fmt);
+        dnnl::memory::desc({src_dims}, src_type, src_fmt);
     dnnl::memory::desc filter_md =
-        dnnl::memory::desc({filter_dims}, data_type, weight_fmt);
+        dnnl::memory::desc({filter_dims}, filter_type, weight_fmt);
     dnnl::memory::desc dst_md =
-        dnnl::memory::desc({dst_dims}, data_type, dst_fmt);
+        dnnl::memory::desc({dst_dims}, dst_type, dst_fmt);
 
-    bool flag = false;
-    tsl::ReadBoolFromEnvVar("ONEDNN_PLAIN_WEIGHT", false, &flag);
     dnnl::memory::desc filter_md_prefer = dnnl::memory::desc(
-        {filter_dims}, data_type, dnnl::memory::format_tag::any);
-    if (flag)
+        {filter_dims}, filter_type, dnnl::memory::format_tag::any);
+    auto knob = knobs.find(kOneDnnWeightFormatKnob);
+    if (knob != knobs.end() && knob->second == kOneDnnWeightFormatPlain)
       filter_md_prefer =
-          dnnl::memory::desc({filter_dims}, data_type, weight_fmt);
+          dnnl::memory::desc({filter_dims}, filter_type, weight_fmt);
+    knob = knobs.find(kOneDnnImplementationKnob);
+    const int64_t implementation = knob == knobs.end() ? 0 : knob->second;
 
     onednn_primitive->src_memory = dnnl::sycl_interop::make_memory(
         src_md, onednn_primitive->engine, kind, input_data);
@@ -470,7 +549,7 @@ Status CreateOneDnnPrimitive(
       po.append_sum(side_input_scale);
     if (!conv_result_scale_one && bias_data) {
       auto bias_post_md =
-          dnnl::memory::desc(bias_dims, data_type, dnnl::memory::format_tag::x);
+          dnnl::memory::desc(bias_dims, bias_type, dnnl::memory::format_tag::x);
       po.append_binary(dnnl::algorithm::binary_add, bias_post_md);
       onednn_primitive->bias_memory = dnnl::sycl_interop::make_memory(
           bias_post_md, onednn_primitive->engine, kind, bias_data);
@@ -492,15 +571,59 @@ Status CreateOneDnnPrimitive(
         case stream_executor::dnn::kTanh:
           po.append_eltwise(dnnl::algorithm::eltwise_tanh, 0, 0);
           break;
+        case stream_executor::dnn::kElu:
+          po.append_eltwise(dnnl::algorithm::eltwise_elu, 1, 0);
+          break;
         case stream_executor::dnn::kNone:
           break;
         default:
           return InternalError("Unsupported Activation mode");
       }
+      TF_RETURN_IF_ERROR(AppendActivationFromKnobs(knobs, po));
     }
     post_ops_attr.set_post_ops(po);
     post_ops_attr.set_scratchpad_mode(dnnl::scratchpad_mode::user);
 
+    // Quantization parameters of the convolutions OnednnQuantizedConvRewriter
+    // creates. The accumulator scales come first in the bias operand.
+    if (has_knob(kOneDnnChannelScalesKnob)) {
+      if (bias_data == nullptr || !conv_result_scale_one) {
+        return InternalError(
+            "Convolution with channel scales needs a bias and no alpha");
+      }
+      auto scales_md = dnnl::memory::desc({oc}, dnnl::memory::data_type::f32,
+                                          dnnl::memory::format_tag::x);
+      onednn_primitive->channel_scales_memory = dnnl::sycl_interop::make_memory(
+          scales_md, onednn_primitive->engine, kind, bias_data);
+      onednn_primitive->fwd_primitives_args.insert(
+          {DNNL_ARG_ATTR_SCALES | DNNL_ARG_WEIGHTS,
+           onednn_primitive->channel_scales_memory});
+      // Per output channel, which spans the first two dimensions of grouped
+      // filters.
+      post_ops_attr.set_scales_mask(DNNL_ARG_WEIGHTS,
+                                    is_group_conv ? (1 << 0) | (1 << 1) : 1);
+      bias_data = static_cast<char*>(bias_data) + scales_md.get_size();
+    }
+    auto set_zero_point = [&](int64_t key, int arg, dnnl::memory* memory) {
+      auto it = knobs.find(key);
+      if (it == knobs.end() || it->second == 0) return;
+      *memory = dnnl::memory({{1},
+                              dnnl::memory::data_type::s32,
+                              dnnl::memory::format_tag::x},
+                             onednn_primitive->engine);
+      const int32_t zero_point = it->second;
+      dpcpp_stream
+          ->memcpy(memory->get_data_handle(), &zero_point, sizeof(zero_point))
+          .wait();
+      post_ops_attr.set_zero_points_mask(arg, 0);
+      onednn_primitive->fwd_primitives_args.insert(
+          {DNNL_ARG_ATTR_ZERO_POINTS | arg, *memory});
+    };
+    set_zero_point(kOneDnnSrcZeroPointKnob, DNNL_ARG_SRC,
+                   &onednn_primitive->src_zero_point_memory);
+    set_zero_point(kOneDnnDstZeroPointKnob, DNNL_ARG_DST,
+                   &onednn_primitive->dst_zero_point_memory);
+
     // Set fp32 mode.
     dnnl::fpmath_mode fp32_math_mode = GetFP32MathMode();
     if (input_type == F32) {
@@ -511,7 +634,7 @@ Status CreateOneDnnPrimitive(
         conv_descriptor.kind == CudnnConvKind::kForwardActivation) {
       ConvFwdPd fwd_pd;
       if (bias_data != nullptr && conv_result_scale_one) {
-        auto bias_md = dnnl::memory::desc(bias_dims, data_type,
+        auto bias_md = dnnl::memory::desc(bias_dims, bias_type,
                                           dnnl::memory::format_tag::x);
         fwd_pd = ConvFwdPd(onednn_primitive->engine, dnnl::prop_kind::forward,
                            dnnl::algorithm::convolution_direct, src_md,
@@ -529,6 +652,7 @@ Status CreateOneDnnPrimitive(
                            padding_dims_l, padding_dims_r, post_ops_attr);
       }
 
+      TF_RETURN_IF_ERROR(SelectImplementation(&fwd_pd, implementation));
       onednn_primitive->fwd_primitive = dnnl::convolution_forward(fwd_pd);
       size_t scratchpad_size = fwd_pd.scratchpad_desc().get_size();
       void* workspace;
@@ -581,6 +705,8 @@ Status CreateOneDnnPrimitive(
           onednn_primitive->engine, dnnl::algorithm::convolution_direct, src_md,
           filter_md_prefer, dst_md, stride_dims, dilation_dims, padding_dims_l,
           padding_dims_r, fwd_pd, attr);
+      TF_RETURN_IF_ERROR(
+          SelectImplementation(&bwd_input_pd, implementation));
 
       size_t scratchpad_size = bwd_input_pd.scratchpad_desc().get_size();
       void* workspace;
@@ -640,6 +766,8 @@ Status CreateOneDnnPrimitive(
           onednn_primitive->engine, dnnl::algorithm::convolution_direct, src_md,
           filter_md_prefer, dst_md, stride_dims, dilation_dims, padding_dims_l,
           padding_dims_r, fwd_pd, attr);
+      TF_RETURN_IF_ERROR(
+          SelectImplementation(&bwd_filter_pd, implementation));
 
       size_t scratchpad_size = bwd_filter_pd.scratchpad_desc().get_size();
       void* workspace;
@@ -695,19 +823,78 @@ Status CreateOneDnnPrimitive(
   return tsl::OkStatus();
 }  // NOLINT
 
-StatusOr<OneDnnConvPrimitive> ConvolutionThunk::GetOrCreateOneDnnConvPrimitive(
+// Parameters are left out even when not donated: the caller may write new
+// weights into the same buffer between runs, which an address check would
+// not notice.
+static bool IsPersistentFilter(CudnnConvKind kind,
+                               const BufferAllocation::Slice& filter) {
+  return (kind == CudnnConvKind::kForward ||
+          kind == CudnnConvKind::kForwardActivation) &&
+         filter.allocation()->is_constant();
+}
+
+// Points the workspaces of a cached `onednn_primitive` at fresh allocations
+// from `scratch_allocator`, requested in the order CreateOneDnnPrimitive
+// requests them so that they land at the same scratch offsets.
+static Status RebindOneDnnConvWorkspaces(
+    const OneDnnConvPrimitive& onednn_primitive, bool rebind_internal_filter,
+    se::ScratchAllocator* scratch_allocator) {
+  void* workspace;
+  TF_RETURN_IF_ERROR(AllocateWorkspace(
+      &workspace, scratch_allocator,
+      onednn_primitive.scratchpad_memory.get_desc().get_size()));
+  onednn_primitive.scratchpad_memory.set_data_handle(workspace);
+  if (onednn_primitive.has_reorder && rebind_internal_filter) {
+    void* internal_filter;
+    TF_RETURN_IF_ERROR(AllocateWorkspace(
+        &internal_filter, scratch_allocator,
+        onednn_primitive.internal_filter_memory.get_desc().get_size()));
+    onednn_primitive.internal_filter_memory.set_data_handle(internal_filter);
+  }
+  return tsl::OkStatus();
+}
+
+StatusOr<ConvolutionThunk::OneDnnConvCacheEntry*>
+ConvolutionThunk::GetOrCreateOneDnnConvPrimitive(
     se::Stream* stream,
     const std::vector<se::DeviceMemoryBase>& operand_se_buffers,
-    const se::DeviceMemoryBase& result_buffer, const ExecuteParams& params,
+    const se::DeviceMemoryBase& result_buffer,
     se::ScratchAllocator* scratch_allocator) {
-  OneDnnConvPrimitive primitive;
-  auto status = CreateOneDnnPrimitive(&primitive, descriptor_,
-                                      absl::MakeSpan(operand_se_buffers),
-                                      result_buffer, params, scratch_allocator);
-  if (TF_PREDICT_FALSE(!status.ok())) {
-    return status;
+  absl::MutexLock lock(&mu_);
+  std::unique_ptr<OneDnnConvCacheEntry>& entry = onednn_primitives_[stream];
+  if (entry != nullptr) {
+    // Operands and result are rebound by RunGpuConv, and a persistent
+    // filter by BindPersistentFilter.
+    TF_RETURN_IF_ERROR(RebindOneDnnConvWorkspaces(
+        entry->primitive, /*rebind_internal_filter=*/!persistent_filter_,
+        scratch_allocator));
+    return entry.get();
   }
-  return primitive;
+  auto created = std::make_unique<OneDnnConvCacheEntry>();
+  TF_RETURN_IF_ERROR(CreateOneDnnPrimitive(
+      &created->primitive, descriptor_, absl::MakeSpan(operand_se_buffers),
+      result_buffer, stream, scratch_allocator));
+  entry = std::move(created);
+  return entry.get();
+}
+
+Status ConvolutionThunk::BindPersistentFilter(
+    OneDnnConvCacheEntry* entry, se::DeviceMemoryBase filter,
+    const BufferAllocations& buffer_allocations) {
+  OneDnnConvPrimitive& primitive = entry->primitive;
+  if (entry->reordered_filter.is_null()) {
+    TF_ASSIGN_OR_RETURN(
+        entry->reordered_filter,
+        buffer_allocations.memory_allocator()->Allocate(
+            buffer_allocations.device_ordinal(),
+            primitive.internal_filter_memory.get_desc().get_size()));
+    entry->reordered_filter_source = nullptr;
+  }
+  primitive.internal_filter_memory.set_data_handle(
+      entry->reordered_filter->opaque());
+  primitive.filter_reorder_cached =
+      entry->reordered_filter_source == filter.opaque();
+  return tsl::OkStatus();
 }
 
 ConvolutionThunk::ConvolutionThunk(
@@ -718,7 +905,9 @@ ConvolutionThunk::ConvolutionThunk(
       operand_buffers_(std::move(operand_slices)),
       result_buffer_(result_slice),
       scratch_buffer_(scratch_slice),
-      descriptor_(std::move(descriptor)) {}
+      descriptor_(std::move(descriptor)),
+      persistent_filter_(IsPersistentFilter(descriptor_.kind,
+                                            operand_buffers_[1])) {}
 
 Status ConvolutionThunk::ExecuteOnStream(const ExecuteParams& params) {
   const auto& buffer_allocations = *params.buffer_allocations;
@@ -735,16 +924,29 @@ Status ConvolutionThunk::ExecuteOnStream(const ExecuteParams& params) {
       buffer_allocations.GetDeviceAddress(scratch_buffer_);
 
   auto stream = params.stream;
-  se::OwningScratchAllocator<2> scratch_allocator(
+  // The scratch slice is sized by the conv autotuner; allocate only what it
+  // does not cover, e.g. for modules compiled without a device.
+  se::OwningScratchAllocator<2> fallback_allocator(
       buffer_allocations.device_ordinal(),
       buffer_allocations.memory_allocator());
-  TF_ASSIGN_OR_RETURN(auto conv_primitive,
+  BufferScratchAllocator scratch_allocator(scratch, &fallback_allocator);
+  TF_ASSIGN_OR_RETURN(OneDnnConvCacheEntry * entry,
                       GetOrCreateOneDnnConvPrimitive(stream, operand_se_buffers,
-                                                     result_buffer, params, &scratch_allocator));
+                                                     result_buffer,
+                                                     &scratch_allocator));
+  const bool persistent_filter =
+      persistent_filter_ && entry->primitive.has_reorder;
+  if (persistent_filter) {
+    TF_RETURN_IF_ERROR(BindPersistentFilter(entry, operand_se_buffers[1],
+                                            buffer_allocations));
+  }
 
-  TF_RETURN_IF_ERROR(RunGpuConv(conv_primitive, descriptor_,
+  TF_RETURN_IF_ERROR(RunGpuConv(entry->primitive, descriptor_,
                                 absl::MakeSpan(operand_se_buffers),
-                                result_buffer, params));
+                                result_buffer, params.stream));
+  if (persistent_filter) {
+    entry->reordered_filter_source = operand_se_buffers[1].opaque();
+  }
 
   // Note:: Convolution has a tuple buffer as an output, but we don't need t
   // populate it as no one should be reading from the tuple directly.
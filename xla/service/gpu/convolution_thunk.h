@@ -18,9 +18,12 @@ limitations under the License.
 #ifndef XLA_SERVICE_GPU_CONVOLUTION_THUNK_H_
 #define XLA_SERVICE_GPU_CONVOLUTION_THUNK_H_
 
+#include <memory>
 #include <optional>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
 #include "tsl/platform/status.h"
 #include "xla/hlo/ir/hlo_instruction.h"
 #include "xla/hlo/ir/hlo_instructions.h"
@@ -28,7 +31,9 @@ limitations under the License.
 #include "xla/service/gpu/buffer_allocations.h"
 #include "xla/service/gpu/gpu_conv_runner.h"
 #include "xla/service/gpu/gpu_executable.h"
+#include "xla/service/gpu/scratch_allocator.h"
 #include "xla/service/gpu/thunk.h"
+#include "xla/stream_executor/device_memory_allocator.h"
 #include "xla/stream_executor/stream_executor.h"
 #include "xla/types.h"
 #include "xla/xla_data.pb.h"
@@ -36,6 +41,14 @@ limitations under the License.
 namespace xla {
 namespace gpu {
 
+// Builds the oneDNN primitive for `conv_descriptor` on the engine of `stream`.
+Status CreateOneDnnPrimitive(
+    OneDnnConvPrimitive* onednn_primitive,
+    const GpuConvDescriptor& conv_descriptor,
+    absl::Span<const se::DeviceMemoryBase> operand_buffers,
+    se::DeviceMemoryBase result_buffer, se::Stream* stream,
+    se::ScratchAllocator* scratch_allocator);
+
 // This class stores everything that StreamExecutor needs to launch a DNN
 // convolution. It is generated by IrEmitter.
 //
@@ -61,13 +74,39 @@ class ConvolutionThunk : public Thunk {
   BufferAllocation::Slice scratch_buffer_;
 
   const GpuConvDescriptor descriptor_;
-  absl::Mutex mu_;
-  absl::flat_hash_map<const se::Stream*, std::unique_ptr<OneDnnConvPrimitive>>
-      onednn_primitives_;
-  StatusOr<OneDnnConvPrimitive> GetOrCreateOneDnnConvPrimitive(
-      se::Stream*, const std::vector<se::DeviceMemoryBase>& operand_se_buffers,
-      const se::DeviceMemoryBase& result_buffer, const ExecuteParams& params,
+  // Whether the filter holds the same weights on every run, so that a copy
+  // reordered into the format oneDNN prefers can be kept across runs. Only
+  // constant filters of forward convolutions qualify.
+  const bool persistent_filter_;
+
+  struct OneDnnConvCacheEntry {
+    OneDnnConvPrimitive primitive;
+    // Persistent copy of the reordered filter.
+    se::OwningDeviceMemory reordered_filter;
+    // Filter address `reordered_filter` was last reordered from. A different
+    // address means other weights were passed in.
+    const void* reordered_filter_source = nullptr;
+  };
+
+  // Returns the entry for `stream`, whose primitive is built on the first
+  // execution with its workspaces allocated from `scratch_allocator`. Only
+  // data handles change between executions, so later calls just rebind the
+  // workspaces.
+  StatusOr<OneDnnConvCacheEntry*> GetOrCreateOneDnnConvPrimitive(
+      se::Stream* stream,
+      const std::vector<se::DeviceMemoryBase>& operand_se_buffers,
+      const se::DeviceMemoryBase& result_buffer,
       se::ScratchAllocator* scratch_allocator);
+
+  // Points the primitive of `entry` at its persistent reordered filter, and
+  // skips the reorder when that is up to date with `filter`.
+  Status BindPersistentFilter(OneDnnConvCacheEntry* entry,
+                              se::DeviceMemoryBase filter,
+                              const BufferAllocations& buffer_allocations);
+
+  absl::Mutex mu_;
+  absl::flat_hash_map<const se::Stream*, std::unique_ptr<OneDnnConvCacheEntry>>
+      onednn_primitives_ ABSL_GUARDED_BY(mu_);
 };
 
 }  // namespace gpu
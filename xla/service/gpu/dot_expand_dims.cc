@@ -15,19 +15,32 @@ limitations under the License.
 
 #include "xla/service/gpu/dot_expand_dims.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <cstdlib>
 #include <functional>
 #include <numeric>
+#include <optional>
+#include <tuple>
 #include <utility>
 #include <vector>
 
+#include "absl/algorithm/container.h"
+#include "absl/types/span.h"
+#include "tsl/platform/errors.h"
 #include "tsl/platform/logging.h"
+#include "tsl/platform/protobuf.h"
 #include "tsl/platform/status.h"
+#include "tsl/platform/statusor.h"
 #include "xla/hlo/ir/dfs_hlo_visitor_with_default.h"
 #include "xla/hlo/ir/hlo_computation.h"
 #include "xla/hlo/ir/hlo_instruction.h"
 #include "xla/hlo/ir/hlo_opcode.h"
 #include "xla/service/gpu/ir_emission_utils.h"
+#include "xla/service/gpu/xetla/gemm/gemm.h"
+#include "xla/service/hlo_creation_utils.h"
+#include "xla/shape_util.h"
+#include "xla/stream_executor/sycl/hw_info.h"
 #include "xla/util.h"
 #include "xla/xla_data.pb.h"
 
@@ -36,160 +49,226 @@ namespace gpu {
 
 namespace {
 
-StatusOr<bool> ExpandDotDims(HloInstruction* original_dot) {
-  if (original_dot->opcode() != HloOpcode::kDot) {
+// A matrix-vector dot moving less data than this many microseconds of memory
+// bandwidth is cheaper to fuse than to launch as a GEMM.
+constexpr double kMinGemmMicros = 5.0;
+
+// Used when the device does not report its memory bandwidth, about 1 TB/s.
+constexpr double kDefaultMemoryBytesPerUs = 1e6;
+
+int64_t DimensionsProduct(const Shape& shape, absl::Span<const int64_t> dims) {
+  int64_t product = 1;
+  for (int64_t dim : dims) product *= shape.dimensions(dim);
+  return product;
+}
+
+// Folds the batch dimensions of a dot into M when its rhs is one matrix
+// broadcast over them:
+//
+//   dot(lhs[b..., m, k], broadcast(w[k, n])) -> [b..., m, n]
+//
+// becomes
+//
+//   reshape(dot(reshape(lhs)[b... * m, k], w[k, n]))
+//
+// so that w is read once by a single GEMM instead of once per batch element.
+StatusOr<bool> FoldBatchIntoM(HloInstruction* dot) {
+  const DotDimensionNumbers& dnums = dot->dot_dimension_numbers();
+  const int64_t num_batch_dims = dnums.lhs_batch_dimensions_size();
+  if (num_batch_dims == 0 || dnums.lhs_contracting_dimensions_size() != 1 ||
+      dnums.rhs_contracting_dimensions_size() != 1 ||
+      !dot->shape().is_static()) {
     return false;
   }
-  auto computation = original_dot->parent();
-  const auto& original_dnums = original_dot->dot_dimension_numbers();
-  const int64_t num_batch_dims = original_dnums.lhs_batch_dimensions_size();
-  const int64_t num_contracting_dims =
-      original_dnums.lhs_contracting_dimensions_size();
-
-  const auto& lhs_shape = original_dot->operand(0)->shape();
-  const int64_t lhs_rank = lhs_shape.rank();
-  const int64_t num_lhs_non_contracting_dims =
-      lhs_rank - num_batch_dims - num_contracting_dims;
-
-  std::vector<int64_t> lhs_non_contracting_dims;
-  lhs_non_contracting_dims.reserve(num_lhs_non_contracting_dims);
-  int64_t lhs_contracting_size = 1;
-  int64_t lhs_non_contracting_size = 1;
-  std::vector<int64_t> batch_dim_sizes;
-  batch_dim_sizes.reserve(num_batch_dims);
-  for (int64_t i = 0; i < lhs_rank; ++i) {
-    if (absl::c_linear_search(original_dnums.lhs_contracting_dimensions(), i)) {
-      lhs_contracting_size *= lhs_shape.dimensions(i);
-    } else if (absl::c_linear_search(original_dnums.lhs_batch_dimensions(),
-                                     i)) {
-      batch_dim_sizes.push_back(lhs_shape.dimensions(i));
-    } else {
-      lhs_non_contracting_dims.push_back(i);
-      lhs_non_contracting_size *= lhs_shape.dimensions(i);
+  for (int64_t i = 0; i < num_batch_dims; ++i) {
+    if (dnums.lhs_batch_dimensions(i) != i ||
+        dnums.rhs_batch_dimensions(i) != i) {
+      return false;
     }
   }
 
-  DotDimensionNumbers dot_dnums;
-  HloInstruction* lhs_operand = original_dot->mutable_operand(0);
-  HloInstruction* reshaped_lhs = lhs_operand;
-  if (lhs_non_contracting_size == 1) {
-    CHECK_EQ(original_dnums.lhs_contracting_dimensions().size(), 1);
-    auto batch_dimensions = original_dnums.lhs_batch_dimensions();
-    int c_dim = original_dnums.lhs_contracting_dimensions()[0];
-    std::vector<int64_t> lhs_reshape_dims = batch_dim_sizes;
-    if (c_dim == batch_dimensions.size()) {
-      // (b1, b2, c) -> (b1, b2, n, c)
-      lhs_reshape_dims.push_back(lhs_non_contracting_size);
-      lhs_reshape_dims.push_back(lhs_contracting_size);
-      *dot_dnums.mutable_lhs_batch_dimensions() =
-          original_dnums.lhs_batch_dimensions();
-      dot_dnums.add_lhs_contracting_dimensions(c_dim + 1);
-    } else if (c_dim == 0) {
-      // (c, b1, b2) -> (n, c, b1, b2)
-      lhs_reshape_dims.insert(lhs_reshape_dims.begin(),
-                              lhs_non_contracting_size);
-      lhs_reshape_dims.insert(lhs_reshape_dims.begin() + 1,
-                              lhs_contracting_size);
-      *dot_dnums.mutable_lhs_batch_dimensions() =
-          original_dnums.lhs_batch_dimensions();
-      for (int64_t i = 0; i < num_batch_dims; ++i)
-        dot_dnums.mutable_lhs_batch_dimensions()->at(i)++;
-      dot_dnums.add_lhs_contracting_dimensions(1);
-    } else
-      return Internal("Unsupported Dot dims in DotExpandDims");
-    reshaped_lhs = computation->AddInstruction(
-        HloInstruction::CreateReshape(
-            ShapeUtil::MakeShape(lhs_shape.element_type(), lhs_reshape_dims),
-            lhs_operand),
-        &lhs_operand->metadata());
-  } else {
-    *dot_dnums.mutable_lhs_batch_dimensions() =
-        original_dnums.lhs_batch_dimensions();
-    *dot_dnums.mutable_lhs_contracting_dimensions() =
-        original_dnums.lhs_contracting_dimensions();
+  // The lhs is [b..., m, k] or [b..., k]: row-major in the batch and M
+  // dimensions, which a reshape can merge.
+  HloInstruction* lhs = dot->mutable_operand(0);
+  const int64_t lhs_rank = lhs->shape().rank();
+  if (lhs_rank > num_batch_dims + 2 ||
+      dnums.lhs_contracting_dimensions(0) != lhs_rank - 1) {
+    return false;
+  }
+
+  HloInstruction* rhs = dot->mutable_operand(1);
+  if (rhs->opcode() != HloOpcode::kBroadcast) return false;
+  HloInstruction* weight = rhs->mutable_operand(0);
+  if (weight->shape().rank() != rhs->shape().rank() - num_batch_dims) {
+    return false;
   }
+  for (int64_t i = 0; i < weight->shape().rank(); ++i) {
+    if (rhs->dimensions(i) != num_batch_dims + i) return false;
+  }
+
+  const int64_t k = lhs->shape().dimensions(lhs_rank - 1);
+  if (k == 0) return false;
+  const std::vector<int64_t> folded_lhs_dims = {
+      ShapeUtil::ElementsIn(lhs->shape()) / k, k};
+  TF_ASSIGN_OR_RETURN(HloInstruction * folded_lhs,
+                      MakeReshapeHlo(folded_lhs_dims, lhs));
 
-  const auto& rhs_shape = original_dot->operand(1)->shape();
-  const int64_t rhs_rank = rhs_shape.rank();
-  const int64_t num_rhs_non_contracting_dims =
-      rhs_rank - num_batch_dims - num_contracting_dims;
-  std::vector<int64_t> rhs_non_contracting_dims;
-  rhs_non_contracting_dims.reserve(num_rhs_non_contracting_dims);
-  int64_t rhs_non_contracting_size = 1;
-  int64_t rhs_contracting_size = 1;
-  for (int64_t i = 0; i < rhs_rank; ++i) {
-    if (absl::c_linear_search(original_dnums.rhs_contracting_dimensions(), i)) {
-      rhs_contracting_size *= rhs_shape.dimensions(i);
-    } else if (!absl::c_linear_search(original_dnums.rhs_batch_dimensions(),
-                                      i)) {
-      rhs_non_contracting_dims.push_back(i);
-      rhs_non_contracting_size *= rhs_shape.dimensions(i);
+  DotDimensionNumbers folded_dnums;
+  folded_dnums.add_lhs_contracting_dimensions(1);
+  folded_dnums.add_rhs_contracting_dimensions(
+      dnums.rhs_contracting_dimensions(0) - num_batch_dims);
+  std::vector<int64_t> folded_dims = {folded_lhs_dims[0]};
+  for (int64_t i = 0; i < weight->shape().rank(); ++i) {
+    if (i != folded_dnums.rhs_contracting_dimensions(0)) {
+      folded_dims.push_back(weight->shape().dimensions(i));
     }
   }
 
-  HloInstruction* rhs_operand = original_dot->mutable_operand(1);
-  HloInstruction* reshaped_rhs = rhs_operand;
-  if (rhs_non_contracting_size == 1) {
-    CHECK_EQ(original_dnums.rhs_contracting_dimensions().size(), 1);
-    auto batch_dimensions = original_dnums.rhs_batch_dimensions();
-    int c_dim = original_dnums.rhs_contracting_dimensions()[0];
-    std::vector<int64_t> rhs_reshape_dims = batch_dim_sizes;
-    if (c_dim == batch_dimensions.size()) {
-      // (b1, b2, c) -> (b1, b2, c, n)
-      rhs_reshape_dims.push_back(rhs_contracting_size);
-      rhs_reshape_dims.push_back(rhs_non_contracting_size);
-      *dot_dnums.mutable_rhs_batch_dimensions() =
-          original_dnums.rhs_batch_dimensions();
-      dot_dnums.add_rhs_contracting_dimensions(c_dim);
-    } else if (c_dim == 0) {
-      // (c, b1, b2) -> (c, n, b1, b2)
-      rhs_reshape_dims.insert(rhs_reshape_dims.begin(), rhs_contracting_size);
-      rhs_reshape_dims.insert(rhs_reshape_dims.begin() + 1,
-                              rhs_non_contracting_size);
-      *dot_dnums.mutable_rhs_batch_dimensions() =
-          original_dnums.rhs_batch_dimensions();
-      for (int64_t i = 0; i < num_batch_dims; ++i)
-        dot_dnums.mutable_rhs_batch_dimensions()->at(i)++;
-      dot_dnums.add_rhs_contracting_dimensions(0);
-    } else
-      return Internal("Unsupported Dot dims in DotExpandDims");
-    reshaped_rhs = computation->AddInstruction(
-        HloInstruction::CreateReshape(
-            ShapeUtil::MakeShape(rhs_shape.element_type(), rhs_reshape_dims),
-            rhs_operand),
-        &rhs_operand->metadata());
+  HloComputation* computation = dot->parent();
+  HloInstruction* folded =
+      computation->AddInstruction(HloInstruction::CreateDot(
+          ShapeUtil::MakeShape(dot->shape().element_type(), folded_dims),
+          folded_lhs, weight, folded_dnums, dot->precision_config()));
+  dot->SetupDerivedInstruction(folded);
+  VLOG(3) << "Folding batch into M:\n"
+          << "\t old: " << dot->ToString() << "\n"
+          << "\t new: " << folded->ToString();
+
+  TF_ASSIGN_OR_RETURN(HloInstruction * result,
+                      MakeReshapeHlo(dot->shape(), folded));
+  TF_RETURN_IF_ERROR(computation->ReplaceInstruction(dot, result));
+  return true;
+}
+
+// Returns the shape of `operand` with a unit non-contracting dimension
+// inserted next to its single contracting dimension `c_dim`, which must be
+// the first or follow the batch dimensions, and updates `batch_dims` and
+// `contracting_dims` for it. Returns nullopt for other layouts.
+std::optional<Shape> ExpandedOperandShape(
+    const Shape& operand, int64_t c_dim, bool unit_dim_before_contracting,
+    int64_t num_batch_dims,
+    tsl::protobuf::RepeatedField<int64_t>* batch_dims,
+    tsl::protobuf::RepeatedField<int64_t>* contracting_dims) {
+  std::vector<int64_t> dims(operand.dimensions().begin(),
+                            operand.dimensions().end());
+  if (c_dim == num_batch_dims) {
+    // (b1, b2, c) -> (b1, b2, 1, c) for the lhs, (b1, b2, c, 1) for the rhs.
+    int64_t unit_dim = unit_dim_before_contracting ? c_dim : c_dim + 1;
+    dims.insert(dims.begin() + unit_dim, 1);
+    contracting_dims->Set(0, unit_dim_before_contracting ? c_dim + 1 : c_dim);
+  } else if (c_dim == 0) {
+    // (c, b1, b2) -> (1, c, b1, b2) for the lhs, (c, 1, b1, b2) for the rhs.
+    dims.insert(dims.begin() + (unit_dim_before_contracting ? 0 : 1), 1);
+    contracting_dims->Set(0, unit_dim_before_contracting ? 1 : 0);
+    for (int64_t i = 0; i < batch_dims->size(); ++i) {
+      batch_dims->Set(i, batch_dims->Get(i) + 1);
+    }
   } else {
-    *dot_dnums.mutable_rhs_batch_dimensions() =
-        original_dnums.rhs_batch_dimensions();
-    *dot_dnums.mutable_rhs_contracting_dimensions() =
-        original_dnums.rhs_contracting_dimensions();
+    return std::nullopt;
+  }
+  return ShapeUtil::MakeShape(operand.element_type(), dims);
+}
+
+}  // namespace
+
+DotExpandDims::DotExpandDims(const GpuDeviceInfo& gpu_info)
+    : memory_bytes_per_us_(gpu_info.memory_bandwidth > 0
+                               ? gpu_info.memory_bandwidth / 1e6
+                               : kDefaultMemoryBytesPerUs),
+      xetla_tuned_shapes_(getXetlaGemmTunedShapes()) {}
+
+bool DotExpandDims::ShouldRunAsGemm(const HloInstruction& dot,
+                                    int64_t batch_size, int64_t m, int64_t n,
+                                    int64_t k) const {
+  PrimitiveType type = dot.shape().element_type();
+  if (type != F16 && type != BF16 && type != F32) return false;
+  if (IsXetlaHardwareSupport() && (type == F16 || type == BF16) &&
+      batch_size == 1 &&
+      std::binary_search(xetla_tuned_shapes_.begin(),
+                         xetla_tuned_shapes_.end(),
+                         std::make_tuple(static_cast<int>(m),
+                                         static_cast<int>(n),
+                                         static_cast<int>(k)))) {
+    return true;
+  }
+  int64_t bytes = ShapeUtil::ByteSizeOf(dot.shape());
+  for (const HloInstruction* operand : dot.operands()) {
+    bytes += ShapeUtil::ByteSizeOf(operand->shape());
+  }
+  return bytes / memory_bytes_per_us_ >= kMinGemmMicros;
+}
+
+StatusOr<bool> DotExpandDims::ExpandMatrixVectorDot(HloInstruction* dot) const {
+  const DotDimensionNumbers& dnums = dot->dot_dimension_numbers();
+  if (!dot->shape().is_static() ||
+      dnums.lhs_contracting_dimensions_size() != 1) {
+    return false;
   }
+  const int64_t num_batch_dims = dnums.lhs_batch_dimensions_size();
+  const Shape& lhs_shape = dot->operand(0)->shape();
+  const Shape& rhs_shape = dot->operand(1)->shape();
+  // An operand without non-contracting dimensions is a vector.
+  const bool lhs_is_vector = lhs_shape.rank() == num_batch_dims + 1;
+  const bool rhs_is_vector = rhs_shape.rank() == num_batch_dims + 1;
+  if (!lhs_is_vector && !rhs_is_vector) return false;
 
-  std::vector<int64_t> dot_dims = batch_dim_sizes;
-  dot_dims.push_back(lhs_non_contracting_size);
-  dot_dims.push_back(rhs_non_contracting_size);
+  const int64_t batch_size =
+      DimensionsProduct(lhs_shape, dnums.lhs_batch_dimensions());
+  const int64_t k =
+      DimensionsProduct(lhs_shape, dnums.lhs_contracting_dimensions());
+  if (batch_size * k == 0) return false;
+  const int64_t m = ShapeUtil::ElementsIn(lhs_shape) / (batch_size * k);
+  const int64_t n = ShapeUtil::ElementsIn(rhs_shape) / (batch_size * k);
+  if (!ShouldRunAsGemm(*dot, batch_size, m, n, k)) {
+    VLOG(3) << "Leaving matrix-vector dot to fusion: " << dot->ToString();
+    return false;
+  }
 
-  HloInstruction* dot = computation->AddInstruction(HloInstruction::CreateDot(
-      ShapeUtil::MakeShape(original_dot->shape().element_type(), dot_dims),
-      reshaped_lhs, reshaped_rhs, dot_dnums, original_dot->precision_config()));
-  original_dot->SetupDerivedInstruction(dot);
+  DotDimensionNumbers expanded_dnums = dnums;
+  HloInstruction* operands[2] = {dot->mutable_operand(0),
+                                 dot->mutable_operand(1)};
+  if (lhs_is_vector) {
+    std::optional<Shape> shape = ExpandedOperandShape(
+        lhs_shape, dnums.lhs_contracting_dimensions(0),
+        /*unit_dim_before_contracting=*/true, num_batch_dims,
+        expanded_dnums.mutable_lhs_batch_dimensions(),
+        expanded_dnums.mutable_lhs_contracting_dimensions());
+    if (!shape.has_value()) return false;
+    TF_ASSIGN_OR_RETURN(operands[0], MakeReshapeHlo(*shape, operands[0]));
+  }
+  if (rhs_is_vector) {
+    std::optional<Shape> shape = ExpandedOperandShape(
+        rhs_shape, dnums.rhs_contracting_dimensions(0),
+        /*unit_dim_before_contracting=*/false, num_batch_dims,
+        expanded_dnums.mutable_rhs_batch_dimensions(),
+        expanded_dnums.mutable_rhs_contracting_dimensions());
+    if (!shape.has_value()) return false;
+    TF_ASSIGN_OR_RETURN(operands[1], MakeReshapeHlo(*shape, operands[1]));
+  }
 
-  std::unique_ptr<HloInstruction> replacement =
-      HloInstruction::CreateReshape(original_dot->shape(), dot);
+  std::vector<int64_t> dot_dims;
+  for (int64_t dim : dnums.lhs_batch_dimensions()) {
+    dot_dims.push_back(lhs_shape.dimensions(dim));
+  }
+  dot_dims.push_back(m);
+  dot_dims.push_back(n);
+
+  HloComputation* computation = dot->parent();
+  HloInstruction* expanded = computation->AddInstruction(
+      HloInstruction::CreateDot(
+          ShapeUtil::MakeShape(dot->shape().element_type(), dot_dims),
+          operands[0], operands[1], expanded_dnums, dot->precision_config()));
+  dot->SetupDerivedInstruction(expanded);
   VLOG(3) << "Canonicalizing dot:\n"
-          << "\t old: " << original_dot->ToString() << "\n"
-          << "\t new: " << dot->ToString() << "\n"
-          << "\t   -> " << replacement->ToString();
+          << "\t old: " << dot->ToString() << "\n"
+          << "\t new: " << expanded->ToString();
 
-  TF_RETURN_IF_ERROR(computation->ReplaceWithNewInstruction(
-      original_dot, std::move(replacement)));
+  TF_ASSIGN_OR_RETURN(HloInstruction * result,
+                      MakeReshapeHlo(dot->shape(), expanded));
+  TF_RETURN_IF_ERROR(computation->ReplaceInstruction(dot, result));
   return true;
 }
 
-}  // namespace
-
-DotExpandDims::DotExpandDims() = default;
-
 StatusOr<bool> DotExpandDims::Run(
     HloModule* module,
     const absl::flat_hash_set<absl::string_view>& execution_threads) {
@@ -197,8 +276,11 @@ StatusOr<bool> DotExpandDims::Run(
   for (HloComputation* computation :
        module->MakeNonfusionComputations(execution_threads)) {
     for (HloInstruction* instr : computation->MakeInstructionPostOrder()) {
-      bool changed = false;
-      TF_ASSIGN_OR_RETURN(changed, ExpandDotDims(instr));
+      if (instr->opcode() != HloOpcode::kDot) continue;
+      TF_ASSIGN_OR_RETURN(bool changed, FoldBatchIntoM(instr));
+      if (!changed) {
+        TF_ASSIGN_OR_RETURN(changed, ExpandMatrixVectorDot(instr));
+      }
       any_changed |= changed;
     }
   }
@@ -206,4 +288,4 @@ StatusOr<bool> DotExpandDims::Run(
 }
 
 }  // namespace gpu
-}  // namespace xla
\ No newline at end of file
+}  // namespace xla
@@ -16,23 +16,51 @@ limitations under the License.
 #ifndef XLA_SERVICE_GPU_DOT_EXPAND_DIMS_H_
 #define XLA_SERVICE_GPU_DOT_EXPAND_DIMS_H_
 
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
 #include "xla/hlo/ir/hlo_computation.h"
 #include "xla/hlo/ir/hlo_module.h"
+#include "xla/service/gpu/gpu_device_info.h"
 #include "xla/service/hlo_pass_interface.h"
 
 namespace xla {
 namespace gpu {
 
-// Expand dot dims for dimension 1 so that it can call onednn.
+// Canonicalizes dots so that they reach the GEMM kernels:
+//
+// - A dot whose rhs broadcasts one matrix over the batch dimensions, and
+//   whose lhs keeps those dimensions major to M, becomes a 2D dot with the
+//   batch folded into M. This always pays off: the batched GEMM would read a
+//   copy of the weights per batch element.
+//
+// - A matrix-vector dot, which GemmRewriter leaves to the fusion emitters,
+//   gets a unit M or N dimension so that it runs as a GEMM, when the cost
+//   model favours that: XeTLA has a tuned config for its shape, or it moves
+//   enough data at the device memory bandwidth to outweigh a kernel launch.
+//   Smaller dots stay fusible with their neighbours.
 class DotExpandDims : public HloModulePass {
  public:
-  explicit DotExpandDims();
+  explicit DotExpandDims(const GpuDeviceInfo& gpu_info);
   absl::string_view name() const override { return "dot-expand-dims"; }
 
   using HloPassInterface::Run;
   StatusOr<bool> Run(
       HloModule* module,
       const absl::flat_hash_set<absl::string_view>& execution_threads) override;
+
+ private:
+  // Gives a matrix-vector `dot` a unit M or N dimension if ShouldRunAsGemm.
+  StatusOr<bool> ExpandMatrixVectorDot(HloInstruction* dot) const;
+
+  // Whether a matrix-vector dot is better run as a GEMM.
+  bool ShouldRunAsGemm(const HloInstruction& dot, int64_t batch_size,
+                       int64_t m, int64_t n, int64_t k) const;
+
+  double memory_bytes_per_us_;
+  // Sorted (m, n, k) that XeTLA has tuned configs for.
+  std::vector<std::tuple<int, int, int>> xetla_tuned_shapes_;
 };
 
 }  // namespace gpu
@@ -0,0 +1,162 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/service/gpu/gemm_autotuner.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "tsl/platform/errors.h"
+#include "tsl/platform/logging.h"
+#include "tsl/platform/statusor.h"
+#include "tsl/util/proto/proto_utils.h"
+#include "xla/service/gpu/autotune_cache.h"
+#include "xla/service/gpu/backend_configs.pb.h"
+#include "xla/service/gpu/ir_emission_utils.h"
+#include "xla/service/gpu/matmul_utils.h"
+#include "xla/service/gpu/onednn_matmul_utils.h"
+#include "xla/service/gpu/scratch_allocator.h"
+#include "xla/util.h"
+
+namespace xla {
+namespace gpu {
+namespace {
+
+bool HasBias(se::cuda::BlasLt::Epilogue epilogue) {
+  switch (epilogue) {
+    case se::cuda::BlasLt::Epilogue::kBias:
+    case se::cuda::BlasLt::Epilogue::kBiasThenReLU:
+    case se::cuda::BlasLt::Epilogue::kBiasThenGELU:
+    case se::cuda::BlasLt::Epilogue::kBiasThenGELUWithAux:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Benchmarks every algorithm RunGemm accepts for `gemm` on zero-filled
+// buffers. Returns nullopt if none of them runs.
+StatusOr<std::optional<AutotuneResult>> BenchmarkGemm(
+    const HloInstruction* gemm, const GemmBackendConfig& gemm_config,
+    se::StreamExecutor* stream_exec, se::DeviceMemoryAllocator* allocator) {
+  TF_ASSIGN_OR_RETURN(GemmConfig config, GemmConfig::For(gemm));
+  TF_ASSIGN_OR_RETURN(config.epilogue,
+                      cublas_lt::AsBlasLtEpilogue(gemm_config.epilogue()));
+
+  se::StreamExecutorMemoryAllocator default_allocator(stream_exec);
+  if (allocator == nullptr) allocator = &default_allocator;
+  TF_ASSIGN_OR_RETURN(se::Stream* const stream,
+                      allocator->GetStream(stream_exec->device_ordinal()));
+
+  std::vector<se::OwningDeviceMemory> operands;
+  for (const HloInstruction* operand : gemm->operands()) {
+    TF_ASSIGN_OR_RETURN(
+        se::OwningDeviceMemory buffer,
+        AllocateAutotuneBuffer(allocator, stream, operand->shape()));
+    operands.push_back(std::move(buffer));
+  }
+  const Shape& output_shape =
+      gemm->shape().IsTuple() ? gemm->shape().tuple_shapes(0) : gemm->shape();
+  TF_ASSIGN_OR_RETURN(se::OwningDeviceMemory output,
+                      AllocateAutotuneBuffer(allocator, stream, output_shape));
+
+  // Mirror the buffers GemmThunk and CublasLtMatmulThunk hand to RunGemm.
+  se::DeviceMemoryBase c, bias;
+  if (IsCublasLtMatmul(*gemm)) {
+    bool has_bias = HasBias(config.epilogue);
+    if (gemm->operand_count() > (has_bias ? 3 : 2)) c = *operands[2];
+    if (has_bias) bias = *operands.back();
+  }
+
+  std::optional<AutotuneResult> best;
+  absl::Duration best_time = absl::InfiniteDuration();
+  for (int64_t algorithm : GetGemmAlgorithmCandidates(config)) {
+    config.algorithm = algorithm;
+    StatusOr<absl::Duration> run_time =
+        ProfileAutotuneCandidate(stream, [&]() -> Status {
+          se::OwningScratchAllocator<> scratch_allocator(
+              stream_exec->device_ordinal(), allocator);
+          return RunGemm(config, *operands[0], *operands[1], c, *output, bias,
+                         stream, &scratch_allocator);
+        });
+    if (!run_time.ok()) {
+      VLOG(1) << "GEMM algorithm " << algorithm
+              << " failed: " << run_time.status();
+      continue;
+    }
+    VLOG(2) << gemm->name() << " algorithm " << algorithm << ": " << *run_time;
+    if (*run_time < best_time) {
+      best_time = *run_time;
+      best.emplace();
+      best->mutable_gemm()->set_algorithm(algorithm);
+      *best->mutable_run_time() = tsl::proto_utils::ToDurationProto(*run_time);
+    }
+  }
+  return best;
+}
+
+}  // namespace
+
+StatusOr<bool> GemmAutotuner::RunOnInstruction(HloInstruction* gemm) {
+  TF_ASSIGN_OR_RETURN(GemmBackendConfig gemm_config,
+                      gemm->backend_config<GemmBackendConfig>());
+  if (gemm_config.algorithm_case() == GemmBackendConfig::kSelectedAlgorithm) {
+    return false;
+  }
+
+  std::string device = AutotuneCache::DeviceKey(stream_exec_);
+  std::string hlo = AutotuneCache::HloKey(*gemm);
+  std::optional<AutotuneResult> result = AutotuneCache::Lookup(device, hlo);
+  if (!result.has_value()) {
+    if (stream_exec_ == nullptr || !AutotuneCache::AutotuneEnabled()) {
+      return false;
+    }
+    TF_ASSIGN_OR_RETURN(
+        result, BenchmarkGemm(gemm, gemm_config, stream_exec_, allocator_));
+    if (!result.has_value()) return false;
+    AutotuneCache::Insert(device, hlo, *result);
+  }
+  if (!result->has_gemm()) return false;
+
+  VLOG(1) << "Selected GEMM algorithm " << result->gemm().algorithm()
+          << " for " << gemm->name();
+  gemm_config.set_selected_algorithm(result->gemm().algorithm());
+  TF_RETURN_IF_ERROR(gemm->set_backend_config(gemm_config));
+  return true;
+}
+
+StatusOr<bool> GemmAutotuner::Run(
+    HloModule* module,
+    const absl::flat_hash_set<absl::string_view>& execution_threads) {
+  XLA_SCOPED_LOGGING_TIMER(
+      absl::StrCat("GemmAutotuner for ", module->name()));
+  bool changed = false;
+  for (HloComputation* computation :
+       module->MakeNonfusionComputations(execution_threads)) {
+    for (HloInstruction* instr : computation->instructions()) {
+      // FP8 GEMMs have a single oneDNN implementation.
+      if (IsCublasGemm(*instr) && !IsCublasLtMatmulF8(*instr)) {
+        TF_ASSIGN_OR_RETURN(bool result, RunOnInstruction(instr));
+        changed |= result;
+      }
+    }
+  }
+  return changed;
+}
+
+}  // namespace gpu
+}  // namespace xla
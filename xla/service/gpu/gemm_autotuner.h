@@ -0,0 +1,57 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef XLA_SERVICE_GPU_GEMM_AUTOTUNER_H_
+#define XLA_SERVICE_GPU_GEMM_AUTOTUNER_H_
+
+#include "xla/hlo/ir/hlo_instruction.h"
+#include "xla/hlo/ir/hlo_module.h"
+#include "xla/service/hlo_pass_interface.h"
+#include "xla/stream_executor/device_memory_allocator.h"
+#include "xla/stream_executor/stream_executor.h"
+
+namespace xla {
+namespace gpu {
+
+// Picks oneDNN or an XeTLA tile config for every GEMM custom call and records
+// it as GemmBackendConfig::selected_algorithm.
+//
+// Results come from the AutotuneCache. Misses are benchmarked on
+// `stream_exec` when XLA_AUTOTUNE=1; without a device they keep the default
+// heuristic.
+class GemmAutotuner : public HloModulePass {
+ public:
+  GemmAutotuner(se::StreamExecutor* stream_exec,
+                se::DeviceMemoryAllocator* allocator)
+      : stream_exec_(stream_exec), allocator_(allocator) {}
+
+  absl::string_view name() const override { return "gemm-autotuner"; }
+
+  using HloPassInterface::Run;
+  StatusOr<bool> Run(
+      HloModule* module,
+      const absl::flat_hash_set<absl::string_view>& execution_threads) override;
+
+ private:
+  StatusOr<bool> RunOnInstruction(HloInstruction* gemm);
+
+  se::StreamExecutor* stream_exec_;
+  se::DeviceMemoryAllocator* allocator_;
+};
+
+}  // namespace gpu
+}  // namespace xla
+
+#endif  // XLA_SERVICE_GPU_GEMM_AUTOTUNER_H_
@@ -0,0 +1,849 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+// Benchmarks the GEMMs RunGemm runs on its XeTLA and oneDNN paths:
+//
+//   gemm_benchmark --shapes=shapes.csv --dtypes=f16,bf16 --layouts=nn,nt \
+//       --epilogues=default,bias_gelu --output=new.json --baseline=old.json
+//
+// The shapes are the (m, n, k) that XeTLA has tuned configs for, then the
+// "m,n,k[,batch]" lines of --shapes. A layout says whether lhs and rhs are
+// stored transposed ("t") or not ("n"). Every case is timed on each path and
+// its result is checked against a host reference, or against the oneDNN
+// result when it would take the host more than --reference_max_flops.
+//
+// The results are written as JSON, one case per line. With --baseline, a
+// file written by an earlier run, cases whose median latency grew by more
+// than --tolerance are reported. The exit status is 1 if any case regressed
+// or produced a wrong result.
+//
+// --engine=cpu runs the cases through a oneDNN matmul on the CPU engine
+// instead, so that results and host overhead can be checked without a GPU.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/functional/function_ref.h"
+#include "absl/strings/ascii.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_replace.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "dnnl.hpp"  // NOLINT(build/include_subdir)
+#include "tsl/platform/env.h"
+#include "tsl/platform/errors.h"
+#include "tsl/platform/init_main.h"
+#include "tsl/platform/logging.h"
+#include "tsl/platform/statusor.h"
+#include "tsl/util/command_line_flags.h"
+#include "xla/primitive_util.h"
+#include "xla/service/gpu/matmul_utils.h"
+#include "xla/service/gpu/onednn_matmul_utils.h"
+#include "xla/service/gpu/xetla/gemm/gemm.h"
+#include "xla/shape_util.h"
+#include "xla/stream_executor/device_memory_allocator.h"
+#include "xla/stream_executor/multi_platform_manager.h"
+#include "xla/stream_executor/scratch_allocator.h"
+#include "xla/stream_executor/stream.h"
+#include "xla/stream_executor/stream_executor.h"
+#include "xla/types.h"
+#include "xla/util.h"
+
+namespace xla {
+namespace gpu {
+namespace {
+
+using Epilogue = se::cuda::BlasLt::Epilogue;
+
+struct BenchmarkOptions {
+  std::string engine = "gpu";
+  int32_t device = 0;
+  bool tuned_shapes = true;
+  std::string shapes;
+  std::string dtypes = "f16,bf16";
+  std::string layouts = "nn";
+  std::string epilogues = "default";
+  bool xetla_configs = false;
+  int32_t warmup = 3;
+  int32_t iterations = 20;
+  int64_t reference_max_flops = int64_t{1} << 31;
+  std::string output;
+  std::string baseline;
+  float tolerance = 0.05f;
+};
+
+constexpr std::pair<Epilogue, absl::string_view> kEpilogueNames[] = {
+    {Epilogue::kDefault, "default"},
+    {Epilogue::kBias, "bias"},
+    {Epilogue::kReLU, "relu"},
+    {Epilogue::kBiasThenReLU, "bias_relu"},
+    {Epilogue::kGELU, "gelu"},
+    {Epilogue::kBiasThenGELU, "bias_gelu"},
+};
+
+absl::string_view EpilogueName(Epilogue epilogue) {
+  for (const auto& [value, name] : kEpilogueNames) {
+    if (value == epilogue) return name;
+  }
+  return "";
+}
+
+bool HasBias(Epilogue epilogue) {
+  return epilogue == Epilogue::kBias || epilogue == Epilogue::kBiasThenReLU ||
+         epilogue == Epilogue::kBiasThenGELU;
+}
+
+float ApplyActivation(Epilogue epilogue, float x) {
+  switch (epilogue) {
+    case Epilogue::kReLU:
+    case Epilogue::kBiasThenReLU:
+      return std::max(x, 0.0f);
+    case Epilogue::kGELU:
+    case Epilogue::kBiasThenGELU:
+      // The tanh approximation, as in the fused GEMM epilogues.
+      return 0.5f * x *
+             (1.0f + std::tanh(0.7978845608f * (x + 0.044715f * x * x * x)));
+    default:
+      return x;
+  }
+}
+
+// A GEMM out[batch, m, n] = activation(lhs[batch, m, k] @ rhs[batch, k, n] +
+// bias[n]). A transposed lhs is stored as [batch, k, m] and a transposed rhs
+// as [batch, n, k].
+struct GemmCase {
+  PrimitiveType dtype;
+  int64_t batch;
+  int64_t m;
+  int64_t n;
+  int64_t k;
+  bool lhs_transposed;
+  bool rhs_transposed;
+  Epilogue epilogue;
+
+  std::string Layout() const {
+    return absl::StrCat(lhs_transposed ? "t" : "n", rhs_transposed ? "t" : "n");
+  }
+  double Flops() const { return 2.0 * batch * m * n * k; }
+};
+
+struct GemmResult {
+  GemmCase gemm;
+  std::string engine;
+  std::string path;
+  // "ok", "wrong result", "fell back to onednn" for an XeTLA path that ran
+  // oneDNN, or the error the path failed with.
+  std::string status = "ok";
+  bool checked = false;
+  double max_error = 0.0;
+  // First run, which creates primitives and compiles kernels.
+  double setup_us = 0.0;
+  // Each timed run, until the device is done.
+  std::vector<double> run_us;
+  // Each timed run, until the call returns. With a GPU this is the host
+  // overhead of enqueuing the GEMM.
+  std::vector<double> call_us;
+
+  std::string Key() const {
+    return absl::StrFormat(
+        "%s/%s/%s/%s/%s/%dx%dx%dx%d", engine, path,
+        primitive_util::LowercasePrimitiveTypeName(gemm.dtype), gemm.Layout(),
+        EpilogueName(gemm.epilogue), gemm.batch, gemm.m, gemm.n, gemm.k);
+  }
+};
+
+// The nearest-rank percentile `p` in [0, 1] of `values`.
+double Percentile(std::vector<double> values, double p) {
+  if (values.empty()) return 0.0;
+  std::sort(values.begin(), values.end());
+  size_t rank = static_cast<size_t>(std::ceil(p * values.size()));
+  return values[std::clamp<size_t>(rank, 1, values.size()) - 1];
+}
+
+template <typename T>
+void EncodeAs(const std::vector<float>& values, uint8_t* bytes) {
+  for (size_t i = 0; i < values.size(); ++i) {
+    T value(values[i]);
+    std::memcpy(bytes + i * sizeof(T), &value, sizeof(T));
+  }
+}
+
+template <typename T>
+void DecodeAs(const uint8_t* bytes, std::vector<float>& values) {
+  for (size_t i = 0; i < values.size(); ++i) {
+    T value;
+    std::memcpy(&value, bytes + i * sizeof(T), sizeof(T));
+    values[i] = static_cast<float>(value);
+  }
+}
+
+std::vector<uint8_t> Encode(PrimitiveType dtype,
+                            const std::vector<float>& values) {
+  std::vector<uint8_t> bytes(values.size() *
+                             primitive_util::ByteWidth(dtype));
+  switch (dtype) {
+    case F16:
+      EncodeAs<half>(values, bytes.data());
+      break;
+    case BF16:
+      EncodeAs<bfloat16>(values, bytes.data());
+      break;
+    default:
+      EncodeAs<float>(values, bytes.data());
+      break;
+  }
+  return bytes;
+}
+
+std::vector<float> Decode(PrimitiveType dtype,
+                          const std::vector<uint8_t>& bytes) {
+  std::vector<float> values(bytes.size() / primitive_util::ByteWidth(dtype));
+  switch (dtype) {
+    case F16:
+      DecodeAs<half>(bytes.data(), values);
+      break;
+    case BF16:
+      DecodeAs<bfloat16>(bytes.data(), values);
+      break;
+    default:
+      DecodeAs<float>(bytes.data(), values);
+      break;
+  }
+  return values;
+}
+
+// The inputs of a case, as the floats that its dtype represents exactly.
+struct GemmInputs {
+  std::vector<float> lhs;
+  std::vector<float> rhs;
+  std::vector<float> bias;
+};
+
+GemmInputs MakeInputs(const GemmCase& gemm) {
+  std::minstd_rand rng(42);
+  std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+  auto random = [&](int64_t size) {
+    std::vector<float> values(size);
+    for (float& value : values) value = distribution(rng);
+    return Decode(gemm.dtype, Encode(gemm.dtype, values));
+  };
+  GemmInputs inputs;
+  inputs.lhs = random(gemm.batch * gemm.m * gemm.k);
+  inputs.rhs = random(gemm.batch * gemm.k * gemm.n);
+  if (HasBias(gemm.epilogue)) inputs.bias = random(gemm.n);
+  return inputs;
+}
+
+std::vector<float> ReferenceGemm(const GemmCase& gemm,
+                                 const GemmInputs& inputs) {
+  const int64_t m = gemm.m, n = gemm.n, k = gemm.k;
+  std::vector<float> out(gemm.batch * m * n, 0.0f);
+  for (int64_t b = 0; b < gemm.batch; ++b) {
+    const float* lhs = inputs.lhs.data() + b * m * k;
+    const float* rhs = inputs.rhs.data() + b * k * n;
+    for (int64_t i = 0; i < m; ++i) {
+      float* row = out.data() + (b * m + i) * n;
+      for (int64_t l = 0; l < k; ++l) {
+        float a = gemm.lhs_transposed ? lhs[l * m + i] : lhs[i * k + l];
+        for (int64_t j = 0; j < n; ++j) {
+          row[j] += a * (gemm.rhs_transposed ? rhs[j * k + l] : rhs[l * n + j]);
+        }
+      }
+      for (int64_t j = 0; j < n; ++j) {
+        if (!inputs.bias.empty()) row[j] += inputs.bias[j];
+        row[j] = ApplyActivation(gemm.epilogue, row[j]);
+      }
+    }
+  }
+  return out;
+}
+
+// The largest difference from `reference`, relative to its largest
+// magnitude, or to 1 if that is smaller.
+double RelativeError(const std::vector<float>& values,
+                     const std::vector<float>& reference) {
+  double max_difference = 0.0;
+  double max_magnitude = 1.0;
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (std::isnan(values[i])) return INFINITY;
+    max_difference = std::max<double>(max_difference,
+                                      std::fabs(values[i] - reference[i]));
+    max_magnitude = std::max<double>(max_magnitude, std::fabs(reference[i]));
+  }
+  return max_difference / max_magnitude;
+}
+
+double ErrorTolerance(PrimitiveType dtype) {
+  switch (dtype) {
+    case F16:
+      return 1e-2;
+    case BF16:
+      return 3e-2;
+    default:
+      // Leaves room for TF32 math.
+      return 5e-3;
+  }
+}
+
+void CheckResult(const std::vector<float>& values,
+                 const std::vector<float>& reference, GemmResult* result) {
+  result->checked = true;
+  result->max_error = RelativeError(values, reference);
+  if (result->max_error > ErrorTolerance(result->gemm.dtype)) {
+    result->status = "wrong result";
+  }
+}
+
+// Runs `run` `options.warmup` times, then `options.iterations` timed times,
+// each followed by `sync`.
+Status Profile(const BenchmarkOptions& options, absl::FunctionRef<Status()> run,
+               absl::FunctionRef<Status()> sync, GemmResult* result) {
+  for (int i = 0; i < std::max(options.warmup, 1); ++i) {
+    absl::Time start = absl::Now();
+    TF_RETURN_IF_ERROR(run());
+    TF_RETURN_IF_ERROR(sync());
+    if (i == 0) {
+      result->setup_us = absl::ToDoubleMicroseconds(absl::Now() - start);
+    }
+  }
+  for (int i = 0; i < options.iterations; ++i) {
+    absl::Time start = absl::Now();
+    TF_RETURN_IF_ERROR(run());
+    absl::Time called = absl::Now();
+    TF_RETURN_IF_ERROR(sync());
+    absl::Time done = absl::Now();
+    result->call_us.push_back(absl::ToDoubleMicroseconds(called - start));
+    result->run_us.push_back(absl::ToDoubleMicroseconds(done - start));
+  }
+  return OkStatus();
+}
+
+StatusOr<GemmConfig> MakeGemmConfig(const GemmCase& gemm) {
+  bool batched = gemm.batch > 1;
+  auto shape = [&](int64_t rows, int64_t cols) {
+    return batched ? ShapeUtil::MakeShape(gemm.dtype, {gemm.batch, rows, cols})
+                   : ShapeUtil::MakeShape(gemm.dtype, {rows, cols});
+  };
+  int64_t rows_dim = batched ? 1 : 0;
+  int64_t cols_dim = rows_dim + 1;
+  std::vector<int64_t> batch_dims;
+  if (batched) batch_dims.push_back(0);
+  TF_ASSIGN_OR_RETURN(
+      GemmConfig config,
+      GemmConfig::For(
+          gemm.lhs_transposed ? shape(gemm.k, gemm.m) : shape(gemm.m, gemm.k),
+          batch_dims, {gemm.lhs_transposed ? rows_dim : cols_dim},
+          gemm.rhs_transposed ? shape(gemm.n, gemm.k) : shape(gemm.k, gemm.n),
+          batch_dims, {gemm.rhs_transposed ? cols_dim : rows_dim},
+          shape(gemm.m, gemm.n), /*alpha_real=*/1.0, /*alpha_imag=*/0.0,
+          /*beta=*/0.0, /*algorithm=*/std::nullopt,
+          se::blas::kDefaultComputePrecision));
+  config.epilogue = gemm.epilogue;
+  return config;
+}
+
+StatusOr<se::OwningDeviceMemory> Upload(se::DeviceMemoryAllocator* allocator,
+                                        se::Stream* stream,
+                                        const std::vector<uint8_t>& bytes) {
+  TF_ASSIGN_OR_RETURN(
+      se::OwningDeviceMemory buffer,
+      allocator->Allocate(stream->parent()->device_ordinal(), bytes.size()));
+  se::DeviceMemoryBase destination = *buffer;
+  stream->ThenMemcpy(&destination, bytes.data(), bytes.size());
+  TF_RETURN_IF_ERROR(stream->BlockHostUntilDone());
+  return buffer;
+}
+
+StatusOr<std::vector<uint8_t>> Download(se::Stream* stream,
+                                        se::DeviceMemoryBase buffer) {
+  std::vector<uint8_t> bytes(buffer.size());
+  stream->ThenMemcpy(bytes.data(), buffer, buffer.size());
+  TF_RETURN_IF_ERROR(stream->BlockHostUntilDone());
+  return bytes;
+}
+
+// Sets every byte of `buffer` to 0xff, a NaN in each GEMM dtype, so that a
+// path that does not write its output fails the result check.
+Status FillWithNaNs(se::Stream* stream, se::DeviceMemoryBase buffer) {
+  std::vector<uint8_t> bytes(buffer.size(), 0xff);
+  stream->ThenMemcpy(&buffer, bytes.data(), bytes.size());
+  return stream->BlockHostUntilDone();
+}
+
+// Times `gemm` with RunGemm on the oneDNN path, then on the XeTLA path if
+// RunGemm has one for it. The XeTLA path is RunGemm's heuristic with
+// XETLA_GEMM set, plus each tile config with --xetla_configs. An XeTLA path
+// that RunGemm runs with oneDNN instead is reported as such, not timed as
+// XeTLA.
+Status BenchmarkOnGpu(const BenchmarkOptions& options,
+                      se::DeviceMemoryAllocator* allocator, se::Stream* stream,
+                      const GemmCase& gemm, std::vector<GemmResult>* results) {
+  GemmInputs inputs = MakeInputs(gemm);
+  std::optional<std::vector<float>> reference;
+  if (gemm.Flops() <= options.reference_max_flops) {
+    reference = ReferenceGemm(gemm, inputs);
+  }
+
+  TF_ASSIGN_OR_RETURN(
+      se::OwningDeviceMemory lhs,
+      Upload(allocator, stream, Encode(gemm.dtype, inputs.lhs)));
+  TF_ASSIGN_OR_RETURN(
+      se::OwningDeviceMemory rhs,
+      Upload(allocator, stream, Encode(gemm.dtype, inputs.rhs)));
+  se::OwningDeviceMemory bias;
+  if (!inputs.bias.empty()) {
+    TF_ASSIGN_OR_RETURN(
+        bias, Upload(allocator, stream, Encode(gemm.dtype, inputs.bias)));
+  }
+  const int device_ordinal = stream->parent()->device_ordinal();
+  TF_ASSIGN_OR_RETURN(
+      se::OwningDeviceMemory output,
+      allocator->Allocate(device_ordinal,
+                          gemm.batch * gemm.m * gemm.n *
+                              primitive_util::ByteWidth(gemm.dtype)));
+
+  TF_ASSIGN_OR_RETURN(GemmConfig config, MakeGemmConfig(gemm));
+  std::vector<std::pair<std::string, int64_t>> paths = {
+      {"onednn", kGemmAlgorithmOneDnn}};
+  std::vector<int64_t> candidates = GetGemmAlgorithmCandidates(config);
+  if (candidates.size() > 1) {
+    paths.push_back({"xetla", kGemmAlgorithmHeuristic});
+    if (options.xetla_configs) {
+      for (int64_t algorithm : candidates) {
+        if (algorithm < kGemmAlgorithmXetla) continue;
+        paths.push_back(
+            {absl::StrCat("xetla:", algorithm - kGemmAlgorithmXetla),
+             algorithm});
+      }
+    }
+  }
+
+  for (const auto& [path, algorithm] : paths) {
+    GemmResult result{gemm, "gpu", path};
+    config.algorithm = algorithm;
+    TF_RETURN_IF_ERROR(FillWithNaNs(stream, *output));
+    // RunGemm only hands out a oneDNN primitive when it runs one.
+    bool ran_onednn = false;
+    Status status = Profile(
+        options,
+        [&]() -> Status {
+          se::OwningScratchAllocator<> scratch_allocator(device_ordinal,
+                                                         allocator);
+          std::shared_ptr<const OneDnnMatMulPrimitive> primitive;
+          TF_RETURN_IF_ERROR(
+              RunGemm(config, *lhs, *rhs, se::DeviceMemoryBase(), *output,
+                      bias.is_null() ? se::DeviceMemoryBase() : *bias, stream,
+                      &scratch_allocator, &primitive));
+          ran_onednn |= primitive != nullptr;
+          return OkStatus();
+        },
+        [&]() { return stream->BlockHostUntilDone(); }, &result);
+    if (status.ok() && algorithm != kGemmAlgorithmOneDnn && ran_onednn) {
+      result.status = "fell back to onednn";
+    } else if (status.ok()) {
+      TF_ASSIGN_OR_RETURN(std::vector<uint8_t> bytes,
+                          Download(stream, *output));
+      std::vector<float> values = Decode(gemm.dtype, bytes);
+      if (reference.has_value()) {
+        CheckResult(values, *reference, &result);
+      } else {
+        // Too large for the host; the other paths are checked against
+        // oneDNN instead.
+        reference = std::move(values);
+      }
+    } else {
+      result.status = status.ToString();
+    }
+    results->push_back(std::move(result));
+  }
+  return OkStatus();
+}
+
+StatusOr<dnnl::memory::data_type> OneDnnDataType(PrimitiveType dtype) {
+  switch (dtype) {
+    case F16:
+      return dnnl::memory::data_type::f16;
+    case BF16:
+      return dnnl::memory::data_type::bf16;
+    case F32:
+      return dnnl::memory::data_type::f32;
+    default:
+      return InvalidArgument(
+          "Unsupported GEMM dtype: %s",
+          primitive_util::LowercasePrimitiveTypeName(dtype));
+  }
+}
+
+// Times `gemm` as a oneDNN matmul on the CPU `engine`, with the descriptors
+// and post-ops the oneDNN path of RunGemm creates it with. The primitive is
+// created by the first run, as RunGemm creates it on a cache miss.
+Status BenchmarkOnCpu(const BenchmarkOptions& options,
+                      const dnnl::engine& engine, const GemmCase& gemm,
+                      std::vector<GemmResult>* results) {
+  GemmResult result{gemm, "cpu", "onednn"};
+  GemmInputs inputs = MakeInputs(gemm);
+  std::vector<uint8_t> lhs = Encode(gemm.dtype, inputs.lhs);
+  std::vector<uint8_t> rhs = Encode(gemm.dtype, inputs.rhs);
+  std::vector<uint8_t> bias = Encode(gemm.dtype, inputs.bias);
+  std::vector<uint8_t> output(gemm.batch * gemm.m * gemm.n *
+                              primitive_util::ByteWidth(gemm.dtype));
+
+  TF_ASSIGN_OR_RETURN(dnnl::memory::data_type type,
+                      OneDnnDataType(gemm.dtype));
+  const int64_t m = gemm.m, n = gemm.n, k = gemm.k;
+  using dims = dnnl::memory::dims;
+  dnnl::memory::desc src_md(
+      {gemm.batch, m, k}, type,
+      gemm.lhs_transposed ? dims{m * k, 1, m} : dims{m * k, k, 1});
+  dnnl::memory::desc weights_md(
+      {gemm.batch, k, n}, type,
+      gemm.rhs_transposed ? dims{k * n, 1, k} : dims{k * n, n, 1});
+  dnnl::memory::desc dst_md({gemm.batch, m, n}, type, dims{m * n, n, 1});
+  dnnl::memory::desc bias_md({1, 1, n}, type, dims{n, n, 1});
+
+  dnnl::post_ops post_ops;
+  switch (gemm.epilogue) {
+    case Epilogue::kReLU:
+    case Epilogue::kBiasThenReLU:
+      post_ops.append_eltwise(dnnl::algorithm::eltwise_relu, 0.0f, 0.0f);
+      break;
+    case Epilogue::kGELU:
+    case Epilogue::kBiasThenGELU:
+      post_ops.append_eltwise(dnnl::algorithm::eltwise_gelu_tanh, 0.0f, 0.0f);
+      break;
+    default:
+      break;
+  }
+  dnnl::primitive_attr attr;
+  attr.set_post_ops(post_ops);
+
+  dnnl::stream stream(engine);
+  std::optional<dnnl::matmul> matmul;
+  std::unordered_map<int, dnnl::memory> args;
+  Status status = Profile(
+      options,
+      [&]() -> Status {
+        try {
+          if (!matmul.has_value()) {
+            matmul = dnnl::matmul(
+                HasBias(gemm.epilogue)
+                    ? dnnl::matmul::primitive_desc(engine, src_md, weights_md,
+                                                   bias_md, dst_md, attr)
+                    : dnnl::matmul::primitive_desc(engine, src_md, weights_md,
+                                                   dst_md, attr));
+            args[DNNL_ARG_SRC] = dnnl::memory(src_md, engine, lhs.data());
+            args[DNNL_ARG_WEIGHTS] =
+                dnnl::memory(weights_md, engine, rhs.data());
+            args[DNNL_ARG_DST] = dnnl::memory(dst_md, engine, output.data());
+            if (HasBias(gemm.epilogue)) {
+              args[DNNL_ARG_BIAS] = dnnl::memory(bias_md, engine, bias.data());
+            }
+          }
+          matmul->execute(stream, args);
+        } catch (const dnnl::error& e) {
+          return InternalError("oneDNN matmul failed: %s", e.what());
+        }
+        return OkStatus();
+      },
+      [&]() {
+        stream.wait();
+        return OkStatus();
+      },
+      &result);
+  if (!status.ok()) {
+    result.status = status.ToString();
+  } else if (gemm.Flops() <= options.reference_max_flops) {
+    CheckResult(Decode(gemm.dtype, output), ReferenceGemm(gemm, inputs),
+                &result);
+  }
+  results->push_back(std::move(result));
+  return OkStatus();
+}
+
+StatusOr<std::vector<GemmCase>> MakeCases(const BenchmarkOptions& options) {
+  // (batch, m, n, k)
+  std::vector<std::tuple<int64_t, int64_t, int64_t, int64_t>> shapes;
+  if (options.tuned_shapes) {
+    for (const auto& [m, n, k] : ::gpu::xetla::getXetlaGemmTunedShapes()) {
+      shapes.emplace_back(1, m, n, k);
+    }
+  }
+  if (!options.shapes.empty()) {
+    std::string contents;
+    TF_RETURN_IF_ERROR(
+        tsl::ReadFileToString(tsl::Env::Default(), options.shapes, &contents));
+    for (absl::string_view line : absl::StrSplit(contents, '\n')) {
+      line = absl::StripAsciiWhitespace(line);
+      if (line.empty() || absl::StartsWith(line, "#")) continue;
+      std::vector<absl::string_view> fields = absl::StrSplit(line, ',');
+      int64_t values[4] = {0, 0, 0, 1};
+      bool ok = fields.size() == 3 || fields.size() == 4;
+      for (size_t i = 0; ok && i < fields.size(); ++i) {
+        ok = absl::SimpleAtoi(absl::StripAsciiWhitespace(fields[i]),
+                              &values[i]) &&
+             values[i] > 0;
+      }
+      if (!ok) {
+        return InvalidArgument("Expected \"m,n,k[,batch]\" in %s, got \"%s\"",
+                               options.shapes, line);
+      }
+      shapes.emplace_back(values[3], values[0], values[1], values[2]);
+    }
+  }
+
+  std::vector<PrimitiveType> dtypes;
+  for (absl::string_view name : absl::StrSplit(options.dtypes, ',')) {
+    TF_ASSIGN_OR_RETURN(PrimitiveType dtype,
+                        primitive_util::StringToPrimitiveType(name));
+    TF_RETURN_IF_ERROR(OneDnnDataType(dtype).status());
+    dtypes.push_back(dtype);
+  }
+  std::vector<std::pair<bool, bool>> layouts;
+  for (absl::string_view name : absl::StrSplit(options.layouts, ',')) {
+    if (name.size() != 2 || name.find_first_not_of("nt") != name.npos) {
+      return InvalidArgument("Unknown GEMM layout: %s", name);
+    }
+    layouts.emplace_back(name[0] == 't', name[1] == 't');
+  }
+  std::vector<Epilogue> epilogues;
+  for (absl::string_view name : absl::StrSplit(options.epilogues, ',')) {
+    auto it = absl::c_find_if(kEpilogueNames, [&](const auto& entry) {
+      return entry.second == name;
+    });
+    if (it == std::end(kEpilogueNames)) {
+      return InvalidArgument("Unknown GEMM epilogue: %s", name);
+    }
+    epilogues.push_back(it->first);
+  }
+
+  std::vector<GemmCase> cases;
+  for (const auto& [batch, m, n, k] : shapes) {
+    for (PrimitiveType dtype : dtypes) {
+      for (const auto& [lhs_transposed, rhs_transposed] : layouts) {
+        for (Epilogue epilogue : epilogues) {
+          cases.push_back({dtype, batch, m, n, k, lhs_transposed,
+                           rhs_transposed, epilogue});
+        }
+      }
+    }
+  }
+  return cases;
+}
+
+std::string JsonEscape(absl::string_view text) {
+  return absl::StrReplaceAll(
+      text, {{"\\", "\\\\"}, {"\"", "\\\""}, {"\n", " "}, {"\t", " "}});
+}
+
+std::string ToJson(const std::vector<GemmResult>& results) {
+  std::string json = "{\"results\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const GemmResult& result = results[i];
+    const GemmCase& gemm = result.gemm;
+    double p50_us = Percentile(result.run_us, 0.5);
+    absl::StrAppendFormat(
+        &json,
+        "  {\"key\": \"%s\", \"engine\": \"%s\", \"path\": \"%s\", "
+        "\"dtype\": \"%s\", \"layout\": \"%s\", \"epilogue\": \"%s\", "
+        "\"batch\": %d, \"m\": %d, \"n\": %d, \"k\": %d, "
+        "\"status\": \"%s\", \"checked\": %s, \"max_error\": %.3g, "
+        "\"setup_us\": %.2f, \"min_us\": %.2f, \"p50_us\": %.2f, "
+        "\"p90_us\": %.2f, \"p99_us\": %.2f, \"call_us\": %.2f, "
+        "\"tflops\": %.3f}%s\n",
+        result.Key(), result.engine, result.path,
+        primitive_util::LowercasePrimitiveTypeName(gemm.dtype), gemm.Layout(),
+        EpilogueName(gemm.epilogue), gemm.batch, gemm.m, gemm.n, gemm.k,
+        JsonEscape(result.status), result.checked ? "true" : "false",
+        result.max_error, result.setup_us, Percentile(result.run_us, 0.0),
+        p50_us, Percentile(result.run_us, 0.9), Percentile(result.run_us, 0.99),
+        Percentile(result.call_us, 0.5),
+        p50_us > 0.0 ? gemm.Flops() / p50_us * 1e-6 : 0.0,
+        i + 1 < results.size() ? "," : "");
+  }
+  json += "]}\n";
+  return json;
+}
+
+// Returns the value of `"name": value` in a line written by ToJson, without
+// quotes.
+std::optional<absl::string_view> FindJsonField(absl::string_view line,
+                                               absl::string_view name) {
+  std::string prefix = absl::StrCat("\"", name, "\": ");
+  size_t pos = line.find(prefix);
+  if (pos == line.npos) return std::nullopt;
+  absl::string_view value = line.substr(pos + prefix.size());
+  if (absl::ConsumePrefix(&value, "\"")) {
+    return value.substr(0, value.find('"'));
+  }
+  return value.substr(0, value.find_first_of(",}"));
+}
+
+// Returns the median latency by key of the passing cases of a file written
+// by ToJson.
+StatusOr<absl::flat_hash_map<std::string, double>> ReadBaseline(
+    const std::string& path) {
+  std::string contents;
+  TF_RETURN_IF_ERROR(
+      tsl::ReadFileToString(tsl::Env::Default(), path, &contents));
+  absl::flat_hash_map<std::string, double> baseline;
+  for (absl::string_view line : absl::StrSplit(contents, '\n')) {
+    std::optional<absl::string_view> key = FindJsonField(line, "key");
+    std::optional<absl::string_view> status = FindJsonField(line, "status");
+    std::optional<absl::string_view> p50_us = FindJsonField(line, "p50_us");
+    if (!key.has_value() || status != "ok" || !p50_us.has_value()) continue;
+    double value;
+    if (!absl::SimpleAtod(*p50_us, &value)) {
+      return InvalidArgument("Bad p50_us of %s in %s", *key, path);
+    }
+    baseline[*key] = value;
+  }
+  return baseline;
+}
+
+// Returns the number of cases that failed or got slower than in the
+// baseline, if any.
+StatusOr<int> RunBenchmark(const BenchmarkOptions& options) {
+  TF_ASSIGN_OR_RETURN(std::vector<GemmCase> cases, MakeCases(options));
+  std::vector<GemmResult> results;
+
+  if (options.engine == "gpu") {
+    // Makes the heuristic path of RunGemm take XeTLA where it can. The
+    // variable is read once, on the first GEMM.
+    setenv("XETLA_GEMM", "1", /*overwrite=*/1);
+    TF_ASSIGN_OR_RETURN(se::Platform * platform,
+                        se::MultiPlatformManager::PlatformWithName("SYCL"));
+    TF_ASSIGN_OR_RETURN(se::StreamExecutor * executor,
+                        platform->ExecutorForDevice(options.device));
+    se::StreamExecutorMemoryAllocator allocator(executor);
+    TF_ASSIGN_OR_RETURN(se::Stream * stream,
+                        allocator.GetStream(executor->device_ordinal()));
+    for (const GemmCase& gemm : cases) {
+      TF_RETURN_IF_ERROR(
+          BenchmarkOnGpu(options, &allocator, stream, gemm, &results));
+    }
+  } else if (options.engine == "cpu") {
+    if (dnnl::engine::get_count(dnnl::engine::kind::cpu) == 0) {
+      return FailedPrecondition("oneDNN has no CPU engine in this build");
+    }
+    dnnl::engine engine(dnnl::engine::kind::cpu, 0);
+    for (const GemmCase& gemm : cases) {
+      TF_RETURN_IF_ERROR(BenchmarkOnCpu(options, engine, gemm, &results));
+    }
+  } else {
+    return InvalidArgument("Unknown engine: %s", options.engine);
+  }
+
+  int failures = 0;
+  for (const GemmResult& result : results) {
+    double p50_us = Percentile(result.run_us, 0.5);
+    absl::FPrintF(stderr, "%-56s %10.2f us %8.3f TFLOP/s  %s\n", result.Key(),
+                  p50_us,
+                  p50_us > 0.0 ? result.gemm.Flops() / p50_us * 1e-6 : 0.0,
+                  result.status);
+    if (result.status == "wrong result") ++failures;
+  }
+
+  if (options.output.empty()) {
+    absl::PrintF("%s", ToJson(results));
+  } else {
+    TF_RETURN_IF_ERROR(tsl::WriteStringToFile(tsl::Env::Default(),
+                                              options.output, ToJson(results)));
+  }
+
+  if (!options.baseline.empty()) {
+    TF_ASSIGN_OR_RETURN(auto baseline, ReadBaseline(options.baseline));
+    for (const GemmResult& result : results) {
+      auto it = baseline.find(result.Key());
+      if (result.status != "ok" || it == baseline.end()) continue;
+      double p50_us = Percentile(result.run_us, 0.5);
+      if (p50_us > it->second * (1.0 + options.tolerance)) {
+        absl::FPrintF(stderr, "Regression: %s %.2f us -> %.2f us (%+.1f%%)\n",
+                      result.Key(), it->second, p50_us,
+                      (p50_us / it->second - 1.0) * 100.0);
+        ++failures;
+      }
+    }
+  }
+  return failures;
+}
+
+}  // namespace
+}  // namespace gpu
+}  // namespace xla
+
+int main(int argc, char** argv) {
+  xla::gpu::BenchmarkOptions options;
+  std::vector<tsl::Flag> flag_list = {
+      tsl::Flag("engine", &options.engine,
+                "\"gpu\" to run RunGemm, or \"cpu\" to run oneDNN on the CPU "
+                "engine"),
+      tsl::Flag("device", &options.device, "GPU device ordinal"),
+      tsl::Flag("tuned_shapes", &options.tuned_shapes,
+                "Include the shapes XeTLA has tuned configs for"),
+      tsl::Flag("shapes", &options.shapes,
+                "CSV file of \"m,n,k[,batch]\" lines to add"),
+      tsl::Flag("dtypes", &options.dtypes, "Comma-separated f16, bf16, f32"),
+      tsl::Flag("layouts", &options.layouts,
+                "Comma-separated nn, nt, tn, tt: whether lhs and rhs are "
+                "transposed"),
+      tsl::Flag("epilogues", &options.epilogues,
+                "Comma-separated default, bias, relu, bias_relu, gelu, "
+                "bias_gelu"),
+      tsl::Flag("xetla_configs", &options.xetla_configs,
+                "Also time each XeTLA tile config"),
+      tsl::Flag("warmup", &options.warmup, "Untimed runs per case"),
+      tsl::Flag("iterations", &options.iterations, "Timed runs per case"),
+      tsl::Flag("reference_max_flops", &options.reference_max_flops,
+                "Largest case checked against a host reference"),
+      tsl::Flag("output", &options.output,
+                "JSON file to write, or empty for stdout"),
+      tsl::Flag("baseline", &options.baseline,
+                "JSON file of an earlier run to compare with"),
+      tsl::Flag("tolerance", &options.tolerance,
+                "Relative median latency increase reported as a regression"),
+  };
+  std::string usage = tsl::Flags::Usage(argv[0], flag_list);
+  bool parsed = tsl::Flags::Parse(&argc, argv, flag_list);
+  tsl::port::InitMain(usage.c_str(), &argc, &argv);
+  if (!parsed || argc > 1) {
+    LOG(ERROR) << "\n" << usage;
+    return 2;
+  }
+  xla::StatusOr<int> failures = xla::gpu::RunBenchmark(options);
+  if (!failures.ok()) {
+    LOG(ERROR) << failures.status();
+    return 2;
+  }
+  return *failures == 0 ? 0 : 1;
+}
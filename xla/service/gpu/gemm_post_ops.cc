@@ -0,0 +1,100 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/service/gpu/gemm_post_ops.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
+#include "xla/hlo/ir/hlo_opcode.h"
+#include "xla/util.h"
+
+namespace xla {
+namespace gpu {
+namespace {
+
+constexpr std::pair<GemmPostOp, absl::string_view> kGemmPostOpNames[] = {
+    {GemmPostOp::kBias, "bias"},
+    {GemmPostOp::kResidualAdd, "res_add"},
+    {GemmPostOp::kResidualMul, "res_mul"},
+    {GemmPostOp::kReLU, "relu"},
+    {GemmPostOp::kGELU, "gelu"},
+    {GemmPostOp::kGELUErf, "gelu_erf"},
+    {GemmPostOp::kSiLU, "silu"},
+    {GemmPostOp::kSigmoid, "sigmoid"},
+};
+
+absl::string_view GemmPostOpName(GemmPostOp post_op) {
+  for (const auto& [op, name] : kGemmPostOpNames) {
+    if (op == post_op) return name;
+  }
+  return "";
+}
+
+}  // namespace
+
+const absl::string_view kGemmWithPostOpsCallTargetPrefix =
+    "__xetla$gemm$post_ops";
+
+bool GemmPostOpHasOperand(GemmPostOp post_op) {
+  return post_op == GemmPostOp::kBias ||
+         post_op == GemmPostOp::kResidualAdd ||
+         post_op == GemmPostOp::kResidualMul;
+}
+
+std::string GemmWithPostOpsCallTarget(absl::Span<const GemmPostOp> post_ops) {
+  std::string target(kGemmWithPostOpsCallTargetPrefix);
+  for (GemmPostOp post_op : post_ops) {
+    absl::StrAppend(&target, "$", GemmPostOpName(post_op));
+  }
+  return target;
+}
+
+bool IsGemmWithPostOps(const HloInstruction& hlo) {
+  return hlo.opcode() == HloOpcode::kCustomCall &&
+         absl::StartsWith(hlo.custom_call_target(),
+                          absl::StrCat(kGemmWithPostOpsCallTargetPrefix, "$"));
+}
+
+StatusOr<std::vector<GemmPostOp>> ParseGemmPostOps(
+    absl::string_view call_target) {
+  if (!absl::ConsumePrefix(&call_target, kGemmWithPostOpsCallTargetPrefix) ||
+      !absl::ConsumePrefix(&call_target, "$")) {
+    return InvalidArgument("Not a GEMM with post-ops: %s", call_target);
+  }
+  std::vector<GemmPostOp> post_ops;
+  for (absl::string_view name : absl::StrSplit(call_target, '$')) {
+    auto it = absl::c_find_if(kGemmPostOpNames, [&](const auto& entry) {
+      return entry.second == name;
+    });
+    if (it == std::end(kGemmPostOpNames)) {
+      return InvalidArgument("Unknown GEMM post-op: %s", name);
+    }
+    post_ops.push_back(it->first);
+  }
+  if (post_ops.size() > kMaxGemmPostOps) {
+    return InvalidArgument("Too many GEMM post-ops: %d", post_ops.size());
+  }
+  return post_ops;
+}
+
+}  // namespace gpu
+}  // namespace xla
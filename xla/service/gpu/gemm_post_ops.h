@@ -0,0 +1,69 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef XLA_SERVICE_GPU_GEMM_POST_OPS_H_
+#define XLA_SERVICE_GPU_GEMM_POST_OPS_H_
+
+#include <string>
+#include <vector>
+
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "xla/hlo/ir/hlo_instruction.h"
+#include "xla/statusor.h"
+
+namespace xla {
+namespace gpu {
+
+// An elementwise op applied to the result of a GEMM before it is stored.
+enum class GemmPostOp {
+  kBias,         // Adds a vector broadcast over the rows of the output.
+  kResidualAdd,  // Adds a tensor of the output shape.
+  kResidualMul,  // Multiplies by a tensor of the output shape.
+  kReLU,
+  kGELU,  // tanh approximation.
+  kGELUErf,
+  kSiLU,  // x * sigmoid(x).
+  kSigmoid,
+};
+
+// At most this many post-ops are fused into one GEMM.
+inline constexpr int kMaxGemmPostOps = 4;
+
+// Whether `post_op` reads an operand.
+bool GemmPostOpHasOperand(GemmPostOp post_op);
+
+// A GEMM followed by a chain of post-ops, which the target names after this
+// prefix, e.g. "__xetla$gemm$post_ops$bias$silu$res_mul". Operands are lhs,
+// rhs, then the operand of each post-op that reads one, in chain order.
+// Residuals have the shape and layout of the output. The backend config is a
+// GemmBackendConfig with alpha 1, beta 0 and the default epilogue.
+//
+// Chains that the GemmBackendConfig epilogues cannot express use this target
+// rather than kCublasLtMatmulCallTarget.
+extern const absl::string_view kGemmWithPostOpsCallTargetPrefix;
+
+std::string GemmWithPostOpsCallTarget(absl::Span<const GemmPostOp> post_ops);
+
+bool IsGemmWithPostOps(const HloInstruction& hlo);
+
+// Inverse of GemmWithPostOpsCallTarget.
+StatusOr<std::vector<GemmPostOp>> ParseGemmPostOps(
+    absl::string_view call_target);
+
+}  // namespace gpu
+}  // namespace xla
+
+#endif  // XLA_SERVICE_GPU_GEMM_POST_OPS_H_
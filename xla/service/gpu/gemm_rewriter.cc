@@ -20,6 +20,7 @@ limitations under the License.
 #include <algorithm>
 #include <array>
 #include <cmath>
+#include <iterator>
 #include <limits>
 #include <memory>
 #include <numeric>
@@ -43,13 +44,16 @@ limitations under the License.
 #include "xla/literal_comparison.h"
 #include "xla/service/gpu/backend_configs.pb.h"
 #include "xla/service/gpu/cublas_cudnn.h"
+#include "xla/service/gpu/gemm_post_ops.h"
 #include "xla/service/gpu/ir_emission_utils.h"
 #include "xla/service/gpu/matmul_utils.h"
 #include "xla/service/hlo_creation_utils.h"
 #include "xla/service/pattern_matcher.h"
+#include "xla/shape_util.h"
 #include "xla/status_macros.h"
 #include "xla/statusor.h"
 #include "xla/stream_executor/blas.h"
+#include "xla/stream_executor/sycl/hw_info.h"
 #include "xla/xla_data.pb.h"
 
 namespace xla {
@@ -81,7 +85,8 @@ Status SetName(HloModule* module, HloInstruction* gemm) {
 // documentation: https://docs.nvidia.com/cuda/cublas/index.html#cublasLtMatmul.
 // Note that `Ctype` also describes the output type of the GEMM. Rows with
 // `Non-default epilogue not supported` entries in the last column indicate data
-// types not compatible with Epilogue Fusion.
+// types not compatible with Epilogue Fusion. F64 GEMMs run on oneMKL, which
+// has no fused epilogues.
 bool SupportsEpilogueFusion(PrimitiveType type) {
   switch (type) {
     case F8E4M3FN:
@@ -89,7 +94,6 @@ bool SupportsEpilogueFusion(PrimitiveType type) {
     case F16:
     case BF16:
     case F32:
-    case F64:
       return true;
     default:
       return false;
@@ -330,6 +334,38 @@ auto OptionalBitcast(Pattern pattern) {
   return m::AnyOf<HloInstruction>(m::Bitcast(pattern), std::move(pattern));
 }
 
+auto GemmWithPostOps(HloInstruction** instr) {
+  return m::Op(instr).WithPredicate(
+      [](const HloInstruction* instr) { return IsGemmWithPostOps(*instr); });
+}
+
+// A GEMM that more post-ops can be chained to.
+auto CublasLtMatmulOrGemmWithPostOps(HloInstruction** instr) {
+  return m::Op(instr).WithPredicate([](const HloInstruction* instr) {
+    return IsCublasLtMatmul(*instr) || IsGemmWithPostOps(*instr);
+  });
+}
+
+// 1 / (1 + exp(-x)).
+template <typename Pattern>
+auto SigmoidDenominator(Pattern x) {
+  return m::AddAnyOrder(BcastConstScalar(1.0), m::Exp(m::Negate(x)));
+}
+
+// Collects the factors of the tree of single-user multiplies rooted at
+// `instr` into `factors`.
+void CollectFactors(HloInstruction* instr,
+                    std::vector<HloInstruction*>& factors) {
+  for (HloInstruction* operand : instr->operands()) {
+    if (operand->opcode() == HloOpcode::kMultiply &&
+        operand->user_count() == 1) {
+      CollectFactors(operand, factors);
+    } else {
+      factors.push_back(operand);
+    }
+  }
+}
+
 // The rewriting proceeds in a bottom-up way:
 //
 // (kDot A B) is rewritten into a (kCustomCall:gemm A B)
@@ -482,6 +518,110 @@ class GemmRewriterVisitor : public DfsHloRewriteVisitor {
       }
       return FuseGeluActivation(instr, existing_gemm);
     }
+
+    // SiLU, x * sigmoid(x).
+    HloInstruction* sigmoid;
+    if (Match(instr,
+              m::MultiplyAnyOrder(
+                  CublasLtMatmulOrGemmWithPostOps(&existing_gemm),
+                  m::Op(&sigmoid)
+                      .WithOpcode(HloOpcode::kLogistic)
+                      .WithOneUser())) &&
+        sigmoid->operand(0) == existing_gemm &&
+        existing_gemm->user_count() == 2) {
+      return FuseGemmPostOp(instr, existing_gemm, GemmPostOp::kSiLU).status();
+    }
+
+    // Exact GELU, x * 0.5 * (1 + erf(x / sqrt(2))), in any association.
+    std::vector<HloInstruction*> factors;
+    CollectFactors(instr, factors);
+    if (factors.size() == 3) {
+      std::vector<HloInstruction*> gemms;
+      absl::c_copy_if(factors, std::back_inserter(gemms),
+                      [](const HloInstruction* factor) {
+                        return IsCublasLtMatmul(*factor) ||
+                               IsGemmWithPostOps(*factor);
+                      });
+      HloInstruction* gemm = gemms.size() == 1 ? gemms.front() : nullptr;
+      bool has_half = false, has_cdf = false;
+      auto erf_argument = m::AnyOf<HloInstruction>(
+          m::MultiplyAnyOrder(m::Op().Is(gemm),
+                              BcastConstScalarNear(M_SQRT1_2)),
+          m::Divide(m::Op().Is(gemm), BcastConstScalarNear(M_SQRT2)));
+      for (HloInstruction* factor : factors) {
+        has_half |= Match(factor, BcastConstScalar(0.5));
+        has_cdf |= gemm != nullptr &&
+                   Match(factor, m::AddAnyOrder(
+                                     BcastConstScalar(1.0),
+                                     m::Op()
+                                         .WithOpcode(HloOpcode::kErf)
+                                         .WithOperand(0, erf_argument)
+                                         .WithOneUser())
+                                     .WithOneUser());
+      }
+      if (gemm != nullptr && has_half && has_cdf && gemm->user_count() == 2) {
+        return FuseGemmPostOp(instr, gemm, GemmPostOp::kGELUErf).status();
+      }
+    }
+
+    // Multiplication by a tensor, e.g. the gate of a gated MLP. When both
+    // operands are GEMMs, the one that already has post-ops takes the other.
+    HloInstruction* residual;
+    for (bool post_ops_only : {true, false}) {
+      auto gemm_pattern =
+          CublasLtMatmulOrGemmWithPostOps(&existing_gemm)
+              .WithPredicate([&](const HloInstruction* gemm) {
+                return !post_ops_only || IsGemmWithPostOps(*gemm);
+              });
+      if (Match(instr, m::MultiplyAnyOrder(
+                           gemm_pattern.WithOneUser(),
+                           m::Op(&residual).WithPredicate(
+                               [](const HloInstruction* instr) {
+                                 return instr->opcode() !=
+                                        HloOpcode::kBroadcast;
+                               })))) {
+        TF_ASSIGN_OR_RETURN(bool fused,
+                            FuseGemmPostOp(instr, existing_gemm,
+                                           GemmPostOp::kResidualMul, residual));
+        if (fused) return OkStatus();
+      }
+    }
+    return OkStatus();
+  }
+
+  Status HandleLogistic(HloInstruction* instr) override {
+    HloInstruction* existing_gemm;
+    if (Match(instr, m::Op()
+                         .WithOpcode(HloOpcode::kLogistic)
+                         .WithOperand(0, CublasLtMatmulOrGemmWithPostOps(
+                                             &existing_gemm)
+                                             .WithOneUser()))) {
+      return FuseGemmPostOp(instr, existing_gemm, GemmPostOp::kSigmoid)
+          .status();
+    }
+    return OkStatus();
+  }
+
+  Status HandleDivide(HloInstruction* instr) override {
+    HloInstruction* existing_gemm;
+    // Sigmoid and SiLU written out: 1 / (1 + exp(-x)) and x / (1 + exp(-x)).
+    if (Match(instr,
+              m::Divide(BcastConstScalar(1.0),
+                        SigmoidDenominator(
+                            CublasLtMatmulOrGemmWithPostOps(&existing_gemm)
+                                .WithOneUser())
+                            .WithOneUser()))) {
+      return FuseGemmPostOp(instr, existing_gemm, GemmPostOp::kSigmoid)
+          .status();
+    }
+    HloInstruction* denominator;
+    if (Match(instr,
+              m::Divide(CublasLtMatmulOrGemmWithPostOps(&existing_gemm),
+                        m::Op(&denominator).WithOneUser())) &&
+        Match(denominator, SigmoidDenominator(m::Op().Is(existing_gemm))) &&
+        existing_gemm->user_count() == 2) {
+      return FuseGemmPostOp(instr, existing_gemm, GemmPostOp::kSiLU).status();
+    }
     return OkStatus();
   }
 
@@ -561,6 +701,23 @@ class GemmRewriterVisitor : public DfsHloRewriteVisitor {
       instr = new_add;
     }
 
+    // A residual added after an activation, or on top of an existing matrix
+    // bias, does not fit the cublasLt epilogues; chain it as a post-op.
+    if (Match(instr, m::AddAnyOrder(
+                         CublasLtMatmulOrGemmWithPostOps(&existing_gemm)
+                             .WithOneUser(),
+                         m::Op(&bias).WithPredicate(is_not_broadcast)))) {
+      TF_ASSIGN_OR_RETURN(auto config,
+                          existing_gemm->backend_config<GemmBackendConfig>());
+      if (IsGemmWithPostOps(*existing_gemm) || config.beta() != 0.0 ||
+          (config.epilogue() != GemmBackendConfig::DEFAULT &&
+           config.epilogue() != GemmBackendConfig::BIAS)) {
+        return FuseGemmPostOp(instr, existing_gemm, GemmPostOp::kResidualAdd,
+                              bias)
+            .status();
+      }
+    }
+
     if (Match(instr,
               m::AddAnyOrder(GemmOrCublasLtMatmul(&existing_gemm).WithOneUser(),
                              m::Op(&bias).WithPredicate(is_not_broadcast)))) {
@@ -589,6 +746,10 @@ class GemmRewriterVisitor : public DfsHloRewriteVisitor {
                   m::Broadcast(&zeros, m::ConstantScalar(0))))) {
       TF_RETURN_IF_ERROR(FuseReluActivation(instr, zeros, existing_gemm,
                                             optional_slice_or_bitcast));
+    } else if (Match(instr, m::MaximumAnyOrder(
+                                GemmWithPostOps(&existing_gemm).WithOneUser(),
+                                BcastConstScalar(0)))) {
+      return FuseGemmPostOp(instr, existing_gemm, GemmPostOp::kReLU).status();
     }
     return OkStatus();
   }
@@ -631,17 +792,11 @@ class GemmRewriterVisitor : public DfsHloRewriteVisitor {
                                     bool b_mult_scale,
                                     std::vector<HloInstruction*> a_unary_ops,
                                     std::vector<HloInstruction*> b_unary_ops) {
-    // FP8 GEMM kernels are only available on Hopper and newer architectures.
-    if (!cuda_compute_capability_.IsAtLeast(
-            se::CudaComputeCapability::HOPPER)) {
-      VLOG(1) << "FP8 Custom Calls require Hopper or newer architecture.";
+    // FP8 GEMMs run on oneDNN FP8 matmuls, which are only available on Xe-HPC.
+    if (!IsXeHPC()) {
+      VLOG(1) << "FP8 Custom Calls require Xe-HPC.";
       return false;
     }
-#if CUDA_VERSION < 11080
-    // FP8 GEMM kernels are only available with CUDA 11.8 and above
-    VLOG(1) << "FP8 Custom Calls require CUDA 11.8 or newer.";
-    return false;
-#endif
 
     // cuBLASLt FP8 GEMM kernels require one of the two operands to be in
     // F8E4M3FN format.
@@ -1185,6 +1340,8 @@ class GemmRewriterVisitor : public DfsHloRewriteVisitor {
       config.set_epilogue(GemmBackendConfig::RELU);
     } else if (config.epilogue() == GemmBackendConfig::BIAS) {
       config.set_epilogue(GemmBackendConfig::BIAS_RELU);
+    } else if (slice_or_bitcast == nullptr) {
+      return FuseGemmPostOp(instr, gemm, GemmPostOp::kReLU).status();
     } else {
       return OkStatus();
     }
@@ -1238,6 +1395,129 @@ class GemmRewriterVisitor : public DfsHloRewriteVisitor {
     return ReplaceWithNewInstruction(multiply, std::move(output));
   }
 
+  struct GemmPostOpChain {
+    std::vector<GemmPostOp> post_ops;
+    // The operands of the post-ops that read one, in chain order.
+    std::vector<HloInstruction*> operands;
+  };
+
+  // The post-ops applied by `gemm`, a cublasLt matmul or a GEMM with post-ops,
+  // or nullopt if no more post-ops can be chained to it.
+  StatusOr<std::optional<GemmPostOpChain>> GetGemmPostOpChain(
+      HloInstruction* gemm) {
+    PrimitiveType type = gemm->shape().element_type();
+    if (type != F16 && type != BF16 && type != F32) {
+      return std::nullopt;
+    }
+
+    GemmPostOpChain chain;
+    if (IsGemmWithPostOps(*gemm)) {
+      TF_ASSIGN_OR_RETURN(chain.post_ops,
+                          ParseGemmPostOps(gemm->custom_call_target()));
+      chain.operands.assign(gemm->operands().begin() + 2,
+                            gemm->operands().end());
+      return chain;
+    }
+    if (!IsCublasLtMatmul(*gemm)) {
+      return std::nullopt;
+    }
+
+    TF_ASSIGN_OR_RETURN(auto config, gemm->backend_config<GemmBackendConfig>());
+    if (config.alpha_real() != 1.0 || config.alpha_imag() != 0.0 ||
+        (config.beta() != 0.0 && config.beta() != 1.0)) {
+      return std::nullopt;
+    }
+    bool has_bias = false;
+    std::optional<GemmPostOp> activation;
+    switch (config.epilogue()) {
+      case GemmBackendConfig::DEFAULT:
+        break;
+      case GemmBackendConfig::BIAS:
+        has_bias = true;
+        break;
+      case GemmBackendConfig::RELU:
+        activation = GemmPostOp::kReLU;
+        break;
+      case GemmBackendConfig::BIAS_RELU:
+        has_bias = true;
+        activation = GemmPostOp::kReLU;
+        break;
+      case GemmBackendConfig::GELU:
+        activation = GemmPostOp::kGELU;
+        break;
+      case GemmBackendConfig::BIAS_GELU:
+        has_bias = true;
+        activation = GemmPostOp::kGELU;
+        break;
+      default:
+        return std::nullopt;
+    }
+
+    // cublasLt operands are a, b, then c if beta is non-zero, then the bias.
+    HloInstruction* c = nullptr;
+    if (config.beta() != 0.0) {
+      c = gemm->mutable_operand(2);
+      if (!ShapeUtil::Equal(c->shape(), gemm->shape())) {
+        return std::nullopt;
+      }
+    }
+    if (has_bias) {
+      chain.post_ops.push_back(GemmPostOp::kBias);
+      chain.operands.push_back(gemm->mutable_operand(c != nullptr ? 3 : 2));
+    }
+    if (c != nullptr) {
+      chain.post_ops.push_back(GemmPostOp::kResidualAdd);
+      chain.operands.push_back(c);
+    }
+    if (activation.has_value()) {
+      chain.post_ops.push_back(*activation);
+    }
+    return chain;
+  }
+
+  // Replaces `instr`, which applies `post_op` to the result of `gemm`, with a
+  // GEMM with post-ops. `operand` is the operand of `post_op`, if it has one.
+  // Returns whether it did.
+  StatusOr<bool> FuseGemmPostOp(HloInstruction* instr, HloInstruction* gemm,
+                                GemmPostOp post_op,
+                                HloInstruction* operand = nullptr) {
+    if (!ShapeUtil::Equal(instr->shape(), gemm->shape())) {
+      return false;
+    }
+    // Residuals are read with the output layout.
+    if (operand != nullptr &&
+        !ShapeUtil::Equal(operand->shape(), gemm->shape())) {
+      return false;
+    }
+    TF_ASSIGN_OR_RETURN(std::optional<GemmPostOpChain> chain,
+                        GetGemmPostOpChain(gemm));
+    if (!chain.has_value() || chain->post_ops.size() >= kMaxGemmPostOps) {
+      return false;
+    }
+    chain->post_ops.push_back(post_op);
+    if (operand != nullptr) {
+      chain->operands.push_back(operand);
+    }
+
+    TF_ASSIGN_OR_RETURN(auto config, gemm->backend_config<GemmBackendConfig>());
+    config.set_alpha_real(1.0);
+    config.set_alpha_imag(0.0);
+    config.set_beta(0.0);
+    config.set_epilogue(GemmBackendConfig::DEFAULT);
+
+    std::vector<HloInstruction*> operands = {gemm->mutable_operand(0),
+                                             gemm->mutable_operand(1)};
+    absl::c_copy(chain->operands, std::back_inserter(operands));
+    HloInstruction* fused = instr->AddInstruction(
+        HloInstruction::CreateCustomCall(
+            gemm->shape(), operands,
+            GemmWithPostOpsCallTarget(chain->post_ops)));
+    TF_RETURN_IF_ERROR(fused->set_backend_config(config));
+    instr->GetModule()->SetAndUniquifyInstrName(fused, "gemm-with-post-ops");
+    TF_RETURN_IF_ERROR(ReplaceInstruction(instr, fused));
+    return true;
+  }
+
  private:
   se::CudaComputeCapability cuda_compute_capability_;
 
@@ -17,8 +17,12 @@ limitations under the License.
 
 #include "xla/service/gpu/gemm_thunk.h"
 
+#include <memory>
 #include <utility>
+#include <vector>
 
+#include "absl/functional/function_ref.h"
+#include "tsl/platform/errors.h"
 #include "tsl/platform/logging.h"
 #include "xla/service/gpu/matmul_utils.h"
 #include "xla/service/gpu/onednn_matmul_utils.h"
@@ -29,6 +33,26 @@ limitations under the License.
 
 namespace xla {
 namespace gpu {
+namespace {
+
+// Calls `run_gemm` with the primitive of the device of `stream` in
+// `primitives`, and remembers the primitive it resolves.
+Status RunWithPrimitives(
+    se::Stream* stream, GemmPrimitives& primitives,
+    absl::FunctionRef<Status(std::shared_ptr<const OneDnnMatMulPrimitive>*)>
+        run_gemm) {
+  se::StreamExecutor* executor = stream->parent();
+  std::shared_ptr<const OneDnnMatMulPrimitive> primitive =
+      primitives.Get(executor);
+  bool resolved = primitive != nullptr;
+  TF_RETURN_IF_ERROR(run_gemm(&primitive));
+  if (!resolved && primitive != nullptr) {
+    primitives.Set(executor, std::move(primitive));
+  }
+  return OkStatus();
+}
+
+}  // namespace
 
 GemmThunk::GemmThunk(ThunkInfo thunk_info, GemmConfig config,
                      const BufferAllocation::Slice& lhs_buffer,
@@ -57,8 +81,13 @@ Status GemmThunk::ExecuteOnStream(const ExecuteParams& params) {
       buffer_allocations.memory_allocator());
 
   VLOG(3) << "Running GEMM thunk";
-  return RunGemm(config_, lhs_data, rhs_data, add_data, output_data, bias_data,
-                 params.stream, &scratch_allocator);
+  return RunWithPrimitives(
+      params.stream, primitives_,
+      [&](std::shared_ptr<const OneDnnMatMulPrimitive>* primitive) {
+        return RunGemm(config_, lhs_data, rhs_data, add_data, output_data,
+                       bias_data, params.stream, &scratch_allocator,
+                       primitive);
+      });
 }
 
 CublasLtMatmulThunk::CublasLtMatmulThunk(
@@ -102,14 +131,124 @@ Status CublasLtMatmulThunk::ExecuteOnStream(const ExecuteParams& params) {
     d = allocs.GetDeviceAddress(d_buffer_);
   }
 
-  se::DeviceMemoryBase bias, a_scale, b_scale, c_scale, d_scale, d_amax;
+  se::DeviceMemoryBase bias;
   if (bias_buffer_.allocation() != nullptr) {
     bias = allocs.GetDeviceAddress(bias_buffer_);
   }
 
   se::OwningScratchAllocator<> scratch_allocator(allocs.device_ordinal(),
                                                  allocs.memory_allocator());
-  return RunGemm(config_, a, b, c, d, bias, params.stream, &scratch_allocator);
+  // FP8 GEMMs always have A and B scales. The C scale is always one, as C is
+  // never an FP8 type.
+  if (a_scale_buffer_.allocation() != nullptr) {
+    Fp8GemmScales scales;
+    scales.a_scale = allocs.GetDeviceAddress(a_scale_buffer_);
+    scales.b_scale = allocs.GetDeviceAddress(b_scale_buffer_);
+    scales.d_scale = allocs.GetDeviceAddress(d_scale_buffer_);
+    if (d_amax_buffer_.allocation() != nullptr) {
+      scales.d_amax = allocs.GetDeviceAddress(d_amax_buffer_);
+    }
+    return RunWithPrimitives(
+        params.stream, primitives_,
+        [&](std::shared_ptr<const OneDnnMatMulPrimitive>* primitive) {
+          return RunFp8Gemm(config_, a, b, c, d, bias, scales, params.stream,
+                            &scratch_allocator, primitive);
+        });
+  }
+  return RunWithPrimitives(
+      params.stream, primitives_,
+      [&](std::shared_ptr<const OneDnnMatMulPrimitive>* primitive) {
+        return RunGemm(config_, a, b, c, d, bias, params.stream,
+                       &scratch_allocator, primitive);
+      });
+}
+
+WeightOnlyGemmThunk::WeightOnlyGemmThunk(
+    ThunkInfo thunk_info, WeightOnlyGemmConfig config,
+    BufferAllocation::Slice lhs_buffer, BufferAllocation::Slice rhs_buffer,
+    BufferAllocation::Slice scales_buffer,
+    BufferAllocation::Slice zero_points_buffer,
+    BufferAllocation::Slice output_buffer)
+    : Thunk(Kind::kGemm, thunk_info),
+      config_(std::move(config)),
+      lhs_buffer_(lhs_buffer),
+      rhs_buffer_(rhs_buffer),
+      scales_buffer_(scales_buffer),
+      zero_points_buffer_(zero_points_buffer),
+      output_buffer_(output_buffer) {}
+
+Status WeightOnlyGemmThunk::ExecuteOnStream(const ExecuteParams& params) {
+  VLOG(3) << "Running weight-only GEMM thunk";
+  const BufferAllocations& allocs = *params.buffer_allocations;
+  se::DeviceMemoryBase zero_points;
+  if (zero_points_buffer_.allocation() != nullptr) {
+    zero_points = allocs.GetDeviceAddress(zero_points_buffer_);
+  }
+  se::OwningScratchAllocator<> scratch_allocator(allocs.device_ordinal(),
+                                                 allocs.memory_allocator());
+  return RunWeightOnlyGemm(config_, allocs.GetDeviceAddress(lhs_buffer_),
+                           allocs.GetDeviceAddress(rhs_buffer_),
+                           allocs.GetDeviceAddress(scales_buffer_),
+                           zero_points, allocs.GetDeviceAddress(output_buffer_),
+                           params.stream, &scratch_allocator);
+}
+
+GroupedGemmThunk::GroupedGemmThunk(ThunkInfo thunk_info,
+                                   GroupedGemmConfig config,
+                                   BufferAllocation::Slice lhs_buffer,
+                                   BufferAllocation::Slice rhs_buffer,
+                                   BufferAllocation::Slice group_offsets_buffer,
+                                   BufferAllocation::Slice output_buffer)
+    : Thunk(Kind::kGemm, thunk_info),
+      config_(std::move(config)),
+      lhs_buffer_(lhs_buffer),
+      rhs_buffer_(rhs_buffer),
+      group_offsets_buffer_(group_offsets_buffer),
+      output_buffer_(output_buffer) {}
+
+Status GroupedGemmThunk::ExecuteOnStream(const ExecuteParams& params) {
+  VLOG(3) << "Running grouped GEMM thunk";
+  const BufferAllocations& allocs = *params.buffer_allocations;
+  return RunGroupedGemm(config_, allocs.GetDeviceAddress(lhs_buffer_),
+                        allocs.GetDeviceAddress(rhs_buffer_),
+                        allocs.GetDeviceAddress(group_offsets_buffer_),
+                        allocs.GetDeviceAddress(output_buffer_),
+                        params.stream);
+}
+
+GemmWithPostOpsThunk::GemmWithPostOpsThunk(
+    ThunkInfo thunk_info, GemmConfig config, std::vector<GemmPostOp> post_ops,
+    BufferAllocation::Slice lhs_buffer, BufferAllocation::Slice rhs_buffer,
+    std::vector<BufferAllocation::Slice> post_op_buffers,
+    BufferAllocation::Slice output_buffer)
+    : Thunk(Kind::kGemm, thunk_info),
+      config_(std::move(config)),
+      post_ops_(std::move(post_ops)),
+      lhs_buffer_(lhs_buffer),
+      rhs_buffer_(rhs_buffer),
+      post_op_buffers_(std::move(post_op_buffers)),
+      output_buffer_(output_buffer) {}
+
+Status GemmWithPostOpsThunk::ExecuteOnStream(const ExecuteParams& params) {
+  VLOG(3) << "Running GEMM with post-ops thunk";
+  const BufferAllocations& allocs = *params.buffer_allocations;
+  std::vector<se::DeviceMemoryBase> post_op_data;
+  post_op_data.reserve(post_op_buffers_.size());
+  for (const BufferAllocation::Slice& slice : post_op_buffers_) {
+    post_op_data.push_back(allocs.GetDeviceAddress(slice));
+  }
+
+  se::OwningScratchAllocator<> scratch_allocator(allocs.device_ordinal(),
+                                                 allocs.memory_allocator());
+  return RunWithPrimitives(
+      params.stream, primitives_,
+      [&](std::shared_ptr<const OneDnnMatMulPrimitive>* primitive) {
+        return RunGemmWithPostOps(
+            config_, allocs.GetDeviceAddress(lhs_buffer_),
+            allocs.GetDeviceAddress(rhs_buffer_),
+            allocs.GetDeviceAddress(output_buffer_), post_ops_, post_op_data,
+            params.stream, &scratch_allocator, primitive);
+      });
 }
 
 }  // namespace gpu
@@ -18,14 +18,47 @@ limitations under the License.
 #ifndef XLA_SERVICE_GPU_GEMM_THUNK_H_
 #define XLA_SERVICE_GPU_GEMM_THUNK_H_
 
+#include <memory>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
 #include "xla/service/buffer_assignment.h"
+#include "xla/service/gpu/gemm_post_ops.h"
 #include "xla/service/gpu/matmul_utils.h"
+#include "xla/service/gpu/onednn_matmul_utils.h"
 #include "xla/service/gpu/thunk.h"
 #include "xla/status.h"
+#include "xla/stream_executor/stream_executor.h"
 
 namespace xla {
 namespace gpu {
 
+// The oneDNN primitive of a GEMM thunk per device. It is resolved through the
+// process-wide primitive cache on the first run on a device, so later runs
+// skip building the cache key and the lookup.
+class GemmPrimitives {
+ public:
+  std::shared_ptr<const OneDnnMatMulPrimitive> Get(
+      se::StreamExecutor* executor) {
+    absl::MutexLock lock(&mu_);
+    auto it = primitives_.find(executor);
+    return it == primitives_.end() ? nullptr : it->second;
+  }
+
+  void Set(se::StreamExecutor* executor,
+           std::shared_ptr<const OneDnnMatMulPrimitive> primitive) {
+    absl::MutexLock lock(&mu_);
+    primitives_[executor] = std::move(primitive);
+  }
+
+ private:
+  absl::Mutex mu_;
+  absl::flat_hash_map<se::StreamExecutor*,
+                      std::shared_ptr<const OneDnnMatMulPrimitive>>
+      primitives_ ABSL_GUARDED_BY(mu_);
+};
+
 // This is thread-compatible.
 class GemmThunk : public Thunk {
  public:
@@ -46,6 +79,7 @@ class GemmThunk : public Thunk {
   const BufferAllocation::Slice lhs_buffer_;
   const BufferAllocation::Slice rhs_buffer_;
   const BufferAllocation::Slice output_buffer_;
+  GemmPrimitives primitives_;
 };
 
 class CublasLtMatmulThunk : public Thunk {
@@ -80,9 +114,83 @@ class CublasLtMatmulThunk : public Thunk {
   BufferAllocation::Slice c_scale_buffer_;
   BufferAllocation::Slice d_scale_buffer_;
   BufferAllocation::Slice d_amax_buffer_;
+  GemmPrimitives primitives_;
   // std::optional<se::cuda::BlasLt::MatmulAlgorithm> algorithm_;
 };
 
+// Runs a kXetlaWeightOnlyGemmCallTarget custom call. Separate from GemmThunk
+// because of the scales and zero points operands, see RunWeightOnlyGemm.
+class WeightOnlyGemmThunk : public Thunk {
+ public:
+  WeightOnlyGemmThunk(ThunkInfo thunk_info, WeightOnlyGemmConfig config,
+                      BufferAllocation::Slice lhs_buffer,
+                      BufferAllocation::Slice rhs_buffer,
+                      BufferAllocation::Slice scales_buffer,
+                      BufferAllocation::Slice zero_points_buffer,
+                      BufferAllocation::Slice output_buffer);
+
+  WeightOnlyGemmThunk(const WeightOnlyGemmThunk&) = delete;
+  WeightOnlyGemmThunk& operator=(const WeightOnlyGemmThunk&) = delete;
+
+  Status ExecuteOnStream(const ExecuteParams& params) override;
+
+ private:
+  const WeightOnlyGemmConfig config_;
+  const BufferAllocation::Slice lhs_buffer_;
+  const BufferAllocation::Slice rhs_buffer_;
+  const BufferAllocation::Slice scales_buffer_;
+  const BufferAllocation::Slice zero_points_buffer_;  // may be null
+  const BufferAllocation::Slice output_buffer_;
+};
+
+// Runs a kXetlaGroupedGemmCallTarget custom call.
+class GroupedGemmThunk : public Thunk {
+ public:
+  GroupedGemmThunk(ThunkInfo thunk_info, GroupedGemmConfig config,
+                   BufferAllocation::Slice lhs_buffer,
+                   BufferAllocation::Slice rhs_buffer,
+                   BufferAllocation::Slice group_offsets_buffer,
+                   BufferAllocation::Slice output_buffer);
+
+  GroupedGemmThunk(const GroupedGemmThunk&) = delete;
+  GroupedGemmThunk& operator=(const GroupedGemmThunk&) = delete;
+
+  Status ExecuteOnStream(const ExecuteParams& params) override;
+
+ private:
+  const GroupedGemmConfig config_;
+  const BufferAllocation::Slice lhs_buffer_;
+  const BufferAllocation::Slice rhs_buffer_;
+  const BufferAllocation::Slice group_offsets_buffer_;
+  const BufferAllocation::Slice output_buffer_;
+};
+
+// Runs a GEMM with post-ops, see kGemmWithPostOpsCallTargetPrefix.
+class GemmWithPostOpsThunk : public Thunk {
+ public:
+  GemmWithPostOpsThunk(ThunkInfo thunk_info, GemmConfig config,
+                       std::vector<GemmPostOp> post_ops,
+                       BufferAllocation::Slice lhs_buffer,
+                       BufferAllocation::Slice rhs_buffer,
+                       std::vector<BufferAllocation::Slice> post_op_buffers,
+                       BufferAllocation::Slice output_buffer);
+
+  GemmWithPostOpsThunk(const GemmWithPostOpsThunk&) = delete;
+  GemmWithPostOpsThunk& operator=(const GemmWithPostOpsThunk&) = delete;
+
+  Status ExecuteOnStream(const ExecuteParams& params) override;
+
+ private:
+  const GemmConfig config_;
+  const std::vector<GemmPostOp> post_ops_;
+  const BufferAllocation::Slice lhs_buffer_;
+  const BufferAllocation::Slice rhs_buffer_;
+  // One per post-op with an operand, in chain order.
+  const std::vector<BufferAllocation::Slice> post_op_buffers_;
+  const BufferAllocation::Slice output_buffer_;
+  GemmPrimitives primitives_;
+};
+
 }  // namespace gpu
 }  // namespace xla
 
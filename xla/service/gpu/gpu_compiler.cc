@@ -99,7 +99,9 @@ limitations under the License.
 #include "xla/service/gather_simplifier.h"
 #include "xla/service/gpu/alias_passthrough_params.h"
 #include "xla/service/gpu/all_reduce_blueconnect.h"
+#include "xla/service/gpu/collective_matmul_decomposer.h"
 #include "xla/service/gpu/compile_module_to_llvm_ir.h"
+#include "xla/service/gpu/compile_profile.h"
 #include "xla/service/gpu/conditional_thunk.h"
 #include "xla/service/gpu/conv_layout_normalization.h"
 #include "xla/service/gpu/copy_fusion.h"
@@ -116,7 +118,6 @@ limitations under the License.
 #include "xla/service/gpu/gpu_device_info.h"
 #include "xla/service/gpu/gpu_executable.h"
 #include "xla/service/gpu/gpu_hlo_cost_analysis.h"
-#include "xla/service/gpu/gpu_hlo_schedule.h"
 #include "xla/service/gpu/gpu_layout_assignment.h"
 #include "xla/service/gpu/gpu_reduce_scatter_creator.h"
 #include "xla/service/gpu/gpu_sanitize_constant_names.h"
@@ -145,6 +146,7 @@ limitations under the License.
 #include "xla/service/gpu/tree_reduction_rewriter.h"
 #include "xla/service/gpu/variadic_op_splitter.h"
 #include "xla/service/gpu/while_thunk.h"
+#include "xla/service/gpu/xpu_hlo_schedule.h"
 #include "xla/service/hlo_computation_deduplicator.h"
 #include "xla/service/hlo_constant_folding.h"
 #include "xla/service/hlo_cse.h"
@@ -359,7 +361,8 @@ Status GpuCompiler::OptimizeHloModule(
   // SYCL: Conv swap has accuracy issue in some cases.
   layout_insensitive_algsimp_opts.set_enable_conv_operand_swap(false);
 
-  HloPassPipeline pre_spmd_pipeline("pre-spmd-partitioner");
+  HloPassPipeline pre_spmd_pipeline("pre-spmd-partitioner",
+                                    CompileProfile::StatsFor(hlo_module));
   // Run some IR cleanup passes before running the SPMD partitioning
   // passes.
   pre_spmd_pipeline.AddPass<CallInliner>();
@@ -384,7 +387,8 @@ Status GpuCompiler::OptimizeHloModule(
           "num_partitions=%d but SPMD partitioning not enabled.",
           num_partitions);
     }
-    HloPassPipeline spmd_pipeline("spmd-partitioner");
+    HloPassPipeline spmd_pipeline("spmd-partitioner",
+                                  CompileProfile::StatsFor(hlo_module));
     // Run some IR cleanup passes before running the SPMD partitioning
     // passes.
     spmd_pipeline.AddPass<CallInliner>();
@@ -425,7 +429,8 @@ Status GpuCompiler::OptimizeHloModule(
     spmd_pipeline.AddPass<CollectivePermuteMotion>();
     TF_RETURN_IF_ERROR(spmd_pipeline.Run(hlo_module).status());
   } else {
-    HloPassPipeline sharding_removal_pipeline("sharding-removal");
+    HloPassPipeline sharding_removal_pipeline(
+        "sharding-removal", CompileProfile::StatsFor(hlo_module));
     // Remove redundant sharding ops when partition_count == 1.
     sharding_removal_pipeline.AddPass<ShardingRemover>();
     sharding_removal_pipeline.AddPass<HloDCE>();
@@ -433,7 +438,8 @@ Status GpuCompiler::OptimizeHloModule(
   }
 
   {
-    HloPassPipeline pipeline("optimization");
+    HloPassPipeline pipeline("optimization",
+                             CompileProfile::StatsFor(hlo_module));
     AddHloVerifier(&pipeline);
     pipeline.AddPass<TopKSplitter>();
     pipeline.AddPass<TopkSpecializer>();
@@ -601,7 +607,8 @@ Status GpuCompiler::OptimizeHloModule(
   // Optimize collectives generated by SPMD partitioning. Enable these passes
   // otherwise as well so that all collectives can get these optimizations.
   {
-    HloPassPipeline collectives_pipeline("collective-optimizations");
+    HloPassPipeline collectives_pipeline("collective-optimizations",
+                                         CompileProfile::StatsFor(hlo_module));
     collectives_pipeline.AddPass<AllReduceFolder>();
     collectives_pipeline.AddPass<ReduceScatterCreator>();
     collectives_pipeline.AddPass<AllReduceReassociate>(
@@ -631,6 +638,11 @@ Status GpuCompiler::OptimizeHloModule(
 
     collectives_pipeline.AddPass<AllGatherBroadcastReorder>();
 
+    // Overlap the collectives of tensor-parallel dots with the dots. Runs after
+    // the simplification pipeline, whose DotMerger would merge the decomposed
+    // dots back together; HorizontalDotBatcher, which runs later, skips them.
+    collectives_pipeline.AddPass<CollectiveMatmulDecomposer>();
+
     // promote 16 bit integer all-reduce and reduce-scatter to 32-bit.
     const std::pair<PrimitiveType, PrimitiveType> ar_promoted_types[] = {
         {U16, U32}, {S16, S32}};
@@ -652,12 +664,12 @@ Status GpuCompiler::OptimizeHloModule(
     // HloPassPipeline also runs its invariant checker before any passes are
     // run, meaning, the pipeline that contains layout assignment cannot contain
     // a layout-sensitive verifier!
-    HloPassPipeline pipeline("layout assignment");
+    HloPassPipeline pipeline("layout assignment",
+                             CompileProfile::StatsFor(hlo_module));
+    // Canonicalizes dots to GEMMs where the device cost model favours it.
+    pipeline.AddPass<DotExpandDims>(gpu_target_config.gpu_device_info);
     // Layout assignment uses alias analysis, which requires the call graph to
     // be flattened.
-    bool llm_flag = false;
-    tsl::ReadBoolFromEnvVar("LLM", false, &llm_flag);
-    if (llm_flag) pipeline.AddPass<DotExpandDims>();
     pipeline.AddPass<FlattenCallGraph>();
     ChannelLayoutConstraints layout_constraints;
     pipeline.AddPass<GpuLayoutAssignment>(
@@ -674,7 +686,8 @@ Status GpuCompiler::OptimizeHloModule(
   const GpuDeviceInfo& gpu_device_info = gpu_target_config.gpu_device_info;
 
   {
-    HloPassFix<HloPassPipeline> fusion("fusion");
+    HloPassFix<HloPassPipeline> fusion("fusion",
+                                       CompileProfile::StatsFor(hlo_module));
     // We try to split variadic ops with many parameters into several such ops
     // to avoid exceeding the parameter space.
     fusion.AddPass<VariadicOpSplitter>();
@@ -708,7 +721,8 @@ Status GpuCompiler::OptimizeHloModule(
   }
 
   {
-    HloPassFix<HloPassPipeline> horizontal_fusion("horizontal fusion");
+    HloPassFix<HloPassPipeline> horizontal_fusion(
+        "horizontal fusion", CompileProfile::StatsFor(hlo_module));
     horizontal_fusion.AddPass<GpuHorizontalLoopFusion>();
     horizontal_fusion.AddPass<GpuHorizontalInputFusion>(gpu_device_info);
     horizontal_fusion.AddPass<HloCSE>(/*is_layout_sensitive=*/true,
@@ -724,7 +738,8 @@ Status GpuCompiler::OptimizeHloModule(
   }
 
   {
-    HloPassPipeline pipeline("post-fusion optimization");
+    HloPassPipeline pipeline("post-fusion optimization",
+                             CompileProfile::StatsFor(hlo_module));
     pipeline.AddPass<AllGatherCombiner>(
         debug_options.xla_gpu_all_gather_combine_threshold_bytes(),
         /*combine_threshold_count=*/256);
@@ -764,7 +779,8 @@ Status GpuCompiler::OptimizeHloModule(
           case HloOpcode::kAllGatherStart:
             return debug_options.xla_gpu_enable_async_all_gather();
           case HloOpcode::kCollectivePermuteStart:
-            return debug_options.xla_gpu_enable_async_collective_permute();
+            return debug_options.xla_gpu_enable_async_collective_permute() ||
+                   IsCollectiveMatmulEnabled();
           case HloOpcode::kAsyncStart: {
             auto async_inst = Cast<HloAsyncInstruction>(inst);
             switch (async_inst->async_wrapped_opcode()) {
@@ -811,7 +827,8 @@ Status GpuCompiler::PrepareHloModuleForIrEmitting(HloModule* hlo_module) {
   // assumed immutable at this point, and should not be reused for output
   // (b/27180329). Therefore, in that case, we set the output to be a copy of
   // the parameter.
-  HloPassPipeline pipeline("GPU-ir-emit-prepare");
+  HloPassPipeline pipeline("GPU-ir-emit-prepare",
+                           CompileProfile::StatsFor(hlo_module));
   AddHloVerifier(
       &pipeline,
       HloVerifierOpts{}.MakeLayoutSensitive().WithInstructionCanChangeLayout(
@@ -850,7 +867,8 @@ Status GpuCompiler::OptimizeHloPostLayoutAssignment(
   const DebugOptions& debug_options = hlo_module->config().debug_options();
 
   {
-    HloPassPipeline pipeline("hlo normalization");
+    HloPassPipeline pipeline("hlo normalization",
+                             CompileProfile::StatsFor(hlo_module));
 
     // The LayoutAssignment pass may leave behind kCopy instructions which are
     // duplicate or NOPs, so remove them with algebraic simplification and CSE.
@@ -898,7 +916,8 @@ Status GpuCompiler::OptimizeHloPostLayoutAssignment(
     TF_RETURN_IF_ERROR(pipeline.Run(hlo_module).status());
   }
 
-  HloPassPipeline pipeline("post-layout_assignment");
+  HloPassPipeline pipeline("post-layout_assignment",
+                           CompileProfile::StatsFor(hlo_module));
   AddHloVerifier(&pipeline,
                  HloVerifierOpts{}
                      .MakeLayoutSensitive()
@@ -953,6 +972,9 @@ StatusOr<std::unique_ptr<HloModule>> GpuCompiler::RunHloPasses(
       [&] { return absl::StrCat("HLO Transforms:", module->name()); },
       tsl::profiler::TraceMeLevel::kInfo);
 
+  std::shared_ptr<CompileProfile> profile =
+      CompileProfile::GetOrCreate(*module);
+
   GpuTargetConfig gpu_target_config = GetGpuTargetConfig(stream_exec);
   TF_RETURN_IF_ERROR(
       OptimizeHloModule(module.get(), stream_exec, options.device_allocator,
@@ -966,6 +988,9 @@ StatusOr<std::unique_ptr<HloModule>> GpuCompiler::RunHloPasses(
   // out we have no way of telling how far through the process we got).
   RecordHloPassesDuration(end_usecs - start_usecs);
 
+  // The report is rewritten with the backend stages by RunBackend.
+  if (profile) profile->Dump(*module);
+
   return std::move(module);
 }
 
@@ -980,6 +1005,8 @@ StatusOr<std::unique_ptr<HloModule>> GpuCompiler::RunHloPassesWithoutDevice(
   tsl::profiler::TraceMe activity(
       [&] { return absl::StrCat("HLO Transforms:", module->name()); },
       tsl::profiler::TraceMeLevel::kInfo);
+  std::shared_ptr<CompileProfile> profile =
+      CompileProfile::GetOrCreate(*module);
   TF_RETURN_IF_ERROR(OptimizeHloModule(module.get(), nullptr,
                                        options.device_allocator,
                                        gpu_target_config, &autotune_results));
@@ -992,6 +1019,8 @@ StatusOr<std::unique_ptr<HloModule>> GpuCompiler::RunHloPassesWithoutDevice(
   // out we have no way of telling how far through the process we got).
   RecordHloPassesDuration(end_usecs - start_usecs);
 
+  if (profile) profile->Dump(*module);
+
   return std::move(module);
 }
 
@@ -999,7 +1028,7 @@ StatusOr<std::unique_ptr<BufferAssignment>> GpuCompiler::AssignBuffers(
     HloModule* hlo_module, se::StreamExecutor* stream_exec) {
   const GpuDeviceInfo gpu_device_info = GetGpuDeviceInfo(stream_exec);
   TF_RETURN_IF_ERROR(
-      ScheduleGpuModule(hlo_module, pointer_size_, gpu_device_info));
+      ScheduleXpuModule(hlo_module, pointer_size_, gpu_device_info));
 
   auto buffer_size_bytes_function =
       [this](const BufferValue& buffer_value) -> int64_t {
@@ -1292,6 +1321,10 @@ StatusOr<std::unique_ptr<Executable>> GpuCompiler::RunBackend(
     }
   }
 
+  // Created here as well for modules that skipped RunHloPasses.
+  std::shared_ptr<CompileProfile> profile =
+      CompileProfile::GetOrCreate(*module);
+
   CompileModuleResults compile_module_results;
   TF_RETURN_IF_ERROR(CompileModuleToLlvmIrImpl(
       module.get(), &llvm_context, target_triple_, data_layout_,
@@ -1338,6 +1371,9 @@ StatusOr<std::unique_ptr<Executable>> GpuCompiler::RunBackend(
   std::shared_ptr<const BufferAssignment> buffer_assignment(
       std::move(compile_module_results.buffer_assignment));
 
+  // The executable keeps the profile to add the module load on first run.
+  CompileProfile::Release(*module);
+
   GpuVersion gpu_version = GetGpuVersion(stream_exec);
   TF_ASSIGN_OR_RETURN(
       auto gpu_executable,
@@ -1352,7 +1388,7 @@ StatusOr<std::unique_ptr<Executable>> GpuCompiler::RunBackend(
            std::move(compile_module_results.allocations),
            std::move(buffer_assignment_proto),
            [buffer_assignment] { return buffer_assignment->ToVerboseString(); },
-           std::move(module)}));
+           std::move(module), std::move(profile)}));
   if (embed_ir_in_executable) {
     DCHECK_NE("", ir_module_string_before_opt);
     gpu_executable->set_ir_module_string(ir_module_string_before_opt);
@@ -1365,6 +1401,7 @@ StatusOr<std::unique_ptr<Executable>> GpuCompiler::RunBackend(
   *hlo_proto->mutable_buffer_assignment() = buffer_assignment->ToProto();
   gpu_executable->set_hlo_proto(std::move(hlo_proto));
   gpu_executable->set_debug_info(buffer_assignment->GetStats().ToString());
+  gpu_executable->DumpCompileProfile();
   return static_cast<std::unique_ptr<Executable>>(std::move(gpu_executable));
 }
 
@@ -25,8 +25,7 @@ namespace gpu {
 Status RunGpuConv(const OneDnnConvPrimitive& onednn_primitive,
                   const GpuConvDescriptor& conv_descriptor,
                   absl::Span<const se::DeviceMemoryBase> operand_buffers,
-                  se::DeviceMemoryBase result_buffer,
-                  const Thunk::ExecuteParams& params) {
+                  se::DeviceMemoryBase result_buffer, se::Stream* stream) {
   void* input_data;
   void* filter_data;
   void* output_data;
@@ -65,19 +64,27 @@ Status RunGpuConv(const OneDnnConvPrimitive& onednn_primitive,
   onednn_primitive.filter_memory.set_data_handle(filter_data);
   onednn_primitive.dst_memory.set_data_handle(output_data);
   if (bias_data != nullptr) {
+    // See kOneDnnChannelScalesKnob.
+    if (onednn_primitive.channel_scales_memory) {
+      onednn_primitive.channel_scales_memory.set_data_handle(bias_data);
+      bias_data = static_cast<char*>(bias_data) +
+                  onednn_primitive.channel_scales_memory.get_desc().get_size();
+    }
     onednn_primitive.bias_memory.set_data_handle(bias_data);
   }
   try {
     if (conv_descriptor.kind == CudnnConvKind::kForward ||
         conv_descriptor.kind == CudnnConvKind::kForwardActivation) {
-      if (onednn_primitive.has_reorder) {
+      if (onednn_primitive.has_reorder &&
+          !onednn_primitive.filter_reorder_cached) {
         onednn_primitive.filter_reorder_primitive.execute(
             onednn_primitive.stream, onednn_primitive.reorder_args);
       }
       onednn_primitive.fwd_primitive.execute(
           onednn_primitive.stream, onednn_primitive.fwd_primitives_args);
     } else if (conv_descriptor.kind == CudnnConvKind::kBackwardInput) {
-      if (onednn_primitive.has_reorder) {
+      if (onednn_primitive.has_reorder &&
+          !onednn_primitive.filter_reorder_cached) {
         onednn_primitive.filter_reorder_primitive.execute(
             onednn_primitive.stream, onednn_primitive.reorder_args);
       }
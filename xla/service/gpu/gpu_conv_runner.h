@@ -41,6 +41,11 @@ typedef struct OneDnnConvPrimitive {
   dnnl::memory internal_filter_memory;
   dnnl::memory scratchpad_memory;
   dnnl::memory bias_memory;
+  // Set for convolutions with kOneDnnChannelScalesKnob.
+  dnnl::memory channel_scales_memory;
+  // Owned by oneDNN, filled in when the primitive is created.
+  dnnl::memory src_zero_point_memory;
+  dnnl::memory dst_zero_point_memory;
   dnnl::convolution_forward fwd_primitive;
   dnnl::convolution_backward_data bwd_input_primitive;
   dnnl::convolution_backward_weights bwd_filter_primitive;
@@ -55,6 +60,9 @@ typedef struct OneDnnConvPrimitive {
   dnnl::engine engine;
   dnnl::stream stream;
   bool has_reorder = false;
+  // internal_filter_memory already holds the reordered filter, so forward
+  // and backward-input convolutions skip filter_reorder_primitive.
+  bool filter_reorder_cached = false;
 } OneDnnConvPrimitive;
 
 struct GpuConvDescriptor {
@@ -70,12 +78,72 @@ struct GpuConvDescriptor {
   int64_t feature_group_count;
 };
 
-Status RunGpuConv(const OneDnnConvPrimitive& onednn_primitive,
+// Key in CudnnConvBackendConfig::algorithm().tuning_knobs() holding the
+// oneDNN filter format picked by the conv autotuner, one of the
+// OneDnnWeightFormat values.
+inline constexpr int64_t kOneDnnWeightFormatKnob = 0;
+
+enum OneDnnWeightFormat : int64_t {
+  // Same as kOneDnnWeightFormatAny.
+  kOneDnnWeightFormatDefault = 0,
+  // Let oneDNN pick a blocked filter layout and reorder into it.
+  kOneDnnWeightFormatAny = 1,
+  // Use the filter in its HLO layout.
+  kOneDnnWeightFormatPlain = 2,
+};
+
+// Keys in CudnnConvBackendConfig::algorithm().tuning_knobs() set to 1 by
+// OneDnnBlockedLayoutPropagation when the input or output activation of a
+// forward convolution is held in the oneDNN blocked format (nChw16c or
+// nCdhw16c) instead of the layout of its HLO shape.
+inline constexpr int64_t kOneDnnBlockedInputKnob = 1;
+inline constexpr int64_t kOneDnnBlockedOutputKnob = 2;
+
+// Channel block of that format. Only activations whose channel count it
+// divides are blocked, so that blocked and plain buffers have equal sizes.
+inline constexpr int64_t kOneDnnActivationBlockSize = 16;
+
+// Key in CudnnConvBackendConfig::algorithm().tuning_knobs() holding the
+// position of the oneDNN implementation picked by the conv autotuner among
+// those primitive_desc::next_impl visits. Absent means the first one, which
+// oneDNN ranks best.
+inline constexpr int64_t kOneDnnImplementationKnob = 3;
+
+// Key in CudnnConvBackendConfig::algorithm().tuning_knobs() holding the
+// activation OnednnFusedConvRewriter fused into a forward convolution when
+// se::dnn::ActivationMode has no value for it, one of the OneDnnActivation
+// values. activation_mode() is kNone then.
+inline constexpr int64_t kOneDnnActivationKnob = 4;
+
+enum OneDnnActivation : int64_t {
+  kOneDnnActivationNone = 0,
+  kOneDnnActivationSiLU = 1,  // x * sigmoid(x).
+  kOneDnnActivationHardSwish = 2,
+  kOneDnnActivationGELU = 3,  // tanh approximation.
+  kOneDnnActivationGELUErf = 4,
+  // Bounds held in kOneDnnClampLowKnob and kOneDnnClampHighKnob.
+  kOneDnnActivationClamp = 5,
+};
 
+// Bit patterns of the float bounds of kOneDnnActivationClamp.
+inline constexpr int64_t kOneDnnClampLowKnob = 5;
+inline constexpr int64_t kOneDnnClampHighKnob = 6;
+
+// Key in CudnnConvBackendConfig::algorithm().tuning_knobs() set to 1 by
+// OnednnQuantizedConvRewriter on the integer convolutions it creates. Their
+// f32 bias operand then holds two values per output feature: first the scale
+// of the integer accumulator, then the bias added after scaling it.
+inline constexpr int64_t kOneDnnChannelScalesKnob = 7;
+
+// Zero points of the u8 or s8 input and output of those convolutions. Absent
+// means 0.
+inline constexpr int64_t kOneDnnSrcZeroPointKnob = 8;
+inline constexpr int64_t kOneDnnDstZeroPointKnob = 9;
+
+Status RunGpuConv(const OneDnnConvPrimitive& onednn_primitive,
                   const GpuConvDescriptor& conv_descriptor,
                   absl::Span<const se::DeviceMemoryBase> operand_buffers,
-                  se::DeviceMemoryBase result_buffer,
-                  const Thunk::ExecuteParams& params);
+                  se::DeviceMemoryBase result_buffer, se::Stream* stream);
 
 }  // namespace gpu
 }  // namespace xla
@@ -45,11 +45,13 @@ limitations under the License.
 #include "xla/hlo/ir/hlo_instruction.h"
 #include "xla/map_util.h"
 #include "xla/service/gpu/buffer_allocations.h"
+#include "xla/service/gpu/compile_profile.h"
 #include "xla/service/gpu/gpu_constants.h"
 #include "xla/service/gpu/gpu_executable_run_options.h"
 #include "xla/service/gpu/gpu_types.h"
 #include "xla/service/gpu/non_atomically_upgradeable_rw_lock.h"
 #include "xla/service/gpu/stream_executor_util.h"
+#include "xla/service/gpu/sycl_graph_runner.h"
 #include "xla/service/hlo_parser.h"
 #include "xla/service/llvm_ir/buffer_assignment_util.h"
 #include "xla/service/logical_buffer.h"
@@ -122,13 +124,20 @@ GpuExecutable::GpuExecutable(GpuExecutable::Params params)
       verbose_buffer_assignment_string_dumper_(
           params.verbose_buffer_assignment_string_dumper),
       constants_(std::move(params.constants)),
-      output_info_(std::move(params.output_info)) {
+      output_info_(std::move(params.output_info)),
+      compile_profile_(std::move(params.compile_profile)) {
   if (has_module()) {
     XlaDebugInfoManager::Get()->RegisterModule(
         module().unique_id(), shared_module(), debug_buffer_assignment_);
   }
 }
 
+void GpuExecutable::DumpCompileProfile() const {
+  if (compile_profile_ != nullptr && has_module()) {
+    compile_profile_->Dump(module());
+  }
+}
+
 GpuExecutable::~GpuExecutable() {
   if (has_module()) {
     XlaDebugInfoManager::Get()->UnregisterModule(module().unique_id());
@@ -173,7 +182,8 @@ Status ExecuteThunks(const std::string& module_name, ModuleIdentifier module_id,
                      const ThunkSequence& thunk_sequence,
                      const ServiceExecutableRunOptions* run_options,
                      const BufferAllocations& buffer_allocations,
-                     bool block_host_until_done) {
+                     bool block_host_until_done,
+                     SyclGraphRunner* graph_runner) {
   se::Stream* main_stream = run_options->stream();
   se::StreamExecutor* executor = main_stream->parent();
 
@@ -195,19 +205,27 @@ Status ExecuteThunks(const std::string& module_name, ModuleIdentifier module_id,
                            module_id_str);
   });
 
-  for (const std::unique_ptr<Thunk>& thunk : thunk_sequence) {
+  Thunk::ExecuteParams thunk_params{
+      *run_options, buffer_allocations, main_stream,
+      async_comms_stream.ok() ? async_comms_stream->get() : nullptr};
+
+  auto execute_thunk = [&](Thunk& thunk) -> Status {
     // Annotate execution of this op if tracing was enabled when we started
     // running this module.  If tracing is enabled *while* we're running the
     // module, we won't get any data, but that's probably an OK trade-off.
-    ScopedAnnotation annotation([&] { return thunk->profile_annotation(); });
-    VLOG(2) << "Executing the thunk for " << thunk->profile_annotation();
-    TF_RET_CHECK(async_comms_stream.ok() || !NeedsAsyncCommsStream(*thunk))
+    ScopedAnnotation annotation([&] { return thunk.profile_annotation(); });
+    VLOG(2) << "Executing the thunk for " << thunk.profile_annotation();
+    TF_RET_CHECK(async_comms_stream.ok() || !NeedsAsyncCommsStream(thunk))
         << "`run_options` must have a stream borrower for async thunks.";
+    return thunk.ExecuteOnStream(thunk_params);
+  };
 
-    Thunk::ExecuteParams thunk_params{
-        *run_options, buffer_allocations, main_stream,
-        async_comms_stream.ok() ? async_comms_stream->get() : nullptr};
-    TF_RETURN_IF_ERROR(thunk->ExecuteOnStream(thunk_params));
+  if (graph_runner != nullptr) {
+    TF_RETURN_IF_ERROR(graph_runner->Execute(thunk_params, execute_thunk));
+  } else {
+    for (const std::unique_ptr<Thunk>& thunk : thunk_sequence) {
+      TF_RETURN_IF_ERROR(execute_thunk(*thunk));
+    }
   }
   return MaybeSyncAndProfile(run_options, start_nanos,
                              block_host_until_done ? main_stream : nullptr);
@@ -268,7 +286,11 @@ GpuExecutable::ResolveConstantGlobals(se::Stream* stream) {
   // just as they should for an empty module.
   // SYCL: Always load module for spirv
   if (module_spec.has_cuda_cubin_in_memory()) {
-    TF_RETURN_IF_ERROR(executor->LoadModule(module_spec, &module_handle));
+    {
+      CompileProfile::ScopedStage stage(compile_profile_.get(), "module-load");
+      TF_RETURN_IF_ERROR(executor->LoadModule(module_spec, &module_handle));
+    }
+    DumpCompileProfile();
   }
 
   // A flag signalling if constant initialization submitted memcpy operations
@@ -660,8 +682,17 @@ Status GpuExecutable::ExecuteThunksOrXlaRuntime(
       TF_RETURN_IF_ERROR(thunk->Initialize(*this, executor));
     }
 
+    SyclGraphRunner* graph_runner = nullptr;
+    if (SyclGraphRunner::Enabled()) {
+      absl::call_once(graph_runner_once_, [&] {
+        graph_runner_ = std::make_unique<SyclGraphRunner>(*thunks_);
+      });
+      graph_runner = graph_runner_.get();
+    }
+
     return ExecuteThunks(module_name_, unique_id, *thunks_, run_options,
-                         buffer_allocations, block_host_until_done);
+                         buffer_allocations, block_host_until_done,
+                         graph_runner);
   }
 
   /*
@@ -28,6 +28,7 @@ limitations under the License.
 #include <variant>
 #include <vector>
 
+#include "absl/base/call_once.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/strings/string_view.h"
 #include "absl/types/span.h"
@@ -37,8 +38,10 @@ limitations under the License.
 #include "xla/service/buffer_assignment.h"
 #include "xla/service/executable.h"
 #include "xla/service/gpu/buffer_allocations.h"
+#include "xla/service/gpu/compile_profile.h"
 #include "xla/service/gpu/gpu_types.h"
 #include "xla/service/gpu/non_atomically_upgradeable_rw_lock.h"
+#include "xla/service/gpu/sycl_graph_runner.h"
 #include "xla/service/gpu/thunk.h"
 #include "xla/service/hlo_execution_profile.h"
 #include "xla/service/shaped_buffer.h"
@@ -120,6 +123,9 @@ class GpuExecutable : public Executable {
     };
 
     std::unique_ptr<HloModule> debug_module = nullptr;
+
+    // Compile-time profile, extended with the module load on first run.
+    std::shared_ptr<CompileProfile> compile_profile = nullptr;
   };
 
   // Analyze the entry function to construct buffer allocation and other output
@@ -201,6 +207,9 @@ class GpuExecutable : public Executable {
 
   const std::vector<ConstantInfo>& constants() const { return constants_; }
 
+  // Writes the compile profile report, if profiling is enabled.
+  void DumpCompileProfile() const;
+
   xla::EntryFunctionAttributes entry_func_attrs() const {
     return entry_func_attrs_;
   }
@@ -312,6 +321,12 @@ class GpuExecutable : public Executable {
   // potentially shared with other executables.
   std::vector<std::shared_ptr<se::DeviceMemoryBase>> shared_constants_;
 
+  std::shared_ptr<CompileProfile> compile_profile_;
+
+  // Submits runs of device-only thunks as SYCL graphs, see SyclGraphRunner.
+  absl::once_flag graph_runner_once_;
+  std::unique_ptr<SyclGraphRunner> graph_runner_;
+
   GpuExecutable(const GpuExecutable&) = delete;
   GpuExecutable& operator=(const GpuExecutable&) = delete;
 };
@@ -0,0 +1,457 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/service/gpu/grouped_gemm_rewriter.h"
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/types/span.h"
+#include "tsl/platform/errors.h"
+#include "tsl/platform/logging.h"
+#include "tsl/platform/statusor.h"
+#include "xla/hlo/ir/hlo_computation.h"
+#include "xla/hlo/ir/hlo_casting_utils.h"
+#include "xla/hlo/ir/hlo_instruction.h"
+#include "xla/hlo/ir/hlo_instructions.h"
+#include "xla/hlo/ir/hlo_opcode.h"
+#include "xla/layout_util.h"
+#include "xla/primitive_util.h"
+#include "xla/service/gpu/xetla/gemm/grouped_gemm.h"
+#include "xla/service/hlo_creation_utils.h"
+#include "xla/service/pattern_matcher.h"
+#include "xla/shape_util.h"
+#include "xla/statusor.h"
+#include "xla/stream_executor/sycl/hw_info.h"
+#include "xla/xla_data.pb.h"
+
+namespace xla {
+namespace gpu {
+
+const absl::string_view kXetlaGroupedGemmCallTarget = "__xetla$gemm$grouped";
+
+bool IsXetlaGroupedGemm(const HloInstruction& hlo) {
+  return hlo.opcode() == HloOpcode::kCustomCall &&
+         hlo.custom_call_target() == kXetlaGroupedGemmCallTarget;
+}
+
+namespace {
+
+namespace m = match;
+
+template <typename Dims>
+bool DimsAre(const Dims& dims, absl::Span<const int64_t> expected) {
+  return absl::c_equal(dims, expected);
+}
+
+// The dot of one expert: rows [row_start, row_start + rows) of `tokens`
+// times weights[expert].
+struct GroupDot {
+  HloInstruction* tokens;
+  int64_t row_start;
+  int64_t rows;
+  HloInstruction* weights;
+  int64_t expert;
+};
+
+bool IsDenseSlice(const HloInstruction* slice) {
+  for (int64_t stride : slice->slice_strides()) {
+    if (stride != 1) return false;
+  }
+  return true;
+}
+
+// Matches dot(slice(tokens), reshape(slice(weights))), where the lhs slice
+// takes whole rows of the [m, k] tokens and the rhs slice one [k, n] matrix
+// of the [experts, k, n] weights.
+std::optional<GroupDot> MatchGroupDot(HloInstruction* dot) {
+  if (dot->opcode() != HloOpcode::kDot || dot->shape().rank() != 2) {
+    return std::nullopt;
+  }
+  const DotDimensionNumbers& dnums = dot->dot_dimension_numbers();
+  if (dnums.lhs_batch_dimensions_size() != 0 ||
+      dnums.lhs_contracting_dimensions_size() != 1 ||
+      dnums.lhs_contracting_dimensions(0) != 1 ||
+      dnums.rhs_contracting_dimensions_size() != 1 ||
+      dnums.rhs_contracting_dimensions(0) != 0) {
+    return std::nullopt;
+  }
+  HloInstruction* lhs = dot->mutable_operand(0);
+  HloInstruction* rhs = dot->mutable_operand(1);
+  PrimitiveType dtype = dot->shape().element_type();
+  if (lhs->shape().element_type() != dtype ||
+      rhs->shape().element_type() != dtype) {
+    return std::nullopt;
+  }
+
+  if (lhs->opcode() != HloOpcode::kSlice || !IsDenseSlice(lhs)) {
+    return std::nullopt;
+  }
+  HloInstruction* tokens = lhs->mutable_operand(0);
+  if (lhs->slice_starts(1) != 0 ||
+      lhs->slice_limits(1) != tokens->shape().dimensions(1)) {
+    return std::nullopt;
+  }
+
+  if (rhs->opcode() != HloOpcode::kReshape ||
+      rhs->operand(0)->opcode() != HloOpcode::kSlice) {
+    return std::nullopt;
+  }
+  HloInstruction* expert_slice = rhs->mutable_operand(0);
+  HloInstruction* weights = expert_slice->mutable_operand(0);
+  const Shape& weights_shape = weights->shape();
+  if (weights_shape.rank() != 3 || !IsDenseSlice(expert_slice) ||
+      expert_slice->slice_limits(0) - expert_slice->slice_starts(0) != 1 ||
+      !ShapeUtil::SameDimensions(
+          rhs->shape(), ShapeUtil::DeleteDimension(0, weights_shape))) {
+    return std::nullopt;
+  }
+  for (int64_t i = 1; i < 3; ++i) {
+    if (expert_slice->slice_starts(i) != 0 ||
+        expert_slice->slice_limits(i) != weights_shape.dimensions(i)) {
+      return std::nullopt;
+    }
+  }
+  return GroupDot{tokens, lhs->slice_starts(0), lhs->shape().dimensions(0),
+                  weights, expert_slice->slice_starts(0)};
+}
+
+// Replaces `instr` by a grouped GEMM with the given operands.
+Status ReplaceWithGroupedGemm(HloInstruction* instr, HloInstruction* lhs,
+                              HloInstruction* weights,
+                              HloInstruction* group_offsets) {
+  std::vector<HloInstruction*> operands = {lhs, weights, group_offsets};
+  std::vector<Shape> operand_shapes;
+  for (const HloInstruction* operand : operands) {
+    operand_shapes.push_back(operand->shape());
+    LayoutUtil::SetToDefaultLayout(&operand_shapes.back());
+  }
+  Shape output_shape = instr->shape();
+  LayoutUtil::SetToDefaultLayout(&output_shape);
+
+  HloComputation* computation = instr->parent();
+  HloInstruction* gemm =
+      computation->AddInstruction(HloInstruction::CreateCustomCall(
+          output_shape, operands, kXetlaGroupedGemmCallTarget,
+          operand_shapes));
+  gemm->set_metadata(instr->metadata());
+  return computation->ReplaceInstruction(instr, gemm);
+}
+
+StatusOr<bool> RewriteConcatenate(HloInstruction* concat) {
+  const Shape& shape = concat->shape();
+  PrimitiveType dtype = shape.element_type();
+  if (shape.rank() != 2 || concat->concatenate_dimension() != 0 ||
+      (dtype != F16 && dtype != BF16) || concat->operand_count() < 2) {
+    return false;
+  }
+  // Group g must multiply the rows that follow those of group g - 1 by the
+  // weights of expert g, with every expert used.
+  std::vector<GroupDot> groups;
+  for (HloInstruction* operand : concat->operands()) {
+    std::optional<GroupDot> group = MatchGroupDot(operand);
+    if (!group.has_value()) return false;
+    if (!groups.empty() &&
+        (group->tokens != groups[0].tokens ||
+         group->weights != groups[0].weights ||
+         group->row_start != groups.back().row_start + groups.back().rows)) {
+      return false;
+    }
+    if (group->expert != static_cast<int64_t>(groups.size())) return false;
+    groups.push_back(*group);
+  }
+  HloInstruction* tokens = groups[0].tokens;
+  HloInstruction* weights = groups[0].weights;
+  int64_t num_groups = groups.size();
+  int64_t m = shape.dimensions(0);
+  int64_t n = shape.dimensions(1);
+  int64_t k = tokens->shape().dimensions(1);
+  if (weights->shape().dimensions(0) != num_groups ||
+      n % ::gpu::xetla::kGroupedGemmAlignment != 0 ||
+      k % ::gpu::xetla::kGroupedGemmAlignment != 0) {
+    return false;
+  }
+
+  VLOG(1) << "Rewriting " << concat->name() << " into a grouped GEMM of "
+          << num_groups << " groups, m=" << m << " n=" << n << " k=" << k;
+
+  HloInstruction* lhs = tokens;
+  int64_t row_start = groups[0].row_start;
+  if (row_start != 0 || m != tokens->shape().dimensions(0)) {
+    TF_ASSIGN_OR_RETURN(lhs, MakeSliceHlo(tokens, {row_start, 0},
+                                          {row_start + m, k}, {1, 1}));
+  }
+  std::vector<int32_t> offsets = {0};
+  for (const GroupDot& group : groups) {
+    offsets.push_back(offsets.back() + group.rows);
+  }
+  HloInstruction* group_offsets =
+      MakeR1ConstantHlo<int32_t>(concat->parent(), S32, offsets);
+  TF_RETURN_IF_ERROR(
+      ReplaceWithGroupedGemm(concat, lhs, weights, group_offsets));
+  return true;
+}
+
+// Whether `hlo` is a row index: an iota along dimension 1, the rows of the
+// [groups, m, k] or [groups, m] mask.
+bool IsRowIota(const HloInstruction* hlo) {
+  if (hlo->opcode() == HloOpcode::kIota) {
+    return Cast<HloIotaInstruction>(hlo)->iota_dimension() == 1;
+  }
+  return hlo->opcode() == HloOpcode::kBroadcast &&
+         DimsAre(hlo->dimensions(), {1}) &&
+         hlo->operand(0)->opcode() == HloOpcode::kIota;
+}
+
+// The [groups] vector that `hlo` broadcasts along dimension 0, or null.
+HloInstruction* GroupBound(HloInstruction* hlo) {
+  if (hlo->opcode() != HloOpcode::kBroadcast ||
+      !DimsAre(hlo->dimensions(), {0}) ||
+      hlo->operand(0)->shape().rank() != 1) {
+    return nullptr;
+  }
+  return hlo->mutable_operand(0);
+}
+
+// Matches starts <= row, or row >= starts.
+HloInstruction* MatchGroupStart(HloInstruction* compare) {
+  if (compare->opcode() != HloOpcode::kCompare) return nullptr;
+  HloInstruction* lhs = compare->mutable_operand(0);
+  HloInstruction* rhs = compare->mutable_operand(1);
+  switch (compare->comparison_direction()) {
+    case ComparisonDirection::kLe:
+      return IsRowIota(rhs) ? GroupBound(lhs) : nullptr;
+    case ComparisonDirection::kGe:
+      return IsRowIota(lhs) ? GroupBound(rhs) : nullptr;
+    default:
+      return nullptr;
+  }
+}
+
+// Matches row < ends, or ends > row.
+HloInstruction* MatchGroupEnd(HloInstruction* compare) {
+  if (compare->opcode() != HloOpcode::kCompare) return nullptr;
+  HloInstruction* lhs = compare->mutable_operand(0);
+  HloInstruction* rhs = compare->mutable_operand(1);
+  switch (compare->comparison_direction()) {
+    case ComparisonDirection::kLt:
+      return IsRowIota(lhs) ? GroupBound(rhs) : nullptr;
+    case ComparisonDirection::kGt:
+      return IsRowIota(rhs) ? GroupBound(lhs) : nullptr;
+    default:
+      return nullptr;
+  }
+}
+
+// Whether `hlo` is all zeros, as a constant or a broadcast or slice of one.
+bool IsZeros(const HloInstruction* hlo) {
+  while (hlo->opcode() == HloOpcode::kSlice ||
+         hlo->opcode() == HloOpcode::kReshape) {
+    hlo = hlo->operand(0);
+  }
+  if (hlo->opcode() == HloOpcode::kConstant) {
+    return hlo->literal().IsAll(0);
+  }
+  return Match(hlo, m::Broadcast(m::ConstantScalar(0)));
+}
+
+// The [groups + 1] table of group offsets, given the [groups] starts and ends
+// of the rows of each group, or null unless every group starts where the
+// previous one ends. Either both are slices of the table, or the starts are
+// zero followed by all ends but the last, as jax.lax.ragged_dot derives them
+// from the cumulative sum of the group sizes.
+StatusOr<HloInstruction*> MakeGroupOffsets(HloInstruction* starts,
+                                           HloInstruction* ends) {
+  int64_t num_groups = starts->shape().dimensions(0);
+  if (starts->opcode() == HloOpcode::kSlice &&
+      ends->opcode() == HloOpcode::kSlice &&
+      starts->operand(0) == ends->operand(0) &&
+      starts->operand(0)->shape().dimensions(0) == num_groups + 1 &&
+      IsDenseSlice(starts) && IsDenseSlice(ends) &&
+      starts->slice_starts(0) == 0 && ends->slice_starts(0) == 1) {
+    return starts->mutable_operand(0);
+  }
+  HloInstruction* zero = nullptr;
+  if (num_groups == 1 && IsZeros(starts)) {
+    zero = starts;
+  } else if (starts->opcode() == HloOpcode::kConcatenate &&
+             starts->operand_count() == 2 &&
+             starts->operand(0)->shape().dimensions(0) == 1 &&
+             IsZeros(starts->operand(0))) {
+    const HloInstruction* previous_ends = starts->operand(1);
+    if (previous_ends->opcode() == HloOpcode::kSlice &&
+        previous_ends->operand(0) == ends && IsDenseSlice(previous_ends) &&
+        previous_ends->slice_starts(0) == 0) {
+      zero = starts->mutable_operand(0);
+    }
+  }
+  if (zero == nullptr) return nullptr;
+  return MakeConcatHlo({zero, ends}, 0);
+}
+
+// The dense form of a ragged dot, as the fallback of jax.lax.ragged_dot
+// spells it, with `tokens` [m, k] and `weights` [groups, k, n]:
+//
+//   masked = select(mask, broadcast(tokens), 0)  // [groups, m, k]
+//   mask   = and(broadcast(starts) <= row, row < broadcast(ends))
+//   result = reduce(dot(masked, weights), dims={0}, add)
+//
+// The dot is batched over groups; the reduction may also be folded into it
+// as a contraction over groups, or canonicalized into the [m, groups * k] x
+// [groups * k, n] dot of a transpose and reshapes.
+struct RaggedDot {
+  HloInstruction* tokens;
+  HloInstruction* weights;
+  HloInstruction* starts;
+  HloInstruction* ends;
+};
+
+// Finds the masked lhs and the weights of the dot forms above.
+bool MatchRaggedDotOperands(HloInstruction* root, HloInstruction** masked,
+                            HloInstruction** weights) {
+  HloInstruction* dot;
+  if (Match(root, m::Reduce(m::Dot(&dot, m::Op(masked), m::Op(weights)),
+                            m::ConstantScalar(0))) &&
+      DimsAre(root->dimensions(), {0}) &&
+      Match(root->to_apply()->root_instruction(),
+            m::AddAnyOrder(m::Parameter(), m::Parameter()))) {
+    const DotDimensionNumbers& dnums = dot->dot_dimension_numbers();
+    return DimsAre(dnums.lhs_batch_dimensions(), {0}) &&
+           DimsAre(dnums.rhs_batch_dimensions(), {0}) &&
+           DimsAre(dnums.lhs_contracting_dimensions(), {2}) &&
+           DimsAre(dnums.rhs_contracting_dimensions(), {1});
+  }
+  if (root->opcode() != HloOpcode::kDot) return false;
+  const DotDimensionNumbers& dnums = root->dot_dimension_numbers();
+  if (dnums.lhs_batch_dimensions_size() != 0) return false;
+  if (DimsAre(dnums.lhs_contracting_dimensions(), {0, 2}) &&
+      DimsAre(dnums.rhs_contracting_dimensions(), {0, 1})) {
+    *masked = root->mutable_operand(0);
+    *weights = root->mutable_operand(1);
+    return true;
+  }
+  HloInstruction* transpose;
+  if (DimsAre(dnums.lhs_contracting_dimensions(), {1}) &&
+      DimsAre(dnums.rhs_contracting_dimensions(), {0}) &&
+      Match(root, m::Dot(m::Reshape(m::Transpose(&transpose, m::Op(masked))),
+                         m::Reshape(m::Op(weights)))) &&
+      DimsAre(transpose->dimensions(), {1, 0, 2})) {
+    // [m, groups, k] -> [m, groups * k]
+    return (*weights)->shape().rank() == 3 &&
+           root->operand(0)->shape().dimensions(0) ==
+               transpose->shape().dimensions(0);
+  }
+  return false;
+}
+
+std::optional<RaggedDot> MatchRaggedDot(HloInstruction* root) {
+  HloInstruction *masked, *weights, *mask, *broadcast_tokens, *tokens;
+  if (!MatchRaggedDotOperands(root, &masked, &weights) ||
+      !Match(masked,
+             m::Select(m::Op(&mask),
+                       m::Broadcast(&broadcast_tokens, m::Op(&tokens)),
+                       m::Broadcast(m::ConstantScalar(0)))) ||
+      !DimsAre(broadcast_tokens->dimensions(), {1, 2})) {
+    return std::nullopt;
+  }
+  // A [groups, m] mask may be broadcast along k.
+  if (mask->opcode() == HloOpcode::kBroadcast &&
+      DimsAre(mask->dimensions(), {0, 1})) {
+    mask = mask->mutable_operand(0);
+  }
+  if (mask->opcode() != HloOpcode::kAnd) return std::nullopt;
+  for (int i = 0; i < 2; ++i) {
+    HloInstruction* starts = MatchGroupStart(mask->mutable_operand(i));
+    HloInstruction* ends = MatchGroupEnd(mask->mutable_operand(1 - i));
+    if (starts != nullptr && ends != nullptr) {
+      return RaggedDot{tokens, weights, starts, ends};
+    }
+  }
+  return std::nullopt;
+}
+
+StatusOr<bool> RewriteRaggedDot(HloInstruction* root) {
+  std::optional<RaggedDot> ragged_dot = MatchRaggedDot(root);
+  if (!ragged_dot.has_value()) return false;
+  const Shape& shape = root->shape();
+  const Shape& tokens_shape = ragged_dot->tokens->shape();
+  const Shape& weights_shape = ragged_dot->weights->shape();
+  PrimitiveType dtype = shape.element_type();
+  if (shape.rank() != 2 || (dtype != F16 && dtype != BF16) ||
+      tokens_shape.element_type() != dtype ||
+      weights_shape.element_type() != dtype ||
+      !primitive_util::IsIntegralType(
+          ragged_dot->starts->shape().element_type())) {
+    return false;
+  }
+  int64_t num_groups = weights_shape.dimensions(0);
+  int64_t m = shape.dimensions(0);
+  int64_t n = shape.dimensions(1);
+  int64_t k = tokens_shape.dimensions(1);
+  if (tokens_shape.dimensions(0) != m || weights_shape.dimensions(1) != k ||
+      weights_shape.dimensions(2) != n ||
+      ragged_dot->starts->shape().dimensions(0) != num_groups ||
+      n % ::gpu::xetla::kGroupedGemmAlignment != 0 ||
+      k % ::gpu::xetla::kGroupedGemmAlignment != 0) {
+    return false;
+  }
+  TF_ASSIGN_OR_RETURN(HloInstruction * group_offsets,
+                      MakeGroupOffsets(ragged_dot->starts, ragged_dot->ends));
+  if (group_offsets == nullptr) return false;
+  if (group_offsets->shape().element_type() != S32) {
+    group_offsets = MakeConvertToHlo(group_offsets, S32);
+  }
+
+  VLOG(1) << "Rewriting ragged dot " << root->name()
+          << " into a grouped GEMM of " << num_groups << " groups, m=" << m
+          << " n=" << n << " k=" << k;
+  TF_RETURN_IF_ERROR(ReplaceWithGroupedGemm(root, ragged_dot->tokens,
+                                            ragged_dot->weights,
+                                            group_offsets));
+  return true;
+}
+
+}  // namespace
+
+StatusOr<bool> GroupedGemmRewriter::Run(
+    HloModule* module,
+    const absl::flat_hash_set<absl::string_view>& execution_threads) {
+  if (!IsXetlaHardwareSupport()) return false;
+  bool changed = false;
+  for (HloComputation* computation :
+       module->MakeNonfusionComputations(execution_threads)) {
+    for (HloInstruction* instr : computation->MakeInstructionPostOrder()) {
+      bool rewritten = false;
+      switch (instr->opcode()) {
+        case HloOpcode::kConcatenate:
+          TF_ASSIGN_OR_RETURN(rewritten, RewriteConcatenate(instr));
+          break;
+        case HloOpcode::kDot:
+        case HloOpcode::kReduce:
+          TF_ASSIGN_OR_RETURN(rewritten, RewriteRaggedDot(instr));
+          break;
+        default:
+          break;
+      }
+      changed |= rewritten;
+    }
+  }
+  return changed;
+}
+
+}  // namespace gpu
+}  // namespace xla
@@ -0,0 +1,76 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef XLA_SERVICE_GPU_GROUPED_GEMM_REWRITER_H_
+#define XLA_SERVICE_GPU_GROUPED_GEMM_REWRITER_H_
+
+#include "absl/strings/string_view.h"
+#include "xla/hlo/ir/hlo_instruction.h"
+#include "xla/hlo/ir/hlo_module.h"
+#include "xla/service/hlo_pass_interface.h"
+
+namespace xla {
+namespace gpu {
+
+// The GEMMs of a mixture-of-experts layer, with one group of rows per
+// expert:
+//
+//   output[offsets[g]:offsets[g + 1]] = lhs[offsets[g]:offsets[g + 1]] @ rhs[g]
+//
+// and the rows of output outside [offsets[0], offsets[groups]) zero.
+//
+// Operands, all row-major:
+//   lhs:           [m, k] F16 or BF16.
+//   rhs:           [groups, k, n] of the type of lhs.
+//   group_offsets: [groups + 1] S32, ascending within [0, m]. They may be
+//                  computed on the device.
+// The result is [m, n] of the type of lhs.
+extern const absl::string_view kXetlaGroupedGemmCallTarget;
+
+bool IsXetlaGroupedGemm(const HloInstruction& hlo);
+
+// Rewrites the GEMMs of mixture-of-experts layers into
+// kXetlaGroupedGemmCallTarget custom calls, which run as one kernel launch
+// rather than one per expert. Two forms are matched:
+//
+// - Ragged dots, whose group sizes come from the router at run time. These
+//   are the dense form jax.lax.ragged_dot falls back to, which masks the
+//   rows of each group out of broadcast tokens before a dot batched over the
+//   experts and sums the results:
+//
+//     reduce(dot(select(starts <= row < ends, broadcast(x), 0), w), add)
+//
+//   The group table comes from the starts and ends on the device. The tokens
+//   x may be gathered into expert order by the router.
+// - One dot per expert on consecutive rows of the tokens, with the row
+//   offsets as constants:
+//
+//     concatenate(dot(slice(x), reshape(slice(w))), ...)
+//
+// Runs before layout assignment, after dots are canonicalized.
+class GroupedGemmRewriter : public HloModulePass {
+ public:
+  absl::string_view name() const override { return "grouped-gemm-rewriter"; }
+
+  using HloPassInterface::Run;
+  StatusOr<bool> Run(
+      HloModule* module,
+      const absl::flat_hash_set<absl::string_view>& execution_threads) override;
+};
+
+}  // namespace gpu
+}  // namespace xla
+
+#endif  // XLA_SERVICE_GPU_GROUPED_GEMM_REWRITER_H_
@@ -0,0 +1,280 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/service/gpu/horizontal_dot_batcher.h"
+
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/strings/str_cat.h"
+#include "absl/types/span.h"
+#include "tsl/platform/errors.h"
+#include "tsl/platform/logging.h"
+#include "tsl/platform/statusor.h"
+#include "tsl/util/env_var.h"
+#include "xla/hlo/ir/hlo_computation.h"
+#include "xla/hlo/ir/hlo_instruction.h"
+#include "xla/hlo/ir/hlo_opcode.h"
+#include "xla/hlo/ir/hlo_reachability.h"
+#include "xla/service/gpu/collective_matmul_decomposer.h"
+#include "xla/service/hlo_creation_utils.h"
+#include "xla/shape_util.h"
+#include "xla/statusor.h"
+#include "xla/xla_data.pb.h"
+
+namespace xla {
+namespace gpu {
+namespace {
+
+// Dots batched into one at most.
+constexpr int64_t kMaxBatchSize = 64;
+
+bool BatchingEnabled() {
+  static bool enabled = [] {
+    bool flag = true;
+    TF_CHECK_OK(
+        tsl::ReadBoolFromEnvVar("XLA_HORIZONTAL_DOT_BATCHING", true, &flag));
+    return flag;
+  }();
+  return enabled;
+}
+
+int64_t DotFlops(const HloInstruction* dot) {
+  int64_t contracting_size = 1;
+  for (int64_t dim :
+       dot->dot_dimension_numbers().lhs_contracting_dimensions()) {
+    contracting_size *= dot->operand(0)->shape().dimensions(dim);
+  }
+  return 2 * ShapeUtil::ElementsIn(dot->shape()) * contracting_size;
+}
+
+// Whether GemmRewriter may fuse a user of `dot` into its GEMM as a bias,
+// residual or activation. It only fuses into GEMMs with one user, or two for
+// the halves of SiLU, and batching gives the batched GEMM a user per dot.
+bool HasFusibleUser(const HloInstruction* dot) {
+  if (dot->user_count() > 2) return false;
+  for (const HloInstruction* user : dot->users()) {
+    // GemmRewriter matches through bitcasts and slices of the result.
+    while ((user->opcode() == HloOpcode::kBitcast ||
+            user->opcode() == HloOpcode::kReshape ||
+            user->opcode() == HloOpcode::kSlice) &&
+           user->user_count() == 1) {
+      user = user->users().front();
+    }
+    switch (user->opcode()) {
+      case HloOpcode::kAdd:
+      case HloOpcode::kDivide:
+      case HloOpcode::kLogistic:
+      case HloOpcode::kMaximum:
+      case HloOpcode::kMultiply:
+      case HloOpcode::kNegate:
+        return true;
+      default:
+        break;
+    }
+  }
+  return false;
+}
+
+bool IsBatchable(const HloInstruction* dot, int64_t max_flops,
+                 int64_t max_copied_bytes) {
+  // The ring steps of a collective matmul must stay apart to overlap with
+  // their collective-permutes, and a fused epilogue saves more than a
+  // launch.
+  if (dot->opcode() != HloOpcode::kDot || !dot->shape().is_static() ||
+      !dot->control_predecessors().empty() ||
+      !dot->control_successors().empty() || IsCollectiveMatmulStep(*dot) ||
+      HasFusibleUser(dot)) {
+    return false;
+  }
+  PrimitiveType type = dot->shape().element_type();
+  if (type != F16 && type != BF16 && type != F32) return false;
+  int64_t copied_bytes = 0;
+  for (const HloInstruction* operand : dot->operands()) {
+    if (operand->shape().element_type() != type) return false;
+    // Concatenations of constants are folded, so they cost nothing at run
+    // time.
+    if (operand->opcode() != HloOpcode::kConstant) {
+      copied_bytes += ShapeUtil::ByteSizeOf(operand->shape());
+    }
+  }
+  return DotFlops(dot) <= max_flops && copied_bytes <= max_copied_bytes;
+}
+
+// Dots with equal keys can be batched together.
+std::string BatchKey(const HloInstruction* dot) {
+  return absl::StrCat(dot->operand(0)->shape().ToString(/*print_layout=*/true),
+                      "|", dot->operand(1)->shape().ToString(true), "|",
+                      dot->shape().ToString(true), "|",
+                      dot->dot_dimension_numbers().ShortDebugString(), "|",
+                      dot->precision_config().ShortDebugString());
+}
+
+// Returns groups of at least two batchable dots of `computation`, other than
+// `excluded`. The dots of a group are independent, and no dot of a group is
+// connected to a dot of another, so that batching every group keeps the
+// graph acyclic.
+std::vector<std::vector<HloInstruction*>> FindBatches(
+    HloComputation* computation,
+    const absl::flat_hash_set<const HloInstruction*>& excluded,
+    int64_t max_flops, int64_t max_copied_bytes) {
+  std::unique_ptr<HloReachabilityMap> reachability =
+      HloReachabilityMap::Build(computation);
+  auto connected = [&](absl::Span<HloInstruction* const> dots,
+                       const HloInstruction* instr) {
+    return absl::c_any_of(dots, [&](const HloInstruction* dot) {
+      return reachability->IsConnected(dot, instr);
+    });
+  };
+
+  // Groups by key, in the order keys are first seen.
+  absl::flat_hash_map<std::string, int64_t> key_indices;
+  std::vector<std::vector<std::vector<HloInstruction*>>> groups_by_key;
+  for (HloInstruction* instr : computation->MakeInstructionPostOrder()) {
+    if (excluded.contains(instr) ||
+        !IsBatchable(instr, max_flops, max_copied_bytes)) {
+      continue;
+    }
+    auto [it, inserted] =
+        key_indices.try_emplace(BatchKey(instr), groups_by_key.size());
+    if (inserted) groups_by_key.emplace_back();
+    std::vector<std::vector<HloInstruction*>>& groups =
+        groups_by_key[it->second];
+    auto group = absl::c_find_if(groups, [&](const auto& dots) {
+      return dots.size() < kMaxBatchSize && !connected(dots, instr);
+    });
+    if (group == groups.end()) {
+      groups.push_back({instr});
+    } else {
+      group->push_back(instr);
+    }
+  }
+
+  std::vector<std::vector<HloInstruction*>> batches;
+  std::vector<HloInstruction*> batched;
+  for (std::vector<std::vector<HloInstruction*>>& groups : groups_by_key) {
+    for (std::vector<HloInstruction*>& group : groups) {
+      if (group.size() < 2 ||
+          absl::c_any_of(group, [&](const HloInstruction* dot) {
+            return connected(batched, dot);
+          })) {
+        continue;
+      }
+      batched.insert(batched.end(), group.begin(), group.end());
+      batches.push_back(std::move(group));
+    }
+  }
+  return batches;
+}
+
+// Replaces `dots` by slices of one dot with a new leading batch dimension,
+// which is returned.
+StatusOr<HloInstruction*> BatchDots(absl::Span<HloInstruction* const> dots) {
+  const HloInstruction* first = dots.front();
+  HloComputation* computation = first->parent();
+  const int64_t batch_size = dots.size();
+
+  std::vector<HloInstruction*> operands[2];
+  for (HloInstruction* dot : dots) {
+    for (int64_t i = 0; i < 2; ++i) {
+      HloInstruction* operand = dot->mutable_operand(i);
+      std::vector<int64_t> dims = {1};
+      absl::c_copy(operand->shape().dimensions(), std::back_inserter(dims));
+      TF_ASSIGN_OR_RETURN(HloInstruction * reshape,
+                          MakeReshapeHlo(dims, operand));
+      operands[i].push_back(reshape);
+    }
+  }
+  TF_ASSIGN_OR_RETURN(HloInstruction * lhs, MakeConcatHlo(operands[0], 0));
+  TF_ASSIGN_OR_RETURN(HloInstruction * rhs, MakeConcatHlo(operands[1], 0));
+
+  const DotDimensionNumbers& dnums = first->dot_dimension_numbers();
+  DotDimensionNumbers batched_dnums;
+  batched_dnums.add_lhs_batch_dimensions(0);
+  batched_dnums.add_rhs_batch_dimensions(0);
+  for (int64_t dim : dnums.lhs_batch_dimensions()) {
+    batched_dnums.add_lhs_batch_dimensions(dim + 1);
+  }
+  for (int64_t dim : dnums.rhs_batch_dimensions()) {
+    batched_dnums.add_rhs_batch_dimensions(dim + 1);
+  }
+  for (int64_t dim : dnums.lhs_contracting_dimensions()) {
+    batched_dnums.add_lhs_contracting_dimensions(dim + 1);
+  }
+  for (int64_t dim : dnums.rhs_contracting_dimensions()) {
+    batched_dnums.add_rhs_contracting_dimensions(dim + 1);
+  }
+  // The new batch dimension comes first in the output, followed by those of
+  // the original dots.
+  std::vector<int64_t> dims = {batch_size};
+  absl::c_copy(first->shape().dimensions(), std::back_inserter(dims));
+  HloInstruction* batched =
+      computation->AddInstruction(HloInstruction::CreateDot(
+          ShapeUtil::MakeShape(first->shape().element_type(), dims), lhs, rhs,
+          batched_dnums, first->precision_config()));
+  batched->set_metadata(first->metadata());
+
+  std::vector<int64_t> start(dims.size(), 0);
+  std::vector<int64_t> limit = dims;
+  std::vector<int64_t> strides(dims.size(), 1);
+  for (int64_t i = 0; i < batch_size; ++i) {
+    start[0] = i;
+    limit[0] = i + 1;
+    TF_ASSIGN_OR_RETURN(HloInstruction * slice,
+                        MakeSliceHlo(batched, start, limit, strides));
+    TF_ASSIGN_OR_RETURN(HloInstruction * result,
+                        MakeReshapeHlo(dots[i]->shape(), slice));
+    TF_RETURN_IF_ERROR(computation->ReplaceInstruction(dots[i], result));
+  }
+  return batched;
+}
+
+}  // namespace
+
+StatusOr<bool> HorizontalDotBatcher::Run(
+    HloModule* module,
+    const absl::flat_hash_set<absl::string_view>& execution_threads) {
+  if (!BatchingEnabled()) return false;
+  bool changed = false;
+  for (HloComputation* computation :
+       module->MakeNonfusionComputations(execution_threads)) {
+    // Dots created here are not batched again.
+    absl::flat_hash_set<const HloInstruction*> batched_dots;
+    while (true) {
+      std::vector<std::vector<HloInstruction*>> batches =
+          FindBatches(computation, batched_dots, max_flops_per_dot_,
+                      max_copied_bytes_per_dot_);
+      if (batches.empty()) break;
+      for (const std::vector<HloInstruction*>& batch : batches) {
+        VLOG(2) << "Batching " << batch.size() << " dots like "
+                << batch.front()->ToString();
+        TF_ASSIGN_OR_RETURN(HloInstruction * batched, BatchDots(batch));
+        batched_dots.insert(batched);
+      }
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+}  // namespace gpu
+}  // namespace xla
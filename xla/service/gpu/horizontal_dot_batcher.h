@@ -0,0 +1,72 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef XLA_SERVICE_GPU_HORIZONTAL_DOT_BATCHER_H_
+#define XLA_SERVICE_GPU_HORIZONTAL_DOT_BATCHER_H_
+
+#include <cstdint>
+
+#include "absl/strings/string_view.h"
+#include "xla/hlo/ir/hlo_module.h"
+#include "xla/service/hlo_pass_interface.h"
+
+namespace xla {
+namespace gpu {
+
+// Batches independent dots of identical shapes, such as the LoRA adapters of
+// the layers of a model or parallel attention branches, into one dot with a
+// new leading batch dimension:
+//
+//   dot(a0, b0), dot(a1, b1)
+//
+// becomes
+//
+//   d = dot(concatenate(reshape(a0), reshape(a1)),
+//           concatenate(reshape(b0), reshape(b1)))
+//   reshape(slice(d, 0)), reshape(slice(d, 1))
+//
+// which GemmRewriter turns into a single batched GEMM. DotMerger already
+// merges dots sharing an operand; this covers dots sharing none.
+//
+// Batching pays for one launch of each small GEMM with a copy of its
+// operands, so only dots of at most `max_flops_per_dot` flops whose
+// non-constant operands hold at most `max_copied_bytes_per_dot` bytes are
+// batched. Dots with a user that GemmRewriter would fuse into their GEMM, a
+// bias or residual add or an activation, are left alone, as are the ring
+// steps of CollectiveMatmulDecomposer. Setting
+// XLA_HORIZONTAL_DOT_BATCHING=false disables the pass.
+class HorizontalDotBatcher : public HloModulePass {
+ public:
+  HorizontalDotBatcher(int64_t max_flops_per_dot,
+                       int64_t max_copied_bytes_per_dot)
+      : max_flops_per_dot_(max_flops_per_dot),
+        max_copied_bytes_per_dot_(max_copied_bytes_per_dot) {}
+
+  absl::string_view name() const override { return "horizontal-dot-batcher"; }
+
+  using HloPassInterface::Run;
+  StatusOr<bool> Run(
+      HloModule* module,
+      const absl::flat_hash_set<absl::string_view>& execution_threads) override;
+
+ private:
+  int64_t max_flops_per_dot_;
+  int64_t max_copied_bytes_per_dot_;
+};
+
+}  // namespace gpu
+}  // namespace xla
+
+#endif  // XLA_SERVICE_GPU_HORIZONTAL_DOT_BATCHER_H_
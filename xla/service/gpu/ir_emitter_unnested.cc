@@ -109,6 +109,7 @@ limitations under the License.
 #include "xla/service/gpu/for_thunk.h"
 #include "xla/service/gpu/fused_mha_thunk.h"
 #include "xla/service/gpu/fused_qkv_thunk.h"
+#include "xla/service/gpu/gemm_post_ops.h"
 #include "xla/service/gpu/gemm_thunk.h"
 #include "xla/service/gpu/gpu_asm_opts_util.h"
 #include "xla/service/gpu/gpu_constants.h"
@@ -116,6 +117,7 @@ limitations under the License.
 #include "xla/service/gpu/gpu_executable.h"
 #include "xla/service/gpu/gpu_fused_qkv_runner.h"
 #include "xla/service/gpu/gpu_fusible.h"
+#include "xla/service/gpu/grouped_gemm_rewriter.h"
 #include "xla/service/gpu/hlo_to_ir_bindings.h"
 #include "xla/service/gpu/infeed_thunk.h"
 #include "xla/service/gpu/ir_emission_utils.h"
@@ -132,6 +134,7 @@ limitations under the License.
 #include "xla/service/gpu/sequential_thunk.h"
 #include "xla/service/gpu/target_util.h"
 #include "xla/service/gpu/thunk.h"
+#include "xla/service/gpu/weight_only_gemm_rewriter.h"
 #include "xla/service/gpu/while_thunk.h"
 #include "xla/service/llvm_ir/buffer_assignment_util.h"
 #include "xla/service/llvm_ir/dynamic_update_slice_util.h"
@@ -1223,6 +1226,138 @@ Status IrEmitterUnnested::EmitCublasLtMatmulThunk(mlir::Operation* op) {
   return OkStatus();
 }
 
+Status IrEmitterUnnested::EmitCublasLtMatmulThunkF8(mlir::Operation* op) {
+  auto matmul = mlir::dyn_cast<mlir::lmhlo_gpu::CublasLtMatmulF8Op>(op);
+  TF_RET_CHECK(matmul != nullptr);
+
+  TF_ASSIGN_OR_RETURN(auto a, GetAllocationSlice(matmul.getA()));
+  TF_ASSIGN_OR_RETURN(auto b, GetAllocationSlice(matmul.getB()));
+  TF_ASSIGN_OR_RETURN(auto c, GetAllocationSlice(matmul.getC()));
+  TF_ASSIGN_OR_RETURN(auto d, GetAllocationSlice(matmul.getD()));
+  TF_ASSIGN_OR_RETURN(auto a_scale, GetAllocationSlice(matmul.getAScale()));
+  TF_ASSIGN_OR_RETURN(auto b_scale, GetAllocationSlice(matmul.getBScale()));
+  TF_ASSIGN_OR_RETURN(auto c_scale, GetAllocationSlice(matmul.getCScale()));
+  TF_ASSIGN_OR_RETURN(auto d_scale, GetAllocationSlice(matmul.getDScale()));
+
+  BufferAllocation::Slice bias, d_amax;
+  if (matmul.getBias() != nullptr) {
+    TF_ASSIGN_OR_RETURN(bias, GetAllocationSlice(matmul.getBias()));
+  }
+  if (matmul.getDAmax() != nullptr) {
+    TF_ASSIGN_OR_RETURN(d_amax, GetAllocationSlice(matmul.getDAmax()));
+  }
+
+  TF_ASSIGN_OR_RETURN(GemmConfig config, cublas_lt::MatmulPlan::For(matmul));
+  auto thunk = std::make_unique<CublasLtMatmulThunk>(
+      GetThunkInfo(op), std::move(config), matmul.getAlgorithm(), a, b, c, d,
+      bias, BufferAllocation::Slice(), a_scale, b_scale, c_scale, d_scale,
+      d_amax);
+
+  AddThunkToThunkSequence(std::move(thunk));
+  return OkStatus();
+}
+
+Status IrEmitterUnnested::EmitWeightOnlyGemmThunk(mlir::Operation* op) {
+  auto custom_call = mlir::cast<mlir::lmhlo::CustomCallOp>(op);
+  auto args = custom_call.getArgs();
+  TF_RET_CHECK(args.size() == 3 || args.size() == 4);
+  TF_RET_CHECK(custom_call.getOutput().size() == 1);
+  mlir::Value output = custom_call.getOutput().front();
+
+  TF_ASSIGN_OR_RETURN(auto lhs, GetAllocationSlice(args[0]));
+  TF_ASSIGN_OR_RETURN(auto rhs, GetAllocationSlice(args[1]));
+  TF_ASSIGN_OR_RETURN(auto scales, GetAllocationSlice(args[2]));
+  BufferAllocation::Slice zero_points;
+  if (args.size() == 4) {
+    TF_ASSIGN_OR_RETURN(zero_points, GetAllocationSlice(args[3]));
+  }
+  TF_ASSIGN_OR_RETURN(auto result, GetAllocationSlice(output));
+
+  TF_ASSIGN_OR_RETURN(
+      WeightOnlyGemmConfig config,
+      WeightOnlyGemmConfig::For(GetShape(args[0]), GetShape(args[1]),
+                                GetShape(args[2]), GetShape(output)));
+  AddThunkToThunkSequence(std::make_unique<WeightOnlyGemmThunk>(
+      GetThunkInfo(op), std::move(config), lhs, rhs, scales, zero_points,
+      result));
+  return OkStatus();
+}
+
+Status IrEmitterUnnested::EmitGroupedGemmThunk(mlir::Operation* op) {
+  auto custom_call = mlir::cast<mlir::lmhlo::CustomCallOp>(op);
+  auto args = custom_call.getArgs();
+  TF_RET_CHECK(args.size() == 3);
+  TF_RET_CHECK(custom_call.getOutput().size() == 1);
+  mlir::Value output = custom_call.getOutput().front();
+
+  TF_ASSIGN_OR_RETURN(auto lhs, GetAllocationSlice(args[0]));
+  TF_ASSIGN_OR_RETURN(auto rhs, GetAllocationSlice(args[1]));
+  TF_ASSIGN_OR_RETURN(auto group_offsets, GetAllocationSlice(args[2]));
+  TF_ASSIGN_OR_RETURN(auto result, GetAllocationSlice(output));
+
+  TF_ASSIGN_OR_RETURN(
+      GroupedGemmConfig config,
+      GroupedGemmConfig::For(GetShape(args[0]), GetShape(args[1]),
+                             GetShape(args[2]), GetShape(output)));
+  AddThunkToThunkSequence(std::make_unique<GroupedGemmThunk>(
+      GetThunkInfo(op), std::move(config), lhs, rhs, group_offsets, result));
+  return OkStatus();
+}
+
+Status IrEmitterUnnested::EmitGemmWithPostOpsThunk(mlir::Operation* op) {
+  auto custom_call = mlir::cast<mlir::lmhlo::CustomCallOp>(op);
+  const llvm::StringRef call_target = custom_call.getCallTargetName();
+  TF_ASSIGN_OR_RETURN(std::vector<GemmPostOp> post_ops,
+                      ParseGemmPostOps(absl::string_view(
+                          call_target.data(), call_target.size())));
+  auto args = custom_call.getArgs();
+  TF_RET_CHECK(args.size() ==
+               2 + absl::c_count_if(post_ops, GemmPostOpHasOperand));
+  TF_RET_CHECK(custom_call.getOutput().size() == 1);
+  mlir::Value output = custom_call.getOutput().front();
+
+  GemmBackendConfig backend_config;
+  if (auto str = custom_call.getBackendConfig()
+                     .value_or(mlir::Attribute())
+                     .dyn_cast_or_null<mlir::StringAttr>())
+    TF_RETURN_IF_ERROR(
+        tsl::HumanReadableJsonToProto(str.str(), &backend_config));
+
+  TF_ASSIGN_OR_RETURN(auto lhs, GetAllocationSlice(args[0]));
+  TF_ASSIGN_OR_RETURN(auto rhs, GetAllocationSlice(args[1]));
+  std::vector<BufferAllocation::Slice> post_op_buffers;
+  for (int i = 2; i < args.size(); ++i) {
+    TF_ASSIGN_OR_RETURN(auto buffer, GetAllocationSlice(args[i]));
+    post_op_buffers.push_back(buffer);
+  }
+  TF_ASSIGN_OR_RETURN(auto result, GetAllocationSlice(output));
+
+  const DotDimensionNumbers& dot_dims =
+      backend_config.dot_dimension_numbers();
+  int64_t compute_precision = 0;
+  for (int precision : backend_config.precision_config().operand_precision()) {
+    compute_precision = std::max<int64_t>(compute_precision, precision);
+  }
+  std::optional<int64_t> algorithm;
+  if (backend_config.algorithm_case() !=
+      GemmBackendConfig::ALGORITHM_NOT_SET) {
+    algorithm = backend_config.selected_algorithm();
+  }
+  TF_ASSIGN_OR_RETURN(
+      GemmConfig config,
+      GemmConfig::For(GetShape(args[0]), dot_dims.lhs_batch_dimensions(),
+                      dot_dims.lhs_contracting_dimensions(), GetShape(args[1]),
+                      dot_dims.rhs_batch_dimensions(),
+                      dot_dims.rhs_contracting_dimensions(), GetShape(output),
+                      /*alpha_real=*/1.0, /*alpha_imag=*/0.0, /*beta=*/0.0,
+                      algorithm, compute_precision));
+  config.epilogue = se::cuda::BlasLt::Epilogue::kDefault;
+  AddThunkToThunkSequence(std::make_unique<GemmWithPostOpsThunk>(
+      GetThunkInfo(op), std::move(config), std::move(post_ops), lhs, rhs,
+      std::move(post_op_buffers), result));
+  return OkStatus();
+}
+
 Status IrEmitterUnnested::EmitFusedQKVThunk(mlir::Operation* op) {
   using mlir::lmhlo_gpu::fusedQKVOp;
 
@@ -5967,6 +6102,19 @@ Status IrEmitterUnnested::EmitOp(mlir::Operation* op) {
       return EmitTriangularSolveCustomCall(op);
     }
 #endif  // ITEX_USE_MKL
+    if (absl::string_view(call_target.data(), call_target.size()) ==
+        kXetlaWeightOnlyGemmCallTarget) {
+      return EmitWeightOnlyGemmThunk(op);
+    }
+    if (absl::string_view(call_target.data(), call_target.size()) ==
+        kXetlaGroupedGemmCallTarget) {
+      return EmitGroupedGemmThunk(op);
+    }
+    if (call_target.startswith(
+            llvm::StringRef(kGemmWithPostOpsCallTargetPrefix.data(),
+                            kGemmWithPostOpsCallTargetPrefix.size()))) {
+      return EmitGemmWithPostOpsThunk(op);
+    }
 
     return EmitCustomCallThunk(op);
   }
@@ -5979,6 +6127,10 @@ Status IrEmitterUnnested::EmitOp(mlir::Operation* op) {
     return EmitCublasLtMatmulThunk(op);
   }
 
+  if (mlir::isa<mlir::lmhlo_gpu::CublasLtMatmulF8Op>(op)) {
+    return EmitCublasLtMatmulThunkF8(op);
+  }
+
   if (mlir::isa<mlir::lmhlo_gpu::fusedQKVOp>(op)) {
     return EmitFusedQKVThunk(op);
   }
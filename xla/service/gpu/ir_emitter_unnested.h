@@ -200,6 +200,10 @@ class IrEmitterUnnested : public IrEmitter {
   Status EmitConvolutionThunk(mlir::Operation* op);
   Status EmitGemmThunk(mlir::Operation* op);
   Status EmitCublasLtMatmulThunk(mlir::Operation* op);
+  Status EmitCublasLtMatmulThunkF8(mlir::Operation* op);
+  Status EmitWeightOnlyGemmThunk(mlir::Operation* op);
+  Status EmitGroupedGemmThunk(mlir::Operation* op);
+  Status EmitGemmWithPostOpsThunk(mlir::Operation* op);
 #if GOOGLE_CUDA
   Status EmitTritonFusion(mlir::Operation* op,
                           tensorflow::AutotuneResult::TritonGemmKey& config);
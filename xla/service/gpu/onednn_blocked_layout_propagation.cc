@@ -0,0 +1,225 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/service/gpu/onednn_blocked_layout_propagation.h"
+
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "tsl/platform/errors.h"
+#include "tsl/platform/logging.h"
+#include "tsl/platform/statusor.h"
+#include "tsl/util/env_var.h"
+#include "xla/hlo/ir/hlo_computation.h"
+#include "xla/hlo/ir/hlo_instruction.h"
+#include "xla/hlo/ir/hlo_opcode.h"
+#include "xla/service/gpu/backend_configs.pb.h"
+#include "xla/service/gpu/cublas_cudnn.h"
+#include "xla/service/gpu/gpu_conv_runner.h"
+#include "xla/shape_util.h"
+#include "xla/xla_data.pb.h"
+
+namespace xla {
+namespace gpu {
+namespace {
+
+bool BlockedLayoutEnabled() {
+  static bool enabled = [] {
+    bool flag = false;
+    TF_CHECK_OK(
+        tsl::ReadBoolFromEnvVar("XLA_ONEDNN_BLOCKED_LAYOUT", false, &flag));
+    return flag;
+  }();
+  return enabled;
+}
+
+bool IsForwardConv(const HloInstruction* instr) {
+  return instr->opcode() == HloOpcode::kCustomCall &&
+         (instr->custom_call_target() == kCudnnConvForwardCallTarget ||
+          instr->custom_call_target() ==
+              kCudnnConvBiasActivationForwardCallTarget);
+}
+
+// Dimensions of the input or output activation of `conv` in the order oneDNN
+// indexes them: batch, feature, spatial.
+std::vector<int64_t> ActivationDims(const HloInstruction* conv, bool input) {
+  const ConvolutionDimensionNumbers& dnums =
+      conv->convolution_dimension_numbers();
+  std::vector<int64_t> dims;
+  if (input) {
+    dims = {dnums.input_batch_dimension(), dnums.input_feature_dimension()};
+    absl::c_copy(dnums.input_spatial_dimensions(), std::back_inserter(dims));
+  } else {
+    dims = {dnums.output_batch_dimension(), dnums.output_feature_dimension()};
+    absl::c_copy(dnums.output_spatial_dimensions(), std::back_inserter(dims));
+  }
+  return dims;
+}
+
+// Whether `conv` can read (`input`) or write its activation blocked.
+bool CanBlockActivation(const HloInstruction* conv, bool input) {
+  // The side input is summed into the output buffer, which would then have
+  // to be blocked as well.
+  if (!IsForwardConv(conv) || conv->operand_count() > 3 ||
+      conv->window().dimensions_size() > 3) {
+    return false;
+  }
+  StatusOr<CudnnConvBackendConfig> config =
+      conv->backend_config<CudnnConvBackendConfig>();
+  if (!config.ok() || config->reordered_int8_nchw_vect()) return false;
+
+  const Shape& shape =
+      input ? conv->operand(0)->shape() : conv->shape().tuple_shapes(0);
+  PrimitiveType type = shape.element_type();
+  if (type != F32 && type != F16 && type != BF16) return false;
+  const int64_t feature_dim = ActivationDims(conv, input)[1];
+  return shape.dimensions(feature_dim) % kOneDnnActivationBlockSize == 0;
+}
+
+// Whether `gte` is the only use of the result of the convolution it reads.
+bool IsOnlyResultUse(const HloInstruction* conv, const HloInstruction* gte) {
+  return absl::c_all_of(conv->users(), [&](const HloInstruction* user) {
+    return user->opcode() == HloOpcode::kGetTupleElement &&
+           (user == gte || user->tuple_index() != 0);
+  });
+}
+
+bool IsBroadcastScalar(const HloInstruction* instr) {
+  return instr->opcode() == HloOpcode::kBroadcast &&
+         ShapeUtil::IsEffectiveScalar(instr->operand(0)->shape());
+}
+
+Status SetKnob(HloInstruction* conv, int64_t knob) {
+  TF_ASSIGN_OR_RETURN(CudnnConvBackendConfig config,
+                      conv->backend_config<CudnnConvBackendConfig>());
+  (*config.mutable_algorithm()->mutable_tuning_knobs())[knob] = 1;
+  return conv->set_backend_config(config);
+}
+
+StatusOr<bool> RunOnComputation(HloComputation* computation) {
+  // Activations that may be blocked, with the ActivationDims of the
+  // convolutions that produce them.
+  absl::flat_hash_map<HloInstruction*, std::vector<int64_t>> candidates;
+  std::vector<HloInstruction*> order;
+  for (HloInstruction* instr : computation->MakeInstructionPostOrder()) {
+    if (instr->opcode() == HloOpcode::kGetTupleElement &&
+        instr->tuple_index() == 0) {
+      const HloInstruction* conv = instr->operand(0);
+      if (CanBlockActivation(conv, /*input=*/false) &&
+          IsOnlyResultUse(conv, instr)) {
+        candidates[instr] = ActivationDims(conv, /*input=*/false);
+        order.push_back(instr);
+      }
+      continue;
+    }
+    if (!instr->IsElementwise() || instr->HasSideEffect()) continue;
+
+    std::vector<int64_t> dims;
+    bool blocked_operands = true;
+    for (const HloInstruction* operand : instr->operands()) {
+      if (IsBroadcastScalar(operand)) continue;
+      auto it = candidates.find(operand);
+      // A layout change would be a transpose, not an elementwise copy.
+      if (it == candidates.end() ||
+          !ShapeUtil::EqualIgnoringElementType(operand->shape(),
+                                               instr->shape()) ||
+          (!dims.empty() && dims != it->second)) {
+        blocked_operands = false;
+        break;
+      }
+      dims = it->second;
+    }
+    if (blocked_operands && !dims.empty()) {
+      candidates[instr] = std::move(dims);
+      order.push_back(instr);
+    }
+  }
+
+  auto is_blocked_use = [&](const HloInstruction* user, int64_t operand_index,
+                            const std::vector<int64_t>& dims) {
+    if (candidates.contains(user)) return true;
+    return operand_index == 0 && CanBlockActivation(user, /*input=*/true) &&
+           ActivationDims(user, /*input=*/true) == dims;
+  };
+  // Drop every activation with a use that needs plain layout, and every
+  // elementwise op reading a dropped one, until the remaining activations
+  // only come from and reach blocked convolutions.
+  bool dropped = true;
+  while (dropped) {
+    dropped = false;
+    for (auto instr = order.rbegin(); instr != order.rend(); ++instr) {
+      auto it = candidates.find(*instr);
+      if (it == candidates.end()) continue;
+      bool blocked = *instr != computation->root_instruction();
+      if ((*instr)->opcode() != HloOpcode::kGetTupleElement) {
+        for (const HloInstruction* operand : (*instr)->operands()) {
+          blocked &= IsBroadcastScalar(operand) || candidates.contains(operand);
+        }
+      }
+      for (const HloInstruction* user : (*instr)->users()) {
+        for (int64_t index : user->OperandIndices(*instr)) {
+          blocked &= is_blocked_use(user, index, it->second);
+        }
+      }
+      if (!blocked) {
+        candidates.erase(it);
+        dropped = true;
+      }
+    }
+  }
+
+  absl::flat_hash_set<HloInstruction*> blocked_inputs;
+  for (HloInstruction* instr : order) {
+    if (!candidates.contains(instr)) continue;
+    if (instr->opcode() == HloOpcode::kGetTupleElement) {
+      VLOG(2) << "Blocked output: " << instr->operand(0)->name();
+      TF_RETURN_IF_ERROR(
+          SetKnob(instr->mutable_operand(0), kOneDnnBlockedOutputKnob));
+    }
+    for (HloInstruction* user : instr->users()) {
+      if (IsForwardConv(user) && user->operand(0) == instr) {
+        blocked_inputs.insert(user);
+      }
+    }
+  }
+  for (HloInstruction* conv : blocked_inputs) {
+    VLOG(2) << "Blocked input: " << conv->name();
+    TF_RETURN_IF_ERROR(SetKnob(conv, kOneDnnBlockedInputKnob));
+  }
+  return !candidates.empty();
+}
+
+}  // namespace
+
+StatusOr<bool> OneDnnBlockedLayoutPropagation::Run(
+    HloModule* module,
+    const absl::flat_hash_set<absl::string_view>& execution_threads) {
+  if (!BlockedLayoutEnabled()) return false;
+  bool changed = false;
+  for (HloComputation* computation :
+       module->MakeNonfusionComputations(execution_threads)) {
+    TF_ASSIGN_OR_RETURN(bool computation_changed,
+                        RunOnComputation(computation));
+    changed |= computation_changed;
+  }
+  return changed;
+}
+
+}  // namespace gpu
+}  // namespace xla
@@ -0,0 +1,59 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef XLA_SERVICE_GPU_ONEDNN_BLOCKED_LAYOUT_PROPAGATION_H_
+#define XLA_SERVICE_GPU_ONEDNN_BLOCKED_LAYOUT_PROPAGATION_H_
+
+#include "absl/strings/string_view.h"
+#include "xla/hlo/ir/hlo_module.h"
+#include "xla/service/hlo_pass_interface.h"
+
+namespace xla {
+namespace gpu {
+
+// Lets chains of oneDNN forward convolutions pass activations to each other
+// in oneDNN's blocked format, so that the producer writes and the consumer
+// reads the format the kernels work in, instead of a plain layout.
+//
+// XLA layouts cannot describe the blocked format, so the activations keep
+// their plain HLO shapes and only the convolutions at both ends learn of it,
+// through kOneDnnBlockedInputKnob and kOneDnnBlockedOutputKnob. This is
+// sound because every other instruction touching a blocked activation is
+// elementwise: with equal layouts and shapes on all its operands and result,
+// it computes the same values whatever order the elements are stored in.
+// Broadcast scalars are the only other operands allowed.
+//
+// An activation is blocked only if all its transitive users are such
+// elementwise ops or forward convolutions reading it as their input, so
+// plain layout remains at every boundary with other consumers: the entry
+// result, reductions, broadcasts, non-oneDNN custom calls and so on.
+//
+// Runs after layout assignment. Enabled by XLA_ONEDNN_BLOCKED_LAYOUT=true.
+class OneDnnBlockedLayoutPropagation : public HloModulePass {
+ public:
+  absl::string_view name() const override {
+    return "onednn-blocked-layout-propagation";
+  }
+
+  using HloPassInterface::Run;
+  StatusOr<bool> Run(
+      HloModule* module,
+      const absl::flat_hash_set<absl::string_view>& execution_threads) override;
+};
+
+}  // namespace gpu
+}  // namespace xla
+
+#endif  // XLA_SERVICE_GPU_ONEDNN_BLOCKED_LAYOUT_PROPAGATION_H_
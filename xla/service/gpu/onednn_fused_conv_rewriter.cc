@@ -18,12 +18,19 @@ limitations under the License.
 #include "xla/service/gpu/onednn_fused_conv_rewriter.h"
 
 #include <array>
+#include <cmath>
+#include <cstdint>
 #include <functional>
+#include <limits>
+#include <optional>
 #include <string>
 #include <tuple>
 #include <utility>
 #include <vector>
 
+#include "absl/algorithm/container.h"
+#include "absl/base/casts.h"
+#include "absl/container/flat_hash_map.h"
 #include "tsl/platform/errors.h"
 #include "tsl/platform/statusor.h"
 #include "xla/hlo/ir/hlo_casting_utils.h"
@@ -32,6 +39,7 @@ limitations under the License.
 #include "xla/primitive_util.h"
 #include "xla/service/gpu/backend_configs.pb.h"
 #include "xla/service/gpu/cublas_cudnn.h"
+#include "xla/service/gpu/gpu_conv_runner.h"
 #include "xla/service/hlo_creation_utils.h"
 #include "xla/service/pattern_matcher.h"
 #include "xla/stream_executor/dnn.pb.h"
@@ -44,11 +52,23 @@ namespace {
 
 namespace m = match;
 
+// Whether `instr` comes from OnednnQuantizedConvRewriter, whose bias operand
+// also holds the scales of the result.
+bool IsQuantizedConv(const HloInstruction* instr) {
+  StatusOr<CudnnConvBackendConfig> config =
+      instr->backend_config<CudnnConvBackendConfig>();
+  return config.ok() &&
+         config->algorithm().tuning_knobs().count(kOneDnnChannelScalesKnob) >
+             0;
+}
+
+// Quantized convs already have everything fused that their scales allow.
 bool IsConvCustomCall(const HloInstruction* instr) {
   return instr->opcode() == HloOpcode::kCustomCall &&
          (instr->custom_call_target() == kCudnnConvForwardCallTarget ||
           instr->custom_call_target() ==
-              kCudnnConvBiasActivationForwardCallTarget);
+              kCudnnConvBiasActivationForwardCallTarget) &&
+         !IsQuantizedConv(instr);
 }
 
 bool IsConvDepthwise(const HloInstruction* instr) {
@@ -69,6 +89,15 @@ bool IsNonDepthwiseConvCustomCall(const HloInstruction* instr) {
   return IsConvCustomCall(instr) && !IsConvDepthwise(instr);
 }
 
+// Whether `config` already has an activation, after which nothing else can be
+// fused.
+bool HasActivation(const CudnnConvBackendConfig& config) {
+  const auto& knobs = config.algorithm().tuning_knobs();
+  auto knob = knobs.find(kOneDnnActivationKnob);
+  return config.activation_mode() != se::dnn::kNone ||
+         (knob != knobs.end() && knob->second != kOneDnnActivationNone);
+}
+
 bool IsExponentialMinusOne(const HloInstruction* instr) {
   return instr->opcode() == HloOpcode::kExpm1;
 }
@@ -299,6 +328,12 @@ StatusOr<bool> FuseConvAlpha(HloComputation* comp) {
   return changed;
 }
 
+// gte(conv) + addend or gte(conv) - addend ->
+// gte(conv-bias-activation(..., bias or side_input)).
+//
+// A bias the conv already has is added to rather than replaced, so that e.g.
+// both the bias of a layer and the shift of the batch norm after it fold into
+// one.
 StatusOr<bool> FuseBiasOrSideInput(HloComputation* comp) {
   bool changed = false;
   for (auto instr : comp->MakeInstructionPostOrder()) {
@@ -308,23 +343,26 @@ StatusOr<bool> FuseBiasOrSideInput(HloComputation* comp) {
 
     // We don't want to upgrade depthwise convolutions to ConvBiasActivation,
     // because the fused CUDNN functions are slower for some of those.
-    auto pattern = m::AddAnyOrder(
+    auto conv_result =
         m::GetTupleElement(&gte,
                            m::Op(&conv)
                                .WithPredicate(IsNonDepthwiseConvCustomCall)
                                .WithOneUse(),
                            0)
-            .WithOneUse(),
-        m::Op(&addend));
-    if (!Match(instr, pattern)) {
-      continue;
+            .WithOneUse();
+    bool subtract = false;
+    if (!Match(instr, m::AddAnyOrder(conv_result, m::Op(&addend)))) {
+      if (!Match(instr, m::Subtract(conv_result, m::Op(&addend)))) {
+        continue;
+      }
+      subtract = true;
     }
 
     // If it's a vanilla forward conv, upgrade it to a bias-activation conv.  We
     // only want to do this if the fusion will succeed, but we're guaranteed
     // that it will, because the only reason we'll bail at this point is if
-    // !can_accept_bias && !can_accept_side_input, and our shiny new
-    // bias-activation conv will be able to accept both.
+    // the addend is no bias and !can_accept_side_input, and our shiny new
+    // bias-activation conv will be able to accept a side input.
     if (conv->custom_call_target() == kCudnnConvForwardCallTarget) {
       TF_ASSIGN_OR_RETURN(conv, EnsureIsConvBiasActivation(conv));
     }
@@ -334,14 +372,14 @@ StatusOr<bool> FuseBiasOrSideInput(HloComputation* comp) {
     // is applied.
     TF_ASSIGN_OR_RETURN(auto config,
                         conv->backend_config<CudnnConvBackendConfig>());
-    if (config.activation_mode() != se::dnn::kNone) {
+    if (HasActivation(config)) {
       continue;
     }
 
     // Does `conv` already have a (nonzero) bias?  Does it already have a
     // side_input?
-    bool can_accept_bias =
-        Match(conv->operand(2), m::Broadcast(m::ConstantEffectiveScalar(0)));
+    bool has_bias =
+        !Match(conv->operand(2), m::Broadcast(m::ConstantEffectiveScalar(0)));
     bool can_accept_side_input = conv->operand_count() < 4;
 
     // The addend can be fused as a bias if
@@ -364,23 +402,36 @@ StatusOr<bool> FuseBiasOrSideInput(HloComputation* comp) {
 
     absl::InlinedVector<HloInstruction*, 4> new_operands(
         conv->operands().begin(), conv->operands().end());
-    if (can_accept_bias && addend_may_be_rank1_bias) {
-      new_operands[2] = MakeConvertToHlo(addend->mutable_operand(0), bias_ty,
-                                         &addend->operand(0)->metadata());
-    } else if (can_accept_bias && addend_may_be_rank0_bias) {
-      new_operands[2] = MakeBroadcastHlo(
+    HloInstruction* bias = nullptr;
+    if (addend_may_be_rank1_bias) {
+      bias = MakeConvertToHlo(addend->mutable_operand(0), bias_ty,
+                              &addend->operand(0)->metadata());
+    } else if (addend_may_be_rank0_bias) {
+      bias = MakeBroadcastHlo(
           MakeConvertToHlo(addend->mutable_operand(0), bias_ty,
                            &addend->operand(0)->metadata()),
           /*broadcast_dimensions=*/{},
           /*result_shape_bounds=*/
           {gte->shape().dimensions(conv->convolution_dimension_numbers()
                                        .output_feature_dimension())});
+    }
+    bool fuse_side_input = false;
+    if (bias != nullptr) {
+      if (subtract) {
+        TF_ASSIGN_OR_RETURN(bias, MakeUnaryHlo(HloOpcode::kNegate, bias));
+      }
+      if (has_bias) {
+        TF_ASSIGN_OR_RETURN(
+            bias, MakeBinaryHlo(HloOpcode::kAdd, new_operands[2], bias));
+      }
+      new_operands[2] = bias;
     } else if (can_accept_side_input) {
       CHECK_EQ(new_operands.size(), 3);
       new_operands.push_back(addend);
-      config.set_side_input_scale(1);
+      config.set_side_input_scale(subtract ? -1 : 1);
+      fuse_side_input = true;
     } else {
-      // Can't fuse; this op already has a bias and a side-input.
+      // Can't fuse; this op already has a side-input and addend is no bias.
       continue;
     }
 
@@ -394,7 +445,7 @@ StatusOr<bool> FuseBiasOrSideInput(HloComputation* comp) {
         conv->CloneWithNewOperands(conv->shape(), new_operands));
     comp->parent()->SetAndUniquifyInstrName(new_conv, conv->name());
     TF_RETURN_IF_ERROR(new_conv->set_backend_config(config));
-    if (can_accept_side_input) {
+    if (fuse_side_input) {
       xla::Cast<HloCustomCallInstruction>(new_conv)
           ->set_output_to_operand_aliasing(
               {{{}, {new_operands.size() - 1, {}}}});
@@ -407,6 +458,83 @@ StatusOr<bool> FuseBiasOrSideInput(HloComputation* comp) {
   return changed;
 }
 
+// gte(custom-call(x, w, bias)) * broadcast(scale) ->
+// gte(custom-call(x, w * broadcast(scale), bias * scale)),
+//
+// where `scale` has one element per output feature. This folds the scale of
+// an inference batch norm into the filter, whose shift FuseBiasOrSideInput
+// then folds into the bias. For constant filters, constant folding computes
+// the scaled filter at compile time.
+StatusOr<bool> FuseChannelScale(HloComputation* comp) {
+  bool changed = false;
+  for (HloInstruction* instr : comp->MakeInstructionPostOrder()) {
+    HloInstruction* conv = nullptr;
+    HloInstruction* gte = nullptr;
+    HloInstruction* broadcast = nullptr;
+    HloInstruction* scale = nullptr;
+    auto pattern = m::MultiplyAnyOrder(
+        m::GetTupleElement(
+            &gte, m::Op(&conv).WithPredicate(IsConvCustomCall).WithOneUse(),
+            0)
+            .WithOneUse(),
+        m::Broadcast(&broadcast, m::Op(&scale)));
+    if (!Match(instr, pattern)) {
+      continue;
+    }
+
+    const ConvolutionDimensionNumbers& dnums =
+        conv->convolution_dimension_numbers();
+    if (broadcast->dimensions().size() != 1 ||
+        broadcast->dimensions(0) != dnums.output_feature_dimension()) {
+      continue;
+    }
+    // Integer filters cannot hold the product, and a side input would have
+    // to be scaled as well.
+    const Shape& filter_shape = conv->operand(1)->shape();
+    if (!primitive_util::IsFloatingPointType(filter_shape.element_type()) ||
+        conv->operand_count() > 3) {
+      continue;
+    }
+    // The activation comes after the scale.
+    TF_ASSIGN_OR_RETURN(CudnnConvBackendConfig config,
+                        conv->backend_config<CudnnConvBackendConfig>());
+    if (HasActivation(config)) {
+      continue;
+    }
+    if (!ConsumeFuel("onednn-fused-convolution-rewriter", [&] {
+          return absl::StrCat("FuseChannelScale: ", conv->ToString());
+        })) {
+      continue;
+    }
+
+    absl::InlinedVector<HloInstruction*, 3> new_operands(
+        conv->operands().begin(), conv->operands().end());
+    HloInstruction* filter_scale = MakeBroadcastHlo(
+        MakeConvertToHlo(scale, filter_shape.element_type()),
+        /*broadcast_dimensions=*/{dnums.kernel_output_feature_dimension()},
+        /*result_shape_bounds=*/filter_shape.dimensions());
+    TF_ASSIGN_OR_RETURN(new_operands[1],
+                        MakeBinaryHlo(HloOpcode::kMultiply, new_operands[1],
+                                      filter_scale));
+    if (new_operands.size() > 2) {
+      HloInstruction* bias_scale = MakeConvertToHlo(
+          scale, new_operands[2]->shape().element_type());
+      TF_ASSIGN_OR_RETURN(new_operands[2],
+                          MakeBinaryHlo(HloOpcode::kMultiply, new_operands[2],
+                                        bias_scale));
+    }
+
+    HloInstruction* new_conv = comp->AddInstruction(
+        conv->CloneWithNewOperands(conv->shape(), new_operands));
+    comp->parent()->SetAndUniquifyInstrName(new_conv, conv->name());
+    TF_ASSIGN_OR_RETURN(HloInstruction * new_gte,
+                        MakeGetTupleElementHlo(new_conv, 0));
+    TF_RETURN_IF_ERROR(comp->ReplaceInstruction(instr, new_gte));
+    changed = true;
+  }
+  return changed;
+}
+
 // custom-call(..., alpha * side_input) ->
 // custom-call(..., side_input, backend_config={alpha}).
 //
@@ -522,12 +650,10 @@ StatusOr<bool> FuseSideInputAlpha(HloComputation* comp) {
   return changed;
 }
 
+// select(gte > 0, gte, expm1(gte)) -> gte, with an elu activation.
 StatusOr<bool> FuseElu(HloComputation* comp) {
   bool changed = false;
   for (HloInstruction* instr : comp->MakeInstructionPostOrder()) {
-    const DebugOptions& debug_options =
-        instr->GetModule()->config().debug_options();
-
     HloInstruction* gte;
     HloInstruction* conv;
     HloInstruction* expm1;
@@ -541,7 +667,6 @@ StatusOr<bool> FuseElu(HloComputation* comp) {
                            m::Op(&conv)
                                .WithPredicate(IsNonDepthwiseConvCustomCall)
                                .WithOneUse())
-            .WithElementType(F16)
             .WithPredicate(HasThreeUsers);
     if (!Match(instr,
                m::Select(m::Compare(gte_pattern,
@@ -556,32 +681,9 @@ StatusOr<bool> FuseElu(HloComputation* comp) {
       continue;
     }
 
-    // In some cases, the XLA optimizes the inputs of the convolution by
-    // moving and broadcasting the bias to the side input, e.g., when the input
-    // spatial dimensions are all ones and filter spatial dimentsions are all
-    // non-ones. However, there is a known issue that the side input is not well
-    // supported in the cuDNN runtime fusion. Therefore, we skip these cases.
-    // TODO(kaixih@nvidia): remove this check when cuDNN fixes it.
-    if (conv->operands().size() > 3) {
-      continue;
-    }
-
-    // cuDNN runtime funsion kernels require 32-bit aligned data access. Since
-    // we only allow fp16 datatype, we need to check if the in and out channels
-    // of filter are even numbers.
-    const Shape& shape = conv->operand(1)->shape();
-    int64_t num_input_features = shape.dimensions(
-        conv->convolution_dimension_numbers().kernel_input_feature_dimension());
-    int64_t num_output_features =
-        shape.dimensions(conv->convolution_dimension_numbers()
-                             .kernel_output_feature_dimension());
-    if (num_input_features % 2 != 0 || num_output_features % 2 != 0) {
-      continue;
-    }
-
     TF_ASSIGN_OR_RETURN(CudnnConvBackendConfig config,
                         conv->backend_config<CudnnConvBackendConfig>());
-    if (config.activation_mode() != se::dnn::kNone) {
+    if (HasActivation(config)) {
       continue;
     }
 
@@ -618,7 +720,7 @@ StatusOr<bool> FuseRelu(HloComputation* comp) {
     }
     TF_ASSIGN_OR_RETURN(CudnnConvBackendConfig config,
                         conv->backend_config<CudnnConvBackendConfig>());
-    if (config.activation_mode() != se::dnn::kNone) {
+    if (HasActivation(config)) {
       continue;
     }
 
@@ -636,6 +738,285 @@ StatusOr<bool> FuseRelu(HloComputation* comp) {
   return changed;
 }
 
+// A broadcast scalar constant close to `value`, for constants such as
+// sqrt(2 / pi) that frontends round differently.
+auto BroadcastConstantNear(double value) {
+  return m::Broadcast(m::ConstantScalar().WithPredicate(
+      [value](const HloInstruction* instr) {
+        std::optional<double> actual =
+            Cast<HloConstantInstruction>(instr)->literal().GetAsDouble({});
+        if (!actual.has_value()) return false;
+        double epsilon = 1024 * std::numeric_limits<float>::epsilon();
+        return std::abs(*actual - value) <
+               std::abs(*actual + value) * epsilon;
+      }));
+}
+
+// Collects the factors of the tree of single-user multiplies and divides
+// rooted at `instr`, a multiply or divide, into `factors` and their divisors
+// into `divisors`.
+void CollectFactors(HloInstruction* instr,
+                    std::vector<HloInstruction*>& factors,
+                    std::vector<HloInstruction*>& divisors) {
+  auto collect = [&](HloInstruction* operand) {
+    if ((operand->opcode() == HloOpcode::kMultiply ||
+         operand->opcode() == HloOpcode::kDivide) &&
+        operand->user_count() == 1) {
+      CollectFactors(operand, factors, divisors);
+    } else {
+      factors.push_back(operand);
+    }
+  };
+  collect(instr->mutable_operand(0));
+  if (instr->opcode() == HloOpcode::kDivide) {
+    divisors.push_back(instr->mutable_operand(1));
+  } else {
+    collect(instr->mutable_operand(1));
+  }
+}
+
+// Whether nothing but `activation` reads `gte` or the instructions computing
+// `activation` from it, so that fusing `activation` leaves none of them live.
+bool IsWholeActivation(const HloInstruction* activation,
+                       const HloInstruction* gte) {
+  absl::flat_hash_map<const HloInstruction*, bool> reads_gte = {{gte, true}};
+  std::function<bool(const HloInstruction*)> visit =
+      [&](const HloInstruction* instr) {
+        auto it = reads_gte.find(instr);
+        if (it != reads_gte.end()) return it->second;
+        bool reads = false;
+        for (const HloInstruction* operand : instr->operands()) {
+          reads |= visit(operand);
+        }
+        reads_gte[instr] = reads;
+        return reads;
+      };
+  visit(activation);
+  return absl::c_all_of(reads_gte, [&](const auto& entry) {
+    return !entry.second || entry.first == activation ||
+           absl::c_all_of(entry.first->users(),
+                          [&](const HloInstruction* user) {
+                            auto it = reads_gte.find(user);
+                            return it != reads_gte.end() && it->second;
+                          });
+  });
+}
+
+// Makes `conv` apply the activation that `instr` computes from `gte`, its
+// result, as `set_activation` records it in the backend config, and replaces
+// `instr` by `gte`. Returns false if `conv` already has an activation.
+StatusOr<bool> FuseActivation(
+    HloInstruction* instr, HloInstruction* gte, HloInstruction* conv,
+    absl::string_view name,
+    const std::function<void(CudnnConvBackendConfig*)>& set_activation) {
+  TF_ASSIGN_OR_RETURN(CudnnConvBackendConfig config,
+                      conv->backend_config<CudnnConvBackendConfig>());
+  if (HasActivation(config)) {
+    return false;
+  }
+  if (!ConsumeFuel("onednn-fused-convolution-rewriter", [&] {
+        return absl::StrCat(name, ": ", conv->ToString());
+      })) {
+    return false;
+  }
+  TF_ASSIGN_OR_RETURN(conv, EnsureIsConvBiasActivation(conv));
+  set_activation(&config);
+  TF_RETURN_IF_ERROR(conv->set_backend_config(config));
+  TF_RETURN_IF_ERROR(conv->parent()->ReplaceInstruction(instr, gte));
+  return true;
+}
+
+void SetOneDnnActivation(CudnnConvBackendConfig* config,
+                         OneDnnActivation activation) {
+  (*config->mutable_algorithm()->mutable_tuning_knobs())
+      [kOneDnnActivationKnob] = activation;
+}
+
+// clamp(lo, gte, hi) -> gte, with a relu6 activation if lo = 0 and hi = 6 and
+// a clamp one otherwise.
+StatusOr<bool> FuseClamp(HloComputation* comp) {
+  bool changed = false;
+  for (HloInstruction* instr : comp->MakeInstructionPostOrder()) {
+    HloInstruction* gte;
+    HloInstruction* conv;
+    HloInstruction* lo;
+    HloInstruction* hi;
+    // We don't want to upgrade depthwise convolutions to ConvBiasActivation,
+    // because the fused CUDNN functions are slower for some of those.
+    auto conv_result =
+        m::GetTupleElement(
+            &gte, m::Op(&conv)
+                      .WithPredicate(IsNonDepthwiseConvCustomCall)
+                      .WithOneUse())
+            .WithOneUse();
+    if (!Match(instr,
+               m::Clamp(m::Broadcast(m::ConstantEffectiveScalar(&lo)),
+                        conv_result,
+                        m::Broadcast(m::ConstantEffectiveScalar(&hi))))) {
+      continue;
+    }
+    // Leave the saturation of s8 convs to FuseConvertToS8.
+    if (absl::c_any_of(instr->users(), [](const HloInstruction* user) {
+          return user->opcode() == HloOpcode::kConvert &&
+                 primitive_util::IsIntegralType(user->shape().element_type());
+        })) {
+      continue;
+    }
+
+    TF_ASSIGN_OR_RETURN(Literal lo_f32, lo->literal().Convert(F32));
+    TF_ASSIGN_OR_RETURN(Literal hi_f32, hi->literal().Convert(F32));
+    float lo_value = lo_f32.GetFirstElement<float>();
+    float hi_value = hi_f32.GetFirstElement<float>();
+    TF_ASSIGN_OR_RETURN(
+        bool fused,
+        FuseActivation(instr, gte, conv, "FuseClamp",
+                       [&](CudnnConvBackendConfig* config) {
+                         if (lo_value == 0 && hi_value == 6) {
+                           config->set_activation_mode(se::dnn::kRelu6);
+                           return;
+                         }
+                         SetOneDnnActivation(config, kOneDnnActivationClamp);
+                         auto& knobs = *config->mutable_algorithm()
+                                            ->mutable_tuning_knobs();
+                         knobs[kOneDnnClampLowKnob] =
+                             absl::bit_cast<int32_t>(lo_value);
+                         knobs[kOneDnnClampHighKnob] =
+                             absl::bit_cast<int32_t>(hi_value);
+                       }));
+    changed |= fused;
+  }
+  return changed;
+}
+
+// Activations of the form gte * gate(gte), in any association of the
+// multiplications and divisions:
+//
+//   SiLU:        gte * logistic(gte) or gte / (1 + exp(-gte))
+//   hard swish:  gte * clamp(0, gte + 3, 6) / 6
+//   GELU:        gte * 0.5 * (1 + tanh(sqrt(2 / pi) *
+//                                      (gte + 0.044715 * gte^3)))
+//   exact GELU:  gte * 0.5 * (1 + erf(gte / sqrt(2)))
+StatusOr<bool> FuseSelfGatedActivation(HloComputation* comp) {
+  bool changed = false;
+  for (HloInstruction* instr : comp->MakeInstructionPostOrder()) {
+    if (instr->opcode() != HloOpcode::kMultiply &&
+        instr->opcode() != HloOpcode::kDivide) {
+      continue;
+    }
+    std::vector<HloInstruction*> factors;
+    std::vector<HloInstruction*> divisors;
+    CollectFactors(instr, factors, divisors);
+
+    // We don't want to upgrade depthwise convolutions to ConvBiasActivation,
+    // because the fused CUDNN functions are slower for some of those.
+    HloInstruction* gte = nullptr;
+    HloInstruction* conv = nullptr;
+    auto conv_result = m::GetTupleElement(
+        &gte,
+        m::Op(&conv).WithPredicate(IsNonDepthwiseConvCustomCall).WithOneUse(),
+        0);
+    auto gte_it = absl::c_find_if(factors, [&](HloInstruction* factor) {
+      return Match(factor, conv_result);
+    });
+    if (gte_it == factors.end()) {
+      continue;
+    }
+    factors.erase(gte_it);
+
+    // Whether `instrs`, the other factors or the divisors, are matched by
+    // `patterns`, one each.
+    auto x = m::Op().Is(gte);
+    auto are = [](const std::vector<HloInstruction*>& instrs,
+                  auto... patterns) {
+      return instrs.size() == sizeof...(patterns) &&
+             (absl::c_any_of(instrs, [&](HloInstruction* instr) {
+                return Match(instr, patterns);
+              }) &&
+              ...);
+    };
+    auto factors_are = [&](auto... patterns) {
+      return are(factors, patterns...);
+    };
+    auto divisors_are = [&](auto... patterns) {
+      return are(divisors, patterns...);
+    };
+    auto relu6_shifted =
+        m::Clamp(m::Broadcast(m::ConstantEffectiveScalar(0)),
+                 m::AddAnyOrder(x, m::Broadcast(m::ConstantEffectiveScalar(3))),
+                 m::Broadcast(m::ConstantEffectiveScalar(6)));
+    auto cube = m::AnyOf<HloInstruction>(
+        m::MultiplyAnyOrder(x, m::MultiplyAnyOrder(x, x)),
+        m::Op()
+            .WithOpcode(HloOpcode::kPower)
+            .WithOperand(0, x)
+            .WithOperand(1, m::Broadcast(m::ConstantEffectiveScalar(3))));
+    auto gelu_cdf = [&](auto argument) {
+      return m::AddAnyOrder(m::Broadcast(m::ConstantEffectiveScalar(1)),
+                            argument);
+    };
+    auto half = m::Broadcast(m::ConstantEffectiveScalar(0.5));
+
+    std::optional<OneDnnActivation> activation;
+    auto logistic = m::Op().WithOpcode(HloOpcode::kLogistic).WithOperand(0, x);
+    if (factors_are(logistic) && divisors.empty()) {
+      activation = kOneDnnActivationSiLU;
+    } else if (factors.empty() &&
+               divisors_are(
+                   m::AddAnyOrder(m::Broadcast(m::ConstantEffectiveScalar(1)),
+                                  m::Exp(m::Negate(x))))) {
+      activation = kOneDnnActivationSiLU;
+    } else if ((factors_are(relu6_shifted) &&
+                divisors_are(m::Broadcast(m::ConstantEffectiveScalar(6)))) ||
+               (factors_are(relu6_shifted, BroadcastConstantNear(1.0 / 6)) &&
+                divisors.empty())) {
+      activation = kOneDnnActivationHardSwish;
+    } else if (factors_are(
+                   half,
+                   gelu_cdf(m::Tanh(m::MultiplyAnyOrder(
+                       BroadcastConstantNear(std::sqrt(M_2_PI)),
+                       m::AddAnyOrder(
+                           x, m::MultiplyAnyOrder(
+                                  BroadcastConstantNear(0.044715), cube)))))) &&
+               divisors.empty()) {
+      activation = kOneDnnActivationGELU;
+    } else if (factors_are(
+                   half,
+                   gelu_cdf(m::Op()
+                                .WithOpcode(HloOpcode::kErf)
+                                .WithOperand(
+                                    0, m::AnyOf<HloInstruction>(
+                                           m::MultiplyAnyOrder(
+                                               x, BroadcastConstantNear(
+                                                      M_SQRT1_2)),
+                                           m::Divide(x, BroadcastConstantNear(
+                                                            M_SQRT2)))))) &&
+               divisors.empty()) {
+      activation = kOneDnnActivationGELUErf;
+    }
+    if (!activation.has_value() || !IsWholeActivation(instr, gte)) {
+      continue;
+    }
+
+    TF_ASSIGN_OR_RETURN(
+        bool fused,
+        FuseActivation(instr, gte, conv, "FuseSelfGatedActivation",
+                       [&](CudnnConvBackendConfig* config) {
+                         SetOneDnnActivation(config, *activation);
+                       }));
+    changed |= fused;
+  }
+  return changed;
+}
+
+StatusOr<bool> FuseActivations(HloComputation* comp) {
+  bool changed = false;
+  for (auto* fuse : {FuseRelu, FuseElu, FuseClamp, FuseSelfGatedActivation}) {
+    TF_ASSIGN_OR_RETURN(bool fused, fuse(comp));
+    changed |= fused;
+  }
+  return changed;
+}
+
 StatusOr<bool> FuseConvertToF16(HloComputation* comp) {
   bool changed = false;
   for (HloInstruction* instr : comp->MakeInstructionPostOrder()) {
@@ -897,6 +1278,12 @@ void VlogStats(HloModule* module) {
       stats[absl::StrCat(
           "32 convs with activation mode ",
           se::dnn::ActivationMode_Name(config->activation_mode()))]++;
+      const auto& knobs = config->algorithm().tuning_knobs();
+      auto activation = knobs.find(kOneDnnActivationKnob);
+      if (activation != knobs.end()) {
+        stats[absl::StrCat("33 convs with oneDNN activation ",
+                           activation->second)]++;
+      }
     }
   }
 
@@ -934,14 +1321,23 @@ StatusOr<bool> OnednnFusedConvRewriter::Run(
     any_changed |= changed;
     TF_ASSIGN_OR_RETURN(changed, FuseBiasOrSideInput(comp));
     any_changed |= changed;
+    // An inference batch norm, (conv - mean) * scale + shift, with the
+    // subtraction fused above and the addition below.
+    TF_ASSIGN_OR_RETURN(changed, FuseChannelScale(comp));
+    any_changed |= changed;
+    // Fuse to a fixed point: in conv -> batch norm -> add(residual), as in
+    // ResNet blocks, the batch norm shift folds into the bias and the residual
+    // then becomes the side input.
+    do {
+      TF_ASSIGN_OR_RETURN(changed, FuseBiasOrSideInput(comp));
+      any_changed |= changed;
+    } while (changed);
     TF_ASSIGN_OR_RETURN(changed, FuseSideInputAlpha(comp));
     any_changed |= changed;
 
-    // Relu might appear before or after convert-to-f16/s8, so we check in both
-    // cases.
-    TF_ASSIGN_OR_RETURN(changed, FuseRelu(comp));
-    any_changed |= changed;
-    TF_ASSIGN_OR_RETURN(changed, FuseElu(comp));
+    // Activations might appear before or after convert-to-f16/s8, so we check
+    // in both cases.
+    TF_ASSIGN_OR_RETURN(changed, FuseActivations(comp));
     any_changed |= changed;
 
     TF_ASSIGN_OR_RETURN(changed, FuseConvertToF16(comp));
@@ -958,9 +1354,7 @@ StatusOr<bool> OnednnFusedConvRewriter::Run(
     TF_ASSIGN_OR_RETURN(changed, FuseSideInputAlpha(comp));
     any_changed |= changed;
 
-    TF_ASSIGN_OR_RETURN(changed, FuseRelu(comp));
-    any_changed |= changed;
-    TF_ASSIGN_OR_RETURN(changed, FuseElu(comp));
+    TF_ASSIGN_OR_RETURN(changed, FuseActivations(comp));
     any_changed |= changed;
 
     // Check that we don't have any convs outputing integer types other than s8.
@@ -41,6 +41,12 @@ namespace gpu {
 // You can leave out side_input, bias, alpha1, alpha2, and max(x, 0) and still
 // get a fused convolution.  alpha1/2 must be broadcasts of scalar constants.
 //
+// Instead of max(x, 0), the activation can also be elu, clamp(lo, x, hi) with
+// constant bounds (relu6 among them), SiLU, hard swish, or GELU in its tanh or
+// erf form.  Vectors over the output features that are added to or subtracted
+// from the conv all go into `bias`, and one multiplying it is folded into `w`
+// and `bias`, so that an inference batch norm after the conv fuses as well.
+//
 // f16 convs accumulate in f32.  We represent this in HLO as an f32 convolution
 // whose inputs can be converted to f16 without loss of precision and whose
 // output is immediately converted to f16.  A fused f16 conv must follow one of
@@ -89,6 +95,10 @@ namespace gpu {
 //
 // If you have an integer convolution that doesn't fit one of these idioms, this
 // pass returns an error -- cudnn will not be able to run it.
+//
+// Convs of dequantized operands that OnednnQuantizedConvRewriter turned into
+// integer convs before this pass, with their u8 operands and per-channel
+// scales, are left as they are.
 class OnednnFusedConvRewriter : public HloModulePass {
  public:
   explicit OnednnFusedConvRewriter() {}
@@ -18,7 +18,11 @@ limitations under the License.
 #include "xla/service/gpu/onednn_matmul_utils.h"
 
 #include <algorithm>
+#include <complex>
 #include <cstdint>
+#include <limits>
+#include <list>
+#include <memory>
 #include <optional>
 #include <tuple>
 #include <type_traits>
@@ -27,6 +31,12 @@ limitations under the License.
 #include <xetla.hpp>
 
 #include "absl/algorithm/container.h"
+#include "absl/base/const_init.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/node_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "absl/types/span.h"
 #include "dnnl.hpp"       // NOLINT(build/include_subdir)
 #include "dnnl_sycl.hpp"  // NOLINT(build/include_subdir)
@@ -38,7 +48,11 @@ limitations under the License.
 #include "xla/hlo/ir/hlo_module.h"
 #include "xla/mlir_hlo/lhlo_gpu/IR/lhlo_gpu_ops.h"
 #include "xla/service/gpu/matrix_descriptor.h"
+#include "xla/service/gpu/mkl.h"
 #include "xla/service/gpu/xetla/gemm/gemm.h"
+#include "xla/service/gpu/xetla/gemm/grouped_gemm.h"
+#include "xla/service/gpu/xetla/gemm/weight_only_gemm.h"
+#include "xla/service/gpu/xetla_gemm_tuning.h"
 #include "xla/service/onednn_util.h"
 #include "xla/shape.h"
 #include "xla/shape_util.h"
@@ -104,6 +118,38 @@ inline dnnl::memory::data_type OneDnnType<::gpu::xetla::bf16>() {
   return dnnl::memory::data_type::bf16;
 }
 
+// A ready oneDNN matmul with the memory descriptors it was created for.
+struct OneDnnMatMulPrimitive {
+  dnnl::engine engine;
+  dnnl::memory::desc src_md;
+  dnnl::memory::desc weights_md;
+  dnnl::memory::desc dst_md;
+  dnnl::memory::desc bias_md;
+  // The bias is the src1 of this binary post-op rather than the matmul bias,
+  // unless it is -1.
+  int bias_post_op = -1;
+  dnnl::memory::desc scratchpad_md;
+  size_t scratchpad_size = 0;
+  dnnl::matmul primitive;
+
+  // FP8 GEMMs only. `scale_md` describes a device F32 scalar. The D scale is
+  // the src1 of post-op `dst_scale_post_op`, unless that is -1.
+  dnnl::memory::desc scale_md;
+  int dst_scale_post_op = -1;
+  // FP8 GEMMs computing amax only. The matmul writes F32 `dst_md` into a
+  // temporary, which `dst_scale` scales and converts into `out_md`.
+  dnnl::memory::desc out_md;
+  dnnl::binary dst_scale;
+
+  // GEMMs with post-ops only. For each post-op operand past a leading bias,
+  // in order: the index of the binary post-op reading it and its desc.
+  std::vector<std::pair<int, dnnl::memory::desc>> binary_post_ops;
+};
+
+class Fp8GemmAmaxKernel;
+template <typename T>
+class WeightOnlyGemmDequantizeKernel;
+
 namespace {
 
 MatrixDescriptor GetMatrixDesc(const MatrixLayout& layout,
@@ -145,14 +191,48 @@ struct OneDnnMatMulParams {
         bias_strides(std::move(bias_strides)) {}
 };
 
+// Scratch memory for the split-K partials of the XeTLA runs of one GEMM,
+// allocated only when a kernel chooses to split. Tuning runs share the
+// largest allocation so far. Without an allocator, or when allocation fails,
+// the kernels run unsplit.
+class XetlaGemmWorkspace {
+ public:
+  explicit XetlaGemmWorkspace(se::ScratchAllocator* scratch_allocator)
+      : scratch_allocator_(scratch_allocator) {}
+
+  ::gpu::xetla::XetlaGemmWorkspaceAllocator allocator() {
+    return [this](size_t size) { return Allocate(size); };
+  }
+
+ private:
+  void* Allocate(size_t size) {
+    if (size <= workspace_.size()) return workspace_.opaque();
+    if (scratch_allocator_ == nullptr) return nullptr;
+    void* data;
+    Status status = AllocateWorkspace(&data, scratch_allocator_, size);
+    if (!status.ok()) {
+      VLOG(1) << "Running XeTLA GEMM unsplit: " << status;
+      return nullptr;
+    }
+    workspace_ = se::DeviceMemoryBase(data, size);
+    return data;
+  }
+
+  se::ScratchAllocator* scratch_allocator_;
+  se::DeviceMemoryBase workspace_;
+};
+
 template <typename InputT>
 std::enable_if_t<std::is_same_v<InputT, ::gpu::xetla::bf16> ||
                      std::is_same_v<InputT, sycl::half>,
                  StatusOr<bool>>
-RunXetlaGemm(se::gpu::GpuStreamHandle handle, const MatrixDescriptor& lhs,
-             const MatrixDescriptor& rhs, const MatrixDescriptor& c,
-             const MatrixDescriptor& out, se::DeviceMemoryBase bias,
-             se::cuda::BlasLt::Epilogue epilogue, float beta) {
+RunXetlaGemm(se::gpu::GpuStreamHandle handle, int64_t batch_size,
+             const MatrixDescriptor& lhs, const MatrixDescriptor& rhs,
+             const MatrixDescriptor& c, const MatrixDescriptor& out,
+             se::DeviceMemoryBase bias, se::cuda::BlasLt::Epilogue epilogue,
+             float beta, int config_index,
+             const ::gpu::xetla::XetlaGemmWorkspaceAllocator&
+                 workspace_allocator) {
   void* bias_data = const_cast<void*>(bias.opaque());
   void* c_data = const_cast<void*>(c.data.opaque());
   switch (epilogue) {
@@ -161,13 +241,17 @@ RunXetlaGemm(se::gpu::GpuStreamHandle handle, const MatrixDescriptor& lhs,
                         .add_matrix_c(out)
                         .add_matrix_a(lhs)
                         .add_matrix_b(rhs)
+                        .add_config_index(config_index)
+                        .add_batch_size(batch_size)
+                        .add_workspace_allocator(workspace_allocator)
                         .build();
       if (fabs(beta) - 0.0f > 1e-6) {
         if (fabs(beta) - 1.0f < 1e-6) {
           policy
               .add_epilogue(
                   c_data,
-                  ::gpu::xetla::XetlaGemmKernel<InputT>::EpilogueType::RES_ADD)
+                  ::gpu::xetla::XetlaGemmKernel<InputT>::EpilogueType::RES_ADD,
+                  1.0f, c.batch_stride)
               .build();
         } else {
           return true;
@@ -184,6 +268,9 @@ RunXetlaGemm(se::gpu::GpuStreamHandle handle, const MatrixDescriptor& lhs,
               .add_matrix_c(out)
               .add_matrix_a(lhs)
               .add_matrix_b(rhs)
+              .add_config_index(config_index)
+              .add_batch_size(batch_size)
+              .add_workspace_allocator(workspace_allocator)
               .add_epilogue(
                   bias_data,
                   ::gpu::xetla::XetlaGemmKernel<InputT>::EpilogueType::BIAS)
@@ -193,7 +280,7 @@ RunXetlaGemm(se::gpu::GpuStreamHandle handle, const MatrixDescriptor& lhs,
             .add_epilogue(
                 c_data,
                 ::gpu::xetla::XetlaGemmKernel<InputT>::EpilogueType::RES_ADD,
-                beta)
+                beta, c.batch_stride)
             .build();
       }
       if (policy.fallback() == false) {
@@ -207,6 +294,9 @@ RunXetlaGemm(se::gpu::GpuStreamHandle handle, const MatrixDescriptor& lhs,
               .add_matrix_c(out)
               .add_matrix_a(lhs)
               .add_matrix_b(rhs)
+              .add_config_index(config_index)
+              .add_batch_size(batch_size)
+              .add_workspace_allocator(workspace_allocator)
               .add_epilogue(
                   nullptr,
                   ::gpu::xetla::XetlaGemmKernel<InputT>::EpilogueType::GELU)
@@ -222,6 +312,9 @@ RunXetlaGemm(se::gpu::GpuStreamHandle handle, const MatrixDescriptor& lhs,
               .add_matrix_c(out)
               .add_matrix_a(lhs)
               .add_matrix_b(rhs)
+              .add_config_index(config_index)
+              .add_batch_size(batch_size)
+              .add_workspace_allocator(workspace_allocator)
               .add_epilogue(
                   bias_data,
                   ::gpu::xetla::XetlaGemmKernel<InputT>::EpilogueType::BIAS)
@@ -244,13 +337,130 @@ RunXetlaGemm(se::gpu::GpuStreamHandle handle, const MatrixDescriptor& lhs,
 
 template <typename InputT>
 std::enable_if_t<std::is_same_v<InputT, float>, StatusOr<bool>> RunXetlaGemm(
-    se::gpu::GpuStreamHandle handle, const MatrixDescriptor& lhs,
-    const MatrixDescriptor& rhs, const MatrixDescriptor& c,
-    const MatrixDescriptor& out, se::DeviceMemoryBase bias,
-    se::cuda::BlasLt::Epilogue epilogue, float beta) {
+    se::gpu::GpuStreamHandle handle, int64_t batch_size,
+    const MatrixDescriptor& lhs, const MatrixDescriptor& rhs,
+    const MatrixDescriptor& c, const MatrixDescriptor& out,
+    se::DeviceMemoryBase bias, se::cuda::BlasLt::Epilogue epilogue, float beta,
+    int config_index,
+    const ::gpu::xetla::XetlaGemmWorkspaceAllocator& workspace_allocator) {
   return InternalError("Unsupported Datatype in XeTLA");
 }
 
+// Times every XeTLA tile config on the problem, writing to a temporary
+// output from `scratch_allocator` so that `out` and a residual aliasing it
+// stay intact. Returns the index of the fastest config, or -1 if none runs.
+template <typename InputT>
+StatusOr<int> TuneXetlaGemm(se::gpu::GpuStreamHandle handle,
+                            int64_t batch_size, const MatrixDescriptor& lhs,
+                            const MatrixDescriptor& rhs,
+                            const MatrixDescriptor& c,
+                            const MatrixDescriptor& out,
+                            se::DeviceMemoryBase bias,
+                            se::cuda::BlasLt::Epilogue epilogue, float beta,
+                            se::ScratchAllocator* scratch_allocator,
+                            const ::gpu::xetla::XetlaGemmWorkspaceAllocator&
+                                workspace_allocator) {
+  constexpr int kTuningRuns = 5;
+  void* tmp_data;
+  TF_RETURN_IF_ERROR(
+      AllocateWorkspace(&tmp_data, scratch_allocator, out.data.size()));
+  MatrixDescriptor tmp_out = out;
+  tmp_out.data = se::DeviceMemoryBase(tmp_data, out.data.size());
+
+  int best_index = -1;
+  absl::Duration best_time = absl::InfiniteDuration();
+  int num_configs = ::gpu::xetla::getXetlaGemmConfigs().size();
+  for (int i = 0; i < num_configs; ++i) {
+    try {
+      // The first run also tells whether the config applies at all.
+      TF_ASSIGN_OR_RETURN(bool fallback,
+                          RunXetlaGemm<InputT>(handle, batch_size, lhs, rhs, c,
+                                               tmp_out, bias, epilogue, beta,
+                                               i, workspace_allocator));
+      if (fallback) continue;
+      handle->wait_and_throw();
+      absl::Time start = absl::Now();
+      for (int run = 0; run < kTuningRuns; ++run) {
+        TF_RETURN_IF_ERROR(RunXetlaGemm<InputT>(handle, batch_size, lhs, rhs,
+                                                c, tmp_out, bias, epilogue,
+                                                beta, i,
+                                                workspace_allocator)
+                               .status());
+      }
+      handle->wait_and_throw();
+      absl::Duration run_time = (absl::Now() - start) / kTuningRuns;
+      VLOG(2) << "XeTLA GEMM config " << i << ": " << run_time;
+      if (run_time < best_time) {
+        best_time = run_time;
+        best_index = i;
+      }
+    } catch (const ::sycl::exception& e) {
+      VLOG(1) << "XeTLA GEMM config " << i << " failed: " << e.what();
+    }
+  }
+  return best_index;
+}
+
+// The XeTLA epilogue running `post_op`.
+template <typename XetlaKernel>
+typename XetlaKernel::EpilogueType GetXetlaEpilogue(GemmPostOp post_op) {
+  using EpilogueType = typename XetlaKernel::EpilogueType;
+  switch (post_op) {
+    case GemmPostOp::kBias:
+      return EpilogueType::BIAS;
+    case GemmPostOp::kResidualAdd:
+      return EpilogueType::RES_ADD;
+    case GemmPostOp::kResidualMul:
+      return EpilogueType::RES_MUL;
+    case GemmPostOp::kReLU:
+      return EpilogueType::RELU;
+    case GemmPostOp::kGELU:
+      return EpilogueType::GELU;
+    case GemmPostOp::kGELUErf:
+      return EpilogueType::GELU_ERF;
+    case GemmPostOp::kSiLU:
+      return EpilogueType::SILU;
+    case GemmPostOp::kSigmoid:
+      return EpilogueType::SIGMOID;
+  }
+  LOG(FATAL) << "Unknown GEMM post-op " << static_cast<int>(post_op);
+}
+
+// Runs lhs @ rhs followed by `post_ops` with XeTLA. Returns whether the GEMM
+// falls back to oneDNN instead.
+template <typename InputT>
+bool RunXetlaGemmWithPostOps(
+    se::gpu::GpuStreamHandle handle, int64_t batch_size,
+    const MatrixDescriptor& lhs, const MatrixDescriptor& rhs,
+    const MatrixDescriptor& out, absl::Span<const GemmPostOp> post_ops,
+    absl::Span<const se::DeviceMemoryBase> post_op_buffers, int config_index,
+    const ::gpu::xetla::XetlaGemmWorkspaceAllocator& workspace_allocator) {
+  using XetlaKernel = ::gpu::xetla::XetlaGemmKernel<InputT>;
+  XetlaKernel policy;
+  policy.add_matrix_c(out)
+      .add_matrix_a(lhs)
+      .add_matrix_b(rhs)
+      .add_config_index(config_index)
+      .add_batch_size(batch_size)
+      .add_workspace_allocator(workspace_allocator);
+  int buffer_index = 0;
+  for (GemmPostOp post_op : post_ops) {
+    const void* data = GemmPostOpHasOperand(post_op)
+                           ? post_op_buffers[buffer_index++].opaque()
+                           : nullptr;
+    // Residuals are laid out like the output; biases are shared by batches.
+    int64_t batch_stride =
+        post_op == GemmPostOp::kBias ? 0 : out.batch_stride;
+    policy.add_epilogue(data, GetXetlaEpilogue<XetlaKernel>(post_op), 1.0f,
+                        batch_stride);
+  }
+  policy.build();
+  if (policy.fallback() == false) {
+    policy.run(handle);
+  }
+  return policy.fallback();
+}
+
 std::unique_ptr<OneDnnMatMulParams> CreateMatMulParams(
     int64_t batch_size, const MatrixDescriptor& lhs,
     const MatrixDescriptor& rhs, const MatrixDescriptor& out) {
@@ -290,6 +500,342 @@ std::unique_ptr<OneDnnMatMulParams> CreateMatMulParams(
       out_strides, bias_strides);
 }
 
+bool XetlaGemmEnabled() {
+  static bool enabled = [] {
+    bool flag = false;
+    TF_CHECK_OK(tsl::ReadBoolFromEnvVar("XETLA_GEMM", false, &flag));
+    return flag;
+  }();
+  return enabled;
+}
+
+dnnl::fpmath_mode GetCachedFP32MathMode() {
+  static dnnl::fpmath_mode mode = GetFP32MathMode();
+  return mode;
+}
+
+StatusOr<dnnl::algorithm> GetOneDnnEltwise(
+    se::cuda::BlasLt::Epilogue epilogue) {
+  switch (epilogue) {
+    case se::cuda::BlasLt::Epilogue::kReLU:
+    case se::cuda::BlasLt::Epilogue::kBiasThenReLU:
+      return dnnl::algorithm::eltwise_relu;
+    case se::cuda::BlasLt::Epilogue::kGELU:
+    case se::cuda::BlasLt::Epilogue::kBiasThenGELU:
+      return dnnl::algorithm::eltwise_gelu_tanh;
+    case se::cuda::BlasLt::Epilogue::kDefault:
+    case se::cuda::BlasLt::Epilogue::kBias:
+      return dnnl::algorithm::undef;
+    default:
+      return InternalError("Unsupported Activation mode");
+  }
+}
+
+// The oneDNN post-op running `post_op`: binary_add or binary_mul for post-ops
+// with an operand, an eltwise algorithm otherwise.
+dnnl::algorithm GetOneDnnPostOp(GemmPostOp post_op) {
+  switch (post_op) {
+    case GemmPostOp::kBias:
+    case GemmPostOp::kResidualAdd:
+      return dnnl::algorithm::binary_add;
+    case GemmPostOp::kResidualMul:
+      return dnnl::algorithm::binary_mul;
+    case GemmPostOp::kReLU:
+      return dnnl::algorithm::eltwise_relu;
+    case GemmPostOp::kGELU:
+      return dnnl::algorithm::eltwise_gelu_tanh;
+    case GemmPostOp::kGELUErf:
+      return dnnl::algorithm::eltwise_gelu_erf;
+    case GemmPostOp::kSiLU:
+      return dnnl::algorithm::eltwise_swish;
+    case GemmPostOp::kSigmoid:
+      return dnnl::algorithm::eltwise_logistic;
+  }
+  LOG(FATAL) << "Unknown GEMM post-op " << static_cast<int>(post_op);
+}
+
+// Everything a oneDNN matmul primitive depends on.
+struct OneDnnMatMulKey {
+  dnnl::memory::dims a_dims;
+  dnnl::memory::dims b_dims;
+  dnnl::memory::dims c_dims;
+  dnnl::memory::dims a_strides;
+  dnnl::memory::dims b_strides;
+  dnnl::memory::dims c_strides;
+  // Element types of A, B, C and the bias. They only differ in FP8 GEMMs.
+  dnnl::memory::data_type a_type;
+  dnnl::memory::data_type b_type;
+  dnnl::memory::data_type c_type;
+  dnnl::memory::data_type bias_type;
+  bool has_bias;
+  // Post-op chain: sum with `sum_scale` if non-zero, then `eltwise` unless it
+  // is dnnl::algorithm::undef.
+  float sum_scale;
+  dnnl::algorithm eltwise;
+  dnnl::fpmath_mode fpmath_mode;
+  // Primitives are bound to the engine of this device.
+  sycl::device device;
+  // FP8 GEMMs: A and B are multiplied by device F32 scalars. A non-zero
+  // `clip` also multiplies the result by a device scalar and clamps it to
+  // +-clip.
+  bool scaled = false;
+  float clip = 0.0f;
+  // FP8 GEMMs computing amax, see OneDnnMatMulPrimitive::dst_scale.
+  bool amax = false;
+  // GEMMs with post-ops: applied after `eltwise`. A leading bias is
+  // `has_bias` instead.
+  std::vector<GemmPostOp> post_ops;
+  // Scales the product before the bias and the sum.
+  float alpha = 1.0f;
+
+  bool operator==(const OneDnnMatMulKey& other) const {
+    return a_dims == other.a_dims && b_dims == other.b_dims &&
+           c_dims == other.c_dims && a_strides == other.a_strides &&
+           b_strides == other.b_strides && c_strides == other.c_strides &&
+           a_type == other.a_type && b_type == other.b_type &&
+           c_type == other.c_type && bias_type == other.bias_type &&
+           has_bias == other.has_bias && sum_scale == other.sum_scale &&
+           eltwise == other.eltwise && fpmath_mode == other.fpmath_mode &&
+           device == other.device && scaled == other.scaled &&
+           clip == other.clip && amax == other.amax &&
+           post_ops == other.post_ops && alpha == other.alpha;
+  }
+
+  template <typename H>
+  friend H AbslHashValue(H h, const OneDnnMatMulKey& key) {
+    return H::combine(
+        std::move(h), key.a_dims, key.b_dims, key.c_dims, key.a_strides,
+        key.b_strides, key.c_strides, static_cast<int>(key.a_type),
+        static_cast<int>(key.b_type), static_cast<int>(key.c_type),
+        static_cast<int>(key.bias_type), key.has_bias, key.sum_scale,
+        static_cast<int>(key.eltwise), static_cast<int>(key.fpmath_mode),
+        std::hash<sycl::device>()(key.device), key.scaled, key.clip,
+        key.amax, key.post_ops, key.alpha);
+  }
+};
+
+OneDnnMatMulKey MakeOneDnnMatMulKey(
+    int64_t batch_size, const MatrixDescriptor& lhs,
+    const MatrixDescriptor& rhs, const MatrixDescriptor& out,
+    dnnl::memory::data_type data_type, bool has_bias, float sum_scale,
+    dnnl::algorithm eltwise, dnnl::fpmath_mode fpmath_mode,
+    sycl::device device) {
+  auto params = CreateMatMulParams(batch_size, lhs, rhs, out);
+  return OneDnnMatMulKey{std::move(params->a_dims),
+                         std::move(params->b_dims),
+                         std::move(params->c_dims),
+                         std::move(params->a_strides),
+                         std::move(params->b_strides),
+                         std::move(params->c_strides),
+                         data_type,
+                         data_type,
+                         data_type,
+                         data_type,
+                         has_bias,
+                         sum_scale,
+                         eltwise,
+                         fpmath_mode,
+                         std::move(device)};
+}
+
+StatusOr<std::shared_ptr<const OneDnnMatMulPrimitive>> CreateOneDnnMatMul(
+    const OneDnnMatMulKey& key, const dnnl::engine& engine) {
+  auto matmul = std::make_shared<OneDnnMatMulPrimitive>();
+  matmul->engine = engine;
+  matmul->src_md = dnnl::memory::desc(key.a_dims, key.a_type, key.a_strides);
+  matmul->weights_md =
+      dnnl::memory::desc(key.b_dims, key.b_type, key.b_strides);
+  if (key.amax) {
+    matmul->dst_md =
+        dnnl::memory::desc(key.c_dims, dnnl::memory::data_type::f32,
+                           CalculateTFStrides(key.c_dims));
+    matmul->out_md =
+        dnnl::memory::desc(key.c_dims, key.c_type, key.c_strides);
+  } else {
+    matmul->dst_md =
+        dnnl::memory::desc(key.c_dims, key.c_type, key.c_strides);
+  }
+  if (key.has_bias) {
+    dnnl::memory::dims bias_dims(key.b_dims.size(), 1);
+    bias_dims.back() = key.b_dims.back();
+    matmul->bias_md = dnnl::memory::desc(bias_dims, key.bias_type,
+                                         CalculateTFStrides(bias_dims));
+  }
+  if (key.scaled) {
+    dnnl::memory::dims scale_dims(key.c_dims.size(), 1);
+    matmul->scale_md = dnnl::memory::desc(
+        scale_dims, dnnl::memory::data_type::f32, scale_dims);
+  }
+
+  dnnl::primitive_attr post_ops_attr;
+  post_ops_attr.set_scratchpad_mode(dnnl::scratchpad_mode::user);
+  if (key.a_type == dnnl::memory::data_type::f32) {
+    post_ops_attr.set_fpmath_mode(key.fpmath_mode);
+  }
+  if (key.scaled) {
+    post_ops_attr.set_scales_mask(DNNL_ARG_SRC, 0);
+    post_ops_attr.set_scales_mask(DNNL_ARG_WEIGHTS, 0);
+  }
+  dnnl::post_ops post_ops = dnnl::post_ops();
+  // The matmul bias would be scaled along with the product, so with alpha
+  // the bias is added by a post-op.
+  bool bias_post_op = key.has_bias && key.alpha != 1.0f;
+  if (key.alpha != 1.0f) {
+    post_ops.append_eltwise(dnnl::algorithm::eltwise_linear, key.alpha, 0.0f);
+  }
+  if (bias_post_op) {
+    matmul->bias_post_op = post_ops.len();
+    post_ops.append_binary(dnnl::algorithm::binary_add, matmul->bias_md);
+  }
+  if (key.sum_scale != 0.0f) post_ops.append_sum(key.sum_scale);
+  if (key.eltwise != dnnl::algorithm::undef) {
+    post_ops.append_eltwise(key.eltwise, 0, 0);
+  }
+  for (GemmPostOp post_op : key.post_ops) {
+    dnnl::algorithm algorithm = GetOneDnnPostOp(post_op);
+    if (!GemmPostOpHasOperand(post_op)) {
+      // Swish with alpha 1 is SiLU; the other eltwise ops ignore alpha.
+      post_ops.append_eltwise(
+          algorithm, post_op == GemmPostOp::kSiLU ? 1.0f : 0.0f, 0.0f);
+      continue;
+    }
+    dnnl::memory::desc src1_md;
+    if (post_op == GemmPostOp::kBias) {
+      dnnl::memory::dims bias_dims(key.c_dims.size(), 1);
+      bias_dims.back() = key.c_dims.back();
+      src1_md = dnnl::memory::desc(bias_dims, key.bias_type,
+                                   CalculateTFStrides(bias_dims));
+    } else {
+      src1_md = dnnl::memory::desc(key.c_dims, key.c_type, key.c_strides);
+    }
+    matmul->binary_post_ops.emplace_back(post_ops.len(), src1_md);
+    post_ops.append_binary(algorithm, src1_md);
+  }
+  // Without amax, D is scaled and saturated by the matmul itself.
+  if (key.clip != 0.0f && !key.amax) {
+    matmul->dst_scale_post_op = post_ops.len();
+    post_ops.append_binary(dnnl::algorithm::binary_mul, matmul->scale_md);
+    post_ops.append_eltwise(dnnl::algorithm::eltwise_clip, -key.clip,
+                            key.clip);
+  }
+  post_ops_attr.set_post_ops(post_ops);
+
+  try {
+    if (key.amax) {
+      dnnl::post_ops dst_scale_post_ops = dnnl::post_ops();
+      if (key.clip != 0.0f) {
+        dst_scale_post_ops.append_eltwise(dnnl::algorithm::eltwise_clip,
+                                          -key.clip, key.clip);
+      }
+      dnnl::primitive_attr dst_scale_attr;
+      dst_scale_attr.set_post_ops(dst_scale_post_ops);
+      matmul->dst_scale = dnnl::binary(dnnl::binary::primitive_desc(
+          engine, dnnl::algorithm::binary_mul, matmul->dst_md,
+          matmul->scale_md, matmul->out_md, dst_scale_attr));
+    }
+    auto matmul_pd =
+        key.has_bias && !bias_post_op
+            ? dnnl::matmul::primitive_desc(engine, matmul->src_md,
+                                           matmul->weights_md, matmul->bias_md,
+                                           matmul->dst_md, post_ops_attr)
+            : dnnl::matmul::primitive_desc(engine, matmul->src_md,
+                                           matmul->weights_md, matmul->dst_md,
+                                           post_ops_attr);
+    matmul->scratchpad_md = matmul_pd.scratchpad_desc();
+    matmul->scratchpad_size = matmul->scratchpad_md.get_size();
+    matmul->primitive = dnnl::matmul(matmul_pd);
+  } catch (const dnnl::error& e) {
+    return InternalError("Failed to create oneDNN matmul: %s", e.what());
+  }
+  return std::shared_ptr<const OneDnnMatMulPrimitive>(std::move(matmul));
+}
+
+// Thread-safe LRU cache of oneDNN matmul primitives shared by all GEMMs.
+// The capacity is read from XLA_ONEDNN_MATMUL_CACHE_SIZE.
+class OneDnnMatMulCache {
+ public:
+  explicit OneDnnMatMulCache(size_t capacity) : capacity_(capacity) {}
+
+  static OneDnnMatMulCache& Global() {
+    static OneDnnMatMulCache* cache = [] {
+      int64_t capacity = 0;
+      TF_CHECK_OK(tsl::ReadInt64FromEnvVar("XLA_ONEDNN_MATMUL_CACHE_SIZE",
+                                           1024, &capacity));
+      return new OneDnnMatMulCache(std::max<int64_t>(capacity, 1));
+    }();
+    return *cache;
+  }
+
+  StatusOr<std::shared_ptr<const OneDnnMatMulPrimitive>> GetOrCreate(
+      const OneDnnMatMulKey& key, const dnnl::engine& engine) {
+    {
+      absl::MutexLock lock(&mu_);
+      auto it = index_.find(key);
+      if (it != index_.end()) {
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return it->second->second;
+      }
+    }
+
+    // Create outside the lock; primitive creation may JIT kernels.
+    TF_ASSIGN_OR_RETURN(std::shared_ptr<const OneDnnMatMulPrimitive> matmul,
+                        CreateOneDnnMatMul(key, engine));
+    absl::MutexLock lock(&mu_);
+    auto it = index_.find(key);
+    if (it != index_.end()) return it->second->second;
+    lru_.emplace_front(key, matmul);
+    index_.emplace(key, lru_.begin());
+    if (lru_.size() > capacity_) {
+      index_.erase(lru_.back().first);
+      lru_.pop_back();
+    }
+    return matmul;
+  }
+
+ private:
+  using Entry =
+      std::pair<OneDnnMatMulKey, std::shared_ptr<const OneDnnMatMulPrimitive>>;
+
+  const size_t capacity_;
+  absl::Mutex mu_;
+  // Most recently used first.
+  std::list<Entry> lru_ ABSL_GUARDED_BY(mu_);
+  absl::flat_hash_map<OneDnnMatMulKey, std::list<Entry>::iterator> index_
+      ABSL_GUARDED_BY(mu_);
+};
+
+// Returns the oneDNN engine for the device of `queue`. Unlike
+// FindOrCreateEngine it is shared by all queues of a device, so cached
+// primitives can run on any of them.
+const dnnl::engine& GetOneDnnMatMulEngine(se::gpu::GpuStreamHandle queue) {
+  static absl::Mutex mu(absl::kConstInit);
+  static auto* engines =
+      new absl::node_hash_map<sycl::device, dnnl::engine,
+                              std::hash<sycl::device>>();
+  absl::MutexLock lock(&mu);
+  auto [it, inserted] = engines->try_emplace(queue->get_device());
+  if (inserted) {
+    it->second = dnnl::sycl_interop::make_engine(queue->get_device(),
+                                                 queue->get_context());
+  }
+  return it->second;
+}
+
+// Returns a oneDNN stream on `engine` wrapping `queue`.
+dnnl::stream& GetOneDnnMatMulStream(const dnnl::engine& engine,
+                                    se::gpu::GpuStreamHandle queue) {
+  static absl::Mutex mu(absl::kConstInit);
+  static auto* streams =
+      new absl::node_hash_map<se::gpu::GpuStreamHandle, dnnl::stream>();
+  absl::MutexLock lock(&mu);
+  dnnl::stream& stream = (*streams)[queue];
+  // Rebuild if the queue was destroyed and its address reused.
+  if (!stream || dnnl::sycl_interop::get_queue(stream) != *queue) {
+    stream = dnnl::sycl_interop::make_stream(engine, *queue);
+  }
+  return stream;
+}
+
 template <typename InputT>
 Status DoGemm(int64_t batch_size, int64_t m, int64_t n, int64_t k,
               const MatrixDescriptor& lhs, const MatrixDescriptor& rhs,
@@ -297,7 +843,9 @@ Status DoGemm(int64_t batch_size, int64_t m, int64_t n, int64_t k,
               se::DeviceMemoryBase bias, float alpha, float beta,
               se::cuda::BlasLt::Epilogue epilogue, se::Stream* stream,
               se::ScratchAllocator* scratch_allocator,
-              se::blas::ComputePrecision compute_precision) {
+              se::blas::ComputePrecision compute_precision,
+              int64_t algorithm,
+              std::shared_ptr<const OneDnnMatMulPrimitive>* primitive) {
   CHECK(output.transpose == se::blas::Transpose::kNoTranspose);
   se::gpu::GpuStreamHandle stream_handle =
       stream_executor::gpu::AsGpuStreamValue(stream);
@@ -322,95 +870,257 @@ Status DoGemm(int64_t batch_size, int64_t m, int64_t n, int64_t k,
   VLOG(2) << "lhs trans: " << TransposeString(lhs.transpose);
   VLOG(2) << "rhs trans: " << TransposeString(rhs.transpose);
 
+  // An autotuned algorithm takes precedence over XETLA_GEMM.
   bool flag = false;
-  tsl::ReadBoolFromEnvVar("XETLA_GEMM", false, &flag);
-  bool xetla_support = flag && IsXetlaHardwareSupport() && (batch_size == 1) &&
-                       (fabs(alpha - 1.0f) < 1e-6);
-  if (xetla_support && (!std::is_same_v<InputT, float>)) {
-    TF_ASSIGN_OR_RETURN(bool fallback,
-                        RunXetlaGemm<InputT>(stream_handle, lhs, rhs, c, output,
-                                             bias, epilogue, beta));
-    if (!fallback) return OkStatus();
-  }
-  auto params = CreateMatMulParams(batch_size, lhs, rhs, output);
-
-  auto src_md = dnnl::memory::desc(params->a_dims, OneDnnType<InputT>(),
-                                   params->a_strides);
-  auto weights_md = dnnl::memory::desc(params->b_dims, OneDnnType<InputT>(),
-                                       params->b_strides);
-  auto dst_md = dnnl::memory::desc(params->c_dims, OneDnnType<InputT>(),
-                                   params->c_strides);
-  auto bias_md =
-      bias_data ? dnnl::memory::desc(params->bias_dims, OneDnnType<InputT>(),
-                                     params->bias_strides)
-                : dnnl::memory::desc();
-
-  auto dnnl_engine = FindOrCreateEngine(stream_handle);
-  dnnl::primitive_attr post_ops_attr;
-  post_ops_attr.set_scratchpad_mode(dnnl::scratchpad_mode::user);
-
-  // Set fp32 mode.
-  dnnl::fpmath_mode fp32_math_mode = GetFP32MathMode();
-  if (std::is_same<InputT, float>::value) {
-    post_ops_attr.set_fpmath_mode(fp32_math_mode);
+  if (algorithm >= kGemmAlgorithmXetla) {
+    flag = true;
+  } else if (algorithm != kGemmAlgorithmOneDnn) {
+    flag = XetlaGemmEnabled();
+  }
+  int config_index = algorithm >= kGemmAlgorithmXetla
+                         ? static_cast<int>(algorithm - kGemmAlgorithmXetla)
+                         : -1;
+  bool xetla_support =
+      flag && IsXetlaHardwareSupport() && (fabs(alpha - 1.0f) < 1e-6);
+  // XeTLA only has F16 and BF16 kernels.
+  if constexpr (std::is_same_v<InputT, sycl::half> ||
+                std::is_same_v<InputT, ::gpu::xetla::bf16>) {
+    XetlaGemmWorkspace xetla_workspace(scratch_allocator);
+    if (xetla_support) {
+      if (config_index < 0 && XetlaGemmTuningCache::Enabled()) {
+        XetlaGemmProblem problem{
+            std::is_same_v<InputT, sycl::half> ? F16 : BF16,
+            batch_size,
+            m,
+            n,
+            k,
+            /*lhs_transposed=*/lhs.transpose == se::blas::Transpose::kTranspose,
+            /*rhs_transposed=*/rhs.transpose == se::blas::Transpose::kTranspose,
+            static_cast<int>(epilogue),
+            /*has_residual=*/fabs(beta) > 1e-6};
+        ::sycl::device device = stream_handle->get_device();
+        std::optional<int> tuned =
+            XetlaGemmTuningCache::Global().Lookup(device, problem);
+        if (!tuned.has_value()) {
+          TF_ASSIGN_OR_RETURN(
+              tuned, TuneXetlaGemm<InputT>(stream_handle, batch_size, lhs, rhs,
+                                           c, output, bias, epilogue, beta,
+                                           scratch_allocator,
+                                           xetla_workspace.allocator()));
+          VLOG(1) << "Tuned XeTLA GEMM " << m << "x" << n << "x" << k
+                  << ": config " << *tuned;
+          XetlaGemmTuningCache::Global().Insert(device, problem, *tuned);
+        }
+        // Nothing runs in XeTLA; go straight to oneDNN.
+        if (*tuned < 0) xetla_support = false;
+        config_index = *tuned;
+      }
+    }
+    if (xetla_support) {
+      TF_ASSIGN_OR_RETURN(
+          bool fallback,
+          RunXetlaGemm<InputT>(stream_handle, batch_size, lhs, rhs, c, output,
+                               bias, epilogue, beta, config_index,
+                               xetla_workspace.allocator()));
+      if (!fallback) return OkStatus();
+    }
+  }
+  std::shared_ptr<const OneDnnMatMulPrimitive> matmul =
+      primitive != nullptr ? *primitive : nullptr;
+  if (matmul == nullptr) {
+    // C = activation(MatMul(x, w, bias) + beta * C)
+    TF_ASSIGN_OR_RETURN(dnnl::algorithm eltwise, GetOneDnnEltwise(epilogue));
+    OneDnnMatMulKey key = MakeOneDnnMatMulKey(
+        batch_size, lhs, rhs, output, OneDnnType<InputT>(),
+        /*has_bias=*/bias_data != nullptr,
+        /*sum_scale=*/c_data && fabs(beta - 0.0f) > 1e-6 ? beta : 0.0f,
+        eltwise,
+        std::is_same<InputT, float>::value ? GetCachedFP32MathMode()
+                                           : dnnl::fpmath_mode::strict,
+        stream_handle->get_device());
+    key.alpha = alpha;
+    // S32 GEMMs multiply S8 matrices.
+    if constexpr (std::is_same_v<InputT, tsl::qint8>) {
+      key.c_type = dnnl::memory::data_type::s32;
+      key.bias_type = dnnl::memory::data_type::s32;
+    }
+    TF_ASSIGN_OR_RETURN(matmul, OneDnnMatMulCache::Global().GetOrCreate(
+                                    key, GetOneDnnMatMulEngine(stream_handle)));
+    if (primitive != nullptr) *primitive = matmul;
   }
 
-  dnnl::post_ops post_ops = dnnl::post_ops();
-  // C = activation(MatMul(x, w, bias) + beta * C)
-  //   po.append_sum(beta)
-  //   po.append_eltwise(dnnl::algorithm::activation, 1, 0);
-  CHECK(fabs(alpha - 1.0f) < 1e-6);
-  if (c_data && fabs(beta - 0.0f) > 1e-6) post_ops.append_sum(beta);
-  switch (epilogue) {
-    case se::cuda::BlasLt::Epilogue::kReLU:
-    case se::cuda::BlasLt::Epilogue::kBiasThenReLU:
-      post_ops.append_eltwise(dnnl::algorithm::eltwise_relu, 0, 0);
-      break;
-    case se::cuda::BlasLt::Epilogue::kGELU:
-    case se::cuda::BlasLt::Epilogue::kBiasThenGELU:
-      post_ops.append_eltwise(dnnl::algorithm::eltwise_gelu_tanh, 0, 0);
-      break;
-    case se::cuda::BlasLt::Epilogue::kDefault:
-    case se::cuda::BlasLt::Epilogue::kBias:
-      break;
-    default:
-      return InternalError("Unsupported Activation mode");
+  // The sum post-op accumulates into the output, so C must be there first.
+  if (c_data != nullptr && c_data != out_data && fabs(beta) > 1e-6) {
+    stream_handle->memcpy(out_data, c_data, output.data.size());
   }
-  post_ops_attr.set_post_ops(post_ops);
 
-  auto matmul_pd =
-      bias_data
-          ? std::make_shared<dnnl::matmul::primitive_desc>(
-                dnnl_engine, src_md, weights_md, bias_md, dst_md, post_ops_attr)
-          : std::make_shared<dnnl::matmul::primitive_desc>(
-                dnnl_engine, src_md, weights_md, dst_md, post_ops_attr);
+  void* workspace;
+  TF_RETURN_IF_ERROR(AllocateWorkspace(&workspace, scratch_allocator,
+                                       matmul->scratchpad_size));
+
+  const dnnl::engine& dnnl_engine = matmul->engine;
   std::unordered_map<int, dnnl::memory> fwd_primitive_args;
+  fwd_primitive_args.emplace(DNNL_ARG_SRC,
+                             CreateDnnlMemory(matmul->src_md, dnnl_engine,
+                                              lhs_data));
+  fwd_primitive_args.emplace(DNNL_ARG_WEIGHTS,
+                             CreateDnnlMemory(matmul->weights_md, dnnl_engine,
+                                              rhs_data));
+  fwd_primitive_args.emplace(DNNL_ARG_DST,
+                             CreateDnnlMemory(matmul->dst_md, dnnl_engine,
+                                              out_data));
+  fwd_primitive_args.emplace(DNNL_ARG_SCRATCHPAD,
+                             dnnl::memory(matmul->scratchpad_md, dnnl_engine,
+                                          workspace));
+  if (bias_data) {
+    fwd_primitive_args.emplace(
+        matmul->bias_post_op >= 0
+            ? DNNL_ARG_ATTR_MULTIPLE_POST_OP(matmul->bias_post_op) |
+                  DNNL_ARG_SRC_1
+            : DNNL_ARG_BIAS,
+        CreateDnnlMemory(matmul->bias_md, dnnl_engine, bias_data));
+  }
+  matmul->primitive.execute(GetOneDnnMatMulStream(dnnl_engine, stream_handle),
+                            fwd_primitive_args);
+  return OkStatus();
+}
 
-  size_t scratchpad_size = matmul_pd->scratchpad_desc().get_size();
-  void* workspace;
-  TF_RETURN_IF_ERROR(
-      AllocateWorkspace(&workspace, scratch_allocator, scratchpad_size));
+#if ITEX_USE_MKL
+oneapi::mkl::transpose AsMklTranspose(se::blas::Transpose transpose) {
+  return transpose == se::blas::Transpose::kTranspose
+             ? oneapi::mkl::transpose::T
+             : oneapi::mkl::transpose::N;
+}
+
+template <typename T>
+T AsMklScalar(std::complex<double> value) {
+  if constexpr (std::is_same_v<T, std::complex<float>> ||
+                std::is_same_v<T, std::complex<double>>) {
+    return T(value.real(), value.imag());
+  } else {
+    return static_cast<T>(value.real());
+  }
+}
+
+// Runs the GEMMs oneDNN has no kernels for, F64 and complex, with oneMKL.
+template <typename T>
+Status DoMklGemm(int64_t batch_size, int64_t m, int64_t n, int64_t k,
+                 const MatrixDescriptor& lhs, const MatrixDescriptor& rhs,
+                 const MatrixDescriptor& c, const MatrixDescriptor& output,
+                 std::complex<double> alpha, double beta,
+                 se::Stream* stream) {
+  CHECK(output.transpose == se::blas::Transpose::kNoTranspose);
+  se::gpu::GpuStreamHandle stream_handle =
+      stream_executor::gpu::AsGpuStreamValue(stream);
+  T* out_data = static_cast<T*>(const_cast<void*>(output.data.opaque()));
+  const void* c_data = c.data.opaque();
+  if (c_data != nullptr && c_data != out_data && beta != 0.0) {
+    stream_handle->memcpy(out_data, c_data, output.data.size());
+  }
 
-  auto scratchpad_mem =
-      dnnl::memory(matmul_pd->scratchpad_desc(), dnnl_engine, workspace);
+  VLOG(2) << "oneMKL gemm_batch: " << batch_size << "x" << m << "x" << n
+          << "x" << k << " lhs " << TransposeString(lhs.transpose) << " rhs "
+          << TransposeString(rhs.transpose);
+  try {
+    oneapi::mkl::blas::row_major::gemm_batch(
+        *stream_handle, AsMklTranspose(lhs.transpose),
+        AsMklTranspose(rhs.transpose), m, n, k, AsMklScalar<T>(alpha),
+        static_cast<const T*>(lhs.data.opaque()), lhs.leading_dim_stride,
+        lhs.batch_stride, static_cast<const T*>(rhs.data.opaque()),
+        rhs.leading_dim_stride, rhs.batch_stride, AsMklScalar<T>(beta),
+        out_data, output.leading_dim_stride, output.batch_stride, batch_size);
+  } catch (const oneapi::mkl::exception& e) {
+    return InternalError("oneMKL gemm_batch failed: %s", e.what());
+  }
+  return OkStatus();
+}
+#endif  // ITEX_USE_MKL
 
-  auto matmul_primitive = dnnl::matmul(*matmul_pd);
+template <typename InputT>
+Status DoGemmWithPostOps(
+    int64_t batch_size, const MatrixDescriptor& lhs,
+    const MatrixDescriptor& rhs, const MatrixDescriptor& output,
+    absl::Span<const GemmPostOp> post_ops,
+    absl::Span<const se::DeviceMemoryBase> post_op_buffers,
+    se::Stream* stream, se::ScratchAllocator* scratch_allocator,
+    int64_t algorithm,
+    std::shared_ptr<const OneDnnMatMulPrimitive>* primitive) {
+  CHECK(output.transpose == se::blas::Transpose::kNoTranspose);
+  se::gpu::GpuStreamHandle stream_handle =
+      stream_executor::gpu::AsGpuStreamValue(stream);
 
-  auto dnnl_stream = dnnl::sycl_interop::make_stream(
-      dnnl_engine, *(stream_executor::gpu::AsGpuStreamValue(stream)));
-  auto src_mem = CreateDnnlMemory(src_md, dnnl_engine, lhs_data);
+  if constexpr (!std::is_same_v<InputT, float>) {
+    // Chains are not tuned online; they run the heuristic tile config unless
+    // the autotuner picked one.
+    bool flag = algorithm >= kGemmAlgorithmXetla ||
+                (algorithm != kGemmAlgorithmOneDnn && XetlaGemmEnabled());
+    if (flag && IsXetlaHardwareSupport()) {
+      int config_index = algorithm >= kGemmAlgorithmXetla
+                             ? static_cast<int>(algorithm - kGemmAlgorithmXetla)
+                             : -1;
+      XetlaGemmWorkspace xetla_workspace(scratch_allocator);
+      bool fallback = RunXetlaGemmWithPostOps<InputT>(
+          stream_handle, batch_size, lhs, rhs, output, post_ops,
+          post_op_buffers, config_index, xetla_workspace.allocator());
+      if (!fallback) return OkStatus();
+    }
+  }
 
-  auto wei_mem = CreateDnnlMemory(weights_md, dnnl_engine, rhs_data);
-  auto dst_mem = CreateDnnlMemory(dst_md, dnnl_engine, out_data);
-  fwd_primitive_args.emplace(DNNL_ARG_SRC, src_mem);
-  fwd_primitive_args.emplace(DNNL_ARG_WEIGHTS, wei_mem);
-  fwd_primitive_args.emplace(DNNL_ARG_DST, dst_mem);
-  fwd_primitive_args.emplace(DNNL_ARG_SCRATCHPAD, scratchpad_mem);
-  if (bias_data) {
-    auto bias_mem = CreateDnnlMemory(bias_md, dnnl_engine, bias_data);
-    fwd_primitive_args.emplace(DNNL_ARG_BIAS, bias_mem);
+  // A leading bias is the matmul bias, everything else a oneDNN post-op.
+  bool has_bias = post_ops.front() == GemmPostOp::kBias;
+  std::shared_ptr<const OneDnnMatMulPrimitive> matmul =
+      primitive != nullptr ? *primitive : nullptr;
+  if (matmul == nullptr) {
+    OneDnnMatMulKey key = MakeOneDnnMatMulKey(
+        batch_size, lhs, rhs, output, OneDnnType<InputT>(), has_bias,
+        /*sum_scale=*/0.0f, dnnl::algorithm::undef,
+        std::is_same<InputT, float>::value ? GetCachedFP32MathMode()
+                                           : dnnl::fpmath_mode::strict,
+        stream_handle->get_device());
+    key.post_ops.assign(post_ops.begin() + (has_bias ? 1 : 0),
+                        post_ops.end());
+    TF_ASSIGN_OR_RETURN(matmul, OneDnnMatMulCache::Global().GetOrCreate(
+                                    key, GetOneDnnMatMulEngine(stream_handle)));
+    if (primitive != nullptr) *primitive = matmul;
   }
-  matmul_primitive.execute(dnnl_stream, fwd_primitive_args);
+
+  void* workspace;
+  TF_RETURN_IF_ERROR(AllocateWorkspace(&workspace, scratch_allocator,
+                                       matmul->scratchpad_size));
+
+  const dnnl::engine& dnnl_engine = matmul->engine;
+  std::unordered_map<int, dnnl::memory> fwd_primitive_args;
+  fwd_primitive_args.emplace(
+      DNNL_ARG_SRC, CreateDnnlMemory(matmul->src_md, dnnl_engine,
+                                     const_cast<void*>(lhs.data.opaque())));
+  fwd_primitive_args.emplace(
+      DNNL_ARG_WEIGHTS,
+      CreateDnnlMemory(matmul->weights_md, dnnl_engine,
+                       const_cast<void*>(rhs.data.opaque())));
+  fwd_primitive_args.emplace(
+      DNNL_ARG_DST, CreateDnnlMemory(matmul->dst_md, dnnl_engine,
+                                     const_cast<void*>(output.data.opaque())));
+  fwd_primitive_args.emplace(DNNL_ARG_SCRATCHPAD,
+                             dnnl::memory(matmul->scratchpad_md, dnnl_engine,
+                                          workspace));
+  absl::Span<const se::DeviceMemoryBase> binary_buffers = post_op_buffers;
+  if (has_bias) {
+    fwd_primitive_args.emplace(
+        DNNL_ARG_BIAS,
+        CreateDnnlMemory(matmul->bias_md, dnnl_engine,
+                         const_cast<void*>(post_op_buffers[0].opaque())));
+    binary_buffers.remove_prefix(1);
+  }
+  TF_RET_CHECK(binary_buffers.size() == matmul->binary_post_ops.size());
+  for (int i = 0; i < binary_buffers.size(); ++i) {
+    const auto& [index, md] = matmul->binary_post_ops[i];
+    fwd_primitive_args.emplace(
+        DNNL_ARG_ATTR_MULTIPLE_POST_OP(index) | DNNL_ARG_SRC_1,
+        CreateDnnlMemory(md, dnnl_engine,
+                         const_cast<void*>(binary_buffers[i].opaque())));
+  }
+  matmul->primitive.execute(GetOneDnnMatMulStream(dnnl_engine, stream_handle),
+                            fwd_primitive_args);
   return OkStatus();
 }
 
@@ -445,13 +1155,168 @@ void MakeBlasGemmCompatible(MatrixDescriptor& lhs, MatrixDescriptor& rhs,
     TransposeMatrixDesc(c);
   }
 }
+
+StatusOr<dnnl::memory::data_type> GetOneDnnFp8GemmType(PrimitiveType type) {
+  switch (type) {
+    case F8E4M3FN:
+      return dnnl::memory::data_type::f8_e4m3;
+    case F8E5M2:
+      return dnnl::memory::data_type::f8_e5m2;
+    case F16:
+      return dnnl::memory::data_type::f16;
+    case BF16:
+      return dnnl::memory::data_type::bf16;
+    case F32:
+      return dnnl::memory::data_type::f32;
+    default:
+      return InternalError("Unexpected FP8 GEMM dtype: %s",
+                           primitive_util::LowercasePrimitiveTypeName(type));
+  }
+}
+
+// Largest finite value of an FP8 output type, or 0 for wider types whose
+// result is neither scaled nor saturated.
+float GetFp8GemmClip(PrimitiveType type) {
+  switch (type) {
+    case F8E4M3FN:
+      return static_cast<float>(
+          std::numeric_limits<tsl::float8_e4m3fn>::max());
+    case F8E5M2:
+      return static_cast<float>(std::numeric_limits<tsl::float8_e5m2>::max());
+    default:
+      return 0.0f;
+  }
+}
+
+// Writes max(|data[i]|) over `size` F32 elements to `amax`.
+void ComputeFp8GemmAmax(se::gpu::GpuStreamHandle queue, const float* data,
+                        int64_t size, float* amax) {
+  queue->submit([&](sycl::handler& cgh) {
+    auto max_reduction =
+        sycl::reduction(amax, sycl::maximum<float>(),
+                        sycl::property::reduction::initialize_to_identity());
+    cgh.parallel_for<Fp8GemmAmaxKernel>(
+        sycl::range<1>(size), max_reduction,
+        [=](sycl::id<1> i, auto& max) { max.combine(sycl::fabs(data[i])); });
+  });
+}
+
+// Writes (rhs - zero_points) * scales of a weight-only GEMM to `weights`, a
+// row-major [k, n] matrix. `zero_points` may be null.
+template <typename T>
+void DequantizeWeightOnlyGemmRhs(se::gpu::GpuStreamHandle queue,
+                                 const WeightOnlyGemmConfig& config,
+                                 const int8_t* rhs, const float* scales,
+                                 const float* zero_points, T* weights) {
+  int64_t n = config.n;
+  int64_t group_size = config.group_size;
+  bool int4 = config.int4;
+  queue->submit([&](sycl::handler& cgh) {
+    cgh.parallel_for<WeightOnlyGemmDequantizeKernel<T>>(
+        sycl::range<2>(config.k, n), [=](sycl::id<2> i) {
+          int64_t row = i[0];
+          int64_t col = i[1];
+          float value;
+          if (int4) {
+            // Sign-extends the nibble of `col`, the low one for even columns.
+            int8_t packed = rhs[row * (n / 2) + col / 2];
+            value = col % 2 == 0 ? static_cast<int8_t>(packed << 4) >> 4
+                                 : packed >> 4;
+          } else {
+            value = rhs[row * n + col];
+          }
+          int64_t group = row / group_size * n + col;
+          if (zero_points != nullptr) value -= zero_points[group];
+          weights[row * n + col] = static_cast<T>(value * scales[group]);
+        });
+  });
+}
+
+template <typename T>
+Status DoWeightOnlyGemm(const WeightOnlyGemmConfig& config,
+                        se::DeviceMemoryBase lhs_buffer,
+                        se::DeviceMemoryBase rhs_buffer,
+                        se::DeviceMemoryBase scales_buffer,
+                        se::DeviceMemoryBase zero_points_buffer,
+                        se::DeviceMemoryBase output_buffer, se::Stream* stream,
+                        se::ScratchAllocator* scratch_allocator) {
+  se::gpu::GpuStreamHandle stream_handle =
+      stream_executor::gpu::AsGpuStreamValue(stream);
+  if (IsXetlaHardwareSupport()) {
+    ::gpu::xetla::XetlaWeightOnlyGemmKernel<T> kernel;
+    kernel.add_problem_size(config.m, config.n, config.k)
+        .add_matrix_out(output_buffer.opaque())
+        .add_matrix_a(lhs_buffer.opaque())
+        .add_matrix_b(rhs_buffer.opaque(), config.int4)
+        .add_scales(scales_buffer.opaque(), config.group_size)
+        .add_zero_points(zero_points_buffer.opaque())
+        .build();
+    if (!kernel.fallback()) {
+      kernel.run(stream_handle);
+      return OkStatus();
+    }
+  }
+
+  // Otherwise dequantize rhs into scratch memory and run a plain oneDNN
+  // matmul on it.
+  VLOG(2) << "Falling back to a dequantized oneDNN GEMM";
+  int64_t weights_size = config.k * config.n * sizeof(T);
+  void* weights;
+  TF_RETURN_IF_ERROR(
+      AllocateWorkspace(&weights, scratch_allocator, weights_size));
+  DequantizeWeightOnlyGemmRhs<T>(
+      stream_handle, config, static_cast<const int8_t*>(rhs_buffer.opaque()),
+      static_cast<const float*>(scales_buffer.opaque()),
+      static_cast<const float*>(zero_points_buffer.opaque()),
+      static_cast<T*>(weights));
+  auto row_major = [](se::DeviceMemoryBase data, int64_t num_rows,
+                      int64_t num_cols) {
+    return MatrixDescriptor{data, se::blas::Transpose::kNoTranspose, num_rows,
+                            num_cols, num_rows * num_cols, num_cols};
+  };
+  return DoGemm<T>(
+      /*batch_size=*/1, config.m, config.n, config.k,
+      row_major(lhs_buffer, config.m, config.k),
+      row_major(se::DeviceMemoryBase(weights, weights_size), config.k,
+                config.n),
+      row_major(se::DeviceMemoryBase(), config.m, config.n),
+      row_major(output_buffer, config.m, config.n),
+      /*bias=*/se::DeviceMemoryBase(), /*alpha=*/1.0f, /*beta=*/0.0f,
+      se::cuda::BlasLt::Epilogue::kDefault, stream, scratch_allocator,
+      se::blas::kDefaultComputePrecision, kGemmAlgorithmOneDnn,
+      /*primitive=*/nullptr);
+}
 }  // namespace
 
+std::vector<int64_t> GetGemmAlgorithmCandidates(const GemmConfig& config) {
+  std::vector<int64_t> candidates = {kGemmAlgorithmOneDnn};
+  PrimitiveType dtype = config.output_layout.dtype;
+  if ((dtype != F16 && dtype != BF16) || !IsXetlaHardwareSupport() ||
+      fabs(config.alpha.real() - 1.0f) >= 1e-6) {
+    return candidates;
+  }
+  switch (config.epilogue) {
+    case se::cuda::BlasLt::Epilogue::kDefault:
+    case se::cuda::BlasLt::Epilogue::kBias:
+    case se::cuda::BlasLt::Epilogue::kGELU:
+    case se::cuda::BlasLt::Epilogue::kBiasThenGELU:
+      break;
+    default:
+      return candidates;
+  }
+  int num_configs = ::gpu::xetla::getXetlaGemmConfigs().size();
+  for (int i = 0; i < num_configs; ++i) {
+    candidates.push_back(kGemmAlgorithmXetla + i);
+  }
+  return candidates;
+}
+
 Status RunGemm(const GemmConfig& config, se::DeviceMemoryBase lhs_buffer,
                se::DeviceMemoryBase rhs_buffer, se::DeviceMemoryBase c_buffer,
                se::DeviceMemoryBase output_buffer,
                se::DeviceMemoryBase bias_buffer, se::Stream* stream,
-               se::ScratchAllocator* scratch_allocator) {
+               se::ScratchAllocator* scratch_allocator,
+               std::shared_ptr<const OneDnnMatMulPrimitive>* primitive) {
   VLOG(2) << "Executing a GemmThunk";
 
   MatrixLayout lhs_layout = config.lhs_layout;
@@ -480,27 +1345,62 @@ Status RunGemm(const GemmConfig& config, se::DeviceMemoryBase lhs_buffer,
         primitive_util::LowercasePrimitiveTypeName(rhs_layout.dtype),
         primitive_util::LowercasePrimitiveTypeName(output_layout.dtype));
   }
+  if (output_layout.dtype == S32 &&
+      (lhs_layout.dtype != S8 || rhs_layout.dtype != S8)) {
+    return InternalError(
+        "S32 GEMM lhs type(%s) and rhs type(%s) must be s8",
+        primitive_util::LowercasePrimitiveTypeName(lhs_layout.dtype),
+        primitive_util::LowercasePrimitiveTypeName(rhs_layout.dtype));
+  }
+  if (primitive_util::IsComplexType(output_layout.dtype) ||
+      output_layout.dtype == F64) {
+    // oneMKL has no fused epilogues.
+    if (config.epilogue != se::cuda::BlasLt::Epilogue::kDefault ||
+        !bias_buffer.is_null()) {
+      return Unimplemented(
+          "GEMM epilogues are not supported for %s",
+          primitive_util::LowercasePrimitiveTypeName(output_layout.dtype));
+    }
+  }
 
+  int64_t algorithm = config.algorithm.value_or(kGemmAlgorithmHeuristic);
   switch (output_layout.dtype) {
     case F16:
       return DoGemm<sycl::half>(batch_size, m, n, k, lhs, rhs, c, output,
                                 bias_buffer, config.alpha.real(), config.beta,
                                 config.epilogue, stream, scratch_allocator,
-                                config.compute_precision);
+                                config.compute_precision, algorithm,
+                                primitive);
     case BF16:
       return DoGemm<::gpu::xetla::bf16>(
           batch_size, m, n, k, lhs, rhs, c, output, bias_buffer,
           config.alpha.real(), config.beta, config.epilogue, stream,
-          scratch_allocator, config.compute_precision);
+          scratch_allocator, config.compute_precision, algorithm, primitive);
     case F32:
       return DoGemm<float>(batch_size, m, n, k, lhs, rhs, c, output,
                            bias_buffer, config.alpha.real(), config.beta,
                            config.epilogue, stream, scratch_allocator,
-                           config.compute_precision);
+                           config.compute_precision, algorithm,
+                           primitive);
     case S32:
+      return DoGemm<tsl::qint8>(batch_size, m, n, k, lhs, rhs, c, output,
+                                bias_buffer, config.alpha.real(), config.beta,
+                                config.epilogue, stream, scratch_allocator,
+                                config.compute_precision, algorithm,
+                                primitive);
+#if ITEX_USE_MKL
     case F64:
+      return DoMklGemm<double>(batch_size, m, n, k, lhs, rhs, c, output,
+                               config.alpha, config.beta, stream);
     case C64:
+      return DoMklGemm<std::complex<float>>(batch_size, m, n, k, lhs, rhs, c,
+                                            output, config.alpha, config.beta,
+                                            stream);
     case C128:
+      return DoMklGemm<std::complex<double>>(batch_size, m, n, k, lhs, rhs, c,
+                                             output, config.alpha, config.beta,
+                                             stream);
+#endif  // ITEX_USE_MKL
     default:
       return InternalError(
           "Unexpected GEMM dtype: %s",
@@ -508,6 +1408,290 @@ Status RunGemm(const GemmConfig& config, se::DeviceMemoryBase lhs_buffer,
   }
 }
 
+Status RunGemmWithPostOps(
+    const GemmConfig& config, se::DeviceMemoryBase lhs_buffer,
+    se::DeviceMemoryBase rhs_buffer, se::DeviceMemoryBase output_buffer,
+    absl::Span<const GemmPostOp> post_ops,
+    absl::Span<const se::DeviceMemoryBase> post_op_buffers, se::Stream* stream,
+    se::ScratchAllocator* scratch_allocator,
+    std::shared_ptr<const OneDnnMatMulPrimitive>* primitive) {
+  VLOG(2) << "Executing a GemmWithPostOpsThunk";
+
+  if (fabs(config.alpha.real() - 1.0f) >= 1e-6 || config.beta != 0.0) {
+    return Unimplemented("GEMMs with post-ops require alpha 1 and beta 0");
+  }
+  TF_RET_CHECK(!post_ops.empty());
+  TF_RET_CHECK(post_op_buffers.size() ==
+               absl::c_count_if(post_ops, GemmPostOpHasOperand));
+
+  MatrixLayout lhs_layout = config.lhs_layout;
+  MatrixLayout rhs_layout = config.rhs_layout;
+  MatrixLayout output_layout = config.output_layout;
+  MatrixDescriptor lhs = GetMatrixDesc(lhs_layout, lhs_buffer);
+  MatrixDescriptor rhs = GetMatrixDesc(rhs_layout, rhs_buffer);
+  MatrixDescriptor output = GetMatrixDesc(output_layout, output_buffer);
+  int64_t batch_size = output_layout.batch_size;
+  // Residuals share the output layout, so they need no transposing of their
+  // own: the swapped GEMM computes the output in its stored order.
+  MakeBlasGemmCompatible(lhs, rhs, output);
+
+  if (lhs_layout.dtype != output_layout.dtype ||
+      rhs_layout.dtype != output_layout.dtype) {
+    return InternalError(
+        "GEMM lhs type(%s) and rhs type(%s) must match output type(%s)",
+        primitive_util::LowercasePrimitiveTypeName(lhs_layout.dtype),
+        primitive_util::LowercasePrimitiveTypeName(rhs_layout.dtype),
+        primitive_util::LowercasePrimitiveTypeName(output_layout.dtype));
+  }
+
+  int64_t algorithm = config.algorithm.value_or(kGemmAlgorithmHeuristic);
+  switch (output_layout.dtype) {
+    case F16:
+      return DoGemmWithPostOps<sycl::half>(
+          batch_size, lhs, rhs, output, post_ops, post_op_buffers, stream,
+          scratch_allocator, algorithm, primitive);
+    case BF16:
+      return DoGemmWithPostOps<::gpu::xetla::bf16>(
+          batch_size, lhs, rhs, output, post_ops, post_op_buffers, stream,
+          scratch_allocator, algorithm, primitive);
+    case F32:
+      return DoGemmWithPostOps<float>(batch_size, lhs, rhs, output, post_ops,
+                                      post_op_buffers, stream,
+                                      scratch_allocator, algorithm, primitive);
+    default:
+      return InternalError(
+          "Unexpected GEMM with post-ops dtype: %s",
+          primitive_util::LowercasePrimitiveTypeName(output_layout.dtype));
+  }
+}
+
+Status RunFp8Gemm(const GemmConfig& config, se::DeviceMemoryBase lhs_buffer,
+                  se::DeviceMemoryBase rhs_buffer,
+                  se::DeviceMemoryBase c_buffer,
+                  se::DeviceMemoryBase output_buffer,
+                  se::DeviceMemoryBase bias_buffer, const Fp8GemmScales& scales,
+                  se::Stream* stream, se::ScratchAllocator* scratch_allocator,
+                  std::shared_ptr<const OneDnnMatMulPrimitive>* primitive) {
+  VLOG(2) << "Executing an FP8 GEMM";
+  if (fabs(config.alpha.real() - 1.0) > 1e-6 || config.alpha.imag() != 0.0) {
+    return Unimplemented("FP8 GEMMs only support alpha = 1");
+  }
+  // GemmRewriter only fuses a matrix bias into FP8 GEMMs with CUDA.
+  if (fabs(config.beta) > 1e-6) {
+    return Unimplemented("FP8 GEMMs do not support a matrix bias");
+  }
+
+  const MatrixLayout& output_layout = config.output_layout;
+  MatrixDescriptor lhs = GetMatrixDesc(config.lhs_layout, lhs_buffer);
+  MatrixDescriptor rhs = GetMatrixDesc(config.rhs_layout, rhs_buffer);
+  MatrixDescriptor c = GetMatrixDesc(config.c_layout, c_buffer);
+  MatrixDescriptor output = GetMatrixDesc(output_layout, output_buffer);
+  TF_ASSIGN_OR_RETURN(dnnl::memory::data_type a_type,
+                      GetOneDnnFp8GemmType(config.lhs_layout.dtype));
+  TF_ASSIGN_OR_RETURN(dnnl::memory::data_type b_type,
+                      GetOneDnnFp8GemmType(config.rhs_layout.dtype));
+  // A transposed output swaps the operands.
+  if (output.transpose == se::blas::Transpose::kTranspose) {
+    std::swap(a_type, b_type);
+  }
+  MakeBlasGemmCompatible(lhs, rhs, c, output);
+
+  se::gpu::GpuStreamHandle stream_handle =
+      stream_executor::gpu::AsGpuStreamValue(stream);
+  void* bias_data = const_cast<void*>(bias_buffer.opaque());
+  void* d_amax_data = const_cast<void*>(scales.d_amax.opaque());
+  std::shared_ptr<const OneDnnMatMulPrimitive> matmul =
+      primitive != nullptr ? *primitive : nullptr;
+  if (matmul == nullptr) {
+    TF_ASSIGN_OR_RETURN(dnnl::algorithm eltwise,
+                        GetOneDnnEltwise(config.epilogue));
+    OneDnnMatMulKey key = MakeOneDnnMatMulKey(
+        output_layout.batch_size, lhs, rhs, output, a_type,
+        /*has_bias=*/bias_data != nullptr, /*sum_scale=*/0.0f, eltwise,
+        dnnl::fpmath_mode::strict, stream_handle->get_device());
+    key.b_type = b_type;
+    TF_ASSIGN_OR_RETURN(key.c_type, GetOneDnnFp8GemmType(output_layout.dtype));
+    TF_ASSIGN_OR_RETURN(key.bias_type,
+                        GetOneDnnFp8GemmType(config.c_layout.dtype));
+    key.scaled = true;
+    key.clip = GetFp8GemmClip(output_layout.dtype);
+    key.amax = d_amax_data != nullptr;
+    TF_ASSIGN_OR_RETURN(matmul, OneDnnMatMulCache::Global().GetOrCreate(
+                                    key, GetOneDnnMatMulEngine(stream_handle)));
+    if (primitive != nullptr) *primitive = matmul;
+  }
+
+  void* workspace;
+  TF_RETURN_IF_ERROR(AllocateWorkspace(&workspace, scratch_allocator,
+                                       matmul->scratchpad_size));
+  void* dst_data = const_cast<void*>(output.data.opaque());
+  if (d_amax_data != nullptr) {
+    TF_RETURN_IF_ERROR(AllocateWorkspace(&dst_data, scratch_allocator,
+                                         matmul->dst_md.get_size()));
+  }
+
+  const dnnl::engine& dnnl_engine = matmul->engine;
+  // A and B scales are 1-D attribute arguments; the D scale is a broadcast
+  // binary operand of the rank of D.
+  dnnl::memory::desc attr_scale_md({1}, dnnl::memory::data_type::f32,
+                                   dnnl::memory::format_tag::a);
+  auto scale_memory = [&](se::DeviceMemoryBase scale,
+                          const dnnl::memory::desc& md) {
+    return CreateDnnlMemory(md, dnnl_engine,
+                            const_cast<void*>(scale.opaque()));
+  };
+  std::unordered_map<int, dnnl::memory> args;
+  args.emplace(DNNL_ARG_SRC,
+               CreateDnnlMemory(matmul->src_md, dnnl_engine,
+                                const_cast<void*>(lhs.data.opaque())));
+  args.emplace(DNNL_ARG_WEIGHTS,
+               CreateDnnlMemory(matmul->weights_md, dnnl_engine,
+                                const_cast<void*>(rhs.data.opaque())));
+  args.emplace(DNNL_ARG_DST,
+               CreateDnnlMemory(matmul->dst_md, dnnl_engine, dst_data));
+  args.emplace(DNNL_ARG_SCRATCHPAD,
+               dnnl::memory(matmul->scratchpad_md, dnnl_engine, workspace));
+  if (bias_data) {
+    args.emplace(DNNL_ARG_BIAS,
+                 CreateDnnlMemory(matmul->bias_md, dnnl_engine, bias_data));
+  }
+  args.emplace(DNNL_ARG_ATTR_SCALES | DNNL_ARG_SRC,
+               scale_memory(scales.a_scale, attr_scale_md));
+  args.emplace(DNNL_ARG_ATTR_SCALES | DNNL_ARG_WEIGHTS,
+               scale_memory(scales.b_scale, attr_scale_md));
+  if (matmul->dst_scale_post_op >= 0) {
+    args.emplace(
+        DNNL_ARG_ATTR_MULTIPLE_POST_OP(matmul->dst_scale_post_op) |
+            DNNL_ARG_SRC_1,
+        scale_memory(scales.d_scale, matmul->scale_md));
+  }
+  dnnl::stream& dnnl_stream = GetOneDnnMatMulStream(dnnl_engine, stream_handle);
+  matmul->primitive.execute(dnnl_stream, args);
+  if (d_amax_data == nullptr) return OkStatus();
+
+  // amax is taken before D is scaled and converted.
+  ComputeFp8GemmAmax(stream_handle, static_cast<const float*>(dst_data),
+                     matmul->dst_md.get_size() / sizeof(float),
+                     static_cast<float*>(d_amax_data));
+  matmul->dst_scale.execute(
+      dnnl_stream,
+      {{DNNL_ARG_SRC_0,
+        CreateDnnlMemory(matmul->dst_md, dnnl_engine, dst_data)},
+       {DNNL_ARG_SRC_1, scale_memory(scales.d_scale, matmul->scale_md)},
+       {DNNL_ARG_DST,
+        CreateDnnlMemory(matmul->out_md, dnnl_engine,
+                         const_cast<void*>(output.data.opaque()))}});
+  return OkStatus();
+}
+
+/*static*/ StatusOr<WeightOnlyGemmConfig> WeightOnlyGemmConfig::For(
+    const Shape& lhs_shape, const Shape& rhs_shape, const Shape& scales_shape,
+    const Shape& output_shape) {
+  TF_RET_CHECK(lhs_shape.rank() == 2 && rhs_shape.rank() == 2 &&
+               scales_shape.rank() == 2 && output_shape.rank() == 2);
+  WeightOnlyGemmConfig config;
+  config.dtype = output_shape.element_type();
+  config.m = lhs_shape.dimensions(0);
+  config.k = lhs_shape.dimensions(1);
+  config.n = output_shape.dimensions(1);
+  TF_RET_CHECK(lhs_shape.element_type() == config.dtype &&
+               (config.dtype == F16 || config.dtype == BF16));
+  TF_RET_CHECK(rhs_shape.element_type() == S8 &&
+               scales_shape.element_type() == F32);
+  TF_RET_CHECK(rhs_shape.dimensions(0) == config.k &&
+               scales_shape.dimensions(1) == config.n);
+  config.int4 = rhs_shape.dimensions(1) != config.n;
+  TF_RET_CHECK(!config.int4 || rhs_shape.dimensions(1) * 2 == config.n);
+  TF_RET_CHECK(scales_shape.dimensions(0) > 0 &&
+               config.k % scales_shape.dimensions(0) == 0);
+  config.group_size = config.k / scales_shape.dimensions(0);
+  return config;
+}
+
+Status RunWeightOnlyGemm(const WeightOnlyGemmConfig& config,
+                         se::DeviceMemoryBase lhs_buffer,
+                         se::DeviceMemoryBase rhs_buffer,
+                         se::DeviceMemoryBase scales_buffer,
+                         se::DeviceMemoryBase zero_points_buffer,
+                         se::DeviceMemoryBase output_buffer, se::Stream* stream,
+                         se::ScratchAllocator* scratch_allocator) {
+  VLOG(2) << "Executing a weight-only GEMM " << config.m << "x" << config.n
+          << "x" << config.k << (config.int4 ? " int4" : " int8")
+          << ", group size " << config.group_size;
+  switch (config.dtype) {
+    case F16:
+      return DoWeightOnlyGemm<sycl::half>(
+          config, lhs_buffer, rhs_buffer, scales_buffer, zero_points_buffer,
+          output_buffer, stream, scratch_allocator);
+    case BF16:
+      return DoWeightOnlyGemm<::gpu::xetla::bf16>(
+          config, lhs_buffer, rhs_buffer, scales_buffer, zero_points_buffer,
+          output_buffer, stream, scratch_allocator);
+    default:
+      return InternalError(
+          "Unexpected weight-only GEMM dtype: %s",
+          primitive_util::LowercasePrimitiveTypeName(config.dtype));
+  }
+}
+
+/*static*/ StatusOr<GroupedGemmConfig> GroupedGemmConfig::For(
+    const Shape& lhs_shape, const Shape& rhs_shape,
+    const Shape& group_offsets_shape, const Shape& output_shape) {
+  TF_RET_CHECK(lhs_shape.rank() == 2 && rhs_shape.rank() == 3 &&
+               group_offsets_shape.rank() == 1 && output_shape.rank() == 2);
+  GroupedGemmConfig config;
+  config.dtype = output_shape.element_type();
+  config.m = lhs_shape.dimensions(0);
+  config.k = lhs_shape.dimensions(1);
+  config.n = output_shape.dimensions(1);
+  config.num_groups = rhs_shape.dimensions(0);
+  TF_RET_CHECK(config.dtype == F16 || config.dtype == BF16);
+  TF_RET_CHECK(lhs_shape.element_type() == config.dtype &&
+               rhs_shape.element_type() == config.dtype);
+  TF_RET_CHECK(group_offsets_shape.element_type() == S32 &&
+               group_offsets_shape.dimensions(0) == config.num_groups + 1);
+  TF_RET_CHECK(output_shape.dimensions(0) == config.m &&
+               rhs_shape.dimensions(1) == config.k &&
+               rhs_shape.dimensions(2) == config.n);
+  return config;
+}
+
+Status RunGroupedGemm(const GroupedGemmConfig& config,
+                      se::DeviceMemoryBase lhs_buffer,
+                      se::DeviceMemoryBase rhs_buffer,
+                      se::DeviceMemoryBase group_offsets_buffer,
+                      se::DeviceMemoryBase output_buffer, se::Stream* stream) {
+  VLOG(2) << "Executing a grouped GEMM " << config.m << "x" << config.n << "x"
+          << config.k << " with " << config.num_groups << " groups";
+  se::gpu::GpuStreamHandle stream_handle =
+      stream_executor::gpu::AsGpuStreamValue(stream);
+  auto run = [&](auto kernel) -> Status {
+    kernel.add_problem_size(config.m, config.n, config.k, config.num_groups)
+        .add_matrix_out(output_buffer.opaque())
+        .add_matrix_a(lhs_buffer.opaque())
+        .add_matrix_b(rhs_buffer.opaque())
+        .add_group_offsets(group_offsets_buffer.opaque())
+        .build();
+    // GroupedGemmRewriter only emits shapes the kernel takes.
+    if (kernel.fallback()) {
+      return InternalError("Unsupported grouped GEMM %dx%dx%d", config.m,
+                           config.n, config.k);
+    }
+    kernel.run(stream_handle);
+    return OkStatus();
+  };
+  switch (config.dtype) {
+    case F16:
+      return run(::gpu::xetla::XetlaGroupedGemmKernel<sycl::half>());
+    case BF16:
+      return run(::gpu::xetla::XetlaGroupedGemmKernel<::gpu::xetla::bf16>());
+    default:
+      return InternalError(
+          "Unexpected grouped GEMM dtype: %s",
+          primitive_util::LowercasePrimitiveTypeName(config.dtype));
+  }
+}
+
 namespace cublas_lt {
 StatusOr<se::cuda::BlasLt::Epilogue> AsBlasLtEpilogue(
     mlir::lmhlo_gpu::CublasLtMatmulEpilogue epilogue) {
@@ -531,6 +1715,30 @@ StatusOr<se::cuda::BlasLt::Epilogue> AsBlasLtEpilogue(
   }
   return InternalError("unexpected epilogue value");
 }
+
+StatusOr<se::cuda::BlasLt::Epilogue> AsBlasLtEpilogue(
+    GemmBackendConfig::Epilogue epilogue) {
+  switch (epilogue) {
+    case GemmBackendConfig::DEFAULT:
+      return se::cuda::BlasLt::Epilogue::kDefault;
+    case GemmBackendConfig::RELU:
+      return se::cuda::BlasLt::Epilogue::kReLU;
+    case GemmBackendConfig::GELU:
+      return se::cuda::BlasLt::Epilogue::kGELU;
+    case GemmBackendConfig::GELU_AUX:
+      return se::cuda::BlasLt::Epilogue::kGELUWithAux;
+    case GemmBackendConfig::BIAS:
+      return se::cuda::BlasLt::Epilogue::kBias;
+    case GemmBackendConfig::BIAS_RELU:
+      return se::cuda::BlasLt::Epilogue::kBiasThenReLU;
+    case GemmBackendConfig::BIAS_GELU:
+      return se::cuda::BlasLt::Epilogue::kBiasThenGELU;
+    case GemmBackendConfig::BIAS_GELU_AUX:
+      return se::cuda::BlasLt::Epilogue::kBiasThenGELUWithAux;
+    default:
+      return InternalError("unexpected epilogue value");
+  }
+}
 }  // namespace cublas_lt
 
 }  // namespace gpu
@@ -19,6 +19,7 @@ limitations under the License.
 #define XLA_SERVICE_GPU_ONEDNN_MATMUL_UTILS_H_
 
 #include <cstdint>
+#include <memory>
 #include <optional>
 #include <utility>
 #include <vector>
@@ -26,6 +27,7 @@ limitations under the License.
 #include "absl/types/span.h"
 #include "xla/hlo/ir/hlo_instruction.h"
 #include "xla/service/gpu/backend_configs.pb.h"
+#include "xla/service/gpu/gemm_post_ops.h"
 #include "xla/service/gpu/ir_emission_utils.h"
 #include "xla/service/gpu/matmul_utils.h"
 #include "xla/service/gpu/scratch_allocator.h"
@@ -38,17 +40,135 @@ limitations under the License.
 namespace xla {
 namespace gpu {
 
+// Values of GemmBackendConfig::selected_algorithm understood by RunGemm.
+// Unset, kDefaultAlgorithm and kGemmAlgorithmHeuristic keep the built-in
+// XeTLA/oneDNN choice.
+inline constexpr int64_t kGemmAlgorithmHeuristic = 0;
+// Always runs oneDNN.
+inline constexpr int64_t kGemmAlgorithmOneDnn = 1;
+// kGemmAlgorithmXetla + i runs XeTLA with tile config i of
+// ::gpu::xetla::getXetlaGemmConfigs().
+inline constexpr int64_t kGemmAlgorithmXetla = 2;
+
+// Returns the selected_algorithm values worth benchmarking for `config`.
+std::vector<int64_t> GetGemmAlgorithmCandidates(const GemmConfig& config);
+
+// A oneDNN matmul primitive ready to execute, taken from a process-wide LRU
+// cache (XLA_ONEDNN_MATMUL_CACHE_SIZE entries, 1024 by default).
+struct OneDnnMatMulPrimitive;
+
+// If `primitive` is non-null and set, the oneDNN path runs it without a cache
+// lookup; it must come from an earlier call with the same config, buffers
+// presence and device. If it is non-null and empty, the primitive used is
+// stored into it.
 Status RunGemm(const GemmConfig& config, se::DeviceMemoryBase lhs_buffer,
                se::DeviceMemoryBase rhs_buffer, se::DeviceMemoryBase add_buffer,
                se::DeviceMemoryBase output_buffer,
                se::DeviceMemoryBase bias_buffer, se::Stream* stream,
-               se::ScratchAllocator* scratch_allocator = nullptr);
+               se::ScratchAllocator* scratch_allocator = nullptr,
+               std::shared_ptr<const OneDnnMatMulPrimitive>* primitive =
+                   nullptr);
+
+// Runs a GEMM whose result goes through `post_ops` in order, like the custom
+// calls named after kGemmWithPostOpsCallTargetPrefix. `post_op_buffers` holds
+// the operand of each post-op that reads one, in order. `config` must have
+// alpha 1 and beta 0; its epilogue is ignored. `primitive` is used as in
+// RunGemm.
+Status RunGemmWithPostOps(
+    const GemmConfig& config, se::DeviceMemoryBase lhs_buffer,
+    se::DeviceMemoryBase rhs_buffer, se::DeviceMemoryBase output_buffer,
+    absl::Span<const GemmPostOp> post_ops,
+    absl::Span<const se::DeviceMemoryBase> post_op_buffers, se::Stream* stream,
+    se::ScratchAllocator* scratch_allocator = nullptr,
+    std::shared_ptr<const OneDnnMatMulPrimitive>* primitive = nullptr);
+
+// Device F32 scalars of an FP8 GEMM, with the semantics of the operands of
+// kCublasLtMatmulF8CallTarget: D = d_scale * (a_scale * A @ b_scale * B).
+struct Fp8GemmScales {
+  se::DeviceMemoryBase a_scale;
+  se::DeviceMemoryBase b_scale;
+  // Only applied, followed by saturation, when D is an FP8 type.
+  se::DeviceMemoryBase d_scale;
+  // If non-null, receives max(|D|) taken before D is scaled and converted.
+  se::DeviceMemoryBase d_amax;
+};
+
+// Runs a GEMM with F8E4M3FN/F8E5M2 operands through oneDNN. `primitive` is
+// used as in RunGemm.
+Status RunFp8Gemm(const GemmConfig& config, se::DeviceMemoryBase lhs_buffer,
+                  se::DeviceMemoryBase rhs_buffer,
+                  se::DeviceMemoryBase c_buffer,
+                  se::DeviceMemoryBase output_buffer,
+                  se::DeviceMemoryBase bias_buffer, const Fp8GemmScales& scales,
+                  se::Stream* stream,
+                  se::ScratchAllocator* scratch_allocator = nullptr,
+                  std::shared_ptr<const OneDnnMatMulPrimitive>* primitive =
+                      nullptr);
+
+// A weight-only quantized GEMM, see kXetlaWeightOnlyGemmCallTarget:
+// output[m, n] = lhs[m, k] @ ((rhs - zero_points) * scales), with one row of
+// scales and zero points per `group_size` rows of rhs.
+struct WeightOnlyGemmConfig {
+  static StatusOr<WeightOnlyGemmConfig> For(const Shape& lhs_shape,
+                                            const Shape& rhs_shape,
+                                            const Shape& scales_shape,
+                                            const Shape& output_shape);
+
+  // Of lhs and output, F16 or BF16.
+  PrimitiveType dtype;
+  int64_t m;
+  int64_t n;
+  int64_t k;
+  int64_t group_size;
+  // rhs holds two int4 values per byte rather than one int8.
+  bool int4;
+};
+
+// Runs a weight-only GEMM with XeTLA. `zero_points_buffer` may be null.
+// Shapes the kernel does not take dequantize rhs into memory from
+// `scratch_allocator` and go through the oneDNN path of RunGemm.
+//
+// This is not a RunGemm dispatch because GemmConfig has no room for the
+// scales and zero points, nor for an S8 rhs under an F16 or BF16 output.
+Status RunWeightOnlyGemm(const WeightOnlyGemmConfig& config,
+                         se::DeviceMemoryBase lhs_buffer,
+                         se::DeviceMemoryBase rhs_buffer,
+                         se::DeviceMemoryBase scales_buffer,
+                         se::DeviceMemoryBase zero_points_buffer,
+                         se::DeviceMemoryBase output_buffer, se::Stream* stream,
+                         se::ScratchAllocator* scratch_allocator);
+
+// A grouped GEMM, see kXetlaGroupedGemmCallTarget: output rows of group g
+// are lhs rows of group g times rhs[g].
+struct GroupedGemmConfig {
+  static StatusOr<GroupedGemmConfig> For(const Shape& lhs_shape,
+                                         const Shape& rhs_shape,
+                                         const Shape& group_offsets_shape,
+                                         const Shape& output_shape);
+
+  // Of lhs, rhs and output, F16 or BF16.
+  PrimitiveType dtype;
+  int64_t m;
+  int64_t n;
+  int64_t k;
+  int64_t num_groups;
+};
+
+// Runs a grouped GEMM with XeTLA as a single kernel launch.
+Status RunGroupedGemm(const GroupedGemmConfig& config,
+                      se::DeviceMemoryBase lhs_buffer,
+                      se::DeviceMemoryBase rhs_buffer,
+                      se::DeviceMemoryBase group_offsets_buffer,
+                      se::DeviceMemoryBase output_buffer, se::Stream* stream);
 
 namespace cublas_lt {
 
 StatusOr<se::cuda::BlasLt::Epilogue> AsBlasLtEpilogue(
     mlir::lmhlo_gpu::CublasLtMatmulEpilogue epilogue);
 
+StatusOr<se::cuda::BlasLt::Epilogue> AsBlasLtEpilogue(
+    GemmBackendConfig::Epilogue epilogue);
+
 class MatmulPlan {
  public:
   template <typename CublasLtMatmulMaybeF8Op,
@@ -0,0 +1,336 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/service/gpu/onednn_quantized_conv_rewriter.h"
+
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "tsl/platform/errors.h"
+#include "tsl/platform/logging.h"
+#include "tsl/platform/statusor.h"
+#include "xla/hlo/ir/hlo_casting_utils.h"
+#include "xla/hlo/ir/hlo_computation.h"
+#include "xla/hlo/ir/hlo_instruction.h"
+#include "xla/hlo/ir/hlo_instructions.h"
+#include "xla/hlo/ir/hlo_opcode.h"
+#include "xla/literal.h"
+#include "xla/primitive_util.h"
+#include "xla/service/gpu/backend_configs.pb.h"
+#include "xla/service/gpu/cublas_cudnn.h"
+#include "xla/service/gpu/gpu_conv_runner.h"
+#include "xla/service/hlo_creation_utils.h"
+#include "xla/service/pattern_matcher.h"
+#include "xla/shape_util.h"
+#include "xla/stream_executor/dnn.pb.h"
+#include "xla/window_util.h"
+#include "xla/xla_data.pb.h"
+
+namespace xla {
+namespace gpu {
+namespace {
+
+namespace m = match;
+
+// The range of values of the s8 or u8 `type`.
+std::optional<std::pair<int64_t, int64_t>> QuantizedRange(
+    PrimitiveType type) {
+  switch (type) {
+    case S8:
+      return std::make_pair(int64_t{-128}, int64_t{127});
+    case U8:
+      return std::make_pair(int64_t{0}, int64_t{255});
+    default:
+      return std::nullopt;
+  }
+}
+
+// The value of `instr`, a scalar constant with an integral value or a
+// broadcast of one.
+std::optional<int64_t> IntegralConstant(const HloInstruction* instr) {
+  if (instr->opcode() == HloOpcode::kBroadcast) instr = instr->operand(0);
+  if (!instr->IsConstant() || !ShapeUtil::IsEffectiveScalar(instr->shape())) {
+    return std::nullopt;
+  }
+  StatusOr<Literal> value = instr->literal().Convert(F64);
+  if (!value.ok()) return std::nullopt;
+  double scalar = value->GetFirstElement<double>();
+  if (scalar != std::round(scalar)) return std::nullopt;
+  return static_cast<int64_t>(scalar);
+}
+
+HloInstruction* SoleUser(HloInstruction* instr) {
+  return instr->user_count() == 1 ? instr->users()[0] : nullptr;
+}
+
+// (convert(value) - zero_point) * scale, with zero_point and scale broadcast
+// to the shape of value.
+struct Dequantize {
+  HloInstruction* value;
+  // Broadcast.
+  HloInstruction* scale;
+  int64_t zero_point;
+};
+
+std::optional<Dequantize> MatchDequantize(HloInstruction* instr) {
+  Dequantize dequantize{};
+  HloInstruction* zero_point = nullptr;
+  if (!Match(instr, m::MultiplyAnyOrder(
+                        m::Subtract(m::Convert(m::Op(&dequantize.value)),
+                                    m::Broadcast(&zero_point, m::Op())),
+                        m::Broadcast(&dequantize.scale, m::Op())))) {
+    zero_point = nullptr;
+    if (!Match(instr, m::MultiplyAnyOrder(
+                          m::Convert(m::Op(&dequantize.value)),
+                          m::Broadcast(&dequantize.scale, m::Op())))) {
+      return std::nullopt;
+    }
+  }
+  auto range = QuantizedRange(dequantize.value->shape().element_type());
+  if (!range.has_value()) return std::nullopt;
+  if (zero_point != nullptr) {
+    std::optional<int64_t> value = IntegralConstant(zero_point);
+    if (!value.has_value() || *value < range->first ||
+        *value > range->second) {
+      return std::nullopt;
+    }
+    dequantize.zero_point = *value;
+  }
+  return dequantize;
+}
+
+// convert(clamp(lo, round_nearest_even(result / scale) + zero_point, hi)),
+// with lo and hi the range of the s8 or u8 convert. The zero point may also
+// be added before rounding, and the scale multiply by its inverse.
+struct Requantize {
+  HloInstruction* convert;
+  // Broadcast.
+  HloInstruction* scale;
+  bool inverse_scale;
+  int64_t zero_point;
+};
+
+std::optional<Requantize> MatchRequantize(HloInstruction* result) {
+  Requantize requantize{};
+  HloInstruction* value = SoleUser(result);
+  if (value == nullptr) return std::nullopt;
+  if (!Match(value, m::Divide(m::Op().Is(result),
+                              m::Broadcast(&requantize.scale, m::Op())))) {
+    if (!Match(value,
+               m::MultiplyAnyOrder(m::Op().Is(result),
+                                   m::Broadcast(&requantize.scale, m::Op())))) {
+      return std::nullopt;
+    }
+    requantize.inverse_scale = true;
+  }
+  if (!requantize.scale->dimensions().empty()) return std::nullopt;
+
+  // The rounding and the zero point, in either order.
+  bool rounded = false;
+  std::optional<int64_t> zero_point;
+  HloInstruction* instr;
+  while ((instr = SoleUser(value)) != nullptr) {
+    HloInstruction* addend;
+    if (!rounded && instr->opcode() == HloOpcode::kRoundNearestEven) {
+      rounded = true;
+    } else if (!zero_point.has_value() &&
+               Match(instr, m::AddAnyOrder(m::Op().Is(value),
+                                           m::Broadcast(&addend, m::Op())))) {
+      zero_point = IntegralConstant(addend);
+      if (!zero_point.has_value()) return std::nullopt;
+    } else {
+      break;
+    }
+    value = instr;
+  }
+  HloInstruction* lo;
+  HloInstruction* hi;
+  if (!rounded || instr == nullptr ||
+      !Match(instr, m::Clamp(m::Op(&lo), m::Op().Is(value), m::Op(&hi)))) {
+    return std::nullopt;
+  }
+  requantize.convert = SoleUser(instr);
+  if (requantize.convert == nullptr ||
+      requantize.convert->opcode() != HloOpcode::kConvert) {
+    return std::nullopt;
+  }
+  auto range = QuantizedRange(requantize.convert->shape().element_type());
+  if (!range.has_value() || IntegralConstant(lo) != range->first ||
+      IntegralConstant(hi) != range->second) {
+    return std::nullopt;
+  }
+  requantize.zero_point = zero_point.value_or(0);
+  if (requantize.zero_point < range->first ||
+      requantize.zero_point > range->second) {
+    return std::nullopt;
+  }
+  return requantize;
+}
+
+// `broadcast`, per tensor or along the output feature dimension of the
+// conv, as f32 values per output feature.
+HloInstruction* FeatureValues(HloInstruction* broadcast, int64_t features) {
+  HloInstruction* values = MakeConvertToHlo(broadcast->mutable_operand(0), F32);
+  if (broadcast->dimensions().empty()) {
+    return MakeBroadcastHlo(values, /*broadcast_dimensions=*/{}, {features});
+  }
+  return values;
+}
+
+StatusOr<bool> RewriteConv(HloInstruction* conv) {
+  HloInstruction* gte = SoleUser(conv);
+  if (gte == nullptr || gte->opcode() != HloOpcode::kGetTupleElement ||
+      gte->tuple_index() != 0) {
+    return false;
+  }
+  PrimitiveType float_type = gte->shape().element_type();
+  if (float_type != F32 && float_type != F16 && float_type != BF16) {
+    return false;
+  }
+
+  const ConvolutionDimensionNumbers& dnums =
+      conv->convolution_dimension_numbers();
+  std::optional<Dequantize> input = MatchDequantize(conv->mutable_operand(0));
+  std::optional<Dequantize> filter = MatchDequantize(conv->mutable_operand(1));
+  // oneDNN takes neither u8 nor zero points for the filter.
+  if (!input.has_value() || !filter.has_value() ||
+      filter->value->shape().element_type() != S8 ||
+      filter->zero_point != 0 || !input->scale->dimensions().empty() ||
+      (!filter->scale->dimensions().empty() &&
+       (filter->scale->dimensions().size() != 1 ||
+        filter->scale->dimensions(0) !=
+            dnums.kernel_output_feature_dimension()))) {
+    return false;
+  }
+  // GpuConvPaddingLegalization pads such inputs with 0 rather than with the
+  // zero point.
+  const Window& window = conv->window();
+  if (input->zero_point != 0 &&
+      (!window_util::HasSymmetricPadding(window) ||
+       window_util::HasNegativePadding(window) ||
+       window_util::HasBaseDilation(window))) {
+    return false;
+  }
+
+  // The epilogue, each step the sole user of the one before.
+  HloInstruction* result = gte;
+  HloInstruction* bias = nullptr;
+  HloInstruction* user = SoleUser(result);
+  if (user != nullptr &&
+      Match(user, m::AddAnyOrder(m::Op().Is(result),
+                                 m::Broadcast(&bias, m::Op()))) &&
+      bias->dimensions().size() == 1 &&
+      bias->dimensions(0) == dnums.output_feature_dimension()) {
+    result = user;
+    user = SoleUser(result);
+  } else {
+    bias = nullptr;
+  }
+  // Commutes with the division by the positive s_y.
+  bool relu = false;
+  if (user != nullptr &&
+      Match(user, m::MaximumAnyOrder(
+                      m::Op().Is(result),
+                      m::Broadcast(m::ConstantEffectiveScalar(0))))) {
+    relu = true;
+    result = user;
+  }
+  std::optional<Requantize> requantize = MatchRequantize(result);
+  if (requantize.has_value()) result = requantize->convert;
+
+  HloComputation* comp = conv->parent();
+  const int64_t features =
+      gte->shape().dimensions(dnums.output_feature_dimension());
+  TF_ASSIGN_OR_RETURN(HloInstruction * scales,
+                      MakeBinaryHlo(HloOpcode::kMultiply,
+                                    FeatureValues(filter->scale, features),
+                                    FeatureValues(input->scale, features)));
+  HloInstruction* biases =
+      bias != nullptr
+          ? MakeConvertToHlo(bias->mutable_operand(0), F32)
+          : BroadcastZeros(comp, F32, {features});
+  if (requantize.has_value()) {
+    HloOpcode opcode = requantize->inverse_scale ? HloOpcode::kMultiply
+                                                 : HloOpcode::kDivide;
+    HloInstruction* output_scale = FeatureValues(requantize->scale, features);
+    TF_ASSIGN_OR_RETURN(scales, MakeBinaryHlo(opcode, scales, output_scale));
+    TF_ASSIGN_OR_RETURN(biases, MakeBinaryHlo(opcode, biases, output_scale));
+  }
+  TF_ASSIGN_OR_RETURN(HloInstruction * scales_and_biases,
+                      MakeConcatHlo({scales, biases}, 0));
+
+  TF_ASSIGN_OR_RETURN(CudnnConvBackendConfig config,
+                      conv->backend_config<CudnnConvBackendConfig>());
+  if (relu) config.set_activation_mode(se::dnn::kRelu);
+  auto& knobs = *config.mutable_algorithm()->mutable_tuning_knobs();
+  knobs[kOneDnnChannelScalesKnob] = 1;
+  if (input->zero_point != 0) {
+    knobs[kOneDnnSrcZeroPointKnob] = input->zero_point;
+  }
+  if (requantize.has_value() && requantize->zero_point != 0) {
+    knobs[kOneDnnDstZeroPointKnob] = requantize->zero_point;
+  }
+
+  PrimitiveType output_type = requantize.has_value()
+                                  ? requantize->convert->shape().element_type()
+                                  : float_type;
+  VLOG(1) << "Rewriting " << conv->name() << " into a "
+          << primitive_util::LowercasePrimitiveTypeName(
+                 input->value->shape().element_type())
+          << "->" << primitive_util::LowercasePrimitiveTypeName(output_type)
+          << " convolution";
+
+  Shape shape = conv->shape();
+  shape.mutable_tuple_shapes(0)->set_element_type(output_type);
+  HloInstruction* new_conv = comp->AddInstruction(conv->CloneWithNewOperands(
+      shape, {input->value, filter->value, scales_and_biases}));
+  new_conv->set_custom_call_target(kCudnnConvBiasActivationForwardCallTarget);
+  comp->parent()->SetAndUniquifyInstrName(new_conv, "onednn-quantized-conv");
+  TF_RETURN_IF_ERROR(new_conv->set_backend_config(config));
+  TF_ASSIGN_OR_RETURN(HloInstruction * new_gte,
+                      MakeGetTupleElementHlo(new_conv, 0));
+  TF_RETURN_IF_ERROR(comp->ReplaceInstruction(result, new_gte));
+  return true;
+}
+
+}  // namespace
+
+StatusOr<bool> OnednnQuantizedConvRewriter::Run(
+    HloModule* module,
+    const absl::flat_hash_set<absl::string_view>& execution_threads) {
+  bool changed = false;
+  for (HloComputation* computation :
+       module->MakeNonfusionComputations(execution_threads)) {
+    // Rewriting a conv removes the instructions after it that it fuses.
+    std::vector<HloInstruction*> convs;
+    for (HloInstruction* instr : computation->instructions()) {
+      if (instr->opcode() == HloOpcode::kCustomCall &&
+          instr->custom_call_target() == kCudnnConvForwardCallTarget) {
+        convs.push_back(instr);
+      }
+    }
+    for (HloInstruction* conv : convs) {
+      TF_ASSIGN_OR_RETURN(bool rewritten, RewriteConv(conv));
+      changed |= rewritten;
+    }
+  }
+  return changed;
+}
+
+}  // namespace gpu
+}  // namespace xla
@@ -0,0 +1,64 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef XLA_SERVICE_GPU_ONEDNN_QUANTIZED_CONV_REWRITER_H_
+#define XLA_SERVICE_GPU_ONEDNN_QUANTIZED_CONV_REWRITER_H_
+
+#include "absl/strings/string_view.h"
+#include "xla/hlo/ir/hlo_module.h"
+#include "xla/service/hlo_pass_interface.h"
+
+namespace xla {
+namespace gpu {
+
+// Rewrites forward convolutions of dequantized operands, as quantization-aware
+// models spell them,
+//
+//   y = conv((convert(x) - zp_x) * s_x, convert(w) * s_w)
+//   [y = y + broadcast(bias)]
+//   [y = max(y, 0)]
+//   [y = convert(clamp(lo, round_nearest_even(y / s_y) + zp_y, hi))]
+//
+// into oneDNN convolutions that read x and w in their quantized form and
+// write the requantized result, or the float one when there is no
+// requantization. x is s8 or u8 and w is s8. s_x, s_y and the zero points are
+// per tensor, s_w per tensor or per output feature, the zero points
+// constants, and lo and hi the range of the s8 or u8 result; s_y may also
+// multiply by its inverse and zp_y be added before rounding.
+//
+// The rewritten conv computes s[f] * conv(x - zp_x, w) + b[f] + zp_y, with
+// s = s_x * s_w / s_y and b = bias / s_y, rounding to nearest even and
+// saturating for integer results. Its bias operand holds s followed by b,
+// marked by kOneDnnChannelScalesKnob; the zero points are in
+// kOneDnnSrcZeroPointKnob and kOneDnnDstZeroPointKnob.
+//
+// Runs after GpuConvRewriter and before OnednnFusedConvRewriter, which leaves
+// these convs alone.
+class OnednnQuantizedConvRewriter : public HloModulePass {
+ public:
+  absl::string_view name() const override {
+    return "onednn-quantized-conv-rewriter";
+  }
+
+  using HloPassInterface::Run;
+  StatusOr<bool> Run(
+      HloModule* module,
+      const absl::flat_hash_set<absl::string_view>& execution_threads) override;
+};
+
+}  // namespace gpu
+}  // namespace xla
+
+#endif  // XLA_SERVICE_GPU_ONEDNN_QUANTIZED_CONV_REWRITER_H_
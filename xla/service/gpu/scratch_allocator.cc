@@ -15,16 +15,54 @@ limitations under the License.
 
 #include "xla/service/gpu/scratch_allocator.h"
 
+#include "tsl/platform/logging.h"
+#include "xla/util.h"
+
 namespace xla {
 namespace gpu {
 tsl::Status AllocateWorkspace(
     void** workspace, stream_executor::ScratchAllocator* scratch_allocator,
     size_t num_bytes) {
+  if (num_bytes == 0) {
+    *workspace = nullptr;
+    return tsl::OkStatus();
+  }
   TF_ASSIGN_OR_RETURN(stream_executor::DeviceMemory<tsl::uint8> workspace_bytes,
                       scratch_allocator->AllocateBytes(num_bytes));
   *workspace = static_cast<void*>(workspace_bytes.opaque());
   return tsl::OkStatus();
 }
 
+int64_t BufferScratchAllocator::GetMemoryLimitInBytes() {
+  return fallback_ != nullptr ? fallback_->GetMemoryLimitInBytes()
+                              : buffer_.size() - offset_;
+}
+
+tsl::StatusOr<stream_executor::DeviceMemory<uint8_t>>
+BufferScratchAllocator::AllocateBytes(int64_t byte_size) {
+  int64_t end = offset_ + byte_size;
+  if (end <= static_cast<int64_t>(buffer_.size())) {
+    stream_executor::DeviceMemoryBase workspace =
+        buffer_.GetByteSlice(offset_, byte_size);
+    offset_ = RoundUpTo<int64_t>(end, kWorkspaceAlignment);
+    return stream_executor::DeviceMemory<uint8_t>(workspace);
+  }
+  if (fallback_ == nullptr) {
+    return ResourceExhausted(
+        "Scratch buffer of %d bytes cannot hold another %d bytes",
+        buffer_.size(), byte_size);
+  }
+  VLOG(2) << "Scratch buffer of " << buffer_.size() << " bytes exhausted, "
+          << "allocating " << byte_size << " bytes";
+  return fallback_->AllocateBytes(byte_size);
+}
+
+tsl::StatusOr<stream_executor::DeviceMemory<uint8_t>>
+WorkspaceSizingAllocator::AllocateBytes(int64_t byte_size) {
+  total_bytes_ = RoundUpTo<int64_t>(total_bytes_, kWorkspaceAlignment);
+  total_bytes_ += byte_size;
+  return stream_executor::DeviceMemory<uint8_t>(placeholder_);
+}
+
 }  // namespace gpu
 }  // namespace xla
\ No newline at end of file
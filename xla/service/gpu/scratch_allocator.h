@@ -15,14 +15,62 @@ limitations under the License.
 
 #ifndef XLA_SERVICE_GPU_SCRATCH_ALLOCATOR_H_
 #define XLA_SERVICE_GPU_SCRATCH_ALLOCATOR_H_
+
+#include <cstdint>
+
+#include "xla/stream_executor/device_memory.h"
 #include "xla/stream_executor/scratch_allocator.h"
 
 namespace xla {
 namespace gpu {
+
+// Alignment of the workspaces carved out of a compile-time scratch buffer.
+inline constexpr int64_t kWorkspaceAlignment = 256;
+
+// Returns a null workspace for `num_bytes` == 0 without touching the
+// allocator.
 tsl::Status AllocateWorkspace(
     void** workspace, stream_executor::ScratchAllocator* scratch_allocator,
     size_t num_bytes);
 
+// Hands out workspaces from `buffer`, a scratch slice assigned at compile
+// time, and from `fallback` once `buffer` is exhausted.
+class BufferScratchAllocator : public stream_executor::ScratchAllocator {
+ public:
+  BufferScratchAllocator(stream_executor::DeviceMemoryBase buffer,
+                         stream_executor::ScratchAllocator* fallback)
+      : buffer_(buffer), fallback_(fallback) {}
+
+  int64_t GetMemoryLimitInBytes() override;
+  tsl::StatusOr<stream_executor::DeviceMemory<uint8_t>> AllocateBytes(
+      int64_t byte_size) override;
+
+ private:
+  stream_executor::DeviceMemoryBase buffer_;
+  int64_t offset_ = 0;
+  stream_executor::ScratchAllocator* fallback_;
+};
+
+// Records the workspaces requested from it and returns `placeholder` for
+// each. Sizes compile-time scratch buffers for BufferScratchAllocator.
+class WorkspaceSizingAllocator : public stream_executor::ScratchAllocator {
+ public:
+  explicit WorkspaceSizingAllocator(
+      stream_executor::DeviceMemoryBase placeholder)
+      : placeholder_(placeholder) {}
+
+  int64_t GetMemoryLimitInBytes() override { return -1; }
+  tsl::StatusOr<stream_executor::DeviceMemory<uint8_t>> AllocateBytes(
+      int64_t byte_size) override;
+
+  // Bytes a BufferScratchAllocator needs to serve the same requests.
+  int64_t total_bytes() const { return total_bytes_; }
+
+ private:
+  stream_executor::DeviceMemoryBase placeholder_;
+  int64_t total_bytes_ = 0;
+};
+
 }  // namespace gpu
 }  // namespace xla
 #endif  // XLA_SERVICE_GPU_SCRATCH_ALLOCATOR_H_
\ No newline at end of file
@@ -17,6 +17,7 @@ limitations under the License.
 
 #include <stdlib.h>
 
+#include <cstdint>
 #include <fstream>
 #include <memory>
 #include <string>
@@ -33,20 +34,29 @@ limitations under the License.
 #include "xla/service/dump.h"
 #include "xla/service/float_normalization.h"
 #include "xla/service/float_support.h"
+#include "xla/service/gpu/autotune_cache.h"
 #include "xla/service/gpu/backend_configs.pb.h"
+#include "xla/service/gpu/compile_profile.h"
+#include "xla/service/gpu/conv_autotuner.h"
 #include "xla/service/gpu/cublas_cudnn.h"
 #include "xla/service/gpu/fused_mha_rewriter.h"
 #include "xla/service/gpu/fused_qkv_rewriter.h"
+#include "xla/service/gpu/gemm_autotuner.h"
 #include "xla/service/gpu/gpu_conv_padding_legalization.h"
 #include "xla/service/gpu/gpu_conv_rewriter.h"
 #include "xla/service/gpu/gpu_layout_assignment.h"
+#include "xla/service/gpu/grouped_gemm_rewriter.h"
+#include "xla/service/gpu/horizontal_dot_batcher.h"
 #include "xla/service/gpu/ir_emission_utils.h"
 #include "xla/service/gpu/llvm_gpu_backend/gpu_backend_lib.h"
 #include "xla/service/gpu/mkl_rewriter.h"
+#include "xla/service/gpu/onednn_blocked_layout_propagation.h"
 #include "xla/service/gpu/onednn_fused_conv_rewriter.h"
+#include "xla/service/gpu/onednn_quantized_conv_rewriter.h"
 #include "xla/service/gpu/redundant_convert_mover.h"
 #include "xla/service/gpu/target_constants.h"
 #include "xla/service/gpu/triangular_solve_rewriter.h"
+#include "xla/service/gpu/weight_only_gemm_rewriter.h"
 #include "xla/service/hlo_constant_folding.h"
 #include "xla/service/hlo_cse.h"
 #include "xla/service/hlo_dce.h"
@@ -87,7 +97,8 @@ Status SPIRCompiler::OptimizeHloConvolutionCanonicalization(
     se::DeviceMemoryAllocator* device_allocator) {
   // Convert convolutions into CustomCalls to onednn, then canonicalize them
   // (GpuConvPaddingLegalization). Also expand cuSolver calls.
-  HloPassPipeline pipeline("conv_canonicalization");
+  HloPassPipeline pipeline("conv_canonicalization",
+                           CompileProfile::StatsFor(hlo_module));
   pipeline.AddInvariantCheckerDebug<HloVerifier>(
       /*layout_sensitive=*/false,
       /*allow_mixed_precision=*/false);
@@ -97,7 +108,16 @@ Status SPIRCompiler::OptimizeHloConvolutionCanonicalization(
   pipeline.AddPass<FloatNormalization>(&conv_bf16_support);
 
   pipeline.AddPass<MklRewriter>();
+  pipeline.AddPass<WeightOnlyGemmRewriter>();
+  pipeline.AddPass<GroupedGemmRewriter>();
+  // Small GEMMs are bound by launch overhead on XPU. Dots whose epilogues
+  // GemmRewriter fuses later are not batched.
+  pipeline.AddPass<HorizontalDotBatcher>(
+      /*max_flops_per_dot=*/int64_t{1} << 28,
+      /*max_copied_bytes_per_dot=*/int64_t{1} << 20);
   pipeline.AddPass<GpuConvRewriter>();
+  // Before the float fusions, which would take dequantized convs apart.
+  pipeline.AddPass<OnednnQuantizedConvRewriter>();
   pipeline.AddPass<OnednnFusedConvRewriter>();
   pipeline.AddPass<GpuConvPaddingLegalization>();
 
@@ -140,7 +160,8 @@ Status SPIRCompiler::OptimizeHloPostLayoutAssignment(
     se::DeviceMemoryAllocator* device_allocator,
     const GpuTargetConfig& gpu_target_config,
     const AutotuneResults* autotune_results) {
-  HloPassPipeline pre_pipeline("spir post-layout_assignment part 1");
+  HloPassPipeline pre_pipeline("spir post-layout_assignment part 1",
+                               CompileProfile::StatsFor(hlo_module));
 
   // Padding a gemm operand that's a constant results in pad(constant).  Run
   // constant-folding to simplify this into a new constant.
@@ -156,7 +177,8 @@ Status SPIRCompiler::OptimizeHloPostLayoutAssignment(
   if (use_mha) {
     auto cuda_compute_capability =
         std::get<se::CudaComputeCapability>(gpu_target_config.gpu_version);
-    HloPassPipeline mha_fusion_pipeline("multi-headed attention fusion");
+    HloPassPipeline mha_fusion_pipeline("multi-headed attention fusion",
+                                        CompileProfile::StatsFor(hlo_module));
     // Rewrite Multi-Headed Attention modules to Fused MHA custom-calls.
     mha_fusion_pipeline.AddPass<RedundantConvertMover>();
     mha_fusion_pipeline.AddPass<HloDCE>();
@@ -174,7 +196,8 @@ Status SPIRCompiler::OptimizeHloPostLayoutAssignment(
 
     auto cuda_compute_capability =
         std::get<se::CudaComputeCapability>(gpu_target_config.gpu_version);
-    HloPassPipeline qkv_fusion_pipeline("QKV BatchedGemm fusion");
+    HloPassPipeline qkv_fusion_pipeline("QKV BatchedGemm fusion",
+                                        CompileProfile::StatsFor(hlo_module));
     // Rewrite 3 gemm modules to Fused QKV custom-calls.
     qkv_fusion_pipeline.AddPass<FusedQKVRewriter>(gpu_device_info,
                                                   cuda_compute_capability);
@@ -183,13 +206,27 @@ Status SPIRCompiler::OptimizeHloPostLayoutAssignment(
     TF_RETURN_IF_ERROR(qkv_fusion_pipeline.Run(hlo_module).status());
   }
 
-  HloPassPipeline post_pipeline("spir post-layout_assignment part 2");
+  HloPassPipeline post_pipeline("spir post-layout_assignment part 2",
+                                CompileProfile::StatsFor(hlo_module));
 
   // Transform TriangularSolve ops into custom-calls, so we can add temp
   // memory.
   post_pipeline.AddPass<TriangularSolveRewriter>();
 
+  // Runs before ConvAutotuner, which measures the activation formats picked
+  // here.
+  post_pipeline.AddPass<OneDnnBlockedLayoutPropagation>();
+
+  // Results shipped for deviceless compilation take part in the lookup like
+  // the ones from XLA_AUTOTUNE_RESULTS_LOAD.
+  if (autotune_results != nullptr && autotune_results->results_size() > 0) {
+    TF_RETURN_IF_ERROR(AutotuneCache::Load(*autotune_results));
+  }
+  post_pipeline.AddPass<GemmAutotuner>(stream_exec, device_allocator);
+  post_pipeline.AddPass<ConvAutotuner>(stream_exec, device_allocator);
+
   TF_RETURN_IF_ERROR(post_pipeline.Run(hlo_module).status());
+  TF_RETURN_IF_ERROR(AutotuneCache::MaybeDump());
 
   return OkStatus();
 }
@@ -303,11 +340,21 @@ SPIRCompiler::CompileTargetBinary(const HloModuleConfig& module_config,
   }
 
   std::string spir;
-  if (debug_module) {
+  if (debug_module && !(selected_module->empty() &&
+                        selected_module->global_empty())) {
     XLA_SCOPED_LOGGING_TIMER("CompileTargetBinary - CompileToSpir");
-    TF_ASSIGN_OR_RETURN(
-        spir,
-        spir::CompileToSpir(selected_module, gpu_version, module_config, libdevice_dir));
+    std::shared_ptr<CompileProfile> profile =
+        CompileProfile::Get(*debug_module);
+    {
+      CompileProfile::ScopedStage stage(profile.get(), "llvm-optimization");
+      TF_RETURN_IF_ERROR(spir::OptimizeSpirModule(
+          selected_module, gpu_version, module_config, libdevice_dir));
+    }
+    {
+      CompileProfile::ScopedStage stage(profile.get(), "spirv-translation");
+      TF_ASSIGN_OR_RETURN(
+          spir, spir::TranslateToSpir(selected_module, module_config));
+    }
   }
 
   std::vector<uint8_t> spir_bin(spir.begin(), spir.end());
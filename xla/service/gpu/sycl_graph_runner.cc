@@ -0,0 +1,249 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/service/gpu/sycl_graph_runner.h"
+
+#include <optional>
+#include <utility>
+
+#include "absl/cleanup/cleanup.h"
+#include "absl/container/btree_set.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "tsl/platform/errors.h"
+#include "tsl/platform/logging.h"
+#include "tsl/util/env_var.h"
+#include "xla/service/gpu/buffer_allocations.h"
+#include "xla/service/gpu/copy_thunk.h"
+#include "xla/service/gpu/kernel_thunk.h"
+#include "xla/service/gpu/memset_thunk.h"
+#include "xla/stream_executor/gpu/gpu_stream.h"
+#include "xla/stream_executor/sycl/sycl_gpu_runtime.h"
+#include "xla/util.h"
+
+namespace xla {
+namespace gpu {
+namespace {
+
+#if defined(SYCL_EXT_ONEAPI_GRAPH)
+namespace sycl_ext = ::sycl::ext::oneapi::experimental;
+using ModifiableGraph =
+    sycl_ext::command_graph<sycl_ext::graph_state::modifiable>;
+using ExecutableGraph =
+    sycl_ext::command_graph<sycl_ext::graph_state::executable>;
+#endif  // SYCL_EXT_ONEAPI_GRAPH
+
+// A single thunk gains nothing from being submitted as a graph.
+constexpr int kMinGraphRegionSize = 2;
+
+// Collects the allocations whose addresses the commands of `thunk` capture.
+// Returns false if `thunk` cannot be recorded into a graph.
+bool CollectGraphAllocations(const Thunk& thunk,
+                             absl::btree_set<BufferAllocation::Index>* out) {
+  auto add = [&](const BufferAllocation::Slice& slice) {
+    out->insert(slice.index());
+  };
+  switch (thunk.kind()) {
+    case Thunk::kKernel: {
+      const auto* kernel = dynamic_cast<const KernelThunk*>(&thunk);
+      if (kernel == nullptr) return false;
+      for (const BufferAllocation::Slice& arg : kernel->arguments()) add(arg);
+      return true;
+    }
+    case Thunk::kCopy: {
+      const auto* copy = dynamic_cast<const DeviceToDeviceCopyThunk*>(&thunk);
+      if (copy == nullptr) return false;
+      add(copy->source());
+      add(copy->destination());
+      return true;
+    }
+    case Thunk::kMemzero: {
+      const auto* memzero = dynamic_cast<const MemzeroThunk*>(&thunk);
+      if (memzero == nullptr) return false;
+      add(memzero->destination());
+      return true;
+    }
+    case Thunk::kMemset32BitValue: {
+      const auto* memset = dynamic_cast<const Memset32BitValueThunk*>(&thunk);
+      if (memset == nullptr) return false;
+      add(memset->destination());
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+}  // namespace
+
+struct SyclGraphRunner::Region {
+  std::vector<Thunk*> thunks;
+  bool graphed = false;
+  std::vector<BufferAllocation::Index> allocations;
+
+#if defined(SYCL_EXT_ONEAPI_GRAPH)
+  struct Recording {
+    std::vector<const void*> addresses;
+    std::optional<ExecutableGraph> graph;
+  };
+
+  absl::Mutex mu;
+  absl::flat_hash_map<se::StreamExecutor*, Recording> recordings
+      ABSL_GUARDED_BY(mu);
+  // Set when the runtime rejects recording; the region then runs eagerly.
+  bool failed ABSL_GUARDED_BY(mu) = false;
+#endif  // SYCL_EXT_ONEAPI_GRAPH
+};
+
+/*static*/ bool SyclGraphRunner::Enabled() {
+#if defined(SYCL_EXT_ONEAPI_GRAPH)
+  static bool enabled = [] {
+    bool flag = false;
+    TF_CHECK_OK(tsl::ReadBoolFromEnvVar("XLA_SYCL_GRAPH", false, &flag));
+    return flag;
+  }();
+  return enabled;
+#else
+  return false;
+#endif  // SYCL_EXT_ONEAPI_GRAPH
+}
+
+SyclGraphRunner::SyclGraphRunner(const ThunkSequence& thunks) {
+  std::unique_ptr<Region> region;
+  absl::btree_set<BufferAllocation::Index> allocations;
+  auto flush = [&] {
+    if (region == nullptr) return;
+    region->graphed = region->thunks.size() >= kMinGraphRegionSize;
+    if (region->graphed) {
+      region->allocations.assign(allocations.begin(), allocations.end());
+    }
+    regions_.push_back(std::move(region));
+    allocations.clear();
+  };
+
+  for (const std::unique_ptr<Thunk>& thunk : thunks) {
+    absl::btree_set<BufferAllocation::Index> thunk_allocations;
+    if (!CollectGraphAllocations(*thunk, &thunk_allocations)) {
+      flush();
+      region = std::make_unique<Region>();
+      region->thunks.push_back(thunk.get());
+      flush();
+      continue;
+    }
+    if (region == nullptr) region = std::make_unique<Region>();
+    region->thunks.push_back(thunk.get());
+    allocations.insert(thunk_allocations.begin(), thunk_allocations.end());
+  }
+  flush();
+
+  VLOG(1) << "SYCL graph runner: " << regions_.size() << " regions for "
+          << thunks.size() << " thunks";
+}
+
+SyclGraphRunner::~SyclGraphRunner() = default;
+
+Status SyclGraphRunner::Execute(
+    const Thunk::ExecuteParams& params,
+    absl::FunctionRef<Status(Thunk&)> execute_thunk) {
+  for (const std::unique_ptr<Region>& region : regions_) {
+    if (region->graphed) {
+      TF_RETURN_IF_ERROR(ExecuteRegion(*region, params, execute_thunk));
+      continue;
+    }
+    for (Thunk* thunk : region->thunks) {
+      TF_RETURN_IF_ERROR(execute_thunk(*thunk));
+    }
+  }
+  return OkStatus();
+}
+
+Status SyclGraphRunner::ExecuteRegion(
+    Region& region, const Thunk::ExecuteParams& params,
+    absl::FunctionRef<Status(Thunk&)> execute_thunk) {
+  auto execute_eagerly = [&]() -> Status {
+    for (Thunk* thunk : region.thunks) {
+      TF_RETURN_IF_ERROR(execute_thunk(*thunk));
+    }
+    return OkStatus();
+  };
+
+#if defined(SYCL_EXT_ONEAPI_GRAPH)
+  std::vector<const void*> addresses;
+  addresses.reserve(region.allocations.size());
+  for (BufferAllocation::Index index : region.allocations) {
+    addresses.push_back(
+        params.buffer_allocations->GetDeviceAddress(index).opaque());
+  }
+
+  ::sycl::queue* queue = se::gpu::AsGpuStreamValue(params.stream);
+  absl::MutexLock lock(&region.mu);
+  if (region.failed) return execute_eagerly();
+  Region::Recording& recording = region.recordings[params.stream->parent()];
+
+  if (!recording.graph.has_value() || recording.addresses != addresses) {
+    Status status = OkStatus();
+    try {
+      ModifiableGraph graph(queue->get_context(), queue->get_device());
+      graph.begin_recording(*queue);
+      {
+        // Leave recording mode even if a submission throws.
+        absl::Cleanup end_recording = [&] { graph.end_recording(*queue); };
+        for (Thunk* thunk : region.thunks) {
+          status = execute_thunk(*thunk);
+          if (!status.ok()) break;
+        }
+      }
+      TF_RETURN_IF_ERROR(status);
+
+      if (recording.graph.has_value()) {
+        VLOG(2) << "Buffer addresses moved, updating SYCL graph of "
+                << region.thunks.size() << " thunks";
+        try {
+          recording.graph->update(graph);
+        } catch (const ::sycl::exception& e) {
+          VLOG(2) << "SYCL graph update failed, finalizing again: "
+                  << e.what();
+          recording.graph.reset();
+        }
+      }
+      if (!recording.graph.has_value()) {
+        recording.graph.emplace(
+            graph.finalize(sycl_ext::property::graph::updatable{}));
+      }
+      recording.addresses = std::move(addresses);
+    } catch (const ::sycl::exception& e) {
+      // Nothing recorded has been submitted yet, so the thunks can still run
+      // eagerly.
+      LOG(WARNING) << "Recording SYCL graph failed, running thunks eagerly: "
+                   << e.what();
+      region.failed = true;
+      region.recordings.clear();
+      return execute_eagerly();
+    }
+  }
+
+  try {
+    queue->ext_oneapi_graph(*recording.graph);
+  } catch (const ::sycl::exception& e) {
+    return InternalError("Failed to submit SYCL graph: %s", e.what());
+  }
+  return OkStatus();
+#else
+  return execute_eagerly();
+#endif  // SYCL_EXT_ONEAPI_GRAPH
+}
+
+}  // namespace gpu
+}  // namespace xla
@@ -0,0 +1,64 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef XLA_SERVICE_GPU_SYCL_GRAPH_RUNNER_H_
+#define XLA_SERVICE_GPU_SYCL_GRAPH_RUNNER_H_
+
+#include <memory>
+#include <vector>
+
+#include "absl/functional/function_ref.h"
+#include "xla/service/gpu/thunk.h"
+#include "xla/status.h"
+
+namespace xla {
+namespace gpu {
+
+// Executes a thunk sequence with runs of kernel, copy and memset thunks
+// submitted as SYCL graphs (sycl_ext_oneapi_graph).
+//
+// Each run of at least two such thunks is recorded into a graph the first
+// time it executes on a device, and the finalized graph is replayed with a
+// single submission afterwards. The recording is keyed by the addresses of
+// the buffer allocations the run touches; when they move, the run is
+// recorded again and the executable graph is updated in place. All other
+// thunks, which may do host-side work, execute one by one in between.
+//
+// Enabled with XLA_SYCL_GRAPH=1 when the SYCL runtime has the extension.
+class SyclGraphRunner {
+ public:
+  static bool Enabled();
+
+  explicit SyclGraphRunner(const ThunkSequence& thunks);
+  ~SyclGraphRunner();
+
+  // Executes all thunks on `params.stream`. `execute_thunk` runs a single
+  // thunk eagerly; it is also used to record the graphed runs.
+  Status Execute(const Thunk::ExecuteParams& params,
+                 absl::FunctionRef<Status(Thunk&)> execute_thunk);
+
+ private:
+  struct Region;
+
+  Status ExecuteRegion(Region& region, const Thunk::ExecuteParams& params,
+                       absl::FunctionRef<Status(Thunk&)> execute_thunk);
+
+  std::vector<std::unique_ptr<Region>> regions_;
+};
+
+}  // namespace gpu
+}  // namespace xla
+
+#endif  // XLA_SERVICE_GPU_SYCL_GRAPH_RUNNER_H_
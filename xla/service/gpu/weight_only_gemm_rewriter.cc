@@ -0,0 +1,293 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/service/gpu/weight_only_gemm_rewriter.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "absl/types/span.h"
+#include "tsl/platform/errors.h"
+#include "tsl/platform/logging.h"
+#include "tsl/platform/statusor.h"
+#include "xla/hlo/ir/hlo_computation.h"
+#include "xla/hlo/ir/hlo_instruction.h"
+#include "xla/hlo/ir/hlo_opcode.h"
+#include "xla/layout_util.h"
+#include "xla/primitive_util.h"
+#include "xla/service/gpu/xetla/gemm/weight_only_gemm.h"
+#include "xla/service/hlo_creation_utils.h"
+#include "xla/service/pattern_matcher.h"
+#include "xla/shape_util.h"
+#include "xla/statusor.h"
+#include "xla/stream_executor/sycl/hw_info.h"
+#include "xla/xla_data.pb.h"
+
+namespace xla {
+namespace gpu {
+
+const absl::string_view kXetlaWeightOnlyGemmCallTarget =
+    "__xetla$gemm$weight_only";
+
+bool IsXetlaWeightOnlyGemm(const HloInstruction& hlo) {
+  return hlo.opcode() == HloOpcode::kCustomCall &&
+         hlo.custom_call_target() == kXetlaWeightOnlyGemmCallTarget;
+}
+
+namespace {
+
+namespace m = match;
+
+// (convert(weight) - zero_point) * scale, with zero_point and scale
+// broadcast to the shape of the weight.
+struct Dequantize {
+  HloInstruction* weight;
+  HloInstruction* scale;
+  // Null when there are no zero points.
+  HloInstruction* zero_point;
+};
+
+std::optional<Dequantize> MatchDequantize(HloInstruction* instr) {
+  if (!primitive_util::IsFloatingPointType(instr->shape().element_type())) {
+    return std::nullopt;
+  }
+  Dequantize dequantize{};
+  if (!Match(instr, m::MultiplyAnyOrder(
+                        m::Subtract(m::Convert(m::Op(&dequantize.weight)),
+                                    m::Broadcast(&dequantize.zero_point,
+                                                 m::Op())),
+                        m::Broadcast(&dequantize.scale, m::Op())))) {
+    dequantize.zero_point = nullptr;
+    if (!Match(instr, m::MultiplyAnyOrder(
+                          m::Convert(m::Op(&dequantize.weight)),
+                          m::Broadcast(&dequantize.scale, m::Op())))) {
+      return std::nullopt;
+    }
+  }
+  PrimitiveType weight_type = dequantize.weight->shape().element_type();
+  if (weight_type != S8 && weight_type != S4) return std::nullopt;
+  return dequantize;
+}
+
+// Whether `broadcast` spreads scales or zero points over a weight whose
+// output channels are dimension `n_dim`: per tensor, per channel, or per
+// channel and group when the weight has a `group_dim`.
+bool IsGroupBroadcast(const HloInstruction* broadcast, int64_t n_dim,
+                      std::optional<int64_t> group_dim) {
+  if (!primitive_util::IsFloatingPointType(
+          broadcast->operand(0)->shape().element_type())) {
+    return false;
+  }
+  absl::Span<const int64_t> dims = broadcast->dimensions();
+  return dims.empty() || (dims.size() == 1 && dims[0] == n_dim) ||
+         (group_dim.has_value() && dims.size() == 2 &&
+          dims[0] == std::min(*group_dim, n_dim) &&
+          dims[1] == std::max(*group_dim, n_dim));
+}
+
+// The number of rows MakeGroupRows returns for `broadcast`.
+int64_t GroupCount(const HloInstruction* broadcast,
+                   std::optional<int64_t> group_dim) {
+  return broadcast->dimensions().size() == 2
+             ? broadcast->shape().dimensions(*group_dim)
+             : 1;
+}
+
+// Turns a broadcast accepted by IsGroupBroadcast into the F32 [groups, n]
+// operand of the custom call.
+StatusOr<HloInstruction*> MakeGroupRows(HloInstruction* broadcast,
+                                        int64_t n_dim,
+                                        std::optional<int64_t> group_dim,
+                                        int64_t n) {
+  HloInstruction* values = MakeConvertToHlo(broadcast->mutable_operand(0), F32);
+  absl::Span<const int64_t> dims = broadcast->dimensions();
+  if (dims.empty()) return MakeBroadcastHlo(values, {}, {1, n});
+  if (dims.size() == 1) return MakeReshapeHlo({1, n}, values);
+  if (*group_dim < n_dim) return values;
+  return MakeTransposeHlo(values, {1, 0});
+}
+
+// Packs an S4 [k, n] weight into S8 [k, n / 2], two values per byte with the
+// even column in the low nibble. Folded away for constant weights.
+StatusOr<HloInstruction*> PackInt4(HloInstruction* weight) {
+  int64_t k = weight->shape().dimensions(0);
+  int64_t n = weight->shape().dimensions(1);
+  TF_ASSIGN_OR_RETURN(
+      HloInstruction * pairs,
+      MakeReshapeHlo({k, n / 2, 2}, MakeConvertToHlo(weight, S8)));
+  TF_ASSIGN_OR_RETURN(HloInstruction * lo,
+                      MakeSliceHlo(pairs, {0, 0, 0}, {k, n / 2, 1}, {1, 1, 1}));
+  TF_ASSIGN_OR_RETURN(HloInstruction * hi,
+                      MakeSliceHlo(pairs, {0, 0, 1}, {k, n / 2, 2}, {1, 1, 1}));
+  TF_ASSIGN_OR_RETURN(lo, MakeReshapeHlo({k, n / 2}, lo));
+  TF_ASSIGN_OR_RETURN(hi, MakeReshapeHlo({k, n / 2}, hi));
+
+  HloComputation* computation = weight->parent();
+  HloInstruction* mask = MakeBroadcastHlo(
+      MakeR0ConstantHlo<int8_t>(computation, 0xf), {}, {k, n / 2});
+  HloInstruction* shift = MakeBroadcastHlo(
+      MakeR0ConstantHlo<int8_t>(computation, 4), {}, {k, n / 2});
+  TF_ASSIGN_OR_RETURN(lo, MakeBinaryHlo(HloOpcode::kAnd, lo, mask));
+  TF_ASSIGN_OR_RETURN(hi, MakeBinaryHlo(HloOpcode::kShiftLeft, hi, shift));
+  return MakeBinaryHlo(HloOpcode::kOr, lo, hi);
+}
+
+bool IsFloatConvert(const HloInstruction* instr) {
+  return instr->opcode() == HloOpcode::kConvert &&
+         primitive_util::IsFloatingPointType(
+             instr->operand(0)->shape().element_type());
+}
+
+StatusOr<bool> RewriteDot(HloInstruction* dot) {
+  const DotDimensionNumbers& dnums = dot->dot_dimension_numbers();
+  HloInstruction* lhs = dot->mutable_operand(0);
+  HloInstruction* rhs = dot->mutable_operand(1);
+  PrimitiveType dtype = dot->shape().element_type();
+  if (dtype != F16 && dtype != BF16) return false;
+  if (lhs->shape().element_type() != dtype || lhs->shape().rank() != 2 ||
+      rhs->shape().rank() != 2 || dnums.lhs_batch_dimensions_size() != 0 ||
+      dnums.lhs_contracting_dimensions_size() != 1 ||
+      dnums.rhs_contracting_dimensions_size() != 1) {
+    return false;
+  }
+  int64_t lhs_k_dim = dnums.lhs_contracting_dimensions(0);
+  int64_t rhs_k_dim = dnums.rhs_contracting_dimensions(0);
+  int64_t m = dot->shape().dimensions(0);
+  int64_t n = dot->shape().dimensions(1);
+  int64_t k = lhs->shape().dimensions(lhs_k_dim);
+  if (m > ::gpu::xetla::kWeightOnlyGemmMaxM ||
+      k % ::gpu::xetla::kWeightOnlyGemmKTile != 0) {
+    return false;
+  }
+
+  // Look through the converts and transposes dot canonicalization leaves
+  // between the dot and the dequantized weight.
+  if (IsFloatConvert(rhs)) rhs = rhs->mutable_operand(0);
+  if (rhs->opcode() == HloOpcode::kTranspose) {
+    rhs_k_dim = rhs->dimensions(rhs_k_dim);
+    rhs = rhs->mutable_operand(0);
+  }
+  if (IsFloatConvert(rhs)) rhs = rhs->mutable_operand(0);
+
+  // Per-group quantization dequantizes a [groups, group_size, n] view of a
+  // k-major weight, or [n, groups, group_size] of an n-major one.
+  std::optional<int64_t> group_dim;
+  if (rhs->opcode() == HloOpcode::kReshape &&
+      rhs->operand(0)->shape().rank() == 3) {
+    const Shape& grouped_shape = rhs->operand(0)->shape();
+    int64_t n_dim = rhs_k_dim == 0 ? 2 : 0;
+    group_dim = rhs_k_dim == 0 ? 0 : 1;
+    if (grouped_shape.dimensions(n_dim) != n) return false;
+    rhs = rhs->mutable_operand(0);
+  } else if (rhs->shape().rank() != 2) {
+    return false;
+  }
+
+  std::optional<Dequantize> dequantize = MatchDequantize(rhs);
+  if (!dequantize.has_value()) return false;
+  bool int4 = dequantize->weight->shape().element_type() == S4;
+  if (n % ::gpu::xetla::WeightOnlyGemmNTile(int4) != 0) return false;
+
+  int64_t n_dim = rhs_k_dim == 0 ? rhs->shape().rank() - 1 : 0;
+  if (!IsGroupBroadcast(dequantize->scale, n_dim, group_dim) ||
+      (dequantize->zero_point != nullptr &&
+       !IsGroupBroadcast(dequantize->zero_point, n_dim, group_dim))) {
+    return false;
+  }
+  int64_t groups = GroupCount(dequantize->scale, group_dim);
+  if (dequantize->zero_point != nullptr) {
+    groups = std::max(groups, GroupCount(dequantize->zero_point, group_dim));
+  }
+  int64_t group_size = k / groups;
+  if (group_size % ::gpu::xetla::kWeightOnlyGemmKTile != 0) return false;
+
+  VLOG(1) << "Rewriting " << dot->name() << " into a weight-only "
+          << (int4 ? "int4" : "int8") << " GEMM, m=" << m << " n=" << n
+          << " k=" << k << " group_size=" << group_size;
+
+  HloInstruction* weight = dequantize->weight;
+  if (group_dim.has_value()) {
+    TF_ASSIGN_OR_RETURN(
+        weight, MakeReshapeHlo(rhs_k_dim == 0 ? std::vector<int64_t>{k, n}
+                                              : std::vector<int64_t>{n, k},
+                               weight));
+  }
+  if (rhs_k_dim != 0) {
+    TF_ASSIGN_OR_RETURN(weight, MakeTransposeHlo(weight, {1, 0}));
+  }
+  if (int4) {
+    TF_ASSIGN_OR_RETURN(weight, PackInt4(weight));
+  }
+  if (lhs_k_dim != 1) {
+    TF_ASSIGN_OR_RETURN(lhs, MakeTransposeHlo(lhs, {1, 0}));
+  }
+
+  // Scales and zero points share the row index in the kernel, so a single
+  // row is repeated to match a grouped one.
+  auto make_rows = [&](HloInstruction* broadcast) -> StatusOr<HloInstruction*> {
+    TF_ASSIGN_OR_RETURN(HloInstruction * rows,
+                        MakeGroupRows(broadcast, n_dim, group_dim, n));
+    if (rows->shape().dimensions(0) == groups) return rows;
+    TF_ASSIGN_OR_RETURN(rows, MakeReshapeHlo({n}, rows));
+    return MakeBroadcastHlo(rows, {1}, {groups, n});
+  };
+  TF_ASSIGN_OR_RETURN(HloInstruction * scales, make_rows(dequantize->scale));
+  HloInstruction* zero_points = nullptr;
+  if (dequantize->zero_point != nullptr) {
+    TF_ASSIGN_OR_RETURN(zero_points, make_rows(dequantize->zero_point));
+  }
+
+  std::vector<HloInstruction*> operands = {lhs, weight, scales};
+  if (zero_points != nullptr) operands.push_back(zero_points);
+  std::vector<Shape> operand_shapes;
+  for (const HloInstruction* operand : operands) {
+    operand_shapes.push_back(operand->shape());
+    LayoutUtil::SetToDefaultLayout(&operand_shapes.back());
+  }
+  Shape output_shape = dot->shape();
+  LayoutUtil::SetToDefaultLayout(&output_shape);
+
+  HloComputation* computation = dot->parent();
+  HloInstruction* gemm =
+      computation->AddInstruction(HloInstruction::CreateCustomCall(
+          output_shape, operands, kXetlaWeightOnlyGemmCallTarget,
+          operand_shapes));
+  gemm->set_metadata(dot->metadata());
+  TF_RETURN_IF_ERROR(computation->ReplaceInstruction(dot, gemm));
+  return true;
+}
+
+}  // namespace
+
+StatusOr<bool> WeightOnlyGemmRewriter::Run(
+    HloModule* module,
+    const absl::flat_hash_set<absl::string_view>& execution_threads) {
+  if (!IsXetlaHardwareSupport()) return false;
+  bool changed = false;
+  for (HloComputation* computation :
+       module->MakeNonfusionComputations(execution_threads)) {
+    for (HloInstruction* instr : computation->MakeInstructionPostOrder()) {
+      if (instr->opcode() != HloOpcode::kDot) continue;
+      TF_ASSIGN_OR_RETURN(bool rewritten, RewriteDot(instr));
+      changed |= rewritten;
+    }
+  }
+  return changed;
+}
+
+}  // namespace gpu
+}  // namespace xla
@@ -0,0 +1,66 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef XLA_SERVICE_GPU_WEIGHT_ONLY_GEMM_REWRITER_H_
+#define XLA_SERVICE_GPU_WEIGHT_ONLY_GEMM_REWRITER_H_
+
+#include "absl/strings/string_view.h"
+#include "xla/hlo/ir/hlo_instruction.h"
+#include "xla/hlo/ir/hlo_module.h"
+#include "xla/service/hlo_pass_interface.h"
+
+namespace xla {
+namespace gpu {
+
+// A GEMM with int8 or int4 weights that are dequantized inside the kernel:
+//
+//   output[m, n] = lhs[m, k] @ ((rhs - zero_points) * scales)
+//
+// Operands, all row-major:
+//   lhs:          [m, k] F16 or BF16.
+//   rhs:          [k, n] S8, or [k, n / 2] S8 holding two int4 values per
+//                 byte, the even column in the low nibble.
+//   scales:       [k / group_size, n] F32.
+//   zero_points:  [k / group_size, n] F32, optional.
+// The result is [m, n] of the type of lhs.
+extern const absl::string_view kXetlaWeightOnlyGemmCallTarget;
+
+bool IsXetlaWeightOnlyGemm(const HloInstruction& hlo);
+
+// Rewrites decode-sized dots whose rhs dequantizes int8 or int4 weights
+//
+//   dot(lhs, [convert](([convert](w) - zero_point) * scale))
+//
+// into kXetlaWeightOnlyGemmCallTarget custom calls, so that the weights are
+// read in their quantized form. Scales and zero points are broadcast per
+// output channel, or per group of rows of w when the dequantization is done
+// on a [k / group_size, group_size, n] view of w that is reshaped into the
+// dot operand. Runs before layout assignment, after dots are canonicalized.
+class WeightOnlyGemmRewriter : public HloModulePass {
+ public:
+  absl::string_view name() const override {
+    return "weight-only-gemm-rewriter";
+  }
+
+  using HloPassInterface::Run;
+  StatusOr<bool> Run(
+      HloModule* module,
+      const absl::flat_hash_set<absl::string_view>& execution_threads) override;
+};
+
+}  // namespace gpu
+}  // namespace xla
+
+#endif  // XLA_SERVICE_GPU_WEIGHT_ONLY_GEMM_REWRITER_H_
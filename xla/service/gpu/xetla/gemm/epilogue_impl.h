@@ -305,6 +305,202 @@ struct silu_op_t {
   }
 };
 
+template <typename dtype_in_>
+struct res_mul_op_t {
+  using dtype_in = dtype_in_;
+  using mem_desc_in_t =
+      mem_desc_t<dtype_in, mem_layout::row_major, mem_space::global>;
+  using shape_t = typename mem_desc_in_t::shape_t;
+  using coord_t = typename mem_desc_in_t::coord_t;
+  using base_t = typename mem_desc_in_t::base_t;
+
+  struct arguments_t {
+    shape_t shape;
+    base_t base;
+    float x;
+    inline arguments_t() = default;
+    inline arguments_t(base_t base_, shape_t shape_, float x_)
+        : base(base_), shape(shape_), x(x_) {}
+  };
+  template <typename matAcc_t>
+  __XETLA_API KERNEL_FUNC void operator()(
+      matAcc_t& matAcc,
+      const coord_t& coord,
+      const arguments_t& args,
+      uint32_t slm_base = 0,
+      uint32_t nbarrier_base = 0) {
+    using dtype_acc = typename matAcc_t::dtype;
+    static constexpr uint32_t tile_size_x = matAcc_t::tile_size_x;
+    static constexpr uint32_t tile_size_y = matAcc_t::tile_size_y;
+    static constexpr uint32_t block_size_x = matAcc_t::block_size_x;
+    static constexpr uint32_t block_size_y = matAcc_t::block_size_y;
+
+    // The residual tile has the layout of the accumulator, so the product is
+    // taken over whole registers.
+    using mat_in_tile_desc_t = subgroup::tile_desc_t<
+        tile_size_x,
+        tile_size_y,
+        block_size_x,
+        block_size_y,
+        reg_layout::tiled>;
+    using mat_in_tile_t = subgroup::tile_t<dtype_in, mat_in_tile_desc_t>;
+    using mat_in_payload_t = subgroup::mem_payload_t<
+        dtype_in,
+        mat_in_tile_desc_t,
+        subgroup::msg_type_v<mat_in_tile_desc_t, mem_desc_in_t::space>,
+        mem_desc_in_t::layout,
+        mem_desc_in_t::space,
+        gpu_arch::Xe>;
+    using mat_in_tile_acc_t = subgroup::tile_t<dtype_acc, mat_in_tile_desc_t>;
+    mem_desc_in_t mem_desc_in(args.base, args.shape, coord);
+    mat_in_tile_t mat_in;
+    mat_in_payload_t mat_in_payload(mem_desc_in);
+    tile_load<cache_hint::cached, cache_hint::cached>(mat_in, mat_in_payload);
+    mat_in_tile_acc_t mat_in_acc;
+    elemwise_cvt(mat_in_acc, mat_in);
+    matAcc.reg = matAcc.reg * (args.x * mat_in_acc.reg);
+  }
+};
+
+struct sigmoid_op_t {
+  struct arguments_t {};
+  template <typename matAcc_t, typename coord_t>
+  __XETLA_API KERNEL_FUNC void operator()(
+      matAcc_t& matAcc,
+      const coord_t& coord,
+      const arguments_t& args,
+      uint32_t slm_base = 0,
+      uint32_t nbarrier_base = 0) {
+    using dtype = typename matAcc_t::dtype;
+    matAcc.reg = 1.f / (1.f + xetla_exp<dtype>(-1.f * matAcc.reg));
+  }
+};
+
+// GELU in its erf form, 0.5 * x * (1 + erf(x / sqrt(2))). erf is taken from
+// Abramowitz and Stegun 7.1.26, whose error of 1.5e-7 is below what F16 and
+// BF16 outputs resolve. Works on 16 elements at a time to bound the
+// temporaries held in registers.
+struct gelu_erf_op_t {
+  struct arguments_t {};
+  template <typename matAcc_t, typename coord_t>
+  __XETLA_API KERNEL_FUNC void operator()(
+      matAcc_t& matAcc,
+      const coord_t& coord,
+      const arguments_t& args,
+      uint32_t slm_base = 0,
+      uint32_t nbarrier_base = 0) {
+    using dtype = typename matAcc_t::dtype;
+    static constexpr uint32_t tile_elems = matAcc_t::tile_elems;
+    static constexpr uint32_t step = 16;
+    static_assert(tile_elems % step == 0, "tile must hold whole steps");
+#pragma unroll
+    for (uint32_t i = 0; i < tile_elems / step; i++) {
+      auto x = matAcc.reg.xetla_select<step, 1>(i * step);
+      xetla_vector<dtype, step> u = x * 0.70710678f;
+      xetla_vector<dtype, step> abs_u = u;
+      abs_u.xetla_merge(-u, u < 0);
+      xetla_vector<dtype, step> t = 1.f / (1.f + 0.3275911f * abs_u);
+      xetla_vector<dtype, step> poly =
+          t * (0.254829592f +
+               t * (-0.284496736f +
+                    t * (1.421413741f +
+                         t * (-1.453152027f + t * 1.061405429f))));
+      xetla_vector<dtype, step> erf =
+          1.f - poly * xetla_exp<dtype>(-1.f * abs_u * abs_u);
+      erf.xetla_merge(-erf, u < 0);
+      x = 0.5f * x * (1.f + erf);
+    }
+  }
+};
+
+// Post-ops of post_op_chain_t.
+enum class post_op_kind : uint32_t {
+  bias = 0,
+  res_add,
+  res_mul,
+  relu,
+  gelu,
+  gelu_erf,
+  silu,
+  sigmoid,
+};
+
+// Applies up to max_ops_ post-ops picked at run time, in order. One kernel
+// per tile config then serves every chain, rather than one per combination.
+// Bias and residual tensors are of dtype_in_; the shape of a bias has a
+// height of 1.
+template <typename dtype_in_, uint32_t max_ops_>
+struct post_op_chain_t {
+  using dtype_in = dtype_in_;
+  static constexpr uint32_t max_ops = max_ops_;
+  using mem_desc_in_t =
+      mem_desc_t<dtype_in, mem_layout::row_major, mem_space::global>;
+  using shape_t = typename mem_desc_in_t::shape_t;
+  using coord_t = typename mem_desc_in_t::coord_t;
+  using base_t = typename mem_desc_in_t::base_t;
+
+  struct op_t {
+    post_op_kind kind;
+    base_t base;
+    shape_t shape;
+    float x;
+    inline op_t() = default;
+    inline op_t(post_op_kind kind_, base_t base_, shape_t shape_, float x_)
+        : kind(kind_), base(base_), shape(shape_), x(x_) {}
+  };
+
+  struct arguments_t {
+    op_t ops[max_ops];
+    uint32_t num_ops = 0;
+  };
+  template <typename matAcc_t>
+  __XETLA_API KERNEL_FUNC void operator()(
+      matAcc_t& matAcc,
+      const coord_t& coord,
+      const arguments_t& args,
+      uint32_t slm_base = 0,
+      uint32_t nbarrier_base = 0) {
+    for (uint32_t i = 0; i < args.num_ops; i++) {
+      const op_t& op = args.ops[i];
+      switch (op.kind) {
+        case post_op_kind::bias:
+          bias_op_t<dtype_in>()(
+              matAcc, coord,
+              typename bias_op_t<dtype_in>::arguments_t(op.base, op.shape,
+                                                        op.x));
+          break;
+        case post_op_kind::res_add:
+          res_op_t<dtype_in>()(
+              matAcc, coord,
+              typename res_op_t<dtype_in>::arguments_t(op.base, op.shape,
+                                                       op.x));
+          break;
+        case post_op_kind::res_mul:
+          res_mul_op_t<dtype_in>()(
+              matAcc, coord,
+              typename res_mul_op_t<dtype_in>::arguments_t(op.base, op.shape,
+                                                           op.x));
+          break;
+        case post_op_kind::relu:
+          subgroup::relu_op_t()(matAcc, coord, {});
+          break;
+        case post_op_kind::gelu:
+          subgroup::gelu_fwd_op_t()(matAcc, coord, {});
+          break;
+        case post_op_kind::gelu_erf:
+          gelu_erf_op_t()(matAcc, coord, {});
+          break;
+        case post_op_kind::silu:
+          silu_op_t()(matAcc, coord, {});
+          break;
+        case post_op_kind::sigmoid:
+          sigmoid_op_t()(matAcc, coord, {});
+          break;
+      }
+    }
+  }
+};
+
 } // namespace epilogue_impl
 
 } // namespace xetla
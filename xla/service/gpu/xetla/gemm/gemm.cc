@@ -15,6 +15,9 @@ limitations under the License.
 
 #include "xla/service/gpu/xetla/gemm/gemm.h"
 
+#include <algorithm>
+
+#include "absl/container/flat_hash_map.h"
 #include "xla/service/gpu/matrix_descriptor.h"
 #include "xla/service/gpu/xetla/gemm/hgemm_impl.h"
 #include "xla/stream_executor/blas.h"
@@ -25,146 +28,179 @@ namespace se = ::stream_executor;
 
 namespace gpu {
 namespace xetla {
+namespace {
+
+using XetlaGemmConfig = std::tuple<int, int, int, int, int, int>;
+
+// Tuned configs keyed by (m, n, k).
+const absl::flat_hash_map<std::tuple<int, int, int>, XetlaGemmConfig>&
+GetXetlaGemmConfigMap() {
+  static const auto* config_map =
+      new absl::flat_hash_map<std::tuple<int, int, int>, XetlaGemmConfig>{
+          {{1, 4096, 16384}, {128, 64, 16, 16, 64, 1}},
+          {{1, 16384, 4096}, {8, 512, 8, 16, 16, 1}},
+          {{1, 4096, 4096}, {128, 64, 16, 16, 64, 1}},
+          {{4, 16384, 4096}, {8, 512, 8, 16, 16, 1}},
+          {{4, 4096, 4096}, {128, 64, 16, 16, 64, 1}},
+          {{4, 4096, 16384}, {128, 64, 16, 16, 64, 1}},
+          {{4096, 16384, 4096}, {256, 256, 32, 64, 32, 1}},
+          {{4096, 4096, 4096}, {256, 256, 32, 64, 32, 1}},
+          {{4096, 4096, 16384}, {256, 256, 32, 64, 32, 1}},
+          {{4, 50400, 4096}, {128, 512, 64, 32, 16, 1}},
+          {{32, 4096, 16384}, {32, 64, 8, 16, 16, 2}},
+          {{32, 16384, 4096}, {32, 512, 32, 16, 16, 1}},
+          {{32, 4096, 4096}, {128, 64, 16, 16, 64, 1}},
+          {{33, 4096, 16384}, {128, 64, 16, 16, 64, 1}},
+          {{33, 16384, 4096}, {128, 512, 64, 32, 16, 1}},
+          {{33, 4096, 4096}, {128, 64, 16, 16, 64, 1}},
+          {{64, 4096, 16384}, {128, 64, 16, 16, 64, 1}},
+          {{64, 16384, 4096}, {128, 256, 64, 16, 16, 1}},
+          {{64, 4096, 4096}, {128, 64, 16, 16, 64, 1}},
+          {{65, 4096, 16384}, {128, 64, 16, 16, 64, 1}},
+          {{65, 16384, 4096}, {128, 256, 64, 16, 16, 1}},
+          {{65, 4096, 4096}, {128, 64, 16, 16, 64, 1}},
+          {{128, 4096, 16384}, {128, 128, 32, 32, 32, 2}},
+          {{128, 16384, 4096}, {256, 256, 64, 32, 16, 1}},
+          {{128, 4096, 4096}, {128, 128, 32, 32, 32, 2}},
+          {{130, 4096, 16384}, {128, 128, 32, 32, 32, 2}},
+          {{130, 16384, 4096}, {256, 256, 64, 32, 16, 1}},
+          {{130, 4096, 4096}, {128, 128, 16, 32, 64, 1}},
+          {{256, 4096, 16384}, {128, 128, 16, 32, 64, 1}},
+          {{256, 16384, 4096}, {256, 256, 64, 32, 16, 1}},
+          {{256, 4096, 4096}, {128, 128, 32, 32, 32, 2}},
+          {{512, 4096, 16384}, {128, 256, 32, 32, 16, 1}},
+          {{512, 16384, 4096}, {256, 256, 64, 32, 16, 1}},
+          {{512, 4096, 4096}, {128, 128, 32, 32, 32, 2}},
+          {{513, 4096, 16384}, {256, 256, 64, 32, 16, 1}},
+          {{513, 4096, 4096}, {128, 512, 64, 32, 16, 1}},
+          {{1024, 4096, 16384}, {256, 256, 64, 32, 16, 1}},
+          {{1024, 16384, 4096}, {256, 256, 64, 32, 16, 1}},
+          {{1024, 4096, 4096}, {256, 256, 64, 32, 16, 1}},
+          {{1028, 4096, 16384}, {256, 256, 64, 32, 16, 1}},
+          {{1028, 16384, 4096}, {256, 256, 64, 32, 16, 1}},
+          {{1028, 4096, 4096}, {256, 256, 64, 32, 16, 1}},
+          {{2016, 4096, 16384}, {256, 256, 64, 32, 16, 1}},
+          {{2016, 16384, 4096}, {256, 256, 64, 32, 16, 1}},
+          {{2016, 4096, 4096}, {256, 256, 64, 32, 16, 1}},
+          {{1, 50400, 4096}, {128, 512, 64, 32, 16, 1}},
+          {{1, 50272, 4096}, {128, 512, 64, 32, 16, 1}},
+          {{4, 50272, 4096}, {128, 512, 64, 32, 16, 1}},
+          {{1, 250880, 4096}, {32, 64, 8, 16, 16, 2}},
+          {{4, 250880, 4096}, {32, 64, 8, 16, 16, 2}},
+          {{1, 11008, 4096}, {16, 256, 8, 16, 16, 1}},
+          {{4, 11008, 4096}, {16, 256, 8, 16, 16, 1}},
+          {{32, 11008, 4096}, {64, 256, 64, 16, 16, 2}},
+          {{64, 11008, 4096}, {64, 256, 64, 16, 16, 2}},
+          {{128, 11008, 4096}, {128, 256, 32, 32, 16, 1}},
+          {{256, 11008, 4096}, {256, 256, 32, 64, 32, 1}},
+          {{512, 11008, 4096}, {256, 256, 64, 32, 16, 1}},
+          {{1024, 11008, 4096}, {256, 256, 64, 32, 16, 1}},
+          {{2016, 11008, 4096}, {256, 256, 64, 32, 16, 1}},
+          {{1, 32000, 4096}, {256, 256, 32, 64, 16, 1}},
+          {{4, 32000, 4096}, {256, 256, 32, 64, 16, 1}},
+          {{1, 13824, 5120}, {256, 256, 32, 64, 16, 1}},
+          {{1, 5120, 5120}, {8, 128, 8, 16, 16, 2}},
+          {{4, 13824, 5120}, {128, 256, 64, 16, 16, 1}},
+          {{4, 5120, 5120}, {8, 128, 8, 16, 16, 2}},
+          {{32, 13824, 5120}, {128, 256, 64, 16, 16, 1}},
+          {{32, 5120, 5120}, {32, 128, 32, 16, 16, 4}},
+          {{64, 13824, 5120}, {128, 256, 32, 32, 16, 1}},
+          {{64, 5120, 5120}, {128, 128, 16, 32, 64, 1}},
+          {{128, 13824, 5120}, {128, 256, 32, 32, 16, 1}},
+          {{128, 5120, 5120}, {128, 128, 16, 32, 64, 1}},
+          {{256, 13824, 5120}, {256, 256, 32, 64, 32, 1}},
+          {{256, 5120, 5120}, {128, 256, 32, 32, 16, 1}},
+          {{512, 13824, 5120}, {256, 256, 64, 32, 16, 1}},
+          {{512, 5120, 5120}, {256, 256, 64, 32, 16, 1}},
+          {{1024, 13824, 5120}, {256, 256, 64, 32, 16, 1}},
+          {{1024, 5120, 5120}, {256, 256, 64, 32, 16, 1}},
+          {{2016, 13824, 5120}, {256, 256, 64, 32, 16, 1}},
+          {{2016, 5120, 5120}, {256, 256, 64, 32, 16, 1}},
+          {{1, 32000, 5120}, {256, 256, 32, 64, 16, 1}},
+          {{4, 32000, 5120}, {256, 256, 32, 64, 16, 1}},
+          {{1, 7168, 14336}, {8, 256, 8, 16, 16, 2}},
+          {{1, 1792, 14336}, {16, 64, 16, 16, 16, 8}},
+          {{4, 7168, 14336}, {8, 256, 8, 16, 16, 2}},
+          {{4, 1792, 14336}, {16, 64, 16, 16, 16, 8}},
+          {{32, 7168, 14336}, {32, 256, 32, 16, 16, 2}},
+          {{32, 1792, 14336}, {16, 64, 16, 16, 16, 8}},
+          {{1, 14336, 7168}, {128, 512, 64, 32, 16, 1}},
+          {{1, 14336, 1792}, {16, 256, 8, 16, 16, 1}},
+          {{4, 14336, 7168}, {128, 256, 64, 16, 16, 1}},
+          {{4, 14336, 1792}, {128, 256, 32, 32, 16, 1}},
+          {{32, 14336, 7168}, {256, 256, 64, 32, 16, 1}},
+          {{32, 14336, 1792}, {128, 256, 32, 32, 16, 1}},
+          {{1, 250880, 1792}, {16, 256, 8, 16, 16, 1}},
+          {{1, 2048, 8192}, {8, 64, 8, 16, 32, 8}},
+          {{1, 3584, 7168}, {32, 64, 8, 16, 16, 2}},
+          {{1, 7168, 3584}, {128, 128, 16, 32, 64, 1}},
+          {{1, 7168, 8192}, {128, 128, 16, 32, 64, 1}},
+          {{1, 8192, 2048}, {128, 64, 16, 16, 64, 1}},
+          {{1, 8192, 7168}, {8, 256, 8, 16, 16, 2}},
+          {{1, 256, 8192}, {16, 64, 16, 16, 16, 8}},
+          {{1, 32000, 2048}, {16, 256, 8, 16, 16, 1}},
+          {{4, 2048, 8192}, {8, 64, 8, 16, 32, 8}},
+          {{4, 3584, 7168}, {32, 64, 8, 16, 16, 2}},
+          {{4, 7168, 3584}, {128, 128, 16, 32, 64, 1}},
+          {{4, 7168, 8192}, {8, 256, 8, 16, 16, 2}},
+          {{4, 8192, 2048}, {8, 256, 8, 16, 16, 2}},
+          {{4, 8192, 7168}, {128, 256, 32, 32, 16, 1}},
+          {{4, 256, 8192}, {16, 64, 16, 16, 16, 8}},
+          {{4, 32000, 2048}, {256, 256, 32, 64, 16, 1}},
+          {{1024, 2048, 8192}, {128, 256, 32, 32, 16, 1}},
+          {{1024, 7168, 8192}, {256, 256, 64, 32, 16, 1}},
+          {{1024, 8192, 2048}, {256, 256, 64, 32, 16, 1}},
+          {{1024, 8192, 7168}, {256, 256, 32, 64, 32, 1}},
+          {{1024, 256, 8192}, {32, 128, 32, 16, 16, 4}},
+          // T5 model shape
+          {{1, 5120, 2048}, {128, 128, 16, 32, 64, 1}},
+          {{1, 2048, 2048}, {16, 64, 16, 16, 16, 8}},
+          {{1, 2048, 5120}, {16, 64, 16, 16, 16, 8}},
+          {{1, 6144, 2048}, {128, 128, 16, 32, 64, 1}},
+          {{32, 98304, 2048}, {256, 256, 32, 64, 16, 1}},
+          {{64, 1, 32}, {8, 256, 8, 16, 16, 2}},
+          {{1, 32, 64}, {8, 256, 8, 16, 16, 2}},
+          {{1, 32128, 2048}, {128, 256, 64, 16, 16, 1}},
+          {{32, 5120, 2048}, {128, 128, 16, 32, 64, 1}},
+          {{32, 24576, 32}, {32, 512, 32, 16, 16, 1}},
+          {{32, 6144, 2048}, {128, 128, 16, 32, 64, 1}},
+          {{32, 2048, 5120}, {16, 64, 16, 16, 16, 8}},
+          {{32, 2048, 2048}, {16, 64, 16, 16, 16, 8}}};
+  return *config_map;
+}
 
-std::unordered_map<std::string, std::tuple<int, int, int, int, int, int>>
-    configMap = {{"1_4096_16384", std::make_tuple(128, 64, 16, 16, 64, 1)},
-                 {"1_16384_4096", std::make_tuple(8, 512, 8, 16, 16, 1)},
-                 {"1_4096_4096", std::make_tuple(128, 64, 16, 16, 64, 1)},
-                 {"4_16384_4096", std::make_tuple(8, 512, 8, 16, 16, 1)},
-                 {"4_4096_4096", std::make_tuple(128, 64, 16, 16, 64, 1)},
-                 {"4_4096_16384", std::make_tuple(128, 64, 16, 16, 64, 1)},
-                 {"4096_16384_4096", std::make_tuple(256, 256, 32, 64, 32, 1)},
-                 {"4096_4096_4096", std::make_tuple(256, 256, 32, 64, 32, 1)},
-                 {"4096_4096_16384", std::make_tuple(256, 256, 32, 64, 32, 1)},
-                 {"4_50400_4096", std::make_tuple(128, 512, 64, 32, 16, 1)},
-                 {"32_4096_16384", std::make_tuple(32, 64, 8, 16, 16, 2)},
-                 {"32_16384_4096", std::make_tuple(32, 512, 32, 16, 16, 1)},
-                 {"32_4096_4096", std::make_tuple(128, 64, 16, 16, 64, 1)},
-                 {"33_4096_16384", std::make_tuple(128, 64, 16, 16, 64, 1)},
-                 {"33_16384_4096", std::make_tuple(128, 512, 64, 32, 16, 1)},
-                 {"33_4096_4096", std::make_tuple(128, 64, 16, 16, 64, 1)},
-                 {"64_4096_16384", std::make_tuple(128, 64, 16, 16, 64, 1)},
-                 {"64_16384_4096", std::make_tuple(128, 256, 64, 16, 16, 1)},
-                 {"64_4096_4096", std::make_tuple(128, 64, 16, 16, 64, 1)},
-                 {"65_4096_16384", std::make_tuple(128, 64, 16, 16, 64, 1)},
-                 {"65_16384_4096", std::make_tuple(128, 256, 64, 16, 16, 1)},
-                 {"65_4096_4096", std::make_tuple(128, 64, 16, 16, 64, 1)},
-                 {"128_4096_16384", std::make_tuple(128, 128, 32, 32, 32, 2)},
-                 {"128_16384_4096", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"128_4096_4096", std::make_tuple(128, 128, 32, 32, 32, 2)},
-                 {"130_4096_16384", std::make_tuple(128, 128, 32, 32, 32, 2)},
-                 {"130_16384_4096", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"130_4096_4096", std::make_tuple(128, 128, 16, 32, 64, 1)},
-                 {"256_4096_16384", std::make_tuple(128, 128, 16, 32, 64, 1)},
-                 {"256_16384_4096", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"256_4096_4096", std::make_tuple(128, 128, 32, 32, 32, 2)},
-                 {"512_4096_16384", std::make_tuple(128, 256, 32, 32, 16, 1)},
-                 {"512_16384_4096", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"512_4096_4096", std::make_tuple(128, 128, 32, 32, 32, 2)},
-                 {"513_4096_16384", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"513_4096_4096", std::make_tuple(128, 512, 64, 32, 16, 1)},
-                 {"1024_4096_16384", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"1024_16384_4096", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"1024_4096_4096", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"1028_4096_16384", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"1028_16384_4096", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"1028_4096_4096", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"2016_4096_16384", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"2016_16384_4096", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"2016_4096_4096", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"1_50400_4096", std::make_tuple(128, 512, 64, 32, 16, 1)},
-                 {"1_50272_4096", std::make_tuple(128, 512, 64, 32, 16, 1)},
-                 {"4_50400_4096", std::make_tuple(128, 512, 64, 32, 16, 1)},
-                 {"4_50272_4096", std::make_tuple(128, 512, 64, 32, 16, 1)},
-                 {"1_250880_4096", std::make_tuple(32, 64, 8, 16, 16, 2)},
-                 {"4_250880_4096", std::make_tuple(32, 64, 8, 16, 16, 2)},
-                 {"1_11008_4096", std::make_tuple(16, 256, 8, 16, 16, 1)},
-                 {"4_11008_4096", std::make_tuple(16, 256, 8, 16, 16, 1)},
-                 {"32_11008_4096", std::make_tuple(64, 256, 64, 16, 16, 2)},
-                 {"64_11008_4096", std::make_tuple(64, 256, 64, 16, 16, 2)},
-                 {"128_11008_4096", std::make_tuple(128, 256, 32, 32, 16, 1)},
-                 {"256_11008_4096", std::make_tuple(256, 256, 32, 64, 32, 1)},
-                 {"512_11008_4096", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"1024_11008_4096", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"2016_11008_4096", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"1_32000_4096", std::make_tuple(256, 256, 32, 64, 16, 1)},
-                 {"4_32000_4096", std::make_tuple(256, 256, 32, 64, 16, 1)},
-                 {"1_13824_5120", std::make_tuple(256, 256, 32, 64, 16, 1)},
-                 {"1_5120_5120", std::make_tuple(8, 128, 8, 16, 16, 2)},
-                 {"4_13824_5120", std::make_tuple(128, 256, 64, 16, 16, 1)},
-                 {"4_5120_5120", std::make_tuple(8, 128, 8, 16, 16, 2)},
-                 {"32_13824_5120", std::make_tuple(128, 256, 64, 16, 16, 1)},
-                 {"32_5120_5120", std::make_tuple(32, 128, 32, 16, 16, 4)},
-                 {"64_13824_5120", std::make_tuple(128, 256, 32, 32, 16, 1)},
-                 {"64_5120_5120", std::make_tuple(128, 128, 16, 32, 64, 1)},
-                 {"128_13824_5120", std::make_tuple(128, 256, 32, 32, 16, 1)},
-                 {"128_5120_5120", std::make_tuple(128, 128, 16, 32, 64, 1)},
-                 {"256_13824_5120", std::make_tuple(256, 256, 32, 64, 32, 1)},
-                 {"256_5120_5120", std::make_tuple(128, 256, 32, 32, 16, 1)},
-                 {"512_13824_5120", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"512_5120_5120", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"1024_13824_5120", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"1024_5120_5120", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"2016_13824_5120", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"2016_5120_5120", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"1_32000_5120", std::make_tuple(256, 256, 32, 64, 16, 1)},
-                 {"4_32000_5120", std::make_tuple(256, 256, 32, 64, 16, 1)},
-                 {"1_7168_14336", std::make_tuple(8, 256, 8, 16, 16, 2)},
-                 {"1_1792_14336", std::make_tuple(16, 64, 16, 16, 16, 8)},
-                 {"4_7168_14336", std::make_tuple(8, 256, 8, 16, 16, 2)},
-                 {"4_1792_14336", std::make_tuple(16, 64, 16, 16, 16, 8)},
-                 {"32_7168_14336", std::make_tuple(32, 256, 32, 16, 16, 2)},
-                 {"32_1792_14336", std::make_tuple(16, 64, 16, 16, 16, 8)},
-                 {"1_14336_7168", std::make_tuple(128, 512, 64, 32, 16, 1)},
-                 {"1_14336_1792", std::make_tuple(16, 256, 8, 16, 16, 1)},
-                 {"4_14336_7168", std::make_tuple(128, 256, 64, 16, 16, 1)},
-                 {"4_14336_1792", std::make_tuple(128, 256, 32, 32, 16, 1)},
-                 {"32_14336_7168", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"32_14336_1792", std::make_tuple(128, 256, 32, 32, 16, 1)},
-                 {"1_250880_1792", std::make_tuple(16, 256, 8, 16, 16, 1)},
-                 {"1_2048_8192", std::make_tuple(8, 64, 8, 16, 32, 8)},
-                 {"1_3584_7168", std::make_tuple(32, 64, 8, 16, 16, 2)},
-                 {"1_7168_3584", std::make_tuple(128, 128, 16, 32, 64, 1)},
-                 {"1_7168_8192", std::make_tuple(128, 128, 16, 32, 64, 1)},
-                 {"1_8192_2048", std::make_tuple(128, 64, 16, 16, 64, 1)},
-                 {"1_8192_7168", std::make_tuple(8, 256, 8, 16, 16, 2)},
-                 {"1_256_8192", std::make_tuple(16, 64, 16, 16, 16, 8)},
-                 {"1_32000_2048", std::make_tuple(16, 256, 8, 16, 16, 1)},
-                 {"4_2048_8192", std::make_tuple(8, 64, 8, 16, 32, 8)},
-                 {"4_3584_7168", std::make_tuple(32, 64, 8, 16, 16, 2)},
-                 {"4_7168_3584", std::make_tuple(128, 128, 16, 32, 64, 1)},
-                 {"4_7168_8192", std::make_tuple(8, 256, 8, 16, 16, 2)},
-                 {"4_8192_2048", std::make_tuple(8, 256, 8, 16, 16, 2)},
-                 {"4_8192_7168", std::make_tuple(128, 256, 32, 32, 16, 1)},
-                 {"4_256_8192", std::make_tuple(16, 64, 16, 16, 16, 8)},
-                 {"4_32000_2048", std::make_tuple(256, 256, 32, 64, 16, 1)},
-                 {"1024_2048_8192", std::make_tuple(128, 256, 32, 32, 16, 1)},
-                 {"1024_7168_8192", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"1024_8192_2048", std::make_tuple(256, 256, 64, 32, 16, 1)},
-                 {"1024_8192_7168", std::make_tuple(256, 256, 32, 64, 32, 1)},
-                 {"1024_256_8192", std::make_tuple(32, 128, 32, 16, 16, 4)},
-                 // T5 model shape
-                 {"1_5120_2048", std::make_tuple(128, 128, 16, 32, 64, 1)},
-                 {"1_2048_2048", std::make_tuple(16, 64, 16, 16, 16, 8)},
-                 {"1_2048_5120", std::make_tuple(16, 64, 16, 16, 16, 8)},
-                 {"1_6144_2048", std::make_tuple(128, 128, 16, 32, 64, 1)},
-                 {"1_2048_2048", std::make_tuple(32, 64, 32, 16, 16, 8)},
-                 {"32_98304_2048", std::make_tuple(256, 256, 32, 64, 16, 1)},
-                 {"64_1_32", std::make_tuple(8, 256, 8, 16, 16, 2)},
-                 {"1_32_64", std::make_tuple(8, 256, 8, 16, 16, 2)},
-                 {"1_32128_2048", std::make_tuple(128, 256, 64, 16, 16, 1)},
-                 {"32_5120_2048", std::make_tuple(128, 128, 16, 32, 64, 1)},
-                 {"32_24576_32", std::make_tuple(32, 512, 32, 16, 16, 1)},
-                 {"32_6144_2048", std::make_tuple(128, 128, 16, 32, 64, 1)},
-                 {"32_2048_5120", std::make_tuple(16, 64, 16, 16, 16, 8)},
-                 {"32_2048_2048", std::make_tuple(16, 64, 16, 16, 16, 8)}};
+// The post_op_chain_t op running an XetlaGemmKernel epilogue.
+template <typename EpilogueType>
+epilogue_impl::post_op_kind ToPostOpKind(EpilogueType type) {
+  switch (type) {
+    case EpilogueType::BIAS:
+      return epilogue_impl::post_op_kind::bias;
+    case EpilogueType::RES_ADD:
+      return epilogue_impl::post_op_kind::res_add;
+    case EpilogueType::GELU:
+      return epilogue_impl::post_op_kind::gelu;
+    case EpilogueType::RES_MUL:
+      return epilogue_impl::post_op_kind::res_mul;
+    case EpilogueType::SILU:
+      return epilogue_impl::post_op_kind::silu;
+    case EpilogueType::RELU:
+      return epilogue_impl::post_op_kind::relu;
+    case EpilogueType::GELU_ERF:
+      return epilogue_impl::post_op_kind::gelu_erf;
+    case EpilogueType::SIGMOID:
+      return epilogue_impl::post_op_kind::sigmoid;
+  }
+  LOG(FATAL) << "Unknown XeTLA epilogue " << static_cast<int>(type);
+}
+
+}  // namespace
 
 std::tuple<int, int, int, int, int, int> selectXetlaGemmConfig(int m, int n,
                                                                int k) {
-  std::string mnk =
-      std::to_string(m) + "_" + std::to_string(n) + "_" + std::to_string(k);
-  if (configMap.find(mnk) != configMap.end()) {
-    return configMap[mnk];
+  const auto& config_map = GetXetlaGemmConfigMap();
+  auto it = config_map.find(std::make_tuple(m, n, k));
+  if (it != config_map.end()) {
+    return it->second;
   }
   // TODO: optimize auto-tuning algorithm
   if (n == 4096 && m <= 128) {
@@ -180,67 +216,152 @@ std::tuple<int, int, int, int, int, int> selectXetlaGemmConfig(int m, int n,
   return std::make_tuple(256, 256, 32, 64, 16, 1);
 }
 
+std::vector<std::tuple<int, int, int>> getXetlaGemmTunedShapes() {
+  std::vector<std::tuple<int, int, int>> shapes;
+  for (const auto& [shape, config] : GetXetlaGemmConfigMap()) {
+    shapes.push_back(shape);
+  }
+  std::sort(shapes.begin(), shapes.end());
+  return shapes;
+}
+
+// Past this, more slices of k cost more in partials than they gain.
+constexpr int kMaxSplitK = 16;
+
+int selectXetlaGemmSplitK(int m, int n, int k, int batch_size,
+                          const XetlaGemmConfig& config, int max_threads) {
+  constexpr int kMinSliceK = 256;
+  // The float partials of hgemm_splitk must start on 64-byte boundaries.
+  if (m > 32 || n % 16 != 0) return 1;
+  auto [wg_m, wg_n, sg_m, sg_n, sg_k, slm_ks] = config;
+  int64_t threads = int64_t{batch_size} * ((m + wg_m - 1) / wg_m) *
+                    ((n + wg_n - 1) / wg_n) * (wg_m / sg_m) * (wg_n / sg_n) *
+                    slm_ks;
+  int splits = 1;
+  while (splits < kMaxSplitK && threads * splits * 2 <= max_threads &&
+         k % (splits * 2 * 64) == 0 && k / (splits * 2) >= kMinSliceK) {
+    splits *= 2;
+  }
+  return splits;
+}
+
 std::tuple<int, int, int, int, int, int> selectXetlaQKVGemmConfig(int m, int n,
                                                                   int k) {
   return std::make_tuple(256, 256, 32, 64, 16, 1);
 }
 
+// Must list the same configs as the PolicyDispatcher in
+// XetlaGemmKernel::run.
+const std::vector<std::tuple<int, int, int, int, int, int>>&
+getXetlaGemmConfigs() {
+  static const auto* configs =
+      new std::vector<std::tuple<int, int, int, int, int, int>>{
+          {8, 64, 8, 16, 32, 8},       {8, 128, 8, 16, 16, 2},
+          {8, 128, 8, 16, 32, 4},      {8, 256, 8, 16, 16, 2},
+          {8, 512, 8, 16, 16, 1},      {16, 64, 16, 16, 16, 8},
+          {16, 256, 8, 16, 16, 1},     {16, 256, 16, 16, 16, 2},
+          {16, 512, 16, 16, 16, 1},    {32, 64, 32, 16, 16, 8},
+          {32, 64, 8, 16, 16, 2},      {32, 128, 32, 16, 16, 4},
+          {32, 256, 32, 16, 16, 2},    {32, 512, 32, 16, 16, 1},
+          {64, 128, 64, 16, 16, 4},    {64, 256, 64, 16, 16, 2},
+          {64, 512, 64, 16, 16, 1},    {128, 128, 32, 32, 32, 2},
+          {128, 256, 64, 16, 16, 1},   {128, 512, 64, 32, 16, 1},
+          {256, 256, 64, 32, 16, 1},   {256, 256, 32, 64, 16, 1},
+          {256, 256, 32, 64, 32, 1},   {128, 64, 16, 16, 64, 1},
+          {128, 128, 16, 32, 64, 1},   {128, 256, 32, 32, 16, 1}};
+  return *configs;
+}
+
 template <typename ComputeType>
-template <int WG_M, int WG_N, int SG_M, int SG_N, int SG_K, int SLM_KS>
-void XetlaGemmKernel<ComputeType>::dispatch(se::gpu::GpuStreamHandle handle) {
+template <int WG_M, int WG_N, int SG_M, int SG_N, int SG_K, int SLM_KS,
+          bool A_ROW_MAJOR, bool B_ROW_MAJOR>
+void XetlaGemmKernel<ComputeType>::dispatch_layout(
+    se::gpu::GpuStreamHandle handle) {
   sycl::queue q = *handle;
-  if (num_epilogues_ == 0) {
+  hgemm_batch_t batch;
+  batch.count = batch_size_;
+  batch.stride_a = a_->batch_stride;
+  batch.stride_b = b_->batch_stride;
+  batch.stride_c = c_->batch_stride;
+  // Only residual epilogues read per-batch tensors.
+  for (int i = 0; i < num_epilogues_; ++i) {
+    if (epilogue_types_[i] == RES_ADD) {
+      batch.stride_res = epilogue_batch_strides_[i];
+    }
+  }
+  auto* out = reinterpret_cast<ComputeType*>(c_->data.opaque());
+  auto* a = reinterpret_cast<ComputeType*>(a_->data.opaque());
+  auto* b = reinterpret_cast<ComputeType*>(b_->data.opaque());
+  static_assert(MAX_EPILOGUES <= hgemm_max_post_ops);
+  hgemm_post_ops_t post_ops;
+  post_ops.count = num_epilogues_;
+  for (int i = 0; i < num_epilogues_; ++i) {
+    post_ops.ops[i].kind = ToPostOpKind(epilogue_types_[i]);
+    post_ops.ops[i].data = epilogue_tensors_[i];
+    post_ops.ops[i].x = epilogue_params_[i];
+    post_ops.ops[i].batch_stride = epilogue_batch_strides_[i];
+  }
+  if (splits_ > 1) {
+    float* partial = static_cast<float*>(workspace_);
+    hgemm_splitk<ComputeType, WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS, 1, 1, 3,
+                 B_ROW_MAJOR, A_ROW_MAJOR>(q, out, a, b, m_, n_, k_, splits_,
+                                           partial, post_ops, batch);
+  } else if (num_epilogues_ == 0) {
     hgemm_common<ComputeType, WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS, 1, 1, 3,
-                 true>(q, reinterpret_cast<ComputeType*>(c_->data.opaque()),
-                       reinterpret_cast<ComputeType*>(a_->data.opaque()),
-                       reinterpret_cast<ComputeType*>(b_->data.opaque()), m_,
-                       n_, k_);
+                 B_ROW_MAJOR, A_ROW_MAJOR>(q, out, a, b, m_, n_, k_, batch);
   } else if (num_epilogues_ == 1 && epilogue_types_[0] == RES_ADD) {
     if (alpha_ == 1.0f) {
       hgemm_res<ComputeType, WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS, 1, 1, 3,
-                true>(q, reinterpret_cast<ComputeType*>(c_->data.opaque()),
-                      reinterpret_cast<ComputeType*>(a_->data.opaque()),
-                      reinterpret_cast<ComputeType*>(b_->data.opaque()),
-                      reinterpret_cast<ComputeType*>(epilogue_tensors_[0]), m_,
-                      n_, k_, epilogue_params_[0]);
+                B_ROW_MAJOR, A_ROW_MAJOR>(
+          q, out, a, b, reinterpret_cast<ComputeType*>(epilogue_tensors_[0]),
+          m_, n_, k_, epilogue_params_[0], batch);
     } else {
       hgemm_addmm<ComputeType, WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS, 1, 1, 3,
-                  true>(q, reinterpret_cast<ComputeType*>(c_->data.opaque()),
-                        reinterpret_cast<ComputeType*>(epilogue_tensors_[0]),
-                        reinterpret_cast<ComputeType*>(a_->data.opaque()),
-                        reinterpret_cast<ComputeType*>(b_->data.opaque()), m_,
-                        n_, k_, alpha_, epilogue_params_[0]);
+                  B_ROW_MAJOR, A_ROW_MAJOR>(
+          q, out, reinterpret_cast<ComputeType*>(epilogue_tensors_[0]), a, b,
+          m_, n_, k_, alpha_, epilogue_params_[0], batch);
     }
   } else if (num_epilogues_ == 1 && epilogue_types_[0] == BIAS) {
     CHECK(alpha_ == 1.0f);
     hgemm_bias<ComputeType, WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS, 1, 1, 3,
-               true>(q, reinterpret_cast<ComputeType*>(c_->data.opaque()),
-                     reinterpret_cast<ComputeType*>(a_->data.opaque()),
-                     reinterpret_cast<ComputeType*>(b_->data.opaque()),
-                     reinterpret_cast<ComputeType*>(epilogue_tensors_[0]), m_,
-                     n_, k_, epilogue_params_[0]);
+               B_ROW_MAJOR, A_ROW_MAJOR>(
+        q, out, a, b, reinterpret_cast<ComputeType*>(epilogue_tensors_[0]), m_,
+        n_, k_, epilogue_params_[0], batch);
   } else if (num_epilogues_ == 2 && epilogue_types_[0] == BIAS &&
              epilogue_types_[1] == RES_ADD) {
     CHECK(alpha_ == 1.0f);
     hgemm_bias_res<ComputeType, WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS, 1, 1, 3,
-                   true>(q, reinterpret_cast<ComputeType*>(c_->data.opaque()),
-                         reinterpret_cast<ComputeType*>(a_->data.opaque()),
-                         reinterpret_cast<ComputeType*>(b_->data.opaque()),
-                         reinterpret_cast<ComputeType*>(epilogue_tensors_[0]),
-                         reinterpret_cast<ComputeType*>(epilogue_tensors_[1]),
-                         m_, n_, k_, epilogue_params_[0], epilogue_params_[1]);
+                   B_ROW_MAJOR, A_ROW_MAJOR>(
+        q, out, a, b, reinterpret_cast<ComputeType*>(epilogue_tensors_[0]),
+        reinterpret_cast<ComputeType*>(epilogue_tensors_[1]), m_, n_, k_,
+        epilogue_params_[0], epilogue_params_[1], batch);
   } else if (num_epilogues_ == 2 && epilogue_types_[0] == BIAS &&
              epilogue_types_[1] == GELU) {
     CHECK(alpha_ == 1.0f);
     hgemm_bias_gelu<ComputeType, WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS, 1, 1, 3,
-                    true>(q, reinterpret_cast<ComputeType*>(c_->data.opaque()),
-                          reinterpret_cast<ComputeType*>(a_->data.opaque()),
-                          reinterpret_cast<ComputeType*>(b_->data.opaque()),
-                          reinterpret_cast<ComputeType*>(epilogue_tensors_[0]),
-                          m_, n_, k_, epilogue_params_[0]);
+                    B_ROW_MAJOR, A_ROW_MAJOR>(
+        q, out, a, b, reinterpret_cast<ComputeType*>(epilogue_tensors_[0]), m_,
+        n_, k_, epilogue_params_[0], batch);
+  } else {
+    CHECK(alpha_ == 1.0f);
+    hgemm_post_ops<ComputeType, WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS, 1, 1, 3,
+                   B_ROW_MAJOR, A_ROW_MAJOR>(q, out, a, b, m_, n_, k_,
+                                             post_ops, batch);
+  }
+}
 
+template <typename ComputeType>
+template <int WG_M, int WG_N, int SG_M, int SG_N, int SG_K, int SLM_KS>
+void XetlaGemmKernel<ComputeType>::dispatch(se::gpu::GpuStreamHandle handle) {
+  if (is_a_row_major_ && is_b_row_major_) {
+    dispatch_layout<WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS, true, true>(handle);
+  } else if (is_a_row_major_) {
+    dispatch_layout<WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS, true, false>(handle);
+  } else if (is_b_row_major_) {
+    dispatch_layout<WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS, false, true>(handle);
   } else {
-    LOG(ERROR) << "No mateched policy";
+    dispatch_layout<WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS, false, false>(
+        handle);
   }
 }
 
@@ -324,6 +445,22 @@ void XetlaGemmKernel<ComputeType>::run(se::gpu::GpuStreamHandle handle) {
   int SG_N = std::get<3>(selected_policy_id_);
   int SG_K = std::get<4>(selected_policy_id_);
   int SLM_KS = std::get<5>(selected_policy_id_);
+  // The split-K reduction runs the post-op chain but not the alpha scaling
+  // of hgemm_addmm.
+  if (alpha_ == 1.0f) {
+    sycl::device device = handle->get_device();
+    int max_threads =
+        device.get_info<sycl::info::device::max_compute_units>() * 8;
+    splits_ = selectXetlaGemmSplitK(m_, n_, k_, batch_size_,
+                                    selected_policy_id_, max_threads);
+    if (splits_ > 1) {
+      workspace_ = workspace_allocator_
+                       ? workspace_allocator_(sizeof(float) * splits_ *
+                                              batch_size_ * m_ * n_)
+                       : nullptr;
+      if (workspace_ == nullptr) splits_ = 1;
+    }
+  }
   gemm_policy::call(WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS, this, handle);
 }
 
@@ -14,7 +14,11 @@ limitations under the License.
 ==============================================================================*/
 #ifndef XLA_SERVICE_GPU_XETLA_GEMM_H_
 #define XLA_SERVICE_GPU_XETLA_GEMM_H_
+#include <functional>
 #include <sycl/sycl.hpp>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 #include "absl/strings/str_cat.h"
 #include "xla/service/gpu/matrix_descriptor.h"
@@ -35,6 +39,26 @@ extern std::tuple<int, int, int, int, int, int> selectXetlaQKVGemmConfig(int m,
                                                                          int n,
                                                                          int k);
 
+// Tile configs (WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS) instantiated by
+// XetlaGemmKernel::run. Autotuned GEMMs refer to a config by its index here.
+extern const std::vector<std::tuple<int, int, int, int, int, int>>&
+getXetlaGemmConfigs();
+
+// The (m, n, k) of the GEMMs that selectXetlaGemmConfig has a tuned config
+// for, in ascending order.
+extern std::vector<std::tuple<int, int, int>> getXetlaGemmTunedShapes();
+
+// Number of slices of k that XetlaGemmKernel reduces across work-groups for
+// a GEMM tiled by `config`, on a device running `max_threads` hardware
+// threads. Returns 1 unless the output tiles leave most of the device idle,
+// as for the m of 1 to 4 of decode steps.
+extern int selectXetlaGemmSplitK(
+    int m, int n, int k, int batch_size,
+    const std::tuple<int, int, int, int, int, int>& config, int max_threads);
+
+// Returns device memory of the given size in bytes, or null if there is none.
+using XetlaGemmWorkspaceAllocator = std::function<void*(size_t)>;
+
 template <typename ComputeType>
 class XetlaGemmKernel {
  public:
@@ -44,6 +68,9 @@ class XetlaGemmKernel {
     GELU,
     RES_MUL,
     SILU,
+    RELU,
+    GELU_ERF,
+    SIGMOID,
   };
 
  private:
@@ -54,7 +81,9 @@ class XetlaGemmKernel {
   void* epilogue_tensors_[MAX_EPILOGUES];
   EpilogueType epilogue_types_[MAX_EPILOGUES];
   float epilogue_params_[MAX_EPILOGUES];
+  int64_t epilogue_batch_strides_[MAX_EPILOGUES];
   int num_epilogues_ = 0;
+  int batch_size_ = 1;
   bool is_a_row_major_;
   bool is_a_col_major_;
   bool is_b_row_major_;
@@ -62,7 +91,11 @@ class XetlaGemmKernel {
   bool fallback_;
   int m_, n_, k_;
   std::tuple<int, int, int, int, int, int> selected_policy_id_;
+  int config_index_ = -1;
   float alpha_ = 1.0f;
+  int splits_ = 1;
+  void* workspace_ = nullptr;
+  XetlaGemmWorkspaceAllocator workspace_allocator_;
 
  public:
   XetlaGemmKernel() = default;
@@ -83,11 +116,40 @@ class XetlaGemmKernel {
     b_ = const_cast<xla::gpu::MatrixDescriptor*>(&b);
     return *this;
   }
+  // Runs `batch_size` GEMMs, stepping each matrix by its batch_stride. A
+  // batch_stride of 0 broadcasts the matrix to all batches.
+  XetlaGemmKernel& add_batch_size(int batch_size) {
+    batch_size_ = batch_size;
+    return *this;
+  }
+  // Runs the given entry of getXetlaGemmConfigs() instead of the heuristic
+  // choice. A negative index keeps the heuristic.
+  XetlaGemmKernel& add_config_index(int index) {
+    config_index_ = index;
+    return *this;
+  }
+  // Source of the float partials of a split-K GEMM, which must not be in use
+  // by another kernel until this one completes. run() asks for them only once
+  // it has chosen to split, and runs unsplit when it gets none.
+  XetlaGemmKernel& add_workspace_allocator(
+      XetlaGemmWorkspaceAllocator allocator) {
+    workspace_allocator_ = std::move(allocator);
+    return *this;
+  }
+  // Epilogues apply in the order they are added. `batch_stride` steps a
+  // residual between batches; biases are shared by all batches. Chains other
+  // than the few with dedicated kernels run through hgemm_post_ops.
   XetlaGemmKernel& add_epilogue(const void* t, EpilogueType eptype,
-                                const float x = 1.0) {
-    epilogue_tensors_[num_epilogues_] = const_cast<void*>(t);
-    epilogue_params_[num_epilogues_] = x;
-    epilogue_types_[num_epilogues_++] = eptype;
+                                const float x = 1.0,
+                                int64_t batch_stride = 0) {
+    // build() falls back on chains longer than MAX_EPILOGUES.
+    if (num_epilogues_ < MAX_EPILOGUES) {
+      epilogue_tensors_[num_epilogues_] = const_cast<void*>(t);
+      epilogue_params_[num_epilogues_] = x;
+      epilogue_batch_strides_[num_epilogues_] = batch_stride;
+      epilogue_types_[num_epilogues_] = eptype;
+    }
+    ++num_epilogues_;
     return *this;
   }
   XetlaGemmKernel& build() {
@@ -99,9 +161,24 @@ class XetlaGemmKernel {
     m_ = is_a_row_major_ ? a_->num_rows : a_->num_cols;
     k_ = is_a_row_major_ ? a_->num_cols : a_->num_rows;
     n_ = is_b_row_major_ ? b_->num_cols : b_->num_rows;
-    if (is_a_col_major_) return *this;
+    // A column-major A is read with transposing 2D block loads, whose
+    // surface pitch of m elements must be a multiple of 16 bytes.
+    if (is_a_col_major_ && (m_ * sizeof(ComputeType)) % 16 != 0) {
+      return *this;
+    }
+    // The kernels take densely packed rows.
+    if (a_->leading_dim_stride != a_->num_cols ||
+        b_->leading_dim_stride != b_->num_cols ||
+        c_->leading_dim_stride != c_->num_cols) {
+      return *this;
+    }
+    if (config_index_ >= static_cast<int>(getXetlaGemmConfigs().size()))
+      return *this;
+    if (num_epilogues_ > MAX_EPILOGUES) return *this;
     fallback_ = false;
-    selected_policy_id_ = selectXetlaGemmConfig(m_, n_, k_);
+    selected_policy_id_ = config_index_ >= 0
+                              ? getXetlaGemmConfigs()[config_index_]
+                              : selectXetlaGemmConfig(m_, n_, k_);
     return *this;
   }
 
@@ -109,6 +186,11 @@ class XetlaGemmKernel {
   void dispatch(se::gpu::GpuStreamHandle handle);
 
   void run(se::gpu::GpuStreamHandle handle);
+
+ private:
+  template <int WG_M, int WG_N, int SG_M, int SG_N, int SG_K, int SLM_KS,
+            bool A_ROW_MAJOR, bool B_ROW_MAJOR>
+  void dispatch_layout(se::gpu::GpuStreamHandle handle);
 };
 
 template <typename ComputeType>
@@ -0,0 +1,66 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/service/gpu/xetla/gemm/grouped_gemm.h"
+
+#include "xla/service/gpu/xetla/gemm/hgemm_impl.h"
+#include "xla/stream_executor/gpu/gpu_types.h"
+#include "xla/stream_executor/sycl/sycl_stream.h"
+
+namespace se = ::stream_executor;
+
+namespace gpu {
+namespace xetla {
+
+template <typename ComputeType>
+template <int WG_M, int WG_N, int SG_M, int SG_N, int SG_K, int SLM_KS>
+void XetlaGroupedGemmKernel<ComputeType>::dispatch(
+    se::gpu::GpuStreamHandle handle) {
+  // As many work-groups as the device runs at once.
+  sycl::device device = handle->get_device();
+  int max_threads =
+      device.get_info<sycl::info::device::max_compute_units>() * 8;
+  int max_work_groups = max_threads / ((WG_M / SG_M) * (WG_N / SG_N));
+  hgemm_grouped<ComputeType, WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS>(
+      *handle, static_cast<ComputeType*>(out_),
+      static_cast<const ComputeType*>(a_),
+      static_cast<const ComputeType*>(b_), group_offsets_, m_, n_, k_,
+      num_groups_, max_work_groups);
+}
+
+template <typename ComputeType>
+void XetlaGroupedGemmKernel<ComputeType>::run(
+    se::gpu::GpuStreamHandle handle) {
+  // Group sizes are only known on the device, so the row tile follows the
+  // average group. Tiles are the getXetlaGemmConfigs() entries that do not
+  // slice k in SLM, which hgemm_grouped does not; the wide ones keep the
+  // tile count of small groups low.
+  int rows_per_group = m_ / num_groups_;
+  if (rows_per_group <= 8) {
+    dispatch<8, 512, 8, 16, 16, 1>(handle);
+  } else if (rows_per_group <= 32) {
+    dispatch<32, 512, 32, 16, 16, 1>(handle);
+  } else if (rows_per_group <= 64) {
+    dispatch<64, 512, 64, 16, 16, 1>(handle);
+  } else {
+    dispatch<128, 256, 64, 16, 16, 1>(handle);
+  }
+}
+
+template class XetlaGroupedGemmKernel<sycl::half>;
+template class XetlaGroupedGemmKernel<gpu::xetla::bf16>;
+
+}  // namespace xetla
+}  // namespace gpu
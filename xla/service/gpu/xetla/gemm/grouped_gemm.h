@@ -0,0 +1,105 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef XLA_SERVICE_GPU_XETLA_GROUPED_GEMM_H_
+#define XLA_SERVICE_GPU_XETLA_GROUPED_GEMM_H_
+#include <sycl/sycl.hpp>
+
+#include <cstdint>
+
+#include "xla/stream_executor/gpu/gpu_types.h"
+#include "xla/stream_executor/sycl/sycl_stream.h"
+
+namespace se = ::stream_executor;
+
+namespace gpu {
+namespace xetla {
+
+// k and n of XetlaGroupedGemmKernel must be multiples of this.
+inline constexpr int kGroupedGemmAlignment = 32;
+
+// The GEMMs of a mixture-of-experts layer in one launch of a persistent
+// kernel that walks the group table:
+//
+//   out[group_offsets[g]:group_offsets[g + 1]] =
+//       a[group_offsets[g]:group_offsets[g + 1]] @ b[g]
+//
+// with the rows of out outside [group_offsets[0], group_offsets[num_groups])
+// zeroed.
+//
+//   a:             [m, k] ComputeType, row-major.
+//   b:             [num_groups, k, n] ComputeType, row-major.
+//   group_offsets: [num_groups + 1] int32 in device memory, ascending within
+//                  [0, m]. Only read by the kernel, so they may be computed
+//                  on the device.
+//   out:           [m, n] ComputeType, row-major.
+template <typename ComputeType>
+class XetlaGroupedGemmKernel {
+ private:
+  void* out_ = nullptr;
+  const void* a_ = nullptr;
+  const void* b_ = nullptr;
+  const int32_t* group_offsets_ = nullptr;
+  int m_ = 0, n_ = 0, k_ = 0;
+  int num_groups_ = 0;
+  bool fallback_;
+
+ public:
+  XetlaGroupedGemmKernel() = default;
+  bool fallback() const { return fallback_; }
+  XetlaGroupedGemmKernel& add_problem_size(int m, int n, int k,
+                                           int num_groups) {
+    m_ = m;
+    n_ = n;
+    k_ = k;
+    num_groups_ = num_groups;
+    return *this;
+  }
+  XetlaGroupedGemmKernel& add_matrix_out(void* out) {
+    out_ = out;
+    return *this;
+  }
+  XetlaGroupedGemmKernel& add_matrix_a(const void* a) {
+    a_ = a;
+    return *this;
+  }
+  XetlaGroupedGemmKernel& add_matrix_b(const void* b) {
+    b_ = b;
+    return *this;
+  }
+  XetlaGroupedGemmKernel& add_group_offsets(const void* group_offsets) {
+    group_offsets_ = static_cast<const int32_t*>(group_offsets);
+    return *this;
+  }
+  XetlaGroupedGemmKernel& build() {
+    fallback_ = true;
+    if (m_ < 1 || num_groups_ < 1) return *this;
+    if (n_ % kGroupedGemmAlignment != 0 || k_ % kGroupedGemmAlignment != 0) {
+      return *this;
+    }
+    fallback_ = false;
+    return *this;
+  }
+
+  void run(se::gpu::GpuStreamHandle handle);
+
+ private:
+  template <int WG_M, int WG_N, int SG_M, int SG_N, int SG_K, int SLM_KS>
+  void dispatch(se::gpu::GpuStreamHandle handle);
+};
+
+}  // namespace xetla
+}  // namespace gpu
+
+#endif  // XLA_SERVICE_GPU_XETLA_GROUPED_GEMM_H_
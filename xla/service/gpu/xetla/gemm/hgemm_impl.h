@@ -15,6 +15,7 @@ limitations under the License.
 #ifndef XLA_SERVICE_GPU_XETLA_HGEMM_IMPL_H_
 #define XLA_SERVICE_GPU_XETLA_HGEMM_IMPL_H_
 
+#include <algorithm>
 #include <sycl/sycl.hpp>
 #include <xetla.hpp>
 
@@ -29,83 +30,145 @@ limitations under the License.
 namespace gpu {
 namespace xetla {
 
+// Batch count and per-batch element strides of a batched GEMM. A stride of 0
+// broadcasts that operand to every batch.
+struct hgemm_batch_t {
+  uint32_t count = 1;
+  uint64_t stride_a = 0;
+  uint64_t stride_b = 0;
+  uint64_t stride_c = 0;
+  uint64_t stride_res = 0;
+};
+
+// Post-ops of hgemm_post_ops, applied in order. Bias and residual tensors
+// hold scalar_t; a residual is a dense [m, n] matrix stepped by
+// `batch_stride` between batches.
+inline constexpr uint32_t hgemm_max_post_ops = 4;
+
+struct hgemm_post_op_t {
+  epilogue_impl::post_op_kind kind = epilogue_impl::post_op_kind::bias;
+  const void* data = nullptr;
+  float x = 1.0f;
+  uint64_t batch_stride = 0;
+};
+
+struct hgemm_post_ops_t {
+  uint32_t count = 0;
+  hgemm_post_op_t ops[hgemm_max_post_ops];
+};
+
+template <typename T>
+inline T* hgemm_batch_ptr(const T* base, uint64_t batch_id, uint64_t stride) {
+  return const_cast<T*>(base) + batch_id * stride;
+}
+
 template <typename scalar_t, int WG_M = 8, int WG_N = 32, int SG_M = 8,
           int SG_N = 16, int SG_K = 64, int SLM_KS = 8, int L3_KS = 1,
-          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true>
+          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true,
+          bool A_ROW_MAJOR = true>
 class HGEMM_ADDMM_KERNEL;
 template <typename scalar_t, int WG_M = 8, int WG_N = 32, int SG_M = 8,
           int SG_N = 16, int SG_K = 64, int SLM_KS = 8, int L3_KS = 1,
-          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true>
+          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true,
+          bool A_ROW_MAJOR = true>
 class HGEMM_COMMON_KERNEL;
 template <typename scalar_t, int WG_M = 8, int WG_N = 32, int SG_M = 8,
           int SG_N = 16, int SG_K = 64, int SLM_KS = 8, int L3_KS = 1,
-          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true>
+          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true,
+          bool A_ROW_MAJOR = true>
 class HGEMM_BIAS_KERNEL;
 template <typename scalar_t, int WG_M = 8, int WG_N = 32, int SG_M = 8,
           int SG_N = 16, int SG_K = 64, int SLM_KS = 8, int L3_KS = 1,
-          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true>
+          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true,
+          bool A_ROW_MAJOR = true>
 class HGEMM_BIAS_GELU_KERNEL;
 template <typename scalar_t, int WG_M = 8, int WG_N = 32, int SG_M = 8,
           int SG_N = 16, int SG_K = 64, int SLM_KS = 8, int L3_KS = 1,
-          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true>
+          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true,
+          bool A_ROW_MAJOR = true>
 class HGEMM_BIAS_RES_RES_KERNEL;
 template <typename scalar_t, int WG_M = 8, int WG_N = 32, int SG_M = 8,
           int SG_N = 16, int SG_K = 64, int SLM_KS = 8, int L3_KS = 1,
-          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true>
+          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true,
+          bool A_ROW_MAJOR = true>
 class HGEMM_BIAS_RES_KERNEL;
 template <typename scalar_t, int WG_M = 8, int WG_N = 32, int SG_M = 8,
           int SG_N = 16, int SG_K = 64, int SLM_KS = 8, int L3_KS = 1,
-          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true>
+          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true,
+          bool A_ROW_MAJOR = true>
 class HGEMM_QKV_KERNEL;
 template <typename scalar_t, int WG_M = 8, int WG_N = 32, int SG_M = 8,
           int SG_N = 16, int SG_K = 64, int SLM_KS = 8, int L3_KS = 1,
-          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true>
+          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true,
+          bool A_ROW_MAJOR = true>
 class HGEMM_QKV_BIAS_KERNEL;
 template <typename scalar_t, int WG_M = 8, int WG_N = 32, int SG_M = 8,
           int SG_N = 16, int SG_K = 64, int SLM_KS = 8, int L3_KS = 1,
-          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true>
+          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true,
+          bool A_ROW_MAJOR = true>
 class HGEMM_MUL_KERNEL;
 template <typename scalar_t, int WG_M = 8, int WG_N = 32, int SG_M = 8,
           int SG_N = 16, int SG_K = 64, int SLM_KS = 8, int L3_KS = 1,
-          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true>
+          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true,
+          bool A_ROW_MAJOR = true>
 class HGEMM_SILU_KERNEL;
 template <typename scalar_t, int WG_M = 8, int WG_N = 32, int SG_M = 8,
           int SG_N = 16, int SG_K = 64, int SLM_KS = 8, int L3_KS = 1,
-          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true>
+          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true,
+          bool A_ROW_MAJOR = true>
 class HGEMM_RES_KERNEL;
 template <typename scalar_t, int WG_M = 8, int WG_N = 32, int SG_M = 8,
           int SG_N = 16, int SG_K = 64, int SLM_KS = 8, int L3_KS = 1,
-          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true>
+          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true,
+          bool A_ROW_MAJOR = true>
 class HGEMM_RES_RES_KERNEL;
+template <typename scalar_t, int WG_M = 8, int WG_N = 32, int SG_M = 8,
+          int SG_N = 16, int SG_K = 64, int SLM_KS = 8, int L3_KS = 1,
+          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true,
+          bool A_ROW_MAJOR = true>
+class HGEMM_POST_OPS_KERNEL;
+template <typename scalar_t, int WG_M = 8, int WG_N = 32, int SG_M = 8,
+          int SG_N = 16, int SG_K = 64, int SLM_KS = 8, int L3_KS = 1,
+          int SYNC_FREQ = 1, int STAGES = 3, bool B_ROW_MAJOR = true,
+          bool A_ROW_MAJOR = true>
+class HGEMM_SPLITK_KERNEL;
+template <typename scalar_t>
+class HGEMM_SPLITK_REDUCE_KERNEL;
+template <typename scalar_t, int WG_M = 8, int WG_N = 32, int SG_M = 8,
+          int SG_N = 16, int SG_K = 64, int SLM_KS = 8, int L3_KS = 1,
+          int SYNC_FREQ = 1, int STAGES = 3>
+class HGEMM_GROUPED_KERNEL;
 
 #define HGEMM_DEFINITIONS                                                \
   static_assert(L3_KS == 1, "currently, L3_KS should be 1");             \
-  constexpr mem_layout layout_a = mem_layout::row_major;                 \
+  constexpr mem_layout layout_a =                                        \
+      A_ROW_MAJOR ? mem_layout::row_major : mem_layout::col_major;       \
   constexpr mem_layout layout_b =                                        \
       B_ROW_MAJOR ? mem_layout::row_major : mem_layout::col_major;       \
   uint32_t group_range_m = (m + WG_M - 1) / WG_M;                        \
   uint32_t group_range_n = (n + WG_N - 1) / WG_N;                        \
   uint32_t thread_range_m = WG_M / SG_M;                                 \
   uint32_t thread_range_n = WG_N / SG_N;                                 \
-  uint32_t lda = k;                                                      \
+  uint32_t lda = A_ROW_MAJOR ? k : m;                                    \
   uint32_t ldb = B_ROW_MAJOR ? n : k;                                    \
   uint32_t ldc = n;                                                      \
-  cl::sycl::range<3> GroupRange{L3_KS, group_range_m, group_range_n};    \
+  cl::sycl::range<3> GroupRange{batch.count, group_range_m,             \
+                                group_range_n};                          \
   cl::sycl::range<3> LocalRange{SLM_KS, thread_range_m, thread_range_n}; \
   cl::sycl::nd_range<3> NDRange(GroupRange* LocalRange, LocalRange);
 
 template <typename scalar_t, int WG_M, int WG_N, int SG_M, int SG_N, int SG_K,
           int SLM_KS, int L3_KS = 1, int SYNC_FREQ = 1, int STAGES = 3,
-          bool B_ROW_MAJOR = true>
+          bool B_ROW_MAJOR = true, bool A_ROW_MAJOR = true>
 inline void hgemm_addmm(sycl::queue& queue, scalar_t* out, const scalar_t* res,
                         const scalar_t* a, const scalar_t* b, const int m,
                         const int n, const int k, const float alpha,
-                        const float beta) {
+                        const float beta, const hgemm_batch_t& batch = {}) {
   HGEMM_DEFINITIONS
   auto cgf = DPCPP_Q_CGF(cgh) {
     cgh.parallel_for<
         HGEMM_ADDMM_KERNEL<scalar_t, WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS,
-                           L3_KS, SYNC_FREQ, STAGES, B_ROW_MAJOR>>(
+                           L3_KS, SYNC_FREQ, STAGES, B_ROW_MAJOR, A_ROW_MAJOR>>(
         NDRange, [=](sycl::nd_item<3> item) SYCL_ESIMD_KERNEL {
           xetla_exec_item<3> ei(item);
           using data_type_b = scalar_t;
@@ -132,10 +195,15 @@ inline void hgemm_addmm(sycl::queue& queue, scalar_t* out, const scalar_t* res,
               gpu::xetla::kernel::dispatch_policy_kslicing<L3_KS, SLM_KS,
                                                            gpu_arch::Xe>,
               brgemm_t, epilogue_t>;
+          uint64_t batch_id = ei.get_group(0);
           typename gemm_op_t::arguments_t arg(
-              m, k, n, const_cast<scalar_t*>(a), lda, const_cast<scalar_t*>(b),
-              ldb, out, ldc,
-              {{{const_cast<scalar_t*>(res), {n, m, n}, alpha, beta}}});
+              m, k, n, hgemm_batch_ptr(a, batch_id, batch.stride_a), lda,
+              hgemm_batch_ptr(b, batch_id, batch.stride_b), ldb,
+              hgemm_batch_ptr(out, batch_id, batch.stride_c), ldc,
+              {{{hgemm_batch_ptr(res, batch_id, batch.stride_res),
+                 {n, m, n},
+                 alpha,
+                 beta}}});
           slm_barrier_init<gemm_op_t>();
           gemm_op_t gemm_op;
           gemm_op(ei, arg);
@@ -146,15 +214,16 @@ inline void hgemm_addmm(sycl::queue& queue, scalar_t* out, const scalar_t* res,
 
 template <typename scalar_t, int WG_M, int WG_N, int SG_M, int SG_N, int SG_K,
           int SLM_KS, int L3_KS = 1, int SYNC_FREQ = 1, int STAGES = 3,
-          bool B_ROW_MAJOR = true>
+          bool B_ROW_MAJOR = true, bool A_ROW_MAJOR = true>
 inline void hgemm_common(sycl::queue& queue, scalar_t* out, const scalar_t* a,
                          const scalar_t* b, const int m, const int n,
-                         const int k) {
+                         const int k, const hgemm_batch_t& batch = {}) {
   HGEMM_DEFINITIONS
   auto cgf = DPCPP_Q_CGF(cgh) {
     cgh.parallel_for<
         HGEMM_COMMON_KERNEL<scalar_t, WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS,
-                            L3_KS, SYNC_FREQ, STAGES, B_ROW_MAJOR>>(
+                            L3_KS, SYNC_FREQ, STAGES, B_ROW_MAJOR,
+                            A_ROW_MAJOR>>(
         NDRange, [=](sycl::nd_item<3> item) SYCL_ESIMD_KERNEL {
           xetla_exec_item<3> ei(item);
           using data_type_b = scalar_t;
@@ -178,9 +247,11 @@ inline void hgemm_common(sycl::queue& queue, scalar_t* out, const scalar_t* a,
               gpu::xetla::kernel::dispatch_policy_kslicing<L3_KS, SLM_KS,
                                                            gpu_arch::Xe>,
               brgemm_t, epilogue_t>;
-          typename gemm_op_t::arguments_t arg(m, k, n, const_cast<scalar_t*>(a),
-                                              lda, const_cast<scalar_t*>(b),
-                                              ldb, out, ldc);
+          uint64_t batch_id = ei.get_group(0);
+          typename gemm_op_t::arguments_t arg(
+              m, k, n, hgemm_batch_ptr(a, batch_id, batch.stride_a), lda,
+              hgemm_batch_ptr(b, batch_id, batch.stride_b), ldb,
+              hgemm_batch_ptr(out, batch_id, batch.stride_c), ldc);
           slm_barrier_init<gemm_op_t>();
           gemm_op_t gemm_op;
           gemm_op(ei, arg);
@@ -191,15 +262,16 @@ inline void hgemm_common(sycl::queue& queue, scalar_t* out, const scalar_t* a,
 
 template <typename scalar_t, int WG_M, int WG_N, int SG_M, int SG_N, int SG_K,
           int SLM_KS, int L3_KS = 1, int SYNC_FREQ = 1, int STAGES = 3,
-          bool B_ROW_MAJOR = true>
+          bool B_ROW_MAJOR = true, bool A_ROW_MAJOR = true>
 inline void hgemm_res(sycl::queue& queue, scalar_t* out, const scalar_t* a,
                       const scalar_t* b, const scalar_t* res, const int m,
-                      const int n, const int k, const float res_factor) {
+                      const int n, const int k, const float res_factor,
+                      const hgemm_batch_t& batch = {}) {
   HGEMM_DEFINITIONS
   auto cgf = DPCPP_Q_CGF(cgh) {
     cgh.parallel_for<
         HGEMM_RES_KERNEL<scalar_t, WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS, L3_KS,
-                         SYNC_FREQ, STAGES, B_ROW_MAJOR>>(
+                         SYNC_FREQ, STAGES, B_ROW_MAJOR, A_ROW_MAJOR>>(
         NDRange, [=](sycl::nd_item<3> item) SYCL_ESIMD_KERNEL {
           xetla_exec_item<3> ei(item);
 
@@ -227,10 +299,14 @@ inline void hgemm_res(sycl::queue& queue, scalar_t* out, const scalar_t* a,
               gpu::xetla::kernel::dispatch_policy_kslicing<L3_KS, SLM_KS,
                                                            gpu_arch::Xe>,
               brgemm_t, epilogue_t>;
+          uint64_t batch_id = ei.get_group(0);
           typename gemm_op_t::arguments_t arg(
-              m, k, n, const_cast<scalar_t*>(a), lda, const_cast<scalar_t*>(b),
-              ldb, out, ldc,
-              {{{const_cast<scalar_t*>(res), {n, m, n}, res_factor}}});
+              m, k, n, hgemm_batch_ptr(a, batch_id, batch.stride_a), lda,
+              hgemm_batch_ptr(b, batch_id, batch.stride_b), ldb,
+              hgemm_batch_ptr(out, batch_id, batch.stride_c), ldc,
+              {{{hgemm_batch_ptr(res, batch_id, batch.stride_res),
+                 {n, m, n},
+                 res_factor}}});
           slm_barrier_init<gemm_op_t>();
           gemm_op_t gemm_op;
           gemm_op(ei, arg);
@@ -241,15 +317,16 @@ inline void hgemm_res(sycl::queue& queue, scalar_t* out, const scalar_t* a,
 
 template <typename scalar_t, int WG_M, int WG_N, int SG_M, int SG_N, int SG_K,
           int SLM_KS, int L3_KS = 1, int SYNC_FREQ = 1, int STAGES = 3,
-          bool B_ROW_MAJOR = true>
+          bool B_ROW_MAJOR = true, bool A_ROW_MAJOR = true>
 inline void hgemm_bias(sycl::queue& queue, scalar_t* out, const scalar_t* a,
                        const scalar_t* b, const scalar_t* bias, const int m,
-                       const int n, const int k, const float bias_factor) {
+                       const int n, const int k, const float bias_factor,
+                       const hgemm_batch_t& batch = {}) {
   HGEMM_DEFINITIONS
   auto cgf = DPCPP_Q_CGF(cgh) {
     cgh.parallel_for<
         HGEMM_BIAS_KERNEL<scalar_t, WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS, L3_KS,
-                          SYNC_FREQ, STAGES, B_ROW_MAJOR>>(
+                          SYNC_FREQ, STAGES, B_ROW_MAJOR, A_ROW_MAJOR>>(
         NDRange, [=](sycl::nd_item<3> item) SYCL_ESIMD_KERNEL {
           xetla_exec_item<3> ei(item);
           using data_type_b = scalar_t;
@@ -276,9 +353,11 @@ inline void hgemm_bias(sycl::queue& queue, scalar_t* out, const scalar_t* a,
               gpu::xetla::kernel::dispatch_policy_kslicing<L3_KS, SLM_KS,
                                                            gpu_arch::Xe>,
               brgemm_t, epilogue_t>;
+          uint64_t batch_id = ei.get_group(0);
           typename gemm_op_t::arguments_t arg(
-              m, k, n, const_cast<scalar_t*>(a), lda, const_cast<scalar_t*>(b),
-              ldb, out, ldc,
+              m, k, n, hgemm_batch_ptr(a, batch_id, batch.stride_a), lda,
+              hgemm_batch_ptr(b, batch_id, batch.stride_b), ldb,
+              hgemm_batch_ptr(out, batch_id, batch.stride_c), ldc,
               {{{const_cast<scalar_t*>(bias), {n, 1, n}, bias_factor}}});
           slm_barrier_init<gemm_op_t>();
           gemm_op_t gemm_op;
@@ -290,17 +369,19 @@ inline void hgemm_bias(sycl::queue& queue, scalar_t* out, const scalar_t* a,
 
 template <typename scalar_t, int WG_M, int WG_N, int SG_M, int SG_N, int SG_K,
           int SLM_KS, int L3_KS = 1, int SYNC_FREQ = 1, int STAGES = 3,
-          bool B_ROW_MAJOR = true>
+          bool B_ROW_MAJOR = true, bool A_ROW_MAJOR = true>
 inline void hgemm_bias_res(sycl::queue& queue, scalar_t* out, const scalar_t* a,
                            const scalar_t* b, const scalar_t* bias,
                            const scalar_t* res, const int m, const int n,
                            const int k, const float bias_factor,
-                           const float res_factor) {
+                           const float res_factor,
+                           const hgemm_batch_t& batch = {}) {
   HGEMM_DEFINITIONS
   auto cgf = DPCPP_Q_CGF(cgh) {
     cgh.parallel_for<
         HGEMM_BIAS_RES_KERNEL<scalar_t, WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS,
-                              L3_KS, SYNC_FREQ, STAGES, B_ROW_MAJOR>>(
+                              L3_KS, SYNC_FREQ, STAGES, B_ROW_MAJOR,
+                              A_ROW_MAJOR>>(
         NDRange, [=](sycl::nd_item<3> item) SYCL_ESIMD_KERNEL {
           xetla_exec_item<3> ei(item);
           using data_type_b = scalar_t;
@@ -329,11 +410,15 @@ inline void hgemm_bias_res(sycl::queue& queue, scalar_t* out, const scalar_t* a,
               gpu::xetla::kernel::dispatch_policy_kslicing<L3_KS, SLM_KS,
                                                            gpu_arch::Xe>,
               brgemm_t, epilogue_t>;
+          uint64_t batch_id = ei.get_group(0);
           typename gemm_op_t::arguments_t arg(
-              m, k, n, const_cast<scalar_t*>(a), lda, const_cast<scalar_t*>(b),
-              ldb, out, ldc,
+              m, k, n, hgemm_batch_ptr(a, batch_id, batch.stride_a), lda,
+              hgemm_batch_ptr(b, batch_id, batch.stride_b), ldb,
+              hgemm_batch_ptr(out, batch_id, batch.stride_c), ldc,
               {{{const_cast<scalar_t*>(bias), {n, 1, n}, bias_factor},
-                {const_cast<scalar_t*>(res), {n, m, n}, res_factor}}});
+                {hgemm_batch_ptr(res, batch_id, batch.stride_res),
+                 {n, m, n},
+                 res_factor}}});
           slm_barrier_init<gemm_op_t>();
           gemm_op_t gemm_op;
           gemm_op(ei, arg);
@@ -344,16 +429,18 @@ inline void hgemm_bias_res(sycl::queue& queue, scalar_t* out, const scalar_t* a,
 
 template <typename scalar_t, int WG_M, int WG_N, int SG_M, int SG_N, int SG_K,
           int SLM_KS, int L3_KS = 1, int SYNC_FREQ = 1, int STAGES = 3,
-          bool B_ROW_MAJOR = true>
+          bool B_ROW_MAJOR = true, bool A_ROW_MAJOR = true>
 inline void hgemm_bias_gelu(sycl::queue& queue, scalar_t* out,
                             const scalar_t* a, const scalar_t* b,
                             const scalar_t* bias, const int m, const int n,
-                            const int k, const float bias_factor) {
+                            const int k, const float bias_factor,
+                            const hgemm_batch_t& batch = {}) {
   HGEMM_DEFINITIONS
   auto cgf = DPCPP_Q_CGF(cgh) {
     cgh.parallel_for<
         HGEMM_BIAS_GELU_KERNEL<scalar_t, WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS,
-                               L3_KS, SYNC_FREQ, STAGES, B_ROW_MAJOR>>(
+                               L3_KS, SYNC_FREQ, STAGES, B_ROW_MAJOR,
+                               A_ROW_MAJOR>>(
         NDRange, [=](sycl::nd_item<3> item) SYCL_ESIMD_KERNEL {
           xetla_exec_item<3> ei(item);
           using data_type_b = scalar_t;
@@ -381,9 +468,11 @@ inline void hgemm_bias_gelu(sycl::queue& queue, scalar_t* out,
               gpu::xetla::kernel::dispatch_policy_kslicing<L3_KS, SLM_KS,
                                                            gpu_arch::Xe>,
               brgemm_t, epilogue_t>;
+          uint64_t batch_id = ei.get_group(0);
           typename gemm_op_t::arguments_t arg(
-              m, k, n, const_cast<scalar_t*>(a), lda, const_cast<scalar_t*>(b),
-              ldb, out, ldc,
+              m, k, n, hgemm_batch_ptr(a, batch_id, batch.stride_a), lda,
+              hgemm_batch_ptr(b, batch_id, batch.stride_b), ldb,
+              hgemm_batch_ptr(out, batch_id, batch.stride_c), ldc,
               {{{const_cast<scalar_t*>(bias), {n, 1, n}, bias_factor}, {}}});
           slm_barrier_init<gemm_op_t>();
           gemm_op_t gemm_op;
@@ -393,6 +482,348 @@ inline void hgemm_bias_gelu(sycl::queue& queue, scalar_t* out,
   DPCPP_Q_SUBMIT(queue, cgf);
 }
 
+template <typename scalar_t, int WG_M, int WG_N, int SG_M, int SG_N, int SG_K,
+          int SLM_KS, int L3_KS = 1, int SYNC_FREQ = 1, int STAGES = 3,
+          bool B_ROW_MAJOR = true, bool A_ROW_MAJOR = true>
+inline void hgemm_post_ops(sycl::queue& queue, scalar_t* out,
+                           const scalar_t* a, const scalar_t* b, const int m,
+                           const int n, const int k,
+                           const hgemm_post_ops_t& post_ops,
+                           const hgemm_batch_t& batch = {}) {
+  HGEMM_DEFINITIONS
+  auto cgf = DPCPP_Q_CGF(cgh) {
+    cgh.parallel_for<
+        HGEMM_POST_OPS_KERNEL<scalar_t, WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS,
+                              L3_KS, SYNC_FREQ, STAGES, B_ROW_MAJOR,
+                              A_ROW_MAJOR>>(
+        NDRange, [=](sycl::nd_item<3> item) SYCL_ESIMD_KERNEL {
+          xetla_exec_item<3> ei(item);
+          using data_type_b = scalar_t;
+          using data_type_a = scalar_t;
+          using data_type_c = scalar_t;
+          using data_type_acc = float;
+          static constexpr uint32_t periodic_sync_interval = SYNC_FREQ;
+          static constexpr uint32_t prefetch_distance = STAGES;
+          using tile_shape = group::tile_shape_t<WG_N, WG_M, SG_N, SG_M>;
+          using brgemm_t = typename group::brgemm_selector_t<
+              data_type_a, data_type_b, layout_a, layout_b, mem_space::global,
+              mem_space::global, 8, 8, data_type_acc, tile_shape, SG_K,
+              mma_engine::xmx, gpu_arch::Xe, prefetch_distance,
+              periodic_sync_interval>::brgemm;
+          using post_op_chain_t =
+              epilogue_impl::post_op_chain_t<data_type_c, hgemm_max_post_ops>;
+          using epilogue_t = group::epilogue_t<
+              xetla::group::epilogue_policy_tile_op<
+                  xetla::subgroup::chained_tile_op_t<post_op_chain_t>,
+                  gpu_arch::Xe>,
+              tile_shape,
+              mem_desc_t<scalar_t, mem_layout::row_major, mem_space::global>>;
+          using gemm_op_t = gpu::xetla::kernel::gemm_t<
+              gpu::xetla::kernel::dispatch_policy_kslicing<L3_KS, SLM_KS,
+                                                           gpu_arch::Xe>,
+              brgemm_t, epilogue_t>;
+          uint64_t batch_id = ei.get_group(0);
+          typename post_op_chain_t::arguments_t chain_args;
+          chain_args.num_ops = post_ops.count;
+          for (uint32_t i = 0; i < post_ops.count; i++) {
+            const hgemm_post_op_t& op = post_ops.ops[i];
+            bool is_bias = op.kind == epilogue_impl::post_op_kind::bias;
+            chain_args.ops[i] = {
+                op.kind,
+                hgemm_batch_ptr(static_cast<const scalar_t*>(op.data),
+                                batch_id, op.batch_stride),
+                {n, is_bias ? 1 : m, n},
+                op.x};
+          }
+          typename gemm_op_t::arguments_t arg(
+              m, k, n, hgemm_batch_ptr(a, batch_id, batch.stride_a), lda,
+              hgemm_batch_ptr(b, batch_id, batch.stride_b), ldb,
+              hgemm_batch_ptr(out, batch_id, batch.stride_c), ldc,
+              {{chain_args}});
+          slm_barrier_init<gemm_op_t>();
+          gemm_op_t gemm_op;
+          gemm_op(ei, arg);
+        });
+  };
+  DPCPP_Q_SUBMIT(queue, cgf);
+}
+
+// Applies `op` to one output element in the reduction of hgemm_splitk. The
+// math matches the epilogue_impl ops that hgemm_post_ops runs.
+template <typename scalar_t>
+inline float hgemm_apply_post_op(const hgemm_post_op_t& op, float acc,
+                                 uint64_t batch_id, uint32_t row,
+                                 uint32_t col, uint32_t n) {
+  using epilogue_impl::post_op_kind;
+  const scalar_t* data = static_cast<const scalar_t*>(op.data);
+  switch (op.kind) {
+    case post_op_kind::bias:
+      return acc + op.x * static_cast<float>(data[col]);
+    case post_op_kind::res_add:
+      return acc +
+             op.x * static_cast<float>(
+                        data[batch_id * op.batch_stride +
+                             static_cast<uint64_t>(row) * n + col]);
+    case post_op_kind::res_mul:
+      return acc *
+             (op.x * static_cast<float>(
+                         data[batch_id * op.batch_stride +
+                              static_cast<uint64_t>(row) * n + col]));
+    case post_op_kind::relu:
+      return sycl::fmax(acc, 0.f);
+    case post_op_kind::gelu:
+      return 0.5f * acc *
+             (1.f + sycl::tanh(0.79788456f * (acc + 0.044715f * acc * acc *
+                                                        acc)));
+    case post_op_kind::gelu_erf:
+      return 0.5f * acc * (1.f + sycl::erf(acc * 0.70710678f));
+    case post_op_kind::silu:
+      return acc / (1.f + sycl::exp(-acc));
+    case post_op_kind::sigmoid:
+      return 1.f / (1.f + sycl::exp(-acc));
+  }
+  return acc;
+}
+
+// Split-K GEMM for shapes whose m x n tiles alone cannot fill the device,
+// such as decode steps with m of 1 to 4. Each of `splits` slices of k runs
+// in its own work-groups and stores a float partial product to `partial`,
+// which holds splits * batch.count * m * n floats. A second kernel then sums
+// the partials of each element in split order, so results do not depend on
+// scheduling, and applies `post_ops` before storing to `out`. k must be a
+// multiple of 64 * splits, which keeps every slice of A and B aligned for
+// 2D block loads, and n a multiple of 16 for the float stores.
+template <typename scalar_t, int WG_M, int WG_N, int SG_M, int SG_N, int SG_K,
+          int SLM_KS, int L3_KS = 1, int SYNC_FREQ = 1, int STAGES = 3,
+          bool B_ROW_MAJOR = true, bool A_ROW_MAJOR = true>
+inline void hgemm_splitk(sycl::queue& queue, scalar_t* out, const scalar_t* a,
+                         const scalar_t* b, const int m, const int n,
+                         const int k, const int splits, float* partial,
+                         const hgemm_post_ops_t& post_ops,
+                         const hgemm_batch_t& batch = {}) {
+  static_assert(L3_KS == 1, "currently, L3_KS should be 1");
+  constexpr mem_layout layout_a =
+      A_ROW_MAJOR ? mem_layout::row_major : mem_layout::col_major;
+  constexpr mem_layout layout_b =
+      B_ROW_MAJOR ? mem_layout::row_major : mem_layout::col_major;
+  uint32_t group_range_m = (m + WG_M - 1) / WG_M;
+  uint32_t group_range_n = (n + WG_N - 1) / WG_N;
+  uint32_t thread_range_m = WG_M / SG_M;
+  uint32_t thread_range_n = WG_N / SG_N;
+  uint32_t lda = A_ROW_MAJOR ? k : m;
+  uint32_t ldb = B_ROW_MAJOR ? n : k;
+  uint32_t ldc = n;
+  uint32_t k_split = k / splits;
+  uint64_t mn = static_cast<uint64_t>(m) * n;
+  cl::sycl::range<3> GroupRange{batch.count * splits, group_range_m,
+                                group_range_n};
+  cl::sycl::range<3> LocalRange{SLM_KS, thread_range_m, thread_range_n};
+  cl::sycl::nd_range<3> NDRange(GroupRange * LocalRange, LocalRange);
+
+  auto cgf = DPCPP_Q_CGF(cgh) {
+    cgh.parallel_for<
+        HGEMM_SPLITK_KERNEL<scalar_t, WG_M, WG_N, SG_M, SG_N, SG_K, SLM_KS,
+                            L3_KS, SYNC_FREQ, STAGES, B_ROW_MAJOR,
+                            A_ROW_MAJOR>>(
+        NDRange, [=](sycl::nd_item<3> item) SYCL_ESIMD_KERNEL {
+          xetla_exec_item<3> ei(item);
+          using data_type_b = scalar_t;
+          using data_type_a = scalar_t;
+          using data_type_acc = float;
+          static constexpr uint32_t periodic_sync_interval = SYNC_FREQ;
+          static constexpr uint32_t prefetch_distance = STAGES;
+          using tile_shape = group::tile_shape_t<WG_N, WG_M, SG_N, SG_M>;
+          using brgemm_t = typename group::brgemm_selector_t<
+              data_type_a, data_type_b, layout_a, layout_b, mem_space::global,
+              mem_space::global, 8, 8, data_type_acc, tile_shape, SG_K,
+              mma_engine::xmx, gpu_arch::Xe, prefetch_distance,
+              periodic_sync_interval>::brgemm;
+          using epilogue_t = group::epilogue_t<
+              xetla::group::epilogue_policy_tile_op<
+                  xetla::subgroup::chained_tile_op_t<>, gpu_arch::Xe>,
+              tile_shape,
+              mem_desc_t<data_type_acc, mem_layout::row_major,
+                         mem_space::global>>;
+          using gemm_op_t = gpu::xetla::kernel::gemm_t<
+              gpu::xetla::kernel::dispatch_policy_kslicing<L3_KS, SLM_KS,
+                                                           gpu_arch::Xe>,
+              brgemm_t, epilogue_t>;
+          uint64_t batch_id = ei.get_group(0) / splits;
+          uint64_t split_id = ei.get_group(0) % splits;
+          uint64_t k_start = split_id * k_split;
+          const scalar_t* a_split =
+              hgemm_batch_ptr(a, batch_id, batch.stride_a) +
+              (A_ROW_MAJOR ? k_start : k_start * m);
+          const scalar_t* b_split =
+              hgemm_batch_ptr(b, batch_id, batch.stride_b) +
+              (B_ROW_MAJOR ? k_start * n : k_start);
+          typename gemm_op_t::arguments_t arg(
+              m, k_split, n, const_cast<scalar_t*>(a_split), lda,
+              const_cast<scalar_t*>(b_split), ldb,
+              partial + (split_id * batch.count + batch_id) * mn, ldc);
+          slm_barrier_init<gemm_op_t>();
+          gemm_op_t gemm_op;
+          gemm_op(ei, arg);
+        });
+  };
+  DPCPP_Q_SUBMIT(queue, cgf);
+
+  uint32_t batch_count = batch.count;
+  uint64_t stride_c = batch.stride_c;
+  auto reduce_cgf = DPCPP_Q_CGF(cgh) {
+    cgh.parallel_for<HGEMM_SPLITK_REDUCE_KERNEL<scalar_t>>(
+        sycl::range<2>(batch_count, mn), [=](sycl::item<2> item) {
+          uint64_t batch_id = item[0];
+          uint64_t idx = item[1];
+          float acc = 0.f;
+          for (int split_id = 0; split_id < splits; ++split_id) {
+            acc += partial[(split_id * batch_count + batch_id) * mn + idx];
+          }
+          uint32_t row = idx / n;
+          uint32_t col = idx % n;
+          for (uint32_t i = 0; i < post_ops.count; ++i) {
+            acc = hgemm_apply_post_op<scalar_t>(post_ops.ops[i], acc,
+                                                batch_id, row, col, n);
+          }
+          out[batch_id * stride_c + idx] = static_cast<scalar_t>(acc);
+        });
+  };
+  DPCPP_Q_SUBMIT(queue, reduce_cgf);
+}
+
+// Grouped GEMM: rows [group_offsets[g], group_offsets[g + 1]) of a and out
+// are multiplied by the [k, n] matrix g of b, for the num_groups groups of a
+// mixture-of-experts layer. Rows before group_offsets[0] and from
+// group_offsets[num_groups] on are zeroed. Offsets are ascending within
+// [0, m] and only read on the device. All matrices are row-major; k and n
+// must be multiples of 32 so that every group's rows start 64-byte aligned
+// for 2D block loads.
+//
+// The kernel is persistent: at most `max_work_groups` work-groups run, and
+// each loops over the row tiles t, t + group_range_m, ... of its column of
+// tiles. The tiles of a segment, a group or the zeroed rows around them,
+// start at its first row, so a work-group walks the offsets table once
+// alongside its tiles and drives brgemm_t with its own start coordinates
+// instead of going through kernel::gemm_t. k is not sliced in SLM.
+template <typename scalar_t, int WG_M, int WG_N, int SG_M, int SG_N, int SG_K,
+          int SLM_KS, int L3_KS = 1, int SYNC_FREQ = 1, int STAGES = 3>
+inline void hgemm_grouped(sycl::queue& queue, scalar_t* out,
+                          const scalar_t* a, const scalar_t* b,
+                          const int32_t* group_offsets, const int m,
+                          const int n, const int k, const int num_groups,
+                          const int max_work_groups) {
+  static_assert(L3_KS == 1, "currently, L3_KS should be 1");
+  static_assert(SLM_KS == 1, "grouped GEMMs do not slice k in SLM");
+  // Each of the num_groups + 1 segment boundaries splits at most one tile in
+  // two.
+  uint32_t max_tiles_m = (m + WG_M - 1) / WG_M + num_groups + 1;
+  uint32_t group_range_n = (n + WG_N - 1) / WG_N;
+  uint32_t group_range_m = std::clamp<uint32_t>(
+      max_work_groups / group_range_n, 1, max_tiles_m);
+  uint32_t thread_range_m = WG_M / SG_M;
+  uint32_t thread_range_n = WG_N / SG_N;
+  uint32_t lda = k;
+  uint32_t ldb = n;
+  uint32_t ldc = n;
+  cl::sycl::range<3> GroupRange{1, group_range_m, group_range_n};
+  cl::sycl::range<3> LocalRange{SLM_KS, thread_range_m, thread_range_n};
+  cl::sycl::nd_range<3> NDRange(GroupRange * LocalRange, LocalRange);
+
+  auto cgf = DPCPP_Q_CGF(cgh) {
+    cgh.parallel_for<HGEMM_GROUPED_KERNEL<scalar_t, WG_M, WG_N, SG_M, SG_N,
+                                          SG_K, SLM_KS, L3_KS, SYNC_FREQ,
+                                          STAGES>>(
+        NDRange, [=](sycl::nd_item<3> item) SYCL_ESIMD_KERNEL {
+          xetla_exec_item<3> ei(item);
+          using data_type_b = scalar_t;
+          using data_type_a = scalar_t;
+          using data_type_c = scalar_t;
+          using data_type_acc = float;
+          static constexpr uint32_t periodic_sync_interval = SYNC_FREQ;
+          static constexpr uint32_t prefetch_distance = STAGES;
+          using tile_shape = group::tile_shape_t<WG_N, WG_M, SG_N, SG_M>;
+          using brgemm_t = typename group::brgemm_selector_t<
+              data_type_a, data_type_b, mem_layout::row_major,
+              mem_layout::row_major, mem_space::global, mem_space::global, 8,
+              8, data_type_acc, tile_shape, SG_K, mma_engine::xmx,
+              gpu_arch::Xe, prefetch_distance,
+              periodic_sync_interval>::brgemm;
+          using epilogue_t = group::epilogue_t<
+              xetla::group::epilogue_policy_tile_op<
+                  xetla::subgroup::chained_tile_op_t<>, gpu_arch::Xe>,
+              tile_shape,
+              mem_desc_t<scalar_t, mem_layout::row_major, mem_space::global>>;
+          // Only sizes the SLM and barriers of brgemm_t and epilogue_t.
+          using gemm_op_t = gpu::xetla::kernel::gemm_t<
+              gpu::xetla::kernel::dispatch_policy_kslicing<L3_KS, SLM_KS,
+                                                           gpu_arch::Xe>,
+              brgemm_t, epilogue_t>;
+          using work_group_t = typename tile_shape::work_group_t;
+          using mem_desc_a_t = typename brgemm_t::mem_desc_a_t;
+          using mem_desc_b_t = typename brgemm_t::mem_desc_b_t;
+          using mem_desc_c_t = typename epilogue_t::mem_desc_c_t;
+          using matAcc_t = typename brgemm_t::matAcc_t;
+          slm_barrier_init<gemm_op_t>();
+          work_group_t g;
+          g.init(ei.get_local_linear_id());
+
+          // The tile covers columns [start_n, end_n) of b and out.
+          uint32_t start_n = ei.get_group(2) * WG_N;
+          uint32_t end_n = std::min<uint32_t>(start_n + WG_N, n);
+          uint32_t loop_count = (k + SG_K - 1) / SG_K;
+
+          // Segment -1 holds the rows before group 0, segment num_groups
+          // those after the last group, and segment g group g.
+          auto* offsets = const_cast<int32_t*>(group_offsets);
+          int segment = -1;
+          int32_t begin = 0;
+          int32_t end = xetla_load_global<int32_t, 1>(offsets, 0)[0];
+          uint32_t tiles_before = 0;
+          for (uint32_t tile_m = ei.get_group(1);; tile_m += group_range_m) {
+            // Advance to the segment holding row tile tile_m.
+            uint32_t tiles = (end - begin + WG_M - 1) / WG_M;
+            while (tile_m >= tiles_before + tiles) {
+              if (++segment > num_groups) return;
+              tiles_before += tiles;
+              begin = end;
+              end = segment < num_groups
+                        ? xetla_load_global<int32_t, 1>(
+                              offsets, (segment + 1) * sizeof(int32_t))[0]
+                        : m;
+              tiles = (end - begin + WG_M - 1) / WG_M;
+            }
+
+            // The tile covers rows [row_start, end_m) of a and out.
+            int32_t row_start = begin + (tile_m - tiles_before) * WG_M;
+            uint32_t end_m = std::min<int32_t>(row_start + WG_M, end);
+            mem_desc_c_t mem_desc_c;
+            mem_desc_c.init(out, {end_n, end_m, ldc},
+                            {static_cast<int32_t>(start_n), row_start});
+            matAcc_t matAcc;
+            matAcc.init(0);
+            if (segment >= 0 && segment < num_groups) {
+              mem_desc_a_t mem_desc_a;
+              mem_desc_b_t mem_desc_b;
+              mem_desc_a.init(const_cast<scalar_t*>(a),
+                              {static_cast<uint32_t>(k), end_m, lda},
+                              {0, row_start});
+              mem_desc_b.init(
+                  const_cast<scalar_t*>(b) + uint64_t(segment) * k * n,
+                  {end_n, static_cast<uint32_t>(k), ldb},
+                  {static_cast<int32_t>(start_n), 0});
+              typename brgemm_t::arguments_t brgemm_args(
+                  mem_desc_a, mem_desc_b, loop_count);
+              brgemm_t brgemm;
+              brgemm(g, matAcc, brgemm_args);
+            }
+            epilogue_t epilogue;
+            epilogue(g, matAcc, mem_desc_c);
+          }
+        });
+  };
+  DPCPP_Q_SUBMIT(queue, cgf);
+}
+
 template <typename scalar_t, int WG_M, int WG_N, int SG_M, int SG_N, int SG_K,
           int SLM_KS, int L3_KS = 1, int SYNC_FREQ = 1, int STAGES = 3,
           bool B_ROW_MAJOR = true>
@@ -0,0 +1,76 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/service/gpu/xetla/gemm/weight_only_gemm.h"
+
+#include <type_traits>
+
+#include "xla/service/gpu/xetla/gemm/weight_only_gemm_impl.h"
+#include "xla/stream_executor/gpu/gpu_types.h"
+#include "xla/stream_executor/sycl/sycl_stream.h"
+
+namespace se = ::stream_executor;
+
+namespace gpu {
+namespace xetla {
+
+template <typename ComputeType>
+template <bool INT4, bool HAS_ZERO_POINTS, int M_MAX, int N_TILE, int KS>
+void XetlaWeightOnlyGemmKernel<ComputeType>::dispatch(
+    se::gpu::GpuStreamHandle handle) {
+  weight_only_gemm<ComputeType, INT4, HAS_ZERO_POINTS, M_MAX, N_TILE, KS>(
+      *handle, static_cast<ComputeType*>(out_),
+      static_cast<const ComputeType*>(a_), b_, scales_, zero_points_, m_, n_,
+      k_, group_size_);
+}
+
+template <typename ComputeType>
+void XetlaWeightOnlyGemmKernel<ComputeType>::run(
+    se::gpu::GpuStreamHandle handle) {
+  // The accumulators of all rows live in registers, so m is rounded up to the
+  // next bucket rather than to the largest one. Small m leaves few threads
+  // per column tile, which a wider split of k makes up for.
+  auto dispatch_m = [&](auto int4, auto has_zero_points) {
+    constexpr bool kInt4 = decltype(int4)::value;
+    constexpr bool kHasZeroPoints = decltype(has_zero_points)::value;
+    constexpr int kNTile = WeightOnlyGemmNTile(kInt4);
+    if (m_ <= 1) {
+      dispatch<kInt4, kHasZeroPoints, 1, kNTile, 16>(handle);
+    } else if (m_ <= 4) {
+      dispatch<kInt4, kHasZeroPoints, 4, kNTile, 16>(handle);
+    } else if (m_ <= 8) {
+      dispatch<kInt4, kHasZeroPoints, 8, kNTile, 8>(handle);
+    } else if (m_ <= 16) {
+      dispatch<kInt4, kHasZeroPoints, 16, kNTile, 8>(handle);
+    } else {
+      dispatch<kInt4, kHasZeroPoints, kWeightOnlyGemmMaxM, kNTile, 4>(handle);
+    }
+  };
+  using True = std::true_type;
+  using False = std::false_type;
+  if (int4_) {
+    zero_points_ != nullptr ? dispatch_m(True(), True())
+                            : dispatch_m(True(), False());
+  } else {
+    zero_points_ != nullptr ? dispatch_m(False(), True())
+                            : dispatch_m(False(), False());
+  }
+}
+
+template class XetlaWeightOnlyGemmKernel<sycl::half>;
+template class XetlaWeightOnlyGemmKernel<gpu::xetla::bf16>;
+
+}  // namespace xetla
+}  // namespace gpu
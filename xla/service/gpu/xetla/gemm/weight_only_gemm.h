@@ -0,0 +1,113 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef XLA_SERVICE_GPU_XETLA_WEIGHT_ONLY_GEMM_H_
+#define XLA_SERVICE_GPU_XETLA_WEIGHT_ONLY_GEMM_H_
+#include <sycl/sycl.hpp>
+
+#include <cstdint>
+
+#include "xla/stream_executor/gpu/gpu_types.h"
+#include "xla/stream_executor/sycl/sycl_stream.h"
+
+namespace se = ::stream_executor;
+
+namespace gpu {
+namespace xetla {
+
+// Shape limits of XetlaWeightOnlyGemmKernel. The kernels only cover decode
+// GEMMs with up to kWeightOnlyGemmMaxM rows; k and the quantization group size
+// must be multiples of kWeightOnlyGemmKTile, and n a multiple of
+// WeightOnlyGemmNTile().
+inline constexpr int kWeightOnlyGemmMaxM = 32;
+inline constexpr int kWeightOnlyGemmKTile = 16;
+constexpr int WeightOnlyGemmNTile(bool int4) { return int4 ? 32 : 16; }
+
+// out = a @ ((b - zero_points) * scales) with int8 or int4 weights b, which
+// are dequantized in registers instead of being materialized.
+//
+//   a:           [m, k] ComputeType, row-major.
+//   b:           [k, n] int8, or [k, n / 2] bytes holding two int4 values
+//                each, the even column in the low nibble.
+//   scales:      [k / group_size, n] F32.
+//   zero_points: [k / group_size, n] F32, optional.
+//   out:         [m, n] ComputeType, row-major.
+template <typename ComputeType>
+class XetlaWeightOnlyGemmKernel {
+ private:
+  void* out_ = nullptr;
+  const void* a_ = nullptr;
+  const int8_t* b_ = nullptr;
+  const float* scales_ = nullptr;
+  const float* zero_points_ = nullptr;
+  bool int4_ = false;
+  int m_ = 0, n_ = 0, k_ = 0;
+  int group_size_ = 0;
+  bool fallback_;
+
+ public:
+  XetlaWeightOnlyGemmKernel() = default;
+  bool fallback() const { return fallback_; }
+  XetlaWeightOnlyGemmKernel& add_problem_size(int m, int n, int k) {
+    m_ = m;
+    n_ = n;
+    k_ = k;
+    return *this;
+  }
+  XetlaWeightOnlyGemmKernel& add_matrix_out(void* out) {
+    out_ = out;
+    return *this;
+  }
+  XetlaWeightOnlyGemmKernel& add_matrix_a(const void* a) {
+    a_ = a;
+    return *this;
+  }
+  XetlaWeightOnlyGemmKernel& add_matrix_b(const void* b, bool int4) {
+    b_ = static_cast<const int8_t*>(b);
+    int4_ = int4;
+    return *this;
+  }
+  XetlaWeightOnlyGemmKernel& add_scales(const void* scales, int group_size) {
+    scales_ = static_cast<const float*>(scales);
+    group_size_ = group_size;
+    return *this;
+  }
+  XetlaWeightOnlyGemmKernel& add_zero_points(const void* zero_points) {
+    zero_points_ = static_cast<const float*>(zero_points);
+    return *this;
+  }
+  XetlaWeightOnlyGemmKernel& build() {
+    fallback_ = true;
+    if (m_ < 1 || m_ > kWeightOnlyGemmMaxM) return *this;
+    if (n_ % WeightOnlyGemmNTile(int4_) != 0) return *this;
+    if (k_ % kWeightOnlyGemmKTile != 0) return *this;
+    if (group_size_ <= 0 || group_size_ % kWeightOnlyGemmKTile != 0 ||
+        k_ % group_size_ != 0) {
+      return *this;
+    }
+    fallback_ = false;
+    return *this;
+  }
+
+  void run(se::gpu::GpuStreamHandle handle);
+
+ private:
+  template <bool INT4, bool HAS_ZERO_POINTS, int M_MAX, int N_TILE, int KS>
+  void dispatch(se::gpu::GpuStreamHandle handle);
+};
+
+}  // namespace xetla
+}  // namespace gpu
+
+#endif  // XLA_SERVICE_GPU_XETLA_WEIGHT_ONLY_GEMM_H_
@@ -0,0 +1,170 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef XLA_SERVICE_GPU_XETLA_WEIGHT_ONLY_GEMM_IMPL_H_
+#define XLA_SERVICE_GPU_XETLA_WEIGHT_ONLY_GEMM_IMPL_H_
+
+#include <sycl/sycl.hpp>
+#include <xetla.hpp>
+
+#include "weight_only_gemm.h"
+
+namespace gpu {
+namespace xetla {
+
+template <typename scalar_t, bool INT4, bool HAS_ZERO_POINTS, int M_MAX,
+          int N_TILE, int KS>
+class WEIGHT_ONLY_GEMM_KERNEL;
+
+// out[m, n] = a[m, k] @ ((b[k, n] - zero_points) * scales), where scales and
+// zero_points hold one F32 row per group of `group_size` rows of b.
+//
+// Decode GEMMs are bound by reading b, so each hardware thread streams a
+// [k / KS, N_TILE] slice of b once, dequantizes it in registers and applies
+// it to all m <= M_MAX rows of a. The KS threads of a work-group split k and
+// add up their partial sums through SLM.
+//
+// b is int8, or int4 packed two per byte along n with the even column in the
+// low nibble. Requires n % N_TILE == 0, and k and group_size to be multiples
+// of kWeightOnlyGemmKTile.
+template <typename scalar_t, bool INT4, bool HAS_ZERO_POINTS, int M_MAX,
+          int N_TILE, int KS>
+inline void weight_only_gemm(sycl::queue& queue, scalar_t* out,
+                             const scalar_t* a, const int8_t* b,
+                             const float* scales, const float* zero_points,
+                             const int m, const int n, const int k,
+                             const int group_size) {
+  constexpr int K_TILE = kWeightOnlyGemmKTile;
+  // Bytes of one row of the slice of b, loaded as dwords.
+  constexpr int B_BYTES = INT4 ? N_TILE / 2 : N_TILE;
+  static_assert(B_BYTES % 4 == 0, "rows of b are loaded as dwords");
+  static_assert(N_TILE * sizeof(scalar_t) % 4 == 0,
+                "rows of out are stored as dwords");
+  static_assert(K_TILE * sizeof(scalar_t) % 4 == 0,
+                "rows of a are loaded as dwords");
+  constexpr uint32_t kPartialSize = M_MAX * N_TILE * sizeof(float);
+
+  uint32_t num_k_tiles = k / K_TILE;
+  uint32_t k_per_thread = (num_k_tiles + KS - 1) / KS * K_TILE;
+  uint32_t ldb = INT4 ? n / 2 : n;
+
+  cl::sycl::range<2> GroupRange{static_cast<size_t>(n / N_TILE), 1};
+  cl::sycl::range<2> LocalRange{1, KS};
+  cl::sycl::nd_range<2> NDRange(GroupRange * LocalRange, LocalRange);
+
+  queue.submit([&](sycl::handler& cgh) {
+    cgh.parallel_for<WEIGHT_ONLY_GEMM_KERNEL<scalar_t, INT4, HAS_ZERO_POINTS,
+                                             M_MAX, N_TILE, KS>>(
+        NDRange, [=](sycl::nd_item<2> item) SYCL_ESIMD_KERNEL {
+          xetla_exec_item<2> ei(item);
+          xetla_local_init<KS * kPartialSize>();
+          xetla_nbarrier_init<1>();
+          xetla_nbarrier_t<KS, KS> nbarrier;
+          nbarrier.init_nbarrier(0, nbarrier_role::producer_consumer);
+
+          uint32_t n0 = ei.get_group(0) * N_TILE;
+          uint32_t ks_id = ei.get_local_id(1);
+          uint32_t k_begin = ks_id * k_per_thread;
+          uint32_t k_end = std::min<uint32_t>(k, k_begin + k_per_thread);
+
+          auto* a_dw = reinterpret_cast<uint32_t*>(const_cast<scalar_t*>(a));
+          auto* b_dw = reinterpret_cast<uint32_t*>(const_cast<int8_t*>(b));
+          auto* scales_p = const_cast<float*>(scales);
+          auto* zero_points_p = const_cast<float*>(zero_points);
+
+          xetla_vector<float, M_MAX * N_TILE> acc = 0;
+          for (uint32_t k0 = k_begin; k0 < k_end; k0 += K_TILE) {
+            // Rows of a past m stay zero; their results are not stored.
+            xetla_vector<float, M_MAX * K_TILE> a_tile = 0;
+#pragma unroll
+            for (int i = 0; i < M_MAX; ++i) {
+              if (i < m) {
+                xetla_vector<uint32_t, K_TILE * sizeof(scalar_t) / 4> raw =
+                    xetla_load_global<uint32_t,
+                                      K_TILE * sizeof(scalar_t) / 4>(
+                        a_dw, (uint64_t(i) * k + k0) * sizeof(scalar_t));
+                a_tile.xetla_select<K_TILE, 1>(i * K_TILE) =
+                    xetla_cvt<float, scalar_t, K_TILE>(
+                        raw.xetla_format<scalar_t>());
+              }
+            }
+
+            uint64_t group_offset =
+                (uint64_t(k0 / group_size) * n + n0) * sizeof(float);
+            xetla_vector<float, N_TILE> scale =
+                xetla_load_global<float, N_TILE>(scales_p, group_offset);
+            xetla_vector<float, N_TILE> zero_point;
+            if constexpr (HAS_ZERO_POINTS) {
+              zero_point =
+                  xetla_load_global<float, N_TILE>(zero_points_p, group_offset);
+            }
+
+#pragma unroll
+            for (int r = 0; r < K_TILE; ++r) {
+              xetla_vector<uint32_t, B_BYTES / 4> raw =
+                  xetla_load_global<uint32_t, B_BYTES / 4>(
+                      b_dw, uint64_t(k0 + r) * ldb + (INT4 ? n0 / 2 : n0));
+              xetla_vector<int32_t, B_BYTES> q = raw.xetla_format<int8_t>();
+              xetla_vector<float, N_TILE> w;
+              if constexpr (INT4) {
+                // Arithmetic shifts sign-extend both nibbles.
+                xetla_vector<int32_t, B_BYTES> lo = (q << 28) >> 28;
+                xetla_vector<int32_t, B_BYTES> hi = q >> 4;
+                w.xetla_select<B_BYTES, 2>(0) = lo;
+                w.xetla_select<B_BYTES, 2>(1) = hi;
+              } else {
+                w = q;
+              }
+              if constexpr (HAS_ZERO_POINTS) w -= zero_point;
+              w *= scale;
+#pragma unroll
+              for (int i = 0; i < M_MAX; ++i) {
+                float a_value = a_tile[i * K_TILE + r];
+                acc.xetla_select<N_TILE, 1>(i * N_TILE) += a_value * w;
+              }
+            }
+          }
+
+#pragma unroll
+          for (int i = 0; i < M_MAX; ++i) {
+            xetla_store_local<float, N_TILE>(
+                ks_id * kPartialSize + i * N_TILE * sizeof(float),
+                acc.xetla_select<N_TILE, 1>(i * N_TILE));
+          }
+          xetla_fence<memory_kind::shared_local>();
+          nbarrier.arrive_wait();
+
+          auto* out_dw = reinterpret_cast<uint32_t*>(out);
+          for (uint32_t i = ks_id; i < std::min<uint32_t>(m, M_MAX);
+               i += KS) {
+            xetla_vector<float, N_TILE> sum = 0;
+#pragma unroll
+            for (int s = 0; s < KS; ++s) {
+              sum += xetla_load_local<float, N_TILE>(
+                  s * kPartialSize + i * N_TILE * sizeof(float));
+            }
+            xetla_vector<scalar_t, N_TILE> result =
+                xetla_cvt<scalar_t, float, N_TILE>(sum);
+            xetla_store_global<uint32_t, N_TILE * sizeof(scalar_t) / 4>(
+                out_dw, (uint64_t(i) * n + n0) * sizeof(scalar_t),
+                result.xetla_format<uint32_t>());
+          }
+        });
+  });
+}
+
+}  // namespace xetla
+}  // namespace gpu
+
+#endif  // XLA_SERVICE_GPU_XETLA_WEIGHT_ONLY_GEMM_IMPL_H_
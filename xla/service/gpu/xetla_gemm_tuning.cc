@@ -0,0 +1,151 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/service/gpu/xetla_gemm_tuning.h"
+
+#include <fstream>
+#include <sstream>
+#include <tuple>
+#include <vector>
+
+#include "absl/strings/ascii.h"
+#include "absl/strings/str_cat.h"
+#include "tsl/platform/logging.h"
+#include "tsl/platform/path.h"
+#include "tsl/util/env_var.h"
+#include "xla/service/gpu/xetla/gemm/gemm.h"
+
+namespace xla {
+namespace gpu {
+namespace {
+
+// File names keep alphanumerics of the device name, e.g.
+// xetla_gemm_Intel_R__Data_Center_GPU_Max_1550.txt.
+std::string DeviceFileName(absl::string_view device_name) {
+  std::string name = "xetla_gemm_";
+  for (char c : device_name) {
+    name.push_back(absl::ascii_isalnum(c) ? c : '_');
+  }
+  return absl::StrCat(name, ".txt");
+}
+
+std::optional<int> FindConfigIndex(
+    const std::tuple<int, int, int, int, int, int>& config) {
+  const auto& configs = ::gpu::xetla::getXetlaGemmConfigs();
+  for (int i = 0; i < static_cast<int>(configs.size()); ++i) {
+    if (configs[i] == config) return i;
+  }
+  return std::nullopt;
+}
+
+// Each line holds a problem followed by its tile config:
+//   dtype batch_size m n k lhs_transposed rhs_transposed epilogue has_residual
+//   WG_M WG_N SG_M SG_N SG_K SLM_KS
+// Configs are stored by value so that files survive changes to the list of
+// instantiated configs.
+void LoadTable(const std::string& path,
+               absl::flat_hash_map<XetlaGemmProblem, int>* configs) {
+  std::ifstream file(path);
+  if (!file.is_open()) return;
+  std::string line;
+  while (std::getline(file, line)) {
+    std::istringstream fields(line);
+    int dtype, lhs_transposed, rhs_transposed, has_residual;
+    XetlaGemmProblem problem;
+    std::tuple<int, int, int, int, int, int> config;
+    if (!(fields >> dtype >> problem.batch_size >> problem.m >> problem.n >>
+          problem.k >> lhs_transposed >> rhs_transposed >> problem.epilogue >>
+          has_residual >>
+          std::get<0>(config) >> std::get<1>(config) >> std::get<2>(config) >>
+          std::get<3>(config) >> std::get<4>(config) >> std::get<5>(config))) {
+      continue;
+    }
+    std::optional<int> index = FindConfigIndex(config);
+    if (!index.has_value()) continue;
+    problem.dtype = static_cast<PrimitiveType>(dtype);
+    problem.lhs_transposed = lhs_transposed != 0;
+    problem.rhs_transposed = rhs_transposed != 0;
+    problem.has_residual = has_residual != 0;
+    (*configs)[problem] = *index;
+  }
+  VLOG(1) << "Loaded " << configs->size() << " XeTLA GEMM configs from "
+          << path;
+}
+
+}  // namespace
+
+/*static*/ bool XetlaGemmTuningCache::Enabled() {
+  static bool enabled = [] {
+    bool flag = false;
+    TF_CHECK_OK(tsl::ReadBoolFromEnvVar("XETLA_GEMM_AUTOTUNE", false, &flag));
+    return flag;
+  }();
+  return enabled;
+}
+
+/*static*/ XetlaGemmTuningCache& XetlaGemmTuningCache::Global() {
+  static auto* cache = new XetlaGemmTuningCache();
+  return *cache;
+}
+
+XetlaGemmTuningCache::DeviceTable& XetlaGemmTuningCache::GetTable(
+    const ::sycl::device& device) {
+  std::string name = device.get_info<::sycl::info::device::name>();
+  auto [it, inserted] = tables_.try_emplace(name);
+  if (inserted) {
+    std::string dir;
+    TF_CHECK_OK(tsl::ReadStringFromEnvVar("XETLA_GEMM_AUTOTUNE_DIR", "", &dir));
+    if (!dir.empty()) {
+      it->second.path = tsl::io::JoinPath(dir, DeviceFileName(name));
+      LoadTable(it->second.path, &it->second.configs);
+    }
+  }
+  return it->second;
+}
+
+std::optional<int> XetlaGemmTuningCache::Lookup(
+    const ::sycl::device& device, const XetlaGemmProblem& problem) {
+  absl::MutexLock lock(&mu_);
+  const DeviceTable& table = GetTable(device);
+  auto it = table.configs.find(problem);
+  if (it == table.configs.end()) return std::nullopt;
+  return it->second;
+}
+
+void XetlaGemmTuningCache::Insert(const ::sycl::device& device,
+                                  const XetlaGemmProblem& problem,
+                                  int config_index) {
+  absl::MutexLock lock(&mu_);
+  DeviceTable& table = GetTable(device);
+  if (!table.configs.emplace(problem, config_index).second) return;
+  if (table.path.empty() || config_index < 0) return;
+
+  const auto& config = ::gpu::xetla::getXetlaGemmConfigs()[config_index];
+  std::ofstream file(table.path, std::ios::app);
+  if (!file.is_open()) {
+    LOG(WARNING) << "Cannot write XeTLA GEMM configs to " << table.path;
+    return;
+  }
+  file << static_cast<int>(problem.dtype) << " " << problem.batch_size << " "
+       << problem.m << " " << problem.n << " " << problem.k << " "
+       << problem.lhs_transposed << " " << problem.rhs_transposed << " "
+       << problem.epilogue << " " << problem.has_residual << " "
+       << std::get<0>(config) << " " << std::get<1>(config) << " "
+       << std::get<2>(config) << " " << std::get<3>(config) << " "
+       << std::get<4>(config) << " " << std::get<5>(config) << "\n";
+}
+
+}  // namespace gpu
+}  // namespace xla
@@ -0,0 +1,100 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef XLA_SERVICE_GPU_XETLA_GEMM_TUNING_H_
+#define XLA_SERVICE_GPU_XETLA_GEMM_TUNING_H_
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "xla/stream_executor/sycl/sycl_gpu_runtime.h"
+#include "xla/xla_data.pb.h"
+
+namespace xla {
+namespace gpu {
+
+// A GEMM problem as XeTLA sees it. Problems that share a key run the same
+// kernel template and therefore the same best tile config.
+struct XetlaGemmProblem {
+  PrimitiveType dtype;
+  int64_t batch_size;
+  int64_t m;
+  int64_t n;
+  int64_t k;
+  bool lhs_transposed;
+  bool rhs_transposed;
+  // se::cuda::BlasLt::Epilogue, plus whether beta * C is added.
+  int epilogue;
+  bool has_residual;
+
+  bool operator==(const XetlaGemmProblem& other) const {
+    return dtype == other.dtype && batch_size == other.batch_size &&
+           m == other.m && n == other.n && k == other.k &&
+           lhs_transposed == other.lhs_transposed &&
+           rhs_transposed == other.rhs_transposed &&
+           epilogue == other.epilogue && has_residual == other.has_residual;
+  }
+
+  template <typename H>
+  friend H AbslHashValue(H h, const XetlaGemmProblem& problem) {
+    return H::combine(std::move(h), problem.dtype, problem.batch_size,
+                      problem.m, problem.n, problem.k, problem.lhs_transposed,
+                      problem.rhs_transposed, problem.epilogue,
+                      problem.has_residual);
+  }
+};
+
+// Best XeTLA tile configs found by benchmarking GEMMs online, as indices
+// into getXetlaGemmConfigs(). A negative index records that no config runs
+// the problem; it is not persisted.
+//
+// Environment variables:
+//   XETLA_GEMM_AUTOTUNE=1         benchmark all configs for GEMMs that were
+//                                 not autotuned at compile time.
+//   XETLA_GEMM_AUTOTUNE_DIR=dir   persist the results per device SKU in
+//                                 `dir`/xetla_gemm_<device name>.txt.
+class XetlaGemmTuningCache {
+ public:
+  static bool Enabled();
+  static XetlaGemmTuningCache& Global();
+
+  std::optional<int> Lookup(const ::sycl::device& device,
+                            const XetlaGemmProblem& problem);
+  // Records `config_index` and appends it to the file of the device SKU.
+  void Insert(const ::sycl::device& device, const XetlaGemmProblem& problem,
+              int config_index);
+
+ private:
+  struct DeviceTable {
+    std::string path;
+    absl::flat_hash_map<XetlaGemmProblem, int> configs;
+  };
+
+  DeviceTable& GetTable(const ::sycl::device& device)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  absl::Mutex mu_;
+  absl::flat_hash_map<std::string, DeviceTable> tables_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace gpu
+}  // namespace xla
+
+#endif  // XLA_SERVICE_GPU_XETLA_GEMM_TUNING_H_
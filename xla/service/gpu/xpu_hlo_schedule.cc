@@ -0,0 +1,326 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "xla/service/gpu/xpu_hlo_schedule.h"
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+#include "tsl/platform/errors.h"
+#include "tsl/platform/logging.h"
+#include "tsl/util/env_var.h"
+#include "xla/hlo/ir/hlo_casting_utils.h"
+#include "xla/hlo/ir/hlo_computation.h"
+#include "xla/hlo/ir/hlo_instructions.h"
+#include "xla/service/gpu/backend_configs.pb.h"
+#include "xla/service/gpu/compile_profile.h"
+#include "xla/service/gpu/cublas_cudnn.h"
+#include "xla/service/gpu/gpu_hlo_schedule.h"
+#include "xla/service/hlo_pass_pipeline.h"
+#include "xla/shape_util.h"
+#include "xla/stream_executor/sycl/hw_info.h"
+
+namespace xla {
+namespace gpu {
+namespace {
+
+constexpr double kLowCost = 1.0;
+
+// Per-EU throughput per clock: SIMD16 FMA on the vector engine, and the
+// 16-bit systolic rate of the XMX engine on Xe-HPC.
+constexpr double kVectorFlopsPerEuPerCycle = 32;
+constexpr double kXmxFlopsPerEuPerCycle = 512;
+
+// Defaults for an Xe Link peer-to-peer transfer.
+constexpr int64_t kDefaultLinkBandwidthGbps = 100;
+constexpr double kCollectiveLaunchMicros = 10;
+
+// Fraction of device memory the latency-hiding scheduler may keep live.
+constexpr double kSchedulerMemoryFraction = 0.9;
+
+bool LatencyHidingSchedulerEnabled() {
+  static bool enabled = [] {
+    bool flag = true;
+    TF_CHECK_OK(
+        tsl::ReadBoolFromEnvVar("XLA_LATENCY_HIDING_SCHEDULER", true, &flag));
+    return flag;
+  }();
+  return enabled;
+}
+
+int64_t LinkBandwidthGbps() {
+  static int64_t bandwidth = [] {
+    int64_t gbps = kDefaultLinkBandwidthGbps;
+    TF_CHECK_OK(tsl::ReadInt64FromEnvVar("XLA_XPU_LINK_BANDWIDTH_GBPS",
+                                         kDefaultLinkBandwidthGbps, &gbps));
+    return std::max<int64_t>(gbps, 1);
+  }();
+  return bandwidth;
+}
+
+bool IsAsyncCollectiveStart(const HloInstruction& instr) {
+  switch (instr.opcode()) {
+    case HloOpcode::kAllReduceStart:
+    case HloOpcode::kAllGatherStart:
+    case HloOpcode::kCollectivePermuteStart:
+      return true;
+    case HloOpcode::kAsyncStart: {
+      HloOpcode wrapped = Cast<HloAsyncInstruction>(&instr)
+                              ->async_wrapped_instruction()
+                              ->opcode();
+      return wrapped == HloOpcode::kReduceScatter ||
+             wrapped == HloOpcode::kAllToAll;
+    }
+    default:
+      return false;
+  }
+}
+
+bool IsAsyncCollectiveDone(const HloInstruction& instr) {
+  switch (instr.opcode()) {
+    case HloOpcode::kAllReduceDone:
+    case HloOpcode::kAllGatherDone:
+    case HloOpcode::kCollectivePermuteDone:
+      return true;
+    case HloOpcode::kAsyncDone:
+      return IsAsyncCollectiveStart(*instr.operand(0));
+    default:
+      return false;
+  }
+}
+
+// GpuAsyncCollectiveAnnotator marks collectives that must stay synchronous.
+bool IsSyncCollective(const HloInstruction& start) {
+  StatusOr<CollectiveBackendConfig> config =
+      start.backend_config<CollectiveBackendConfig>();
+  return config.ok() && config->is_sync();
+}
+
+// Only collectives that run on the async CCL stream can be overlapped.
+class XpuAsyncTracker : public AsyncTracker {
+ public:
+  explicit XpuAsyncTracker(const SchedulerConfig& config)
+      : AsyncTracker(config) {}
+
+  bool IsSupportedAsyncDone(const HloInstruction& hlo) const override {
+    return IsAsyncCollectiveDone(hlo) && !IsSyncCollective(*hlo.operand(0));
+  }
+  bool IsSupportedAsyncStart(const HloInstruction& hlo) const override {
+    return IsAsyncCollectiveStart(hlo) && !IsSyncCollective(hlo);
+  }
+};
+
+bool HasAsyncCollectives(const HloModule& module) {
+  for (const HloComputation* computation : module.computations()) {
+    for (const HloInstruction* instr : computation->instructions()) {
+      if (IsAsyncCollectiveStart(*instr) && !IsSyncCollective(*instr)) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+int64_t ArrayBytes(const Shape& shape) {
+  int64_t bytes = 0;
+  ShapeUtil::ForEachSubshape(shape, [&](const Shape& subshape,
+                                        const ShapeIndex& /*index*/) {
+    if (subshape.IsArray()) bytes += ShapeUtil::ByteSizeOfElements(subshape);
+  });
+  return bytes;
+}
+
+int64_t OperandBytes(const HloInstruction& instr) {
+  int64_t bytes = 0;
+  for (const HloInstruction* operand : instr.operands()) {
+    bytes += ArrayBytes(operand->shape());
+  }
+  return bytes;
+}
+
+// Number of devices taking part in `collective`.
+int64_t GroupSize(const HloInstruction& collective) {
+  if (const auto* instr = DynCast<HloCollectiveInstruction>(&collective)) {
+    if (!instr->replica_groups().empty()) {
+      return std::max(instr->replica_groups()[0].replica_ids_size(), 1);
+    }
+  }
+  const HloModuleConfig& config = collective.GetModule()->config();
+  return std::max<int64_t>(
+      std::max(config.replica_count(), config.num_partitions()), 1);
+}
+
+const Shape& ResultArrayShape(const HloInstruction& instr) {
+  return instr.shape().IsTuple() ? instr.shape().tuple_shapes(0)
+                                 : instr.shape();
+}
+
+bool IsXmxType(PrimitiveType type) { return type == F16 || type == BF16; }
+
+}  // namespace
+
+XpuLatencyEstimator::XpuLatencyEstimator(const GpuDeviceInfo& gpu_info) {
+  double clock_ghz = gpu_info.clock_rate_ghz > 0 ? gpu_info.clock_rate_ghz : 1;
+  cycles_per_us_ = std::max(static_cast<int>(clock_ghz * 1e3), 1);
+  // The SYCL executor reports the total EU count as fpus_per_core.
+  double eus = std::max(gpu_info.fpus_per_core, 1);
+  vector_flops_per_us_ = eus * kVectorFlopsPerEuPerCycle * clock_ghz * 1e3;
+  xmx_flops_per_us_ = IsXetlaHardwareSupport()
+                          ? eus * kXmxFlopsPerEuPerCycle * clock_ghz * 1e3
+                          : vector_flops_per_us_;
+  memory_bytes_per_us_ =
+      std::max(static_cast<double>(gpu_info.memory_bandwidth) / 1e6, 1.0);
+  link_bytes_per_us_ = LinkBandwidthGbps() * 1e3;
+}
+
+double XpuLatencyEstimator::CollectiveMicros(
+    const HloInstruction& start) const {
+  const HloInstruction& collective =
+      start.opcode() == HloOpcode::kAsyncStart
+          ? *Cast<HloAsyncInstruction>(&start)->async_wrapped_instruction()
+          : start;
+  double n = GroupSize(collective);
+  double bytes = OperandBytes(collective);
+  // Bytes each device sends over its link with ring algorithms.
+  double sent = 0;
+  switch (collective.opcode()) {
+    case HloOpcode::kAllReduceStart:
+      sent = 2 * (n - 1) / n * bytes;
+      break;
+    case HloOpcode::kAllGatherStart:
+      sent = (n - 1) * bytes;
+      break;
+    case HloOpcode::kReduceScatter:
+    case HloOpcode::kAllToAll:
+      sent = (n - 1) / n * bytes;
+      break;
+    default:
+      sent = bytes;
+      break;
+  }
+  return kCollectiveLaunchMicros + sent / link_bytes_per_us_;
+}
+
+double XpuLatencyEstimator::ComputeMicros(const HloInstruction& instr) const {
+  if (IsCublasGemm(instr)) {
+    StatusOr<GemmBackendConfig> config =
+        instr.backend_config<GemmBackendConfig>();
+    if (config.ok()) {
+      const Shape& lhs = instr.operand(0)->shape();
+      double k = 1;
+      for (int64_t dim :
+           config->dot_dimension_numbers().lhs_contracting_dimensions()) {
+        k *= lhs.dimensions(dim);
+      }
+      double flops = 2 * k * ShapeUtil::ElementsIn(ResultArrayShape(instr));
+      return flops / (IsXmxType(lhs.element_type()) ? xmx_flops_per_us_
+                                                    : vector_flops_per_us_);
+    }
+  }
+  if (IsCustomCallToDnnConvolution(instr)) {
+    StatusOr<CudnnConvKind> kind = GetCudnnConvKind(
+        Cast<HloCustomCallInstruction>(&instr));
+    if (kind.ok()) {
+      // Every kind does the work of the forward convolution producing
+      // `output` with `filter`.
+      const Shape* output = &ResultArrayShape(instr);
+      const Shape* filter = &instr.operand(1)->shape();
+      if (*kind == CudnnConvKind::kBackwardInput) {
+        output = &instr.operand(0)->shape();
+      } else if (*kind == CudnnConvKind::kBackwardFilter) {
+        output = &instr.operand(1)->shape();
+        filter = &ResultArrayShape(instr);
+      }
+      int64_t output_features = filter->dimensions(
+          instr.convolution_dimension_numbers()
+              .kernel_output_feature_dimension());
+      double flops = 2.0 * ShapeUtil::ElementsIn(*output) *
+                     ShapeUtil::ElementsIn(*filter) /
+                     std::max<int64_t>(output_features, 1);
+      return flops / (IsXmxType(filter->element_type()) ? xmx_flops_per_us_
+                                                        : vector_flops_per_us_);
+    }
+  }
+  double bytes = OperandBytes(instr) + ArrayBytes(instr.shape());
+  return bytes / memory_bytes_per_us_;
+}
+
+LatencyEstimator::TimeCost XpuLatencyEstimator::GetLatencyBetween(
+    const HloGraphNode& from, const HloGraphNode& target) const {
+  const HloInstruction& start = from.GetInstr();
+  const HloInstruction& done = target.GetInstr();
+  if (IsAsyncCollectiveStart(start) && IsAsyncCollectiveDone(done) &&
+      done.operand(0) == &start) {
+    return CollectiveMicros(start) * cycles_per_us_;
+  }
+  return kLowCost;
+}
+
+LatencyEstimator::TimeCost XpuLatencyEstimator::NodeCost(
+    const HloInstruction* instr) const {
+  switch (instr->opcode()) {
+    case HloOpcode::kParameter:
+    case HloOpcode::kConstant:
+    case HloOpcode::kBitcast:
+    case HloOpcode::kGetTupleElement:
+    case HloOpcode::kTuple:
+      return kLowCost;
+    default:
+      break;
+  }
+  if (IsAsyncCollectiveStart(*instr) || IsAsyncCollectiveDone(*instr)) {
+    return kLowCost;
+  }
+  return std::max(ComputeMicros(*instr) * cycles_per_us_, kLowCost);
+}
+
+Status ScheduleXpuModule(HloModule* module, int64_t pointer_size,
+                         const GpuDeviceInfo& gpu_info) {
+  TF_RETURN_IF_ERROR(ScheduleGpuModule(module, pointer_size, gpu_info));
+
+  // The upstream scheduler has already run its own latency-hiding pass.
+  if (module->config()
+          .debug_options()
+          .xla_gpu_enable_latency_hiding_scheduler()) {
+    return OkStatus();
+  }
+  if (!LatencyHidingSchedulerEnabled() || !HasAsyncCollectives(*module)) {
+    return OkStatus();
+  }
+
+  SchedulerConfig config;
+  if (gpu_info.device_memory_size > 0) {
+    config.memory_limit = static_cast<uint64_t>(gpu_info.device_memory_size *
+                                                kSchedulerMemoryFraction);
+  }
+  auto shape_size_bytes = [pointer_size](const Shape& shape) {
+    return ShapeUtil::ByteSizeOf(shape, pointer_size);
+  };
+  auto async_tracker = std::make_unique<XpuAsyncTracker>(config);
+  auto latency_estimator = std::make_unique<XpuLatencyEstimator>(gpu_info);
+  auto scheduler_core = std::make_unique<DefaultSchedulerCore>(
+      shape_size_bytes, async_tracker.get(), latency_estimator.get(), config);
+
+  HloPassPipeline pipeline("latency-hiding-scheduler",
+                           CompileProfile::StatsFor(module));
+  pipeline.AddPass<LatencyHidingScheduler>(
+      std::move(latency_estimator), std::move(async_tracker),
+      std::move(scheduler_core), shape_size_bytes);
+  return pipeline.Run(module).status();
+}
+
+}  // namespace gpu
+}  // namespace xla
@@ -0,0 +1,68 @@
+/* Copyright (c) 2023 Intel Corporation
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#ifndef XLA_SERVICE_GPU_XPU_HLO_SCHEDULE_H_
+#define XLA_SERVICE_GPU_XPU_HLO_SCHEDULE_H_
+
+#include <cstdint>
+
+#include "xla/hlo/ir/hlo_instruction.h"
+#include "xla/hlo/ir/hlo_module.h"
+#include "xla/service/gpu/gpu_device_info.h"
+#include "xla/service/latency_hiding_scheduler.h"
+#include "xla/status.h"
+
+namespace xla {
+namespace gpu {
+
+// Latency estimator for Intel GPUs.
+//
+// Compute cost is derived from the device capability model: GEMMs and
+// convolutions are costed by FLOPs against the vector or XMX peak of all EUs,
+// everything else by bytes accessed against memory bandwidth. The latency of
+// an async collective is a ring model over the Xe Link bandwidth, which can
+// be overridden with XLA_XPU_LINK_BANDWIDTH_GBPS.
+class XpuLatencyEstimator : public LatencyEstimator {
+ public:
+  explicit XpuLatencyEstimator(const GpuDeviceInfo& gpu_info);
+
+  TimeCost GetLatencyBetween(const HloGraphNode& from,
+                             const HloGraphNode& target) const override;
+  TimeCost NodeCost(const HloInstruction* instr) const override;
+  int CyclesPerMicrosecond() const override { return cycles_per_us_; }
+
+ private:
+  // Estimated execution time of the collective started by `start`.
+  double CollectiveMicros(const HloInstruction& start) const;
+  double ComputeMicros(const HloInstruction& instr) const;
+
+  int cycles_per_us_;
+  double vector_flops_per_us_;
+  double xmx_flops_per_us_;
+  double memory_bytes_per_us_;
+  double link_bytes_per_us_;
+};
+
+// Schedules `module` with the memory-aware GPU scheduler and then, when the
+// module has async collectives, reorders it with the latency-hiding scheduler
+// so that collectives overlap independent compute. Set
+// XLA_LATENCY_HIDING_SCHEDULER=0 to keep the memory-aware schedule.
+Status ScheduleXpuModule(HloModule* module, int64_t pointer_size,
+                         const GpuDeviceInfo& gpu_info);
+
+}  // namespace gpu
+}  // namespace xla
+
+#endif  // XLA_SERVICE_GPU_XPU_HLO_SCHEDULE_H_